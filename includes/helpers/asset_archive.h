@@ -0,0 +1,338 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include <helpers/lz4_block.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// .pak: every asset in one file, mapped into memory once.
+//   header (64 bytes) | index: entryCount ArchiveEntry sorted by (hash, name) | name table | payloads
+// Payloads start 64-byte aligned. A stored payload is the file itself; a compressed one is a table of
+// chunkCount + 1 offsets (uint64, relative to the payload) followed by LZ4 blocks (helpers/lz4_block.h),
+// each of which decodes to chunkSize bytes (the last one to the rest), so chunks decode independently.
+const unsigned int ARCHIVE_MAGIC = 0x4b415047; // "GPAK"
+const unsigned int ARCHIVE_VERSION = 1;
+const unsigned int ARCHIVE_ALIGNMENT = 64;
+
+struct ArchiveHeader
+{
+    unsigned int magic, version;
+    unsigned int entryCount, reserved;
+    unsigned long long indexOffset, namesOffset;
+    unsigned long long padding[5];
+};
+
+struct ArchiveEntry
+{
+    unsigned long long hash;       // archiveHash(name)
+    unsigned long long offset;     // payload, from the start of the file
+    unsigned long long size;       // decoded
+    unsigned long long storedSize; // in the file
+    unsigned int nameOffset, nameLength;
+    unsigned int chunkSize;        // 0 when stored
+    unsigned int chunkCount;
+};
+
+// 64-bit FNV-1a of an archive path ('/' separated, relative to the project root)
+inline unsigned long long archiveHash(const char *name, size_t length)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i)
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ull;
+    return hash;
+}
+
+
+// A view of an asset: points straight into the mapping for stored entries, owns the decoded bytes otherwise
+// (or, for a loose file mapped by FileSystem::map, the mapping)
+struct AssetSpan
+{
+    const unsigned char *data;
+    size_t size;
+    std::shared_ptr<std::vector<unsigned char> > storage;
+    std::shared_ptr<void> mapping;
+
+    AssetSpan() : data(NULL), size(0) {}
+    bool valid() const { return data != NULL; }
+};
+
+
+// Workers every archive decodes its chunks on, started once: one per core less the caller, who takes parts of
+// its own job too. Jobs from threads reading at the same time queue up and share the workers.
+class ArchiveDecodePool
+{
+public:
+    static ArchiveDecodePool &shared()
+    {
+        static ArchiveDecodePool pool;
+        return pool;
+    }
+
+    ~ArchiveDecodePool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    int threads() const { return (int)workers.size() + 1; }
+
+    // runs work(0) to work(count - 1) on the workers and the calling thread, returns once all are done
+    void parallel(int count, const std::function<void(int)> &work)
+    {
+        if (workers.empty() || count <= 1)
+        {
+            for (int i = 0; i < count; ++i)
+                work(i);
+            return;
+        }
+        Job job(work, count);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(&job);
+        }
+        wake.notify_all();
+        job.take();
+        std::unique_lock<std::mutex> lock(mutex);
+        // no worker joins it once it's off the queue; wait for the ones still on a part
+        std::deque<Job *>::iterator queued = std::find(pending.begin(), pending.end(), &job);
+        if (queued != pending.end())
+            pending.erase(queued);
+        finished.wait(lock, [&job] { return job.active == 0; });
+    }
+
+private:
+    struct Job
+    {
+        const std::function<void(int)> &work;
+        int count;
+        std::atomic<int> next;
+        int active; // workers on it, under the mutex
+
+        Job(const std::function<void(int)> &work, int count) : work(work), count(count), next(0), active(0) {}
+        void take()
+        {
+            for (int i; (i = next++) < count;)
+                work(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    std::deque<Job *> pending;
+    bool stopping;
+
+    ArchiveDecodePool() : stopping(false)
+    {
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 1; i < cores; ++i)
+            workers.push_back(std::thread(&ArchiveDecodePool::serve, this));
+    }
+    ArchiveDecodePool(const ArchiveDecodePool &);
+    ArchiveDecodePool &operator=(const ArchiveDecodePool &);
+
+    void serve()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (stopping)
+                return;
+            Job *job = pending.front();
+            // every part is taken once the first worker runs out of them: later ones go on to the next job
+            if (job->next >= job->count)
+            {
+                pending.pop_front();
+                continue;
+            }
+            ++job->active;
+            lock.unlock();
+            job->take();
+            lock.lock();
+            if (!pending.empty() && pending.front() == job)
+                pending.pop_front();
+            if (--job->active == 0)
+                finished.notify_all();
+        }
+    }
+};
+
+
+// A read-only, memory-mapped .pak. Lookups and reads are safe from any thread once open() returned.
+class AssetArchive
+{
+public:
+    AssetArchive() : base(NULL), length(0), entries(NULL), names(NULL), entryCount(0)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+    {}
+
+    ~AssetArchive() { close(); }
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = (size_t)fileSize.QuadPart;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        base = mapping ? (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            length = (size_t)info.st_size;
+            void *mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            base = mapped == MAP_FAILED ? NULL : (const unsigned char *)mapped;
+        }
+        ::close(fd);
+#endif
+        if (!base || length < sizeof(ArchiveHeader))
+        {
+            close();
+            return false;
+        }
+        const ArchiveHeader *header = (const ArchiveHeader *)base;
+        if (header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION ||
+            header->indexOffset + (unsigned long long)header->entryCount * sizeof(ArchiveEntry) > length ||
+            header->namesOffset > length)
+        {
+            close();
+            return false;
+        }
+        entries = (const ArchiveEntry *)(base + header->indexOffset);
+        entryCount = header->entryCount;
+        names = (const char *)(base + header->namesOffset);
+        // find() compares names in place
+        for (unsigned int i = 0; i < entryCount; ++i)
+            if (header->namesOffset + (unsigned long long)entries[i].nameOffset + entries[i].nameLength > length)
+            {
+                close();
+                return false;
+            }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (base)
+            UnmapViewOfFile(base);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base)
+            munmap((void *)base, length);
+#endif
+        base = NULL;
+        length = 0;
+        entries = NULL;
+        entryCount = 0;
+        names = NULL;
+    }
+
+    bool isOpen() const { return base != NULL; }
+
+    // binary search on the hash, then the name to settle collisions
+    const ArchiveEntry *find(const std::string &name) const
+    {
+        if (!base)
+            return NULL;
+        unsigned long long hash = archiveHash(name.data(), name.size());
+        const ArchiveEntry *end = entries + entryCount;
+        const ArchiveEntry *entry = std::lower_bound(entries, end, hash,
+            [](const ArchiveEntry &e, unsigned long long h) { return e.hash < h; });
+        for (; entry != end && entry->hash == hash; ++entry)
+            if (entry->nameLength == name.size() && !memcmp(names + entry->nameOffset, name.data(), name.size()))
+                return entry;
+        return NULL;
+    }
+
+    // the asset's bytes: zero-copy when stored, chunks decoded on ArchiveDecodePool when compressed
+    AssetSpan read(const ArchiveEntry &entry) const
+    {
+        AssetSpan span;
+        const unsigned char *payload = base + entry.offset;
+        if (entry.offset + entry.storedSize > length)
+            return span;
+        if (!entry.chunkSize)
+        {
+            span.data = payload;
+            span.size = (size_t)entry.size;
+            return span;
+        }
+        if (!entry.chunkCount || (entry.chunkCount + 1ull) * sizeof(unsigned long long) > entry.storedSize ||
+            (unsigned long long)entry.chunkCount * entry.chunkSize < entry.size ||
+            (entry.chunkCount - 1ull) * entry.chunkSize >= entry.size)
+            return span;
+        span.storage = std::make_shared<std::vector<unsigned char> >((size_t)entry.size);
+        unsigned char *out = span.storage->data();
+        const unsigned long long *chunks = (const unsigned long long *)payload;
+        std::atomic<bool> ok(true);
+        ArchiveDecodePool::shared().parallel((int)entry.chunkCount, [&](int chunk) {
+            size_t begin = (size_t)chunk * entry.chunkSize;
+            size_t size = std::min<size_t>(entry.chunkSize, (size_t)entry.size - begin);
+            if (chunks[chunk] > chunks[chunk + 1] || chunks[chunk + 1] > entry.storedSize ||
+                !Lz4Block::decompress(payload + chunks[chunk], (size_t)(chunks[chunk + 1] - chunks[chunk]), out + begin, size))
+                ok = false;
+        });
+        if (!ok)
+            return AssetSpan();
+        span.data = out;
+        span.size = span.storage->size();
+        return span;
+    }
+
+    size_t size() const { return entryCount; }
+
+private:
+    const unsigned char *base;
+    size_t length;
+    const ArchiveEntry *entries;
+    const char *names;
+    size_t entryCount;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#endif
+};
+#endif
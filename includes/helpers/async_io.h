@@ -0,0 +1,555 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <helpers/filesystem.h>
+#include <helpers/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// histogram buckets: queue depth 1, 2-3, 4-7, ...; latency < 16 us, < 32 us, ... (the last one open-ended)
+const int ASYNC_IO_BUCKETS = 16;
+// io_uring reads of at least this much go straight to the kernel's worker threads
+const size_t ASYNC_IO_INLINE_BYTES = 256 * 1024;
+
+
+// reads since the last report
+struct AsyncIOStats
+{
+    const char *backend;
+    unsigned long long reads, mapped, failed; // mapped: served by the mounted archive, no I/O
+    unsigned long long bytes;
+    unsigned int inFlight, maxDepth;
+    unsigned long long depth[ASYNC_IO_BUCKETS];   // reads in flight when one was submitted, itself included
+    unsigned long long latency[ASYNC_IO_BUCKETS]; // submit to completion
+    double latencyAvgMs, latencyMaxMs;
+};
+
+
+// Whole-file reads that complete in the background. submit() returns a future (and calls an optional
+// callback on the completing thread), so a loader can issue all its files at once and only wait when it
+// needs the bytes. On Linux 5.7+ the opens and reads go through an io_uring (one io_uring_enter per batch,
+// a thread that reaps completions and sizes the buffers); elsewhere a small pool of threads calls pread.
+// Files in the archive mounted on FileSystem complete straight away, without counting as I/O.
+class AsyncIO
+{
+public:
+    typedef std::function<void(const AssetSpan &)> Callback;
+
+    // the instance every loader shares
+    static AsyncIO &shared()
+    {
+        static AsyncIO io;
+        return io;
+    }
+
+    explicit AsyncIO(bool useRing = true, int threads = 4)
+        : inFlight(0), stop(false)
+#ifdef __linux__
+        , ringFd(-1), ringInFlight(0)
+#endif
+    {
+        counters.backend = NULL;
+        resetStats();
+#ifdef __linux__
+        if (useRing && setupRing())
+        {
+            counters.backend = "io_uring";
+            workers.push_back(std::thread(&AsyncIO::reap, this));
+            return;
+        }
+#else
+        (void)useRing;
+#endif
+        counters.backend = "pread pool";
+        for (int i = 0; i < std::max(1, threads); ++i)
+            workers.push_back(std::thread(&AsyncIO::serve, this));
+    }
+
+    ~AsyncIO()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (inFlight)
+                idle.wait(lock);
+            stop = true;
+        }
+#ifdef __linux__
+        if (ringFd >= 0)
+        {
+            // a nop without a read wakes the reaper up to exit
+            std::lock_guard<std::mutex> lock(mutex);
+            io_uring_sqe *sqe = nextSqe();
+            sqe->opcode = IORING_OP_NOP;
+            __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+            syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, NULL, 0);
+        }
+#endif
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+#ifdef __linux__
+        if (ringFd >= 0)
+        {
+            munmap(sqes, sqesBytes);
+            if (cqRing != sqRing)
+                munmap(cqRing, cqRingBytes);
+            munmap(sqRing, sqRingBytes);
+            close(ringFd);
+        }
+#endif
+    }
+
+    // a failed read completes with an invalid span, as FileSystem::read returns
+    std::shared_future<AssetSpan> submit(const std::string &path, Callback done = Callback())
+    {
+        return submit(std::vector<std::string>(1, path), done)[0];
+    }
+
+    // every path in one go, done is called once per file
+    std::vector<std::shared_future<AssetSpan> > submit(const std::vector<std::string> &paths, Callback done = Callback())
+    {
+        std::vector<std::shared_future<AssetSpan> > futures;
+        std::vector<Read *> reads;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            Read *read = new Read();
+            read->path = paths[i];
+            read->done = done;
+            read->start = Clock::now();
+            futures.push_back(read->promise.get_future().share());
+            AssetSpan mounted = FileSystem::readMounted(paths[i]);
+            if (mounted.valid())
+            {
+                read->span = mounted;
+                finish(read, true, true);
+                continue;
+            }
+            reads.push_back(read);
+        }
+        if (reads.empty())
+            return futures;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < reads.size(); ++i)
+            {
+                ++inFlight;
+                ++counters.depth[bucket(inFlight)];
+                counters.maxDepth = std::max(counters.maxDepth, inFlight);
+            }
+        }
+#ifdef __linux__
+        if (ringFd >= 0)
+        {
+            submitRing(reads);
+            return futures;
+        }
+#endif
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.insert(queue.end(), reads.begin(), reads.end());
+        }
+        wake.notify_all();
+        return futures;
+    }
+
+    AsyncIOStats stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        AsyncIOStats stats = counters;
+        stats.inFlight = inFlight;
+        stats.latencyAvgMs = latencyCount ? latencySumMs / latencyCount : 0.0;
+        return stats;
+    }
+
+    // prints stats() with both histograms and starts over
+    void report()
+    {
+        AsyncIOStats s = stats();
+        // the histograms are written out here, one message for the whole report
+        std::string depth, latency;
+        char bucket[64];
+        for (int i = 0; i < ASYNC_IO_BUCKETS; ++i)
+            if (s.depth[i])
+            {
+                if (i == 0)
+                    std::snprintf(bucket, sizeof(bucket), " 1: %llu", s.depth[i]);
+                else
+                    std::snprintf(bucket, sizeof(bucket), " %u-%u: %llu", 1u << i, (2u << i) - 1, s.depth[i]);
+                depth += bucket;
+            }
+        for (int i = 0; i < ASYNC_IO_BUCKETS; ++i)
+            if (s.latency[i])
+            {
+                if (i == ASYNC_IO_BUCKETS - 1)
+                    std::snprintf(bucket, sizeof(bucket), " >=%u us: %llu", 16u << (i - 1), s.latency[i]);
+                else
+                    std::snprintf(bucket, sizeof(bucket), " <%u us: %llu", 16u << i, s.latency[i]);
+                latency += bucket;
+            }
+        Log::info("async io (%s): %llu reads, %llu from the archive, %llu failed, %.1f MB, latency avg %.2f ms max %.2f ms\n"
+                  "  queue depth:%s\n  latency:%s",
+                  s.backend, s.reads, s.mapped, s.failed, s.bytes / 1048576.0, s.latencyAvgMs, s.latencyMaxMs, depth, latency);
+        std::lock_guard<std::mutex> lock(mutex);
+        resetStats();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Read
+    {
+        std::string path;
+        Callback done;
+        std::promise<AssetSpan> promise;
+        AssetSpan span;
+        Clock::time_point start;
+        int fd;
+        size_t offset; // bytes read so far
+        Read() : fd(-1), offset(0) {}
+    };
+
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::deque<Read *> queue; // pread pool
+    std::vector<std::thread> workers;
+    unsigned int inFlight;
+    bool stop;
+    AsyncIOStats counters;
+    double latencySumMs;
+    unsigned long long latencyCount;
+
+    static int bucket(unsigned long long value)
+    {
+        int i = 0;
+        while (value > 1 && i < ASYNC_IO_BUCKETS - 1)
+        {
+            value >>= 1;
+            ++i;
+        }
+        return i;
+    }
+
+    void resetStats()
+    {
+        const char *backend = counters.backend;
+        memset(&counters, 0, sizeof(counters));
+        counters.backend = backend;
+        latencySumMs = 0.0;
+        latencyCount = 0;
+    }
+
+    // hands the file over and deletes the read
+    void finish(Read *read, bool ok, bool mapped = false)
+    {
+#ifndef _WIN32
+        if (read->fd >= 0)
+            close(read->fd);
+#endif
+        if (!ok)
+            read->span = AssetSpan();
+        else if (!read->span.data)
+        {
+            // a non-null pointer even for empty files
+            static const unsigned char empty = 0;
+            read->span.data = read->span.storage->empty() ? &empty : read->span.storage->data();
+            read->span.size = read->span.storage->size();
+        }
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - read->start).count();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++counters.reads;
+            if (mapped)
+                ++counters.mapped;
+            else
+            {
+                ++counters.latency[bucket((unsigned long long)(ms * 1000.0) / 8)];
+                latencySumMs += ms;
+                ++latencyCount;
+                counters.latencyMaxMs = std::max(counters.latencyMaxMs, ms);
+            }
+            if (!ok)
+                ++counters.failed;
+            counters.bytes += read->span.size;
+        }
+        if (read->done)
+            read->done(read->span);
+        read->promise.set_value(read->span);
+        delete read;
+        if (!mapped)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--inFlight == 0)
+                idle.notify_all();
+        }
+    }
+
+#ifndef _WIN32
+    // opens the file and sizes its buffer, false when there's nothing left to read
+    bool openFile(Read *read, bool &ok)
+    {
+        read->fd = ::open(read->path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        ok = read->fd >= 0 && fstat(read->fd, &info) == 0;
+        if (!ok)
+            return false;
+        read->span.storage = std::make_shared<std::vector<unsigned char> >((size_t)info.st_size);
+        return info.st_size > 0;
+    }
+#endif
+
+    // pread pool
+    void serve()
+    {
+        for (;;)
+        {
+            Read *read;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stop && queue.empty())
+                    wake.wait(lock);
+                if (queue.empty())
+                    return;
+                read = queue.front();
+                queue.pop_front();
+            }
+#ifdef _WIN32
+            read->span = FileSystem::read(read->path);
+            finish(read, read->span.valid());
+#else
+            bool ok;
+            if (openFile(read, ok))
+            {
+                std::vector<unsigned char> &data = *read->span.storage;
+                while (ok && read->offset < data.size())
+                {
+                    ssize_t n = pread(read->fd, &data[read->offset], data.size() - read->offset, (off_t)read->offset);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    // a file that shrank since fstat is a failed read too
+                    ok = n > 0;
+                    if (ok)
+                        read->offset += (size_t)n;
+                }
+            }
+            finish(read, ok);
+#endif
+        }
+    }
+
+#ifdef __linux__
+    int ringFd;
+    unsigned char *sqRing, *cqRing;
+    size_t sqRingBytes, cqRingBytes, sqesBytes;
+    unsigned *sqHead, *sqTail, *sqMask, *sqEntries, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask, *cqEntries;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    unsigned int ringInFlight;  // opens and reads the kernel has, at most a completion queue's worth
+    std::deque<Read *> pending; // waiting for room in the ring: to open while fd < 0, to read after
+
+    bool setupRing()
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = (int)syscall(__NR_io_uring_setup, 64, &params);
+        if (ringFd < 0)
+            return false;
+        // opens and reads go through the ring and big reads are punted to workers (IORING_OP_OPENAT,
+        // IORING_OP_READ and IOSQE_ASYNC are 5.6), fast poll marks 5.7
+        if (!(params.features & IORING_FEAT_FAST_POLL))
+        {
+            close(ringFd);
+            ringFd = -1;
+            return false;
+        }
+        sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+            sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+        void *sq = mmap(NULL, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        void *cq = single ? sq : mmap(NULL, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+        void *entries = mmap(NULL, sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sq == MAP_FAILED || cq == MAP_FAILED || entries == MAP_FAILED)
+        {
+            if (entries != MAP_FAILED)
+                munmap(entries, sqesBytes);
+            if (cq != MAP_FAILED && cq != sq)
+                munmap(cq, cqRingBytes);
+            if (sq != MAP_FAILED)
+                munmap(sq, sqRingBytes);
+            close(ringFd);
+            ringFd = -1;
+            return false;
+        }
+        sqRing = (unsigned char *)sq;
+        cqRing = (unsigned char *)cq;
+        sqes = (io_uring_sqe *)entries;
+        sqHead = (unsigned *)(sqRing + params.sq_off.head);
+        sqTail = (unsigned *)(sqRing + params.sq_off.tail);
+        sqMask = (unsigned *)(sqRing + params.sq_off.ring_mask);
+        sqEntries = (unsigned *)(sqRing + params.sq_off.ring_entries);
+        sqArray = (unsigned *)(sqRing + params.sq_off.array);
+        cqHead = (unsigned *)(cqRing + params.cq_off.head);
+        cqTail = (unsigned *)(cqRing + params.cq_off.tail);
+        cqMask = (unsigned *)(cqRing + params.cq_off.ring_mask);
+        cqEntries = (unsigned *)(cqRing + params.cq_off.ring_entries);
+        cqes = (io_uring_cqe *)(cqRing + params.cq_off.cqes);
+        return true;
+    }
+
+    // the next free submission entry, cleared, under mutex; submits what's queued when the ring is full
+    io_uring_sqe *nextSqe()
+    {
+        unsigned tail = *sqTail;
+        while (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= *sqEntries)
+            syscall(__NR_io_uring_enter, ringFd, *sqEntries, 0, 0, NULL, 0);
+        sqArray[tail & *sqMask] = tail & *sqMask;
+        io_uring_sqe *sqe = &sqes[tail & *sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void submitRing(const std::vector<Read *> &reads)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.insert(pending.end(), reads.begin(), reads.end());
+        pump();
+    }
+
+    // moves pending opens and reads into the ring and submits them with one io_uring_enter, under mutex
+    void pump()
+    {
+        unsigned submitted = 0;
+        while (!pending.empty() && ringInFlight < *cqEntries)
+        {
+            Read *read = pending.front();
+            pending.pop_front();
+            io_uring_sqe *sqe = nextSqe();
+            if (read->fd < 0)
+            {
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = (unsigned long long)(uintptr_t)read->path.c_str();
+                sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            }
+            else
+            {
+                std::vector<unsigned char> &data = *read->span.storage;
+                sqe->opcode = IORING_OP_READ;
+                // small cached files are quicker read inline by the reaper's io_uring_enter, big ones are
+                // copied in parallel by the kernel's workers
+                if (data.size() - read->offset >= ASYNC_IO_INLINE_BYTES)
+                    sqe->flags = IOSQE_ASYNC;
+                sqe->fd = read->fd;
+                sqe->addr = (unsigned long long)(uintptr_t)&data[read->offset];
+                sqe->len = (unsigned)std::min<size_t>(data.size() - read->offset, 1u << 30);
+                sqe->off = read->offset;
+            }
+            sqe->user_data = (unsigned long long)(uintptr_t)read;
+            __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+            ++ringInFlight;
+            ++submitted;
+        }
+        if (submitted)
+            syscall(__NR_io_uring_enter, ringFd, submitted, 0, 0, NULL, 0);
+    }
+
+    // completion thread: sizes opened files and queues their reads, short reads go back for the rest
+    void reap()
+    {
+        for (;;)
+        {
+            if (syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+                return;
+            std::vector<std::pair<Read *, bool> > finished;
+            std::vector<Read *> opened;
+            bool exit = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                unsigned head = *cqHead, tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+                for (; head != tail; ++head)
+                {
+                    const io_uring_cqe &cqe = cqes[head & *cqMask];
+                    Read *read = (Read *)(uintptr_t)cqe.user_data;
+                    if (!read)
+                    {
+                        exit = true;
+                        continue;
+                    }
+                    --ringInFlight;
+                    if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+                        pending.push_front(read);
+                    else if (cqe.res < 0)
+                        finished.push_back(std::make_pair(read, false));
+                    else if (read->fd < 0)
+                    {
+                        read->fd = cqe.res;
+                        opened.push_back(read);
+                    }
+                    // a file that shrank since fstat is a failed read too
+                    else if (cqe.res == 0)
+                        finished.push_back(std::make_pair(read, false));
+                    else if ((read->offset += (size_t)cqe.res) < read->span.storage->size())
+                        pending.push_front(read);
+                    else
+                        finished.push_back(std::make_pair(read, true));
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            }
+            // buffers are allocated here rather than on the submitting thread
+            std::vector<Read *> reads;
+            for (size_t i = 0; i < opened.size(); ++i)
+            {
+                struct stat info;
+                if (fstat(opened[i]->fd, &info) != 0)
+                    finished.push_back(std::make_pair(opened[i], false));
+                else
+                {
+                    opened[i]->span.storage = std::make_shared<std::vector<unsigned char> >((size_t)info.st_size);
+                    if (info.st_size > 0)
+                        reads.push_back(opened[i]);
+                    else
+                        finished.push_back(std::make_pair(opened[i], true));
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.insert(pending.end(), reads.begin(), reads.end());
+                pump();
+            }
+            for (size_t i = 0; i < finished.size(); ++i)
+                finish(finished[i].first, finished[i].second);
+            if (exit)
+                return;
+        }
+    }
+#endif
+};
+#endif
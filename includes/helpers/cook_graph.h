@@ -0,0 +1,498 @@
+#ifndef COOK_GRAPH_H
+#define COOK_GRAPH_H
+
+#include <helpers/asset_archive.h>
+#include <helpers/filesystem.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#define popen _popen
+#define pclose _pclose
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a cooker run making one file
+struct CookJob
+{
+    std::string output;                 // absolute
+    std::string cooker;                 // executable, next to assetcook
+    std::vector<std::string> arguments; // "{out}" stands for the file being made
+};
+
+struct CookStats
+{
+    int jobs;
+    int cooked;   // ran the cooker
+    int cached;   // copied out of the cache
+    int upToDate; // nothing to do
+    int failed;   // the cooker failed, or a job it depends on did
+    int hashed;   // input files read to hash them, the others had the size and time they were hashed at
+};
+
+
+// The build graph of the cookers (texcook, meshcook, scenecook): which cooker makes which file out of which.
+// A job's inputs are its arguments that name files (path[:channels] sources included) and whatever the
+// cooker reported reading besides them last time (--deps, e.g. the meshes a scene measures; a job only
+// waits for the jobs making those from the second run on, and cooks again then if it ran ahead of them the
+// first time). Its key is a 64-bit hash of the cooker's --version, the arguments and the content of every
+// input, so touching a file cooks nothing, and a change that is undone again is a copy out of the cache.
+//   <cache>/hashes    content hash of every input, with the size and mtime it was hashed at
+//   <cache>/jobs      per output: the key it was made with, its size and mtime, its extra inputs
+//   <cache>/objects/  cooked files by key
+// Jobs run in parallel, each as soon as the jobs making its inputs are done.
+class CookGraph
+{
+public:
+    CookGraph(const std::string &cacheDirectory, const std::string &toolDirectory)
+        : cache(cacheDirectory), tools(toolDirectory)
+    {
+    }
+
+    void add(const CookJob &job)
+    {
+        jobs.push_back(job);
+    }
+
+    // cooks what's out of date on threads workers, false when a job failed
+    bool run(int threads, CookStats &stats)
+    {
+        memset(&stats, 0, sizeof(stats));
+        stats.jobs = (int)jobs.size();
+        makeDirectory(cache);
+        makeDirectory(cache + "/objects");
+        makeDirectory(cache + "/tmp");
+        loadHashes();
+        loadRecords();
+        for (size_t i = 0; i < jobs.size(); ++i)
+            outputs[jobs[i].output] = (int)i;
+        for (size_t i = 0; i < jobs.size(); ++i)
+            if (!versions.count(jobs[i].cooker))
+                versions[jobs[i].cooker] = version(jobs[i].cooker);
+
+        // a job waits for the jobs making any of its inputs
+        state.assign(jobs.size(), WAITING);
+        inputs.assign(jobs.size(), std::vector<std::string>());
+        after.assign(jobs.size(), std::vector<int>());
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            gatherInputs((int)i);
+            for (size_t k = 0; k < inputs[i].size(); ++k)
+            {
+                std::map<std::string, int>::iterator maker = outputs.find(inputs[i][k]);
+                if (maker != outputs.end() && maker->second != (int)i)
+                    after[i].push_back(maker->second);
+            }
+        }
+
+        counters = &stats;
+        std::vector<std::thread> workers;
+        for (int t = 0; t < std::max(threads, 1); ++t)
+            workers.push_back(std::thread(&CookGraph::work, this));
+        for (size_t t = 0; t < workers.size(); ++t)
+            workers[t].join();
+        for (size_t i = 0; i < jobs.size(); ++i)
+            if (state[i] == WAITING)
+            {
+                std::cout << "ERROR::COOK::CYCLE: " << jobs[i].output << " depends on itself" << std::endl;
+                ++stats.failed;
+            }
+        saveHashes();
+        saveRecords();
+        return stats.failed == 0;
+    }
+
+    // for cookers: the files read besides their arguments, one a line, for the next run to watch
+    static bool writeDependencies(const std::string &path, const std::vector<std::string> &files)
+    {
+        std::ofstream file(path.c_str());
+        for (size_t i = 0; i < files.size(); ++i)
+            file << files[i] << "\n";
+        return file.good();
+    }
+
+private:
+    enum JobState { WAITING, RUNNING, DONE, FAILED };
+
+    struct FileHash
+    {
+        unsigned long long size, time, hash;
+    };
+
+    struct Record
+    {
+        unsigned long long key, size, time;
+        std::vector<std::string> dependencies;
+    };
+
+    std::string cache, tools;
+    std::vector<CookJob> jobs;
+    std::map<std::string, int> outputs;
+    std::map<std::string, std::string> versions;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<int> state;
+    std::vector<std::vector<std::string> > inputs;
+    std::vector<std::vector<int> > after;
+    std::map<std::string, FileHash> hashes;
+    std::map<std::string, Record> records;
+    CookStats *counters;
+
+    static void makeDirectory(const std::string &path)
+    {
+#ifdef _WIN32
+        _mkdir(path.c_str());
+#else
+        mkdir(path.c_str(), 0755);
+#endif
+    }
+
+    // size and modification time, false when there's no such file
+    static bool stamp(const std::string &path, unsigned long long &size, unsigned long long &time)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG)
+            return false;
+        size = (unsigned long long)info.st_size;
+#if defined(__linux__)
+        time = (unsigned long long)info.st_mtim.tv_sec * 1000000000ull + info.st_mtim.tv_nsec;
+#else
+        time = (unsigned long long)info.st_mtime * 1000000000ull;
+#endif
+        return true;
+    }
+
+    static std::string hex(unsigned long long value)
+    {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", value);
+        return text;
+    }
+
+    static unsigned long long mix(unsigned long long hash, const std::string &s)
+    {
+        // the terminating zero keeps "ab" "c" apart from "a" "bc"
+        return archiveHash(s.c_str(), s.size() + 1) ^ (hash * 1099511628211ull);
+    }
+
+    static bool copyFile(const std::string &from, const std::string &to)
+    {
+        std::ifstream in(from.c_str(), std::ios::binary);
+        std::string temporary = to + ".cooking";
+        std::ofstream out(temporary.c_str(), std::ios::binary);
+        if (!in || !out || !(out << in.rdbuf()))
+            return false;
+        out.close();
+        std::remove(to.c_str());
+        return std::rename(temporary.c_str(), to.c_str()) == 0;
+    }
+
+    // the first line the cooker prints for --version
+    std::string version(const std::string &cooker) const
+    {
+        std::string command = "\"" + tools + "/" + cooker + "\" --version";
+        FILE *pipe = popen(command.c_str(), "r");
+        char line[256] = "";
+        if (pipe)
+        {
+            if (!fgets(line, sizeof(line), pipe))
+                line[0] = 0;
+            pclose(pipe);
+        }
+        return line;
+    }
+
+    // arguments naming files or outputs (path[:channels] as well), then the extra inputs recorded last time
+    void gatherInputs(int job)
+    {
+        std::set<std::string> found;
+        const std::vector<std::string> &arguments = jobs[job].arguments;
+        for (size_t i = 0; i < arguments.size(); ++i)
+        {
+            std::string path = arguments[i];
+            unsigned long long size, time;
+            for (;;)
+            {
+                if (outputs.count(path) || stamp(path, size, time))
+                {
+                    found.insert(path);
+                    break;
+                }
+                size_t colon = path.find_last_of(':');
+                if (colon == std::string::npos || colon < path.find_last_of("/\\") + 1)
+                    break;
+                path.erase(colon);
+            }
+        }
+        std::map<std::string, Record>::const_iterator record = records.find(jobs[job].output);
+        if (record != records.end())
+            found.insert(record->second.dependencies.begin(), record->second.dependencies.end());
+        found.erase(jobs[job].output);
+        inputs[job].assign(found.begin(), found.end());
+    }
+
+    // the content hash of a file, read again only when its size or time changed; 0 for a missing file
+    unsigned long long contentHash(const std::string &path)
+    {
+        unsigned long long size, time;
+        if (!stamp(path, size, time))
+            return 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<std::string, FileHash>::const_iterator known = hashes.find(path);
+            if (known != hashes.end() && known->second.size == size && known->second.time == time)
+                return known->second.hash;
+            ++counters->hashed;
+        }
+        AssetSpan file = FileSystem::map(path);
+        FileHash entry = { size, time, file.valid() ? archiveHash((const char *)file.data, file.size) : 0 };
+        std::lock_guard<std::mutex> lock(mutex);
+        hashes[path] = entry;
+        return entry.hash;
+    }
+
+    unsigned long long key(int job, const std::vector<std::string> &files)
+    {
+        const CookJob &j = jobs[job];
+        unsigned long long hash = mix(mix(0, j.cooker), versions.find(j.cooker)->second);
+        size_t dot = j.output.find_last_of('.');
+        hash = mix(hash, dot == std::string::npos ? "" : j.output.substr(dot)); // texcook picks formats by it
+        for (size_t i = 0; i < j.arguments.size(); ++i)
+            hash = mix(hash, j.arguments[i]);
+        for (size_t i = 0; i < files.size(); ++i)
+            hash = mix(hash, files[i] + ":" + hex(contentHash(files[i])));
+        return hash;
+    }
+
+    void work()
+    {
+        for (;;)
+        {
+            int job = -1;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                    bool running = false;
+                    for (size_t i = 0; i < jobs.size() && job < 0; ++i)
+                    {
+                        running = running || state[i] == RUNNING;
+                        if (state[i] != WAITING)
+                            continue;
+                        bool ready = true, failed = false;
+                        for (size_t k = 0; k < after[i].size(); ++k)
+                        {
+                            ready = ready && state[after[i][k]] >= DONE;
+                            failed = failed || state[after[i][k]] == FAILED;
+                        }
+                        if (failed)
+                        {
+                            state[i] = FAILED;
+                            ++counters->failed;
+                            std::cout << "ERROR::COOK::SKIPPED: " << jobs[i].output << ", an input failed to cook" << std::endl;
+                            changed.notify_all();
+                        }
+                        else if (ready)
+                            job = (int)i;
+                    }
+                    if (job >= 0)
+                    {
+                        state[job] = RUNNING;
+                        break;
+                    }
+                    for (size_t i = 0; i < jobs.size() && !running; ++i)
+                        running = state[i] == RUNNING;
+                    if (!running)
+                        return; // done, or what's left waits on a cycle
+                    changed.wait(lock);
+                }
+            }
+            bool cooked = cook(job);
+            std::lock_guard<std::mutex> lock(mutex);
+            state[job] = cooked ? DONE : FAILED;
+            counters->failed += cooked ? 0 : 1;
+            changed.notify_all();
+        }
+    }
+
+    bool cook(int job)
+    {
+        const CookJob &j = jobs[job];
+        unsigned long long jobKey = key(job, inputs[job]);
+        unsigned long long size, time;
+        bool hasOutput = stamp(j.output, size, time);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<std::string, Record>::const_iterator record = records.find(j.output);
+            if (hasOutput && record != records.end() && record->second.key == jobKey && record->second.size == size &&
+                record->second.time == time)
+            {
+                ++counters->upToDate;
+                return true;
+            }
+        }
+
+        std::string object = cache + "/objects/" + hex(jobKey);
+        std::vector<std::string> dependencies;
+        bool fromCache = stamp(object, size, time);
+        if (fromCache)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<std::string, Record>::const_iterator record = records.find(j.output);
+            if (record != records.end())
+                dependencies = record->second.dependencies;
+        }
+        else if (!runCooker(job, jobKey, object, dependencies))
+            return false;
+        size_t slash = j.output.find_last_of("/\\");
+        if (slash != std::string::npos)
+            makeDirectory(j.output.substr(0, slash)); // cooked/ next to the sources
+        if (!copyFile(object, j.output))
+        {
+            std::cout << "ERROR::COOK::FILE_NOT_SUCCESFULLY_WRITTEN: " << j.output << std::endl;
+            return false;
+        }
+
+        Record record;
+        record.key = jobKey;
+        record.dependencies = dependencies;
+        stamp(j.output, record.size, record.time);
+        std::lock_guard<std::mutex> lock(mutex);
+        records[j.output] = record;
+        ++(fromCache ? counters->cached : counters->cooked);
+        return true;
+    }
+
+    // runs the cooker into the cache; the key changes when it read files it didn't read last time
+    bool runCooker(int job, unsigned long long &jobKey, std::string &object, std::vector<std::string> &dependencies)
+    {
+        const CookJob &j = jobs[job];
+        size_t dot = j.output.find_last_of('.');
+        std::string temporary = cache + "/tmp/" + hex(jobKey) + (dot == std::string::npos ? "" : j.output.substr(dot));
+        std::string depfile = cache + "/tmp/" + hex(jobKey) + ".deps";
+        std::string command = "\"" + tools + "/" + j.cooker + "\" --deps \"" + depfile + "\"";
+        for (size_t i = 0; i < j.arguments.size(); ++i)
+            command += " \"" + (j.arguments[i] == "{out}" ? temporary : j.arguments[i]) + "\"";
+        command += " 2>&1";
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::string log;
+        FILE *pipe = popen(command.c_str(), "r");
+        int status = -1;
+        if (pipe)
+        {
+            char buffer[4096];
+            size_t read;
+            while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+                log.append(buffer, read);
+            status = pclose(pipe);
+        }
+        unsigned long long size, time;
+        bool made = status == 0 && stamp(temporary, size, time);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::cout << log;
+            if (!made)
+                std::cout << "ERROR::COOK::COOKER_FAILED: " << j.output << ": " << j.cooker << " failed" << std::endl;
+            else
+                printf("cooked %s in %.2f s\n", j.output.c_str(),
+                       std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        if (!made)
+        {
+            std::remove(temporary.c_str());
+            std::remove(depfile.c_str());
+            return false;
+        }
+
+        std::ifstream reported(depfile.c_str());
+        std::string line;
+        while (std::getline(reported, line))
+            if (!line.empty())
+                dependencies.push_back(line);
+        reported.close();
+        std::remove(depfile.c_str());
+        std::set<std::string> files(inputs[job].begin(), inputs[job].end());
+        size_t known = files.size();
+        files.insert(dependencies.begin(), dependencies.end());
+        if (files.size() != known)
+        {
+            inputs[job].assign(files.begin(), files.end());
+            jobKey = key(job, inputs[job]);
+        }
+        object = cache + "/objects/" + hex(jobKey);
+        std::remove(object.c_str());
+        return std::rename(temporary.c_str(), object.c_str()) == 0;
+    }
+
+    void loadHashes()
+    {
+        std::ifstream file((cache + "/hashes").c_str());
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            FileHash entry;
+            std::string path;
+            if (fields >> std::hex >> entry.hash >> std::dec >> entry.size >> entry.time && std::getline(fields >> std::ws, path))
+                hashes[path] = entry;
+        }
+    }
+
+    void saveHashes() const
+    {
+        std::ofstream file((cache + "/hashes").c_str());
+        for (std::map<std::string, FileHash>::const_iterator i = hashes.begin(); i != hashes.end(); ++i)
+            file << hex(i->second.hash) << " " << i->second.size << " " << i->second.time << " " << i->first << "\n";
+    }
+
+    // "job <key> <size> <time> <output>" and a "dep <path>" line for each extra input
+    void loadRecords()
+    {
+        std::ifstream file((cache + "/jobs").c_str());
+        std::string line;
+        Record *current = NULL;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            std::string kind, path;
+            fields >> kind;
+            if (kind == "job")
+            {
+                Record record;
+                if (fields >> std::hex >> record.key >> std::dec >> record.size >> record.time && std::getline(fields >> std::ws, path))
+                    current = &(records[path] = record);
+            }
+            else if (kind == "dep" && current && std::getline(fields >> std::ws, path))
+                current->dependencies.push_back(path);
+        }
+    }
+
+    void saveRecords() const
+    {
+        std::ofstream file((cache + "/jobs").c_str());
+        for (std::map<std::string, Record>::const_iterator i = records.begin(); i != records.end(); ++i)
+        {
+            file << "job " << hex(i->second.key) << " " << i->second.size << " " << i->second.time << " " << i->first << "\n";
+            for (size_t k = 0; k < i->second.dependencies.size(); ++k)
+                file << "dep " << i->second.dependencies[k] << "\n";
+        }
+    }
+};
+#endif
@@ -0,0 +1,301 @@
+#ifndef DRAW_BATCH_H
+#define DRAW_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <helpers/geometry_heap.h>
+#include <helpers/gpu_culling.h>
+#include <helpers/log.h>
+#include <helpers/shader.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// must match draw_data.glsl
+const GLuint DRAW_ID_LOCATION = 7;
+const int DRAW_DATA_UNIT = 8;
+const int DRAW_DATA_TEXELS = 5; // the model matrix's columns, then the draw's parameters
+
+// glMultiDrawElementsIndirect's command
+struct DrawElementsIndirectCommand
+{
+    GLuint count, instanceCount, firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// draws and API calls since the last report
+struct DrawBatchStats
+{
+    long long draws, calls, flushes;
+};
+
+
+// Draws of heap ranges (see helpers/geometry_heap.h) gathered over a pass and submitted together: the
+// ones sharing a VAO, mode, index type and restart go out as one glMultiDrawElementsIndirect, so what the
+// CPU submits doesn't grow with the number of objects. Everything else the draws share (program, textures)
+// is the caller's to set before flush(), which it calls again whenever that changes.
+// Shaders get each draw's model matrix and a vec4 of parameters from draw_data.glsl: the draw's index is
+// a per-instance attribute at DRAW_ID_LOCATION, which the command's baseInstance picks out of a buffer of
+// 0, 1, 2..., and it indexes a buffer texture of DRAW_DATA_TEXELS texels per draw on unit DRAW_DATA_UNIT.
+// That works in GLSL 3.30 where gl_DrawID needs 4.60 or ARB_shader_draw_parameters, and a buffer texture
+// where a shader storage buffer needs 4.30. Contexts older than 4.3 (macOS stops at 4.1) draw one by one
+// with the index as the attribute's current value instead, the same shaders either way.
+// With a GpuCulling set (helpers/gpu_culling.h) and a view to submit against, the indirect path culls the
+// commands on the GPU before drawing them, by the bounding spheres (and normal cones) the draws were added with.
+// Must be used on the thread that owns the GL context.
+class DrawBatch
+{
+public:
+    DrawBatch()
+        : culling(NULL), dataBuffer(0), dataTexture(0), commandBuffer(0), idBuffer(0), idCapacity(0), maxDraws(0), indirect(false),
+          sorted(false)
+    {
+        memset(&counters, 0, sizeof(counters));
+    }
+    ~DrawBatch()
+    {
+        if (dataBuffer)
+        {
+            glDeleteTextures(1, &dataTexture);
+            GLuint buffers[] = { dataBuffer, commandBuffer, idBuffer };
+            glDeleteBuffers(3, buffers);
+        }
+    }
+
+    // bounds: the draw's bounding sphere in world space (center, radius), no radius is never culled; cone:
+    // the world space axis and cutoff of a meshlet's normal cone (helpers/meshlet.h), a cutoff of 1 for none
+    void add(const GeometryDraw &draw, const glm::mat4 &model, const glm::vec4 &parameters = glm::vec4(0.0f),
+             const glm::vec4 &bounds = glm::vec4(0.0f), const glm::vec4 &cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))
+    {
+        if (draw.count == 0)
+            return;
+        Entry entry = { draw, (GLuint)entries.size(), bounds, cone };
+        entries.push_back(entry);
+        sorted = false;
+        for (int c = 0; c < 4; ++c)
+            data.push_back(model[c]);
+        data.push_back(parameters);
+    }
+
+    bool empty() const { return entries.empty(); }
+
+    // submits the draws added since the last clear() with shader, which is in use, culled against view when
+    // there is one and culling is set up; a pass drawing the same draws to several views (a shadow cubemap's
+    // faces) submits once per view, then clears
+    void submit(Shader &shader, const CullView *view = NULL)
+    {
+        if (entries.empty())
+            return;
+        if (!dataBuffer)
+            create();
+        if (!sorted)
+        {
+            // grouped by state, the data reordered to match so a group's draws read consecutive texels
+            std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return key(a.draw) < key(b.draw); });
+            packed.resize(data.size());
+            for (size_t i = 0; i < entries.size(); ++i)
+                std::copy(&data[entries[i].data * DRAW_DATA_TEXELS], &data[entries[i].data * DRAW_DATA_TEXELS] + DRAW_DATA_TEXELS,
+                          &packed[i * DRAW_DATA_TEXELS]);
+            sorted = true;
+        }
+        glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, dataTexture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("drawData", DRAW_DATA_UNIT);
+        // the buffer texture holds maxDraws at a time
+        for (size_t begin = 0; begin < entries.size(); begin += maxDraws)
+            submit(begin, std::min(entries.size(), begin + maxDraws), view);
+        counters.draws += entries.size();
+        ++counters.flushes;
+    }
+
+    void clear()
+    {
+        entries.clear();
+        data.clear();
+        sorted = false;
+    }
+
+    // submit() and clear()
+    void flush(Shader &shader, const CullView *view = NULL)
+    {
+        submit(shader, view);
+        clear();
+    }
+
+    // culls the indirect path's draws from now on, or stops when NULL; the caller keeps it
+    void setCulling(GpuCulling *gpuCulling)
+    {
+        culling = gpuCulling;
+    }
+
+    // whether submits against a view are culled
+    bool culls()
+    {
+        return multiDraw() && culling && culling->ready();
+    }
+
+    // one glMultiDrawElementsIndirect per group, or a draw per draw
+    bool multiDraw()
+    {
+        if (!dataBuffer)
+            create();
+        return indirect;
+    }
+
+    DrawBatchStats stats() const { return counters; }
+
+    void resetStats() { memset(&counters, 0, sizeof(counters)); }
+
+private:
+    struct Entry
+    {
+        GeometryDraw draw;
+        GLuint data; // draw index in data
+        glm::vec4 bounds, cone;
+    };
+
+    GpuCulling *culling;
+    std::vector<Entry> entries;
+    std::vector<glm::vec4> data;   // DRAW_DATA_TEXELS per entry, in the order added
+    std::vector<glm::vec4> packed; // in the order submitted
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<glm::vec4> cullBounds, cullCones;
+    std::vector<GLuint> cullGroups;
+    GLuint dataBuffer, dataTexture, commandBuffer, idBuffer;
+    size_t idCapacity, maxDraws;
+    bool indirect, sorted;
+    DrawBatchStats counters;
+
+    // entries [begin, end): their data, then one call per group
+    void submit(size_t begin, size_t end, const CullView *view)
+    {
+        size_t count = end - begin;
+        if (count > idCapacity)
+            growIds(count);
+        glBindBuffer(GL_TEXTURE_BUFFER, dataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, count * DRAW_DATA_TEXELS * sizeof(glm::vec4), &packed[begin * DRAW_DATA_TEXELS], GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        commands.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const GeometryDraw &draw = entries[begin + i].draw;
+            DrawElementsIndirectCommand command = { draw.count, 1, draw.firstIndex, draw.baseVertex, (GLuint)i };
+            commands[i] = command;
+        }
+        if (indirect)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, count * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+            if (view && culling && culling->ready())
+                cull(begin, count, *view);
+        }
+        for (size_t first = 0, last; first < count; first = last)
+        {
+            const GeometryDraw &draw = entries[begin + first].draw;
+            for (last = first + 1; last < count && key(entries[begin + last].draw) == key(draw);)
+                ++last;
+            bindVertexArray(draw.vertexArray);
+            if (draw.restart)
+            {
+                glEnable(GL_PRIMITIVE_RESTART);
+                glPrimitiveRestartIndex(draw.type == GL_UNSIGNED_INT ? 0xFFFFFFFF : draw.type == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFF);
+            }
+            if (indirect)
+            {
+                attachIds();
+                glMultiDrawElementsIndirect(draw.mode, draw.type, (void *)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)(last - first), 0);
+                ++counters.calls;
+            }
+            else
+            {
+                glDisableVertexAttribArray(DRAW_ID_LOCATION);
+                size_t indexSize = draw.type == GL_UNSIGNED_INT ? 4 : draw.type == GL_UNSIGNED_SHORT ? 2 : 1;
+                for (size_t i = first; i < last; ++i)
+                {
+                    glVertexAttribI4ui(DRAW_ID_LOCATION, commands[i].baseInstance, 0, 0, 0);
+                    glDrawElementsBaseVertex(draw.mode, commands[i].count, draw.type, (void *)(commands[i].firstIndex * indexSize), commands[i].baseVertex);
+                }
+                counters.calls += last - first;
+            }
+            if (draw.restart)
+                glDisable(GL_PRIMITIVE_RESTART);
+        }
+        if (indirect)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // replaces the bound commands with the ones culling leaves, at the same offsets
+    void cull(size_t begin, size_t count, const CullView &view)
+    {
+        cullBounds.resize(count);
+        cullCones.resize(count);
+        cullGroups.resize(2 * count);
+        size_t groups = 0;
+        for (size_t first = 0, last; first < count; first = last, ++groups)
+        {
+            for (last = first + 1; last < count && key(entries[begin + last].draw) == key(entries[begin + first].draw);)
+                ++last;
+            for (size_t i = first; i < last; ++i)
+            {
+                cullBounds[i] = entries[begin + i].bounds;
+                cullCones[i] = entries[begin + i].cone;
+                cullGroups[2 * i] = (GLuint)first;
+                cullGroups[2 * i + 1] = (GLuint)groups;
+            }
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling->cull(view, commandBuffer, cullBounds, cullCones, cullGroups, groups));
+    }
+
+    static unsigned long long key(const GeometryDraw &draw)
+    {
+        return (unsigned long long)draw.vertexArray << 32 | (unsigned long long)(draw.mode & 0xFF) << 24 |
+               (unsigned long long)(draw.type & 0xFF) << 16 | (draw.restart ? 1u : 0u);
+    }
+
+    void create()
+    {
+        glGenBuffers(1, &dataBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &idBuffer);
+        glGenTextures(1, &dataTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, dataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, DRAW_DATA_TEXELS * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, dataTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, dataBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        indirect = GLAD_GL_VERSION_4_3 && glMultiDrawElementsIndirect;
+        GLint texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+        maxDraws = std::max(texels, 65536) / DRAW_DATA_TEXELS;
+    }
+
+    void growIds(size_t count)
+    {
+        idCapacity = std::max(count, idCapacity * 2);
+        std::vector<GLuint> ids(idCapacity);
+        for (size_t i = 0; i < idCapacity; ++i)
+            ids[i] = (GLuint)i;
+        glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+        glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // the id stream on the bound VAO, instance baseInstance reading element baseInstance
+    void attachIds()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+        glEnableVertexAttribArray(DRAW_ID_LOCATION);
+        glVertexAttribIPointer(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0, (void *)0);
+        glVertexAttribDivisor(DRAW_ID_LOCATION, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    DrawBatch(const DrawBatch &);
+    DrawBatch &operator=(const DrawBatch &);
+};
+#endif
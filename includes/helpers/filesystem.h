@@ -3,6 +3,8 @@
 
 #include <string>
 #include <cstdlib>
+#include <fstream>
+#include <helpers/asset_archive.h>
 #include "root_directory.h" // This is a configuration file generated by CMake.
 
 class FileSystem
@@ -17,6 +19,89 @@ public:
     return (*pathBuilder)(path);
   }
 
+  // maps an asset archive (.pak, see helpers/asset_archive.h) once; read() then serves every path it holds
+  // without touching the disk again
+  static bool mount(const std::string& archivePath)
+  {
+    return archive().open(archivePath);
+  }
+
+  // the bytes of path (as given by getPath, or relative to the working directory): zero-copy from the
+  // mounted archive when it holds the file, read from disk otherwise
+  static AssetSpan read(const std::string& path)
+  {
+    AssetSpan span = readMounted(path);
+    if (span.valid())
+      return span;
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file)
+      return span;
+    span.storage = std::make_shared<std::vector<unsigned char> >((size_t)file.tellg());
+    file.seekg(0);
+    if (!file.read((char *)span.storage->data(), span.storage->size()))
+      return AssetSpan();
+    // a non-null pointer even for empty files
+    static const unsigned char empty = 0;
+    span.data = span.storage->empty() ? &empty : span.storage->data();
+    span.size = span.storage->size();
+    return span;
+  }
+
+  // like read(), but a loose file is mapped rather than copied: the span stays valid, without a copy of the
+  // file in memory, for as long as it's kept around
+  static AssetSpan map(const std::string& path)
+  {
+    AssetSpan span = readMounted(path);
+    if (span.valid())
+      return span;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+      return span;
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    HANDLE mapping = fileSize.QuadPart ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mapping)
+      CloseHandle(mapping);
+    CloseHandle(file);
+    // empty files can't be mapped
+    if (!fileSize.QuadPart)
+      return read(path);
+    if (!view)
+      return span;
+    span.mapping = std::shared_ptr<void>(view, [](void *view) { UnmapViewOfFile(view); });
+    span.size = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return span;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+      ::close(fd);
+      // empty files can't be mapped
+      return read(path);
+    }
+    void *view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+      return span;
+    size_t size = (size_t)info.st_size;
+    span.mapping = std::shared_ptr<void>(view, [size](void *view) { munmap(view, size); });
+    span.size = size;
+#endif
+    span.data = (const unsigned char *)span.mapping.get();
+    return span;
+  }
+
+  // only what the mounted archive holds, for callers that stream big files from disk themselves
+  static AssetSpan readMounted(const std::string& path)
+  {
+    const ArchiveEntry *entry = archive().find(archiveName(path));
+    return entry ? archive().read(*entry) : AssetSpan();
+  }
+
 private:
   static std::string const & getRoot()
   {
@@ -37,7 +122,8 @@ private:
 
   static std::string getPathRelativeRoot(const std::string& path)
   {
-    return getRoot() + std::string("/") + path;
+    static const std::string prefix = getRoot() + "/";
+    return prefix + path;
   }
 
   static std::string getPathRelativeBinary(const std::string& path)
@@ -45,6 +131,21 @@ private:
     return "../../../" + path;
   }
 
+  static AssetArchive& archive()
+  {
+    static AssetArchive mounted;
+    return mounted;
+  }
+
+  // archives name files relative to the project root: strip what getPath() put in front
+  static std::string archiveName(const std::string& path)
+  {
+    static const std::string prefix = getPath("");
+    if (path.compare(0, prefix.size(), prefix) == 0)
+      return path.substr(prefix.size());
+    return path;
+  }
+
 
 };
 
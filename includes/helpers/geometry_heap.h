@@ -0,0 +1,469 @@
+#ifndef GEOMETRY_HEAP_H
+#define GEOMETRY_HEAP_H
+
+#include <glad/glad.h>
+
+#include <helpers/log.h>
+#include <helpers/vertex_layout.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// the VAO bound last through bindVertexArray, and how many times that changed
+struct VertexArrayState
+{
+    GLuint bound;
+    unsigned long long switches;
+};
+
+inline VertexArrayState &vertexArrayState()
+{
+    static VertexArrayState state = { 0, 0 };
+    return state;
+}
+
+// glBindVertexArray unless VAO is bound already; whatever binds VAOs goes through here, so the state is right
+inline void bindVertexArray(GLuint VAO)
+{
+    VertexArrayState &state = vertexArrayState();
+    if (state.bound == VAO)
+        return;
+    glBindVertexArray(VAO);
+    state.bound = VAO;
+    ++state.switches;
+}
+
+
+// one draw of a heap range as a DrawBatch (helpers/draw_batch.h) takes it: first and count in indices of
+// type from the start of the heap's index buffer, restart at type's largest index when restart is set.
+// count 0 draws nothing
+struct GeometryDraw
+{
+    GLuint vertexArray;
+    GLenum mode, type;
+    bool restart;
+    GLuint count, firstIndex;
+    GLint baseVertex;
+};
+
+
+// Offsets into [0, capacity()): first fit over the free ranges in offset order, a freed range merged with
+// the free ones next to it
+class RangeAllocator
+{
+public:
+    static const size_t NONE = ~(size_t)0;
+
+    RangeAllocator() : total(0), allocated(0) {}
+
+    // everything free again
+    void reset(size_t capacity)
+    {
+        free.clear();
+        if (capacity)
+            free[0] = capacity;
+        total = capacity;
+        allocated = 0;
+    }
+
+    // [0, used) taken, the rest free: what compacting leaves
+    void reset(size_t capacity, size_t used)
+    {
+        reset(capacity);
+        if (used)
+            allocate(used);
+    }
+
+    // size units at a multiple of alignment, NONE when no free range holds them
+    size_t allocate(size_t size, size_t alignment = 1)
+    {
+        for (std::map<size_t, size_t>::iterator range = free.begin(); range != free.end(); ++range)
+        {
+            size_t begin = range->first, end = range->first + range->second;
+            size_t start = (begin + alignment - 1) / alignment * alignment;
+            if (start + size > end)
+                continue;
+            free.erase(range);
+            if (start > begin)
+                free[begin] = start - begin;
+            if (start + size < end)
+                free[start + size] = end - start - size;
+            allocated += size;
+            return start;
+        }
+        return NONE;
+    }
+
+    void release(size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        allocated -= size;
+        std::map<size_t, size_t>::iterator next = free.lower_bound(offset);
+        if (next != free.end() && offset + size == next->first)
+        {
+            size += next->second;
+            free.erase(next++);
+        }
+        if (next != free.begin())
+        {
+            std::map<size_t, size_t>::iterator previous = next;
+            --previous;
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += size;
+                return;
+            }
+        }
+        free[offset] = size;
+    }
+
+    size_t capacity() const { return total; }
+    size_t used() const { return allocated; }
+    // free ranges: 1 (or 0 when full) when nothing is fragmented
+    size_t holes() const { return free.size(); }
+
+private:
+    std::map<size_t, size_t> free; // offset to size
+    size_t total, allocated;
+};
+
+
+// Vertex and index ranges of many meshes sub-allocated from one index buffer and one vertex buffer per
+// stream, so they all draw from one VAO without switching it. Every stream is a VertexLayout, the first
+// at location 0 and each next one after the attributes of the one before; a range holds the same
+// vertices in every stream. A mesh's indices count from its first vertex, which glDrawElementsBaseVertex
+// adds, and can be 16 or 32 bits whatever the others'.
+// Full buffers grow by doubling, compacting the live ranges on the GPU as they are copied; when the room
+// is there but in holes too small, allocate() compacts the ranges in place instead. Compacting moves
+// ranges, so they are handles and their offsets are looked up when drawing.
+// Writes go through GL_COPY_WRITE_BUFFER, which leaves the VAO's element array binding alone.
+// Must be used on the thread that owns the GL context.
+template <typename... Streams> class GeometryHeap
+{
+public:
+    typedef int Handle; // -1 for none
+    static const int streamCount = sizeof...(Streams);
+
+    // in vertices and index bytes; the buffers are created by the first allocate()
+    GeometryHeap(size_t vertexCapacity = 1 << 16, size_t indexCapacity = 1 << 20)
+        : VAO(0), EBO(0), initialVertices(std::max<size_t>(vertexCapacity, 1)), initialIndices(std::max<size_t>(indexCapacity, 4)), movedBytes(0)
+    {
+        std::fill(VBOs, VBOs + streamCount, 0);
+    }
+    ~GeometryHeap()
+    {
+        release();
+    }
+
+    // vertexCount vertices in every stream and indexBytes of indices, -1 when the buffers can't grow
+    Handle allocate(size_t vertexCount, size_t indexBytes)
+    {
+        if (!VAO)
+            create(initialVertices, initialIndices);
+        Range range = { RangeAllocator::NONE, vertexCount, RangeAllocator::NONE, indexBytes, true };
+        if (!place(range))
+        {
+            size_t vertexCapacity = vertices.capacity(), indexCapacity = indices.capacity();
+            while (vertices.used() + vertexCount > vertexCapacity)
+                vertexCapacity *= 2;
+            // compacted, every live range takes whole words: used() leaves the padding between them out
+            size_t indexEnd = 0;
+            for (size_t h = 0; h < ranges.size(); ++h)
+                if (ranges[h].live)
+                    indexEnd += (ranges[h].indexBytes + 3) / 4 * 4;
+            while (indexEnd + indexBytes > indexCapacity)
+                indexCapacity *= 2;
+            if (!rebuild(vertexCapacity, indexCapacity) || !place(range))
+            {
+                Log::error("GEOMETRY_HEAP::OUT_OF_MEMORY: %d vertices, %d index bytes", (int)vertexCount, (int)indexBytes);
+                return -1;
+            }
+        }
+        Handle handle;
+        if (!freeHandles.empty())
+        {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+            ranges[handle] = range;
+        }
+        else
+        {
+            handle = (Handle)ranges.size();
+            ranges.push_back(range);
+        }
+        return handle;
+    }
+
+    void free(Handle handle)
+    {
+        if (handle < 0 || handle >= (Handle)ranges.size() || !ranges[handle].live)
+            return;
+        Range &range = ranges[handle];
+        vertices.release(range.firstVertex, range.vertexCount);
+        indices.release(range.indexOffset, range.indexBytes);
+        range.live = false;
+        freeHandles.push_back(handle);
+    }
+
+    // size bytes at offset into the range's part of a stream
+    void writeVertices(Handle handle, int stream, size_t offset, const void *data, size_t size)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, VBOs[stream]);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, ranges[handle].firstVertex * stride(stream) + offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void writeIndices(Handle handle, size_t offset, const void *data, size_t size)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, ranges[handle].indexOffset + offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // the range's part of a stream, or its indices, mapped for writing; NULL on failure. unmap() every
+    // mapping, false when the contents were lost meanwhile
+    void *mapVertices(Handle handle, int stream)
+    {
+        return map(VBOs[stream], ranges[handle].firstVertex * stride(stream), ranges[handle].vertexCount * stride(stream));
+    }
+
+    void *mapIndices(Handle handle)
+    {
+        return map(EBO, ranges[handle].indexOffset, ranges[handle].indexBytes);
+    }
+
+    bool unmapVertices(int stream)
+    {
+        return unmap(VBOs[stream]);
+    }
+
+    bool unmapIndices()
+    {
+        return unmap(EBO);
+    }
+
+    // count indices of type from byte offset into the range's, each plus the range's first vertex and
+    // baseVertex; binds the heap's VAO unless it is bound
+    void draw(Handle handle, GLenum mode, GLsizei count, GLenum type, size_t offset, GLint baseVertex = 0) const
+    {
+        const Range &range = ranges[handle];
+        bindVertexArray(VAO);
+        glDrawElementsBaseVertex(mode, count, type, (void *)(range.indexOffset + offset), (GLint)range.firstVertex + baseVertex);
+    }
+
+    // draw() of the same arguments for a DrawBatch; offsets are multiples of the index size
+    GeometryDraw drawOf(Handle handle, GLenum mode, GLsizei count, GLenum type, size_t offset, GLint baseVertex = 0, bool restart = false) const
+    {
+        const Range &range = ranges[handle];
+        size_t indexSize = type == GL_UNSIGNED_INT ? 4 : type == GL_UNSIGNED_SHORT ? 2 : 1;
+        GeometryDraw draw = { VAO, mode, type, restart, (GLuint)count, (GLuint)((range.indexOffset + offset) / indexSize),
+                              (GLint)range.firstVertex + baseVertex };
+        return draw;
+    }
+
+    GLuint vertexArray() const { return VAO; }
+
+    // moves the live ranges to the front of the buffers, closing the holes between them
+    void compact()
+    {
+        if (VAO)
+            rebuild(vertices.capacity(), indices.capacity());
+    }
+
+    // GPU memory of the buffers, and of what is allocated in them
+    size_t bytes() const { return vertices.capacity() * vertexBytes() + indices.capacity(); }
+    size_t usedBytes() const { return vertices.used() * vertexBytes() + indices.used(); }
+    // free ranges in the vertex and index buffers
+    size_t holes() const { return vertices.holes() + indices.holes(); }
+    // copied by growing and compacting so far
+    size_t moved() const { return movedBytes; }
+
+    void release()
+    {
+        if (VAO)
+        {
+            if (vertexArrayState().bound == VAO)
+                bindVertexArray(0);
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(streamCount, VBOs);
+            glDeleteBuffers(1, &EBO);
+        }
+        VAO = EBO = 0;
+        std::fill(VBOs, VBOs + streamCount, 0);
+        ranges.clear();
+        freeHandles.clear();
+        vertices.reset(0);
+        indices.reset(0);
+    }
+
+private:
+    struct Range
+    {
+        size_t firstVertex, vertexCount;
+        size_t indexOffset, indexBytes;
+        bool live;
+    };
+
+    GLuint VAO, EBO;
+    GLuint VBOs[sizeof...(Streams)];
+    size_t initialVertices, initialIndices;
+    RangeAllocator vertices, indices; // in vertices, in bytes
+    std::vector<Range> ranges;         // by handle
+    std::vector<Handle> freeHandles;
+    size_t movedBytes;
+
+    static size_t stride(int stream)
+    {
+        static const size_t strides[] = { Streams::bytes... };
+        return strides[stream];
+    }
+
+    static size_t vertexBytes()
+    {
+        size_t bytes = 0;
+        for (int s = 0; s < streamCount; ++s)
+            bytes += stride(s);
+        return bytes;
+    }
+
+    // both parts of a range, or neither
+    bool place(Range &range)
+    {
+        range.firstVertex = vertices.allocate(range.vertexCount);
+        range.indexOffset = indices.allocate(range.indexBytes, 4);
+        if (range.firstVertex != RangeAllocator::NONE && range.indexOffset != RangeAllocator::NONE)
+            return true;
+        if (range.firstVertex != RangeAllocator::NONE)
+            vertices.release(range.firstVertex, range.vertexCount);
+        if (range.indexOffset != RangeAllocator::NONE)
+            indices.release(range.indexOffset, range.indexBytes);
+        return false;
+    }
+
+    void create(size_t vertexCapacity, size_t indexCapacity)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(streamCount, VBOs);
+        glGenBuffers(1, &EBO);
+        allocateBuffers(VBOs, EBO, vertexCapacity, indexCapacity);
+        attach();
+        vertices.reset(vertexCapacity);
+        indices.reset(indexCapacity);
+    }
+
+    void allocateBuffers(const GLuint *vbos, GLuint ebo, size_t vertexCapacity, size_t indexCapacity)
+    {
+        for (int s = 0; s < streamCount; ++s)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, vbos[s]);
+            glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * stride(s), NULL, GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // points the VAO at the current buffers
+    void attach()
+    {
+        bindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        GLuint location = 0;
+        int stream = 0;
+        int expand[] = { 0, (attachStream<Streams>(stream++, location), 0)... };
+        (void)expand;
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    template <typename Layout> void attachStream(int stream, GLuint &location)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, VBOs[stream]);
+        Layout::setup(location);
+        location += Layout::count;
+    }
+
+    // new buffers of the given capacities with the live ranges copied to their fronts in offset order
+    bool rebuild(size_t vertexCapacity, size_t indexCapacity)
+    {
+        GLuint vbos[sizeof...(Streams)], ebo;
+        glGenBuffers(streamCount, vbos);
+        glGenBuffers(1, &ebo);
+        allocateBuffers(vbos, ebo, vertexCapacity, indexCapacity);
+        if (glGetError() == GL_OUT_OF_MEMORY)
+        {
+            glDeleteBuffers(streamCount, vbos);
+            glDeleteBuffers(1, &ebo);
+            return false;
+        }
+
+        std::vector<Handle> order;
+        for (size_t h = 0; h < ranges.size(); ++h)
+            if (ranges[h].live)
+                order.push_back((Handle)h);
+        std::sort(order.begin(), order.end(), [this](Handle a, Handle b) { return ranges[a].firstVertex < ranges[b].firstVertex; });
+        size_t vertexEnd = 0;
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            Range &range = ranges[order[i]];
+            for (int s = 0; s < streamCount; ++s)
+                copy(VBOs[s], vbos[s], range.firstVertex * stride(s), vertexEnd * stride(s), range.vertexCount * stride(s));
+            range.firstVertex = vertexEnd;
+            vertexEnd += range.vertexCount;
+        }
+        std::sort(order.begin(), order.end(), [this](Handle a, Handle b) { return ranges[a].indexOffset < ranges[b].indexOffset; });
+        size_t indexEnd = 0;
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            Range &range = ranges[order[i]];
+            copy(EBO, ebo, range.indexOffset, indexEnd, range.indexBytes);
+            range.indexOffset = indexEnd;
+            indexEnd = (indexEnd + range.indexBytes + 3) / 4 * 4;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(streamCount, VBOs);
+        glDeleteBuffers(1, &EBO);
+        std::copy(vbos, vbos + streamCount, VBOs);
+        EBO = ebo;
+        attach();
+        vertices.reset(vertexCapacity, vertexEnd);
+        // range by range, so the alignment padding between them stays free and out of used()
+        indices.reset(indexCapacity);
+        for (size_t i = 0; i < order.size(); ++i)
+            indices.allocate(ranges[order[i]].indexBytes, 4);
+        return true;
+    }
+
+    void copy(GLuint from, GLuint to, size_t fromOffset, size_t toOffset, size_t size)
+    {
+        if (size == 0)
+            return;
+        glBindBuffer(GL_COPY_READ_BUFFER, from);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, to);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, fromOffset, toOffset, size);
+        movedBytes += size;
+    }
+
+    void *map(GLuint buffer, size_t offset, size_t size)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void *data = size ? glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT) : NULL;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return data;
+    }
+
+    bool unmap(GLuint buffer)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        bool intact = glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return intact;
+    }
+
+    GeometryHeap(const GeometryHeap &);
+    GeometryHeap &operator=(const GeometryHeap &);
+};
+#endif
@@ -0,0 +1,342 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <helpers/log.h>
+#include <helpers/shader.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// must match cull_comp.glsl and hiz_comp.glsl
+const int CULL_GROUP_SIZE = 64;
+const int HIZ_GROUP_SIZE = 8;
+const int CULL_PYRAMID_UNIT = 9;    // after DRAW_DATA_UNIT, clear of the passes' textures
+const int CULL_READBACK_FRAMES = 4; // frames a count can take to come back before its slot is reused
+
+// what the draws of a DrawBatch (see helpers/draw_batch.h) are culled against
+struct CullView
+{
+    glm::mat4 viewProjection;
+    glm::vec3 eye;
+    bool occlusion; // against the depth pyramid too, which must be of this view's camera
+    bool cones;     // draws with a normal cone (meshlets, see helpers/meshlet.h) facing away from eye are dropped
+};
+
+// instances tested and drawn, over the frames whose counts came back since the last report
+struct GpuCullingStats
+{
+    long long frames, instancesIn, instancesOut;
+    bool occlusion; // whether the pyramid was there to test against
+};
+
+
+// Culls the draws of a DrawBatch on the GPU, between uploading their commands and drawing them: a compute
+// pass tests each draw's bounding sphere against the view's frustum and, optionally, against a
+// hierarchical-Z pyramid of the last frame's depth, and appends the survivors to their group's range of a
+// new command buffer; in views that ask for it, draws whose normal cone faces away from the eye go too.
+// The range's tail stays zeroed, so glMultiDrawElementsIndirect still draws the group's
+// full count and the culled commands cost nothing; without ARB_indirect_parameters that is as compact as
+// the draw call gets. Nothing is read back to decide anything: the counts of instances in and out are
+// copied to a ring of buffers and read a few frames later, once a fence says they are there.
+// The pyramid is built by updatePyramid() from the default framebuffer's depth after the frame's camera
+// passes, max-reducing 2x2 (3x3 at odd edges) per level so that a texel is never nearer than what it covers.
+// Occlusion against it is a frame late: whatever comes out from behind an occluder shows up one frame
+// after. A sphere crossing the near plane, or with no radius, is never culled.
+// Needs GL 4.3 (compute shaders, storage buffers); see supported().
+// Must be used on the thread that owns the GL context.
+class GpuCulling
+{
+public:
+    // cull: cull_comp.glsl, reduce: hiz_comp.glsl
+    GpuCulling(Shader &cull, Shader &reduce)
+        : cullShader(cull), reduceShader(reduce), boundsBuffer(0), conesBuffer(0), groupsBuffer(0), outputBuffer(0), countsBuffer(0),
+          totalBuffer(0), readbackBuffer(0), depthFBO(0), depthTexture(0), pyramid(0), depthWidth(0), depthHeight(0),
+          levels(0), pyramidValid(false), blitFailed(false), frameIn(0), slot(0)
+    {
+        memset(&counters, 0, sizeof(counters));
+        std::fill(fences, fences + CULL_READBACK_FRAMES, (GLsync)0);
+        std::fill(slotIn, slotIn + CULL_READBACK_FRAMES, 0);
+    }
+    ~GpuCulling()
+    {
+        for (int i = 0; i < CULL_READBACK_FRAMES; ++i)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        if (boundsBuffer)
+        {
+            GLuint buffers[] = { boundsBuffer, conesBuffer, groupsBuffer, outputBuffer, countsBuffer, totalBuffer, readbackBuffer };
+            glDeleteBuffers(7, buffers);
+        }
+        releasePyramid();
+    }
+
+    static bool supported()
+    {
+        return GLAD_GL_VERSION_4_3 != 0;
+    }
+
+    // whether cull() does anything yet; the programs compile in the background
+    bool ready()
+    {
+        return cullShader.ready();
+    }
+
+    // call once a frame, before its first cull(): collects the counts that came back and starts the frame's
+    void beginFrame()
+    {
+        if (!boundsBuffer)
+            create();
+        GLuint zero = 0;
+        if (frameIn > 0)
+        {
+            // the last frame's total goes to its slot, read once its fence is signaled
+            if (fences[slot])
+                collect(slot, true);
+            glBindBuffer(GL_COPY_READ_BUFFER, totalBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, slot * sizeof(GLuint), sizeof(GLuint));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            slotIn[slot] = frameIn;
+            slot = (slot + 1) % CULL_READBACK_FRAMES;
+        }
+        for (int i = 0; i < CULL_READBACK_FRAMES; ++i)
+            if (fences[i])
+                collect(i, false);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, totalBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(GLuint), &zero);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        frameIn = 0;
+    }
+
+    // commands: the draws' DrawElementsIndirectCommands; bounds: a sphere (center, radius) per draw; cones:
+    // a normal cone (axis, cutoff) per draw, a cutoff of 1 for none; groups: per draw, its group's first
+    // command and the group's index. Returns the buffer of culled commands, laid out as commands is
+    GLuint cull(const CullView &view, GLuint commands, const std::vector<glm::vec4> &bounds, const std::vector<glm::vec4> &cones,
+                const std::vector<GLuint> &groups, size_t groupCount)
+    {
+        GLuint drawCount = (GLuint)bounds.size();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(glm::vec4), bounds.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, conesBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, cones.size() * sizeof(glm::vec4), cones.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, groupsBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, groups.size() * sizeof(GLuint), groups.data(), GL_STREAM_DRAW);
+        // zeroed commands draw nothing, zeroed counts append from the start
+        GLuint zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, outputBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, drawCount * 5 * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countsBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(groupCount, 1) * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, commands);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, groupsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, outputBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, countsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, totalBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, conesBuffer);
+
+        GLint program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        cullShader.use();
+        glm::vec4 planes[6];
+        frustumPlanes(view.viewProjection, planes);
+        glUniform4fv(glGetUniformLocation(cullShader.ID, "planes"), 6, &planes[0][0]);
+        cullShader.setInt("drawCount", (int)drawCount);
+        cullShader.setBool("cones", view.cones);
+        cullShader.setVec3("eye", view.eye);
+        bool occlusion = view.occlusion && pyramidValid;
+        cullShader.setBool("occlusion", occlusion);
+        if (occlusion)
+        {
+            cullShader.setMat4("occluderViewProjection", pyramidViewProjection);
+            cullShader.setInt("pyramidLevels", levels);
+            cullShader.setInt("pyramid", CULL_PYRAMID_UNIT);
+            glActiveTexture(GL_TEXTURE0 + CULL_PYRAMID_UNIT);
+            glBindTexture(GL_TEXTURE_2D, pyramid);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        glDispatchCompute((drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+        glUseProgram(program);
+        frameIn += drawCount;
+        counters.occlusion = occlusion;
+        return outputBuffer;
+    }
+
+    // the pyramid for the next frame's occlusion tests, from the default framebuffer's depth of
+    // width x height pixels as viewProjection drew it
+    void updatePyramid(int width, int height, const glm::mat4 &viewProjection)
+    {
+        if (blitFailed || width < 2 || height < 2 || !reduceShader.ready())
+            return;
+        if (width != depthWidth || height != depthHeight)
+            createPyramid(width, height);
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        if (glGetError() != GL_NO_ERROR)
+        {
+            // the window's depth format differs from the copy's, which a blit can't convert
+            Log::error("GPU_CULLING::DEPTH_NOT_COPIED: occlusion culling is off");
+            blitFailed = true;
+            pyramidValid = false;
+            return;
+        }
+
+        GLint program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        reduceShader.use();
+        reduceShader.setInt("source", CULL_PYRAMID_UNIT);
+        glActiveTexture(GL_TEXTURE0 + CULL_PYRAMID_UNIT);
+        int sourceWidth = width, sourceHeight = height;
+        for (int level = 0; level < levels; ++level)
+        {
+            // level 0 reduces the depth copy, the others the level before them
+            glBindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : pyramid);
+            reduceShader.setInt("sourceLevel", level == 0 ? 0 : level - 1);
+            glUniform2i(glGetUniformLocation(reduceShader.ID, "sourceSize"), sourceWidth, sourceHeight);
+            glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            int targetWidth = std::max(sourceWidth / 2, 1), targetHeight = std::max(sourceHeight / 2, 1);
+            glDispatchCompute((targetWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (targetHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            sourceWidth = targetWidth;
+            sourceHeight = targetHeight;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glUseProgram(program);
+        pyramidViewProjection = viewProjection;
+        pyramidValid = true;
+    }
+
+    // the next updatePyramid() starts over; until then nothing is occlusion culled
+    void invalidatePyramid()
+    {
+        pyramidValid = false;
+    }
+
+    GpuCullingStats stats() const { return counters; }
+
+    void resetStats()
+    {
+        bool occlusion = counters.occlusion;
+        memset(&counters, 0, sizeof(counters));
+        counters.occlusion = occlusion;
+    }
+
+private:
+    Shader &cullShader, &reduceShader;
+    GLuint boundsBuffer, conesBuffer, groupsBuffer, outputBuffer, countsBuffer, totalBuffer, readbackBuffer;
+    GLuint depthFBO, depthTexture, pyramid;
+    int depthWidth, depthHeight, levels;
+    glm::mat4 pyramidViewProjection;
+    bool pyramidValid, blitFailed;
+    long long frameIn; // draws culled this frame
+    GLsync fences[CULL_READBACK_FRAMES];
+    long long slotIn[CULL_READBACK_FRAMES];
+    int slot;
+    GpuCullingStats counters;
+
+    void create()
+    {
+        GLuint *buffers[] = { &boundsBuffer, &conesBuffer, &groupsBuffer, &outputBuffer, &countsBuffer, &totalBuffer, &readbackBuffer };
+        for (int i = 0; i < 7; ++i)
+            glGenBuffers(1, buffers[i]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, totalBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, CULL_READBACK_FRAMES * sizeof(GLuint), NULL, GL_STREAM_READ);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // reads a slot's count once it's there, or now when wait says so
+    void collect(int i, bool wait)
+    {
+        GLenum status = glClientWaitSync(fences[i], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return;
+        GLuint out = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, i * sizeof(GLuint), sizeof(GLuint), &out);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteSync(fences[i]);
+        fences[i] = 0;
+        ++counters.frames;
+        counters.instancesIn += slotIn[i];
+        counters.instancesOut += out;
+    }
+
+    // inward facing, normalized, from the rows of viewProjection (Gribb and Hartmann)
+    static void frustumPlanes(const glm::mat4 &m, glm::vec4 *planes)
+    {
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; ++r)
+            rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+        for (int i = 0; i < 3; ++i)
+        {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (int i = 0; i < 6; ++i)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    void createPyramid(int width, int height)
+    {
+        releasePyramid();
+        depthWidth = width;
+        depthHeight = height;
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenFramebuffers(1, &depthFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+        // level 0 is half the screen, down to 1x1
+        levels = 0;
+        for (int size = std::max(width / 2, height / 2); size >= 1; size /= 2)
+            ++levels;
+        glGenTextures(1, &pyramid);
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, std::max(width / 2, 1), std::max(height / 2, 1));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        pyramidValid = false;
+    }
+
+    void releasePyramid()
+    {
+        if (depthFBO)
+        {
+            glDeleteFramebuffers(1, &depthFBO);
+            glDeleteTextures(1, &depthTexture);
+            glDeleteTextures(1, &pyramid);
+        }
+        depthFBO = depthTexture = pyramid = 0;
+        depthWidth = depthHeight = levels = 0;
+        pyramidValid = false;
+    }
+
+    GpuCulling(const GpuCulling &);
+    GpuCulling &operator=(const GpuCulling &);
+};
+#endif
@@ -0,0 +1,485 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+enum LogLevel
+{
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARNING,
+    LOG_ERROR
+};
+
+const unsigned int LOG_CAPACITY = 4096;      // records in the ring, a power of two
+const int LOG_MAX_ARGUMENTS = 16;
+const unsigned int LOG_TEXT_BYTES = 192;     // string arguments are copied into the record, longer ones to the heap
+const unsigned int LOG_MAX_NAMED_THREADS = 64;
+
+
+// messages since the start
+struct LogStats
+{
+    unsigned long long written, dropped;
+};
+
+
+// Diagnostics that cost the thread writing them a few tens of nanoseconds: write() stamps the time and the
+// thread, copies the arguments as they are into a slot of a fixed ring shared by every thread (claimed with
+// one compare-and-swap, no lock), and a background thread formats and prints them. The format is printf's,
+// with the conversion taken from the argument's type where they disagree ("%d" of a float prints it as an
+// integer, not garbage); it must outlive the program, a string literal, as only the pointer is kept.
+//   Log::error("SHADER::COMPILATION_ERROR of type: %s\n%s", type, infoLog);
+// prints "[    0.431022] main ERROR::SHADER::COMPILATION_ERROR of type: ...". When the ring is three
+// quarters full debug and info messages are dropped, keeping the rest for warnings and errors, and when it
+// is full everything is; the printing thread says how many went missing.
+class Log
+{
+public:
+    static Log &shared()
+    {
+        static Log log;
+        return log;
+    }
+
+    template <typename... Arguments> static void debug(const char *format, const Arguments &... arguments)
+    {
+        shared().write(LOG_DEBUG, format, arguments...);
+    }
+    template <typename... Arguments> static void info(const char *format, const Arguments &... arguments)
+    {
+        shared().write(LOG_INFO, format, arguments...);
+    }
+    template <typename... Arguments> static void warning(const char *format, const Arguments &... arguments)
+    {
+        shared().write(LOG_WARNING, format, arguments...);
+    }
+    template <typename... Arguments> static void error(const char *format, const Arguments &... arguments)
+    {
+        shared().write(LOG_ERROR, format, arguments...);
+    }
+
+    // shown instead of the thread's number; name must outlive the program
+    static void nameThread(const char *name)
+    {
+        unsigned int thread = threadIndex();
+        if (thread < LOG_MAX_NAMED_THREADS)
+            threadNames()[thread].store(name, std::memory_order_release);
+    }
+
+    // messages below level are ignored
+    void setLevel(LogLevel level)
+    {
+        minimumLevel.store(level, std::memory_order_relaxed);
+    }
+
+    template <typename... Arguments> void write(LogLevel level, const char *format, const Arguments &... arguments)
+    {
+        static_assert(sizeof...(Arguments) <= LOG_MAX_ARGUMENTS, "too many arguments to log");
+        if (level < minimumLevel.load(std::memory_order_relaxed))
+            return;
+        unsigned long long position;
+        Slot *slot = claim(level, position);
+        if (!slot)
+            return;
+        Record &record = slot->record;
+        record.format = format;
+        record.time = (unsigned long long)std::chrono::steady_clock::now().time_since_epoch().count();
+        record.thread = threadIndex();
+        record.level = (unsigned char)level;
+        record.count = 0;
+        record.textUsed = 0;
+        capture(record, arguments...);
+        slot->sequence.store(position + 1, std::memory_order_release);
+    }
+
+    // waits until everything written so far is printed, before exiting on an error for one
+    static void flush()
+    {
+        shared().drain();
+    }
+
+    LogStats stats() const
+    {
+        LogStats stats = { written.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed) };
+        return stats;
+    }
+
+    ~Log()
+    {
+        stop.store(true, std::memory_order_release);
+        printer.join();
+    }
+
+private:
+    void drain()
+    {
+        unsigned long long target = tail.load(std::memory_order_acquire);
+        while (printed.load(std::memory_order_acquire) < target)
+        {
+            // a claimed slot that's still being filled, or one the printer hasn't got to
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    enum ArgumentType { SIGNED, UNSIGNED, FLOATING, TEXT, HEAP_TEXT, POINTER };
+
+    struct Argument
+    {
+        unsigned char type;
+        union
+        {
+            long long i;
+            unsigned long long u;
+            double d;
+            const void *p;
+            char *heap;
+            struct
+            {
+                unsigned int offset, length;
+            } text;
+        };
+    };
+
+    struct Record
+    {
+        const char *format;
+        unsigned long long time;
+        unsigned int thread;
+        unsigned char level, count;
+        unsigned int textUsed;
+        Argument arguments[LOG_MAX_ARGUMENTS];
+        char text[LOG_TEXT_BYTES];
+    };
+
+    // free for position p when sequence == p, holding the record of p when sequence == p + 1
+    struct Slot
+    {
+        std::atomic<unsigned long long> sequence;
+        Record record;
+    };
+
+    Slot *slots;
+    // producers only ever touch tail, the printer head; apart so they don't share a cache line
+    alignas(64) std::atomic<unsigned long long> tail;
+    alignas(64) std::atomic<unsigned long long> head;
+    std::atomic<unsigned long long> printed, written, dropped;
+    std::atomic<int> minimumLevel;
+    std::atomic<bool> stop;
+    std::chrono::steady_clock::time_point start;
+    std::thread printer;
+
+    Log() : tail(0), head(0), printed(0), written(0), dropped(0), minimumLevel(LOG_DEBUG), stop(false),
+            start(std::chrono::steady_clock::now())
+    {
+        slots = new Slot[LOG_CAPACITY];
+        for (unsigned int i = 0; i < LOG_CAPACITY; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        printer = std::thread(&Log::run, this);
+    }
+
+    Log(const Log &);
+    Log &operator=(const Log &);
+
+    static unsigned int threadIndex()
+    {
+        static std::atomic<unsigned int> threads(0);
+        static thread_local unsigned int index = threads.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    static std::atomic<const char *> *threadNames()
+    {
+        static std::atomic<const char *> names[LOG_MAX_NAMED_THREADS];
+        return names;
+    }
+
+    // a free slot, or NULL when the message is dropped
+    Slot *claim(LogLevel level, unsigned long long &position)
+    {
+        position = tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            // position may be older than head by now: a negative backlog is an empty ring
+            long long backlog = (long long)(position - head.load(std::memory_order_relaxed));
+            if (level < LOG_WARNING && backlog >= (long long)(LOG_CAPACITY / 4 * 3))
+                break;
+            Slot *slot = &slots[position & (LOG_CAPACITY - 1)];
+            long long lag = (long long)(slot->sequence.load(std::memory_order_acquire) - position);
+            if (lag == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    return slot;
+            }
+            else if (lag < 0)
+                break; // full: the printer hasn't freed this slot since the last lap
+            else
+                position = tail.load(std::memory_order_relaxed);
+        }
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    static void capture(Record &)
+    {
+    }
+
+    template <typename First, typename... Rest> static void capture(Record &record, const First &first, const Rest &... rest)
+    {
+        put(record, first);
+        capture(record, rest...);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type put(Record &record, T value)
+    {
+        Argument &argument = record.arguments[record.count++];
+        argument.type = SIGNED;
+        argument.i = value;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type put(Record &record, T value)
+    {
+        Argument &argument = record.arguments[record.count++];
+        argument.type = UNSIGNED;
+        argument.u = value;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type put(Record &record, T value)
+    {
+        Argument &argument = record.arguments[record.count++];
+        argument.type = FLOATING;
+        argument.d = value;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_enum<T>::value>::type put(Record &record, T value)
+    {
+        put(record, (long long)value);
+    }
+
+    template <typename T> static void put(Record &record, T *value)
+    {
+        Argument &argument = record.arguments[record.count++];
+        argument.type = POINTER;
+        argument.p = (const void *)value;
+    }
+
+    static void put(Record &record, const char *value)
+    {
+        putText(record, value ? value : "(null)", value ? strlen(value) : 6);
+    }
+
+    static void put(Record &record, char *value)
+    {
+        put(record, (const char *)value);
+    }
+
+    // string literals and char buffers, up to their terminator
+    template <size_t N> static void put(Record &record, const char (&value)[N])
+    {
+        putText(record, value, strnlen(value, N));
+    }
+
+    template <size_t N> static void put(Record &record, char (&value)[N])
+    {
+        putText(record, value, strnlen(value, N));
+    }
+
+    static void put(Record &record, const std::string &value)
+    {
+        putText(record, value.data(), value.size());
+    }
+
+    static void putText(Record &record, const char *text, size_t length)
+    {
+        Argument &argument = record.arguments[record.count++];
+        if (record.textUsed + length <= LOG_TEXT_BYTES)
+        {
+            argument.type = TEXT;
+            argument.text.offset = record.textUsed;
+            argument.text.length = (unsigned int)length;
+            memcpy(record.text + record.textUsed, text, length);
+            record.textUsed += (unsigned int)length;
+        }
+        else
+        {
+            // rare and long, a shader's info log: allocating beats truncating it
+            argument.type = HEAP_TEXT;
+            argument.heap = new char[length + 1];
+            memcpy(argument.heap, text, length);
+            argument.heap[length] = 0;
+        }
+    }
+
+    // printer
+    void run()
+    {
+        std::string lines;
+        unsigned long long reportedDrops = 0;
+        for (;;)
+        {
+            bool stopping = stop.load(std::memory_order_acquire);
+            unsigned long long position = head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Slot &slot = slots[position & (LOG_CAPACITY - 1)];
+                if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+                    break;
+                format(slot.record, lines);
+                slot.sequence.store(position + LOG_CAPACITY, std::memory_order_release);
+                head.store(++position, std::memory_order_relaxed);
+                written.fetch_add(1, std::memory_order_relaxed);
+                if (lines.size() > 1 << 16)
+                    print(lines, position);
+            }
+            unsigned long long drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops)
+            {
+                char line[128];
+                snprintf(line, sizeof(line), "WARNING::LOG::DROPPED: %llu messages, the ring was full\n", drops - reportedDrops);
+                lines += line;
+                reportedDrops = drops;
+            }
+            print(lines, position);
+            if (stopping)
+                return; // everything written before stop was set is out
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void print(std::string &lines, unsigned long long position)
+    {
+        if (!lines.empty())
+        {
+            fwrite(lines.data(), 1, lines.size(), stdout);
+            fflush(stdout);
+            lines.clear();
+        }
+        printed.store(position, std::memory_order_release);
+    }
+
+    void format(Record &record, std::string &out) const
+    {
+        static const char *levels[] = { "DEBUG::", "", "WARNING::", "ERROR::" };
+        char buffer[256];
+        double seconds = (double)(record.time - (unsigned long long)start.time_since_epoch().count()) *
+                         std::chrono::steady_clock::period::num / std::chrono::steady_clock::period::den;
+        const char *name = record.thread < LOG_MAX_NAMED_THREADS ? threadNames()[record.thread].load(std::memory_order_acquire) : NULL;
+        if (name)
+            snprintf(buffer, sizeof(buffer), "[%12.6f] %s %s", seconds, name, levels[record.level]);
+        else
+            snprintf(buffer, sizeof(buffer), "[%12.6f] #%u %s", seconds, record.thread, levels[record.level]);
+        out += buffer;
+
+        int next = 0;
+        for (const char *p = record.format; *p; ++p)
+        {
+            if (*p != '%')
+            {
+                out += *p;
+                continue;
+            }
+            if (p[1] == '%')
+            {
+                out += '%';
+                ++p;
+                continue;
+            }
+            // %[flags][width][.precision][length]conversion, the length replaced to fit the argument and a * width
+            // or precision replaced by the argument it takes
+            std::string spec = "%";
+            const char *q = p + 1;
+            bool missing = false;
+            while (*q && strchr("-+ #0", *q))
+                spec += *q++;
+            while (*q && ((*q >= '0' && *q <= '9') || *q == '.' || *q == '*'))
+            {
+                if (*q++ != '*')
+                {
+                    spec += q[-1];
+                    continue;
+                }
+                if (next >= record.count)
+                {
+                    missing = true;
+                    continue;
+                }
+                const Argument &star = record.arguments[next++];
+                long long value = star.type == SIGNED ? star.i : star.type == FLOATING ? (long long)star.d : (long long)star.u;
+                if (value >= 0 || spec[spec.size() - 1] != '.')
+                    spec += std::to_string(value); // a negative width is the - flag
+                else
+                    spec.erase(spec.size() - 1); // a negative precision is none
+            }
+            while (*q && strchr("hlLqjzt", *q))
+                ++q;
+            char conversion = *q;
+            p = *q ? q : q - 1;
+            if (missing || next >= record.count)
+            {
+                out += "<missing>";
+                continue;
+            }
+            append(out, spec, conversion, record, record.arguments[next++]);
+        }
+        out += '\n';
+        for (int i = 0; i < record.count; ++i)
+            if (record.arguments[i].type == HEAP_TEXT)
+                delete[] record.arguments[i].heap;
+    }
+
+    static void append(std::string &out, std::string spec, char conversion, const Record &record, const Argument &argument)
+    {
+        char buffer[512];
+        bool integer = conversion && strchr("diouxXc", conversion), floating = conversion && strchr("fFeEgGaA", conversion);
+        if (argument.type == TEXT || argument.type == HEAP_TEXT)
+        {
+            const char *text = argument.type == TEXT ? record.text + argument.text.offset : argument.heap;
+            int length = argument.type == TEXT ? (int)argument.text.length : (int)strlen(text);
+            // the text isn't terminated: a precision only shortens it
+            std::string::size_type dot = spec.find('.');
+            if (dot != std::string::npos)
+            {
+                length = std::min(length, atoi(spec.c_str() + dot + 1));
+                spec.erase(dot);
+            }
+            if (spec == "%")
+                out.append(text, length);
+            else
+            {
+                snprintf(buffer, sizeof(buffer), (spec + ".*s").c_str(), length, text);
+                out += buffer;
+            }
+            return;
+        }
+        if (argument.type == POINTER && !integer && !floating)
+            snprintf(buffer, sizeof(buffer), (spec + "p").c_str(), argument.p);
+        else if (floating || (!integer && argument.type == FLOATING))
+        {
+            double value = argument.type == FLOATING ? argument.d : argument.type == SIGNED ? (double)argument.i : (double)argument.u;
+            snprintf(buffer, sizeof(buffer), (spec + (floating ? conversion : 'g')).c_str(), value);
+        }
+        else
+        {
+            long long value = argument.type == FLOATING ? (long long)argument.d : argument.type == POINTER ? (long long)(size_t)argument.p : argument.i;
+            char type = integer ? conversion : argument.type == SIGNED ? 'd' : 'u';
+            if (type == 'c')
+                snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), (int)value);
+            else
+                snprintf(buffer, sizeof(buffer), (spec + "ll" + type).c_str(), value);
+        }
+        out += buffer;
+    }
+};
+#endif
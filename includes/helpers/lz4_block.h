@@ -0,0 +1,152 @@
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <cstring>
+#include <vector>
+
+// LZ4 block format (no frame): sequences of a token (literal length << 4 | match length - 4), extra length
+// bytes for either nibble of 15, the literals and a 2-byte little-endian match offset. Compression is the
+// greedy single-probe hash search of the reference fast mode; decompression checks every bound so a
+// corrupt block fails instead of overrunning.
+class Lz4Block
+{
+public:
+    // appends the compressed block to out
+    static void compress(const unsigned char *src, size_t size, std::vector<unsigned char> &out)
+    {
+        const size_t MIN_MATCH = 4, LAST_LITERALS = 5, MF_LIMIT = 12;
+        std::vector<unsigned int> table(1 << HASH_BITS, 0);
+        size_t anchor = 0, pos = 0;
+        if (size >= MF_LIMIT + 1)
+        {
+            size_t limit = size - MF_LIMIT;
+            ++pos; // a match at 0 would have offset 0
+            while (pos < limit)
+            {
+                unsigned int sequence = read32(src + pos);
+                unsigned int &slot = table[hash(sequence)];
+                size_t candidate = slot;
+                slot = (unsigned int)pos;
+                if (candidate == 0 || pos - candidate > 65535 || read32(src + candidate) != sequence)
+                {
+                    ++pos;
+                    continue;
+                }
+                // extend backwards over pending literals, then forwards
+                while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1])
+                {
+                    --pos;
+                    --candidate;
+                }
+                size_t length = MIN_MATCH;
+                while (pos + length < size - LAST_LITERALS && src[pos + length] == src[candidate + length])
+                    ++length;
+                writeSequence(src + anchor, pos - anchor, pos - candidate, length, out);
+                pos += length;
+                anchor = pos;
+                if (pos >= 2 && pos - 2 < limit)
+                    table[hash(read32(src + pos - 2))] = (unsigned int)(pos - 2);
+            }
+        }
+        writeSequence(src + anchor, size - anchor, 0, 0, out);
+    }
+
+    // decompresses exactly size bytes into dst, false on a corrupt block
+    static bool decompress(const unsigned char *src, size_t srcSize, unsigned char *dst, size_t size)
+    {
+        const unsigned char *in = src, *inEnd = src + srcSize;
+        unsigned char *out = dst, *outEnd = dst + size;
+        while (in < inEnd)
+        {
+            unsigned int token = *in++;
+            size_t literals = token >> 4;
+            if (literals == 15 && !readLength(in, inEnd, literals))
+                return false;
+            if (literals > (size_t)(inEnd - in) || literals > (size_t)(outEnd - out))
+                return false;
+            memcpy(out, in, literals);
+            in += literals;
+            out += literals;
+            if (in == inEnd)
+                break; // the last sequence has no match
+            if (inEnd - in < 2)
+                return false;
+            size_t offset = in[0] | (in[1] << 8);
+            in += 2;
+            size_t length = (token & 15);
+            if (length == 15 && !readLength(in, inEnd, length))
+                return false;
+            length += 4;
+            if (offset == 0 || offset > (size_t)(out - dst) || length > (size_t)(outEnd - out))
+                return false;
+            const unsigned char *match = out - offset;
+            if (offset >= 8)
+            {
+                // whole 8-byte copies where the ranges can't overlap within one step
+                while (length >= 8)
+                {
+                    memcpy(out, match, 8);
+                    out += 8;
+                    match += 8;
+                    length -= 8;
+                }
+            }
+            while (length--)
+                *out++ = *match++;
+        }
+        return out == outEnd;
+    }
+
+private:
+    static const int HASH_BITS = 16;
+
+    static unsigned int read32(const unsigned char *p)
+    {
+        unsigned int v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static unsigned int hash(unsigned int sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static bool readLength(const unsigned char *&in, const unsigned char *end, size_t &length)
+    {
+        unsigned int byte;
+        do
+        {
+            if (in == end)
+                return false;
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    static void writeLength(size_t length, std::vector<unsigned char> &out)
+    {
+        for (; length >= 255; length -= 255)
+            out.push_back(255);
+        out.push_back((unsigned char)length);
+    }
+
+    // literals followed by a match, or the final literals when length is 0
+    static void writeSequence(const unsigned char *literals, size_t count, size_t offset, size_t length,
+                              std::vector<unsigned char> &out)
+    {
+        size_t matchCode = length ? length - 4 : 0;
+        out.push_back((unsigned char)(((count < 15 ? count : 15) << 4) | (matchCode < 15 ? matchCode : 15)));
+        if (count >= 15)
+            writeLength(count - 15, out);
+        out.insert(out.end(), literals, literals + count);
+        if (!length)
+            return;
+        out.push_back((unsigned char)(offset & 255));
+        out.push_back((unsigned char)(offset >> 8));
+        if (matchCode >= 15)
+            writeLength(matchCode - 15, out);
+    }
+};
+#endif
@@ -0,0 +1,195 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <helpers/geometry_heap.h>
+#include <helpers/log.h>
+#include <helpers/mesh_file.h>
+#include <helpers/meshlet_culling.h>
+#include <helpers/vertex_layout.h>
+
+#include <string>
+
+// A cooked .gmesh (see helpers/mesh_file.h) on the GPU. The file is mapped and its vertex streams and
+// indices go to a range of a MeshHeap as they are: no parsing, no conversion, no copy in between. All the
+// meshes of a heap draw from its one VAO. A streamer that has read the file already can upload it piece
+// by piece instead, begin() and then upload() every frame until ready().
+// Attributes keep the usual locations (0 position, 1 normal, 2 texcoords), decoded by the vertex fetch;
+// positions come out in 0..1 though, so draw with model * decodeMatrix().
+// The meshlets (helpers/meshlet.h) stay on the CPU, in object space, to cull and to draw ranges of.
+// Must be created on the thread that owns the GL context.
+
+// the .gmesh streams: positions at location 0, then normals and texcoords
+typedef VertexLayout<VertexUnorm16x3> MeshPositionLayout;
+typedef VertexLayout<VertexSnorm1010102, VertexHalf2> MeshAttributeLayout;
+typedef GeometryHeap<MeshPositionLayout, MeshAttributeLayout> MeshHeap;
+
+class Mesh
+{
+public:
+    Mesh(MeshHeap &heap) : heap(heap), range(-1), indexType(GL_UNSIGNED_SHORT), indexSize(2), positionBytes(0), vertexBytes(0), uploaded(0)
+    {
+        memset(&header, 0, sizeof(header));
+    }
+    ~Mesh()
+    {
+        release();
+    }
+
+    bool load(const std::string &path)
+    {
+        if (!begin(FileSystem::map(path), path))
+            return false;
+        upload(~(size_t)0);
+        return true;
+    }
+
+    // allocates the heap range for a .gmesh in memory, which has to stay valid until ready()
+    bool begin(const AssetSpan &span, const std::string &name)
+    {
+        release();
+        std::string error;
+        if (!file.open(span, name, error))
+        {
+            Log::error("MESH::FILE_NOT_SUCCESFULLY_READ: %s", error);
+            return false;
+        }
+        header = *file.header;
+        lods.assign(file.lods, file.lods + header.lodCount);
+        meshlets.assign(file.meshlets, header.meshletCount);
+        lodMeshlets.assign(1, 0);
+        for (size_t i = 0; i < lods.size(); ++i)
+            lodMeshlets.push_back(lodMeshlets.back() + lods[i].meshletCount);
+        indexSize = header.indexSize;
+        indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        // each stream goes to its own buffer of the heap
+        positionBytes = file.positionBytes();
+        vertexBytes = positionBytes + file.attributeBytes();
+        uploaded = 0;
+        range = heap.allocate(header.vertexCount, indexBytes());
+        if (range < 0)
+        {
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    // copies up to maxBytes more of the file to the buffers, returns how many it did
+    size_t upload(size_t maxBytes)
+    {
+        size_t done = 0;
+        while (range >= 0 && uploaded < bytes() && done < maxBytes)
+        {
+            // positions, then attributes, then indices
+            int part = uploaded < positionBytes ? 0 : uploaded < vertexBytes ? 1 : 2;
+            size_t begin = part == 0 ? 0 : part == 1 ? positionBytes : vertexBytes;
+            size_t end = part == 0 ? positionBytes : part == 1 ? vertexBytes : bytes();
+            size_t offset = uploaded - begin;
+            size_t size = std::min(end - uploaded, maxBytes - done);
+            if (part == 2)
+                heap.writeIndices(range, offset, file.indices + offset, size);
+            else
+                heap.writeVertices(range, part, offset, (part == 0 ? file.positions : file.attributes) + offset, size);
+            uploaded += size;
+            done += size;
+        }
+        if (ready() && file.header)
+            file = MeshFile(); // the data isn't needed anymore
+        return done;
+    }
+
+    bool ready() const { return range >= 0 && uploaded == bytes(); }
+
+    // GPU memory of the range
+    size_t bytes() const { return range >= 0 ? vertexBytes + indexBytes() : 0; }
+
+    bool loaded() const { return range >= 0; }
+
+    // from the 0..1 the positions are stored in to object space
+    glm::mat4 decodeMatrix() const
+    {
+        glm::mat4 decode = glm::translate(glm::mat4(1.0f), glm::vec3(header.positionOffset[0], header.positionOffset[1], header.positionOffset[2]));
+        return glm::scale(decode, glm::vec3(header.positionScale));
+    }
+
+    glm::vec3 boundsMin() const { return glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]); }
+    glm::vec3 boundsMax() const { return glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]); }
+    glm::vec3 center() const { return glm::vec3(header.center[0], header.center[1], header.center[2]); }
+    float radius() const { return header.radius; }
+    unsigned int vertexCount() const { return header.vertexCount; }
+    unsigned int triangleCount(int lod = 0) const { return lods.empty() ? 0 : lods[clampLod(lod)].indexCount / 3; }
+    int lodCount() const { return (int)lods.size(); }
+    // object space, 0 for the original
+    float lodError(int lod) const { return lods.empty() ? 0.0f : lods[clampLod(lod)].error; }
+
+    void draw(int lod = 0) const
+    {
+        if (!ready())
+            return;
+        const MeshLod &level = lods[clampLod(lod)];
+        heap.draw(range, GL_TRIANGLES, level.indexCount, indexType, (size_t)level.firstIndex * indexSize);
+    }
+
+    // draw() for a DrawBatch, drawing nothing until ready()
+    GeometryDraw drawOf(int lod = 0) const
+    {
+        if (!ready())
+            return GeometryDraw();
+        const MeshLod &level = lods[clampLod(lod)];
+        return heap.drawOf(range, GL_TRIANGLES, level.indexCount, indexType, (size_t)level.firstIndex * indexSize);
+    }
+
+    // the LOD's meshlets are meshletSet()'s [firstMeshlet(lod), firstMeshlet(lod) + meshletCount(lod))
+    const MeshletSet &meshletSet() const { return meshlets; }
+    size_t firstMeshlet(int lod) const { return lods.empty() ? 0 : lodMeshlets[clampLod(lod)]; }
+    size_t meshletCount(int lod) const { return lods.empty() ? 0 : lods[clampLod(lod)].meshletCount; }
+
+    // meshlets [first, first + count) for a DrawBatch, one range of indices as meshlets next to each other are
+    GeometryDraw meshletDraw(size_t first, size_t count) const
+    {
+        if (!ready() || count == 0)
+            return GeometryDraw();
+        size_t last = first + count - 1;
+        unsigned int indices = meshlets.firstIndex[last] + meshlets.indexCount[last] - meshlets.firstIndex[first];
+        return heap.drawOf(range, GL_TRIANGLES, indices, indexType, (size_t)meshlets.firstIndex[first] * indexSize);
+    }
+
+private:
+    MeshHeap &heap;
+    MeshHeap::Handle range;
+    GLenum indexType;
+    size_t indexSize;
+    MeshHeader header;
+    std::vector<MeshLod> lods;
+    MeshletSet meshlets;
+    std::vector<size_t> lodMeshlets; // the first of each LOD
+    MeshFile file; // while uploading
+    size_t positionBytes, vertexBytes, uploaded;
+
+    Mesh(const Mesh &);
+    Mesh &operator=(const Mesh &);
+
+    size_t indexBytes() const { return (size_t)header.indexCount * indexSize; }
+
+    size_t clampLod(int lod) const
+    {
+        return (size_t)std::min(std::max(lod, 0), (int)lods.size() - 1);
+    }
+
+    void release()
+    {
+        heap.free(range);
+        range = -1;
+        lods.clear();
+        meshlets.clear();
+        lodMeshlets.clear();
+        file = MeshFile();
+        uploaded = vertexBytes = 0;
+    }
+};
+#endif
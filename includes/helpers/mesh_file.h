@@ -0,0 +1,315 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <helpers/filesystem.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// .gmesh: a cooked mesh (meshcook) laid out for the GPU, so loading is a map and two glBufferData calls.
+//   header (128 bytes) | LOD table | meshlets | positions | attributes | indices, each section 64-byte aligned
+// positions:  unorm16 x, y, z, pad per vertex (8 bytes), the mesh's bounding box scaled uniformly to 0..1;
+//             decode with positionOffset + q * positionScale (the same scale on every axis, so the model
+//             matrix times the decode matrix still transforms normals right)
+// attributes: a normal in GL_INT_2_10_10_10_REV (snorm) and texcoords as two halfs per vertex (8 bytes)
+// indices:    uint16 or uint32 (indexSize), triangles, ordered for the post-transform vertex cache
+// LODs:       index ranges into the one index buffer, finest first, with the object-space error of each
+// meshlets:   every LOD's range cut into consecutive runs of at most 64 vertices and 124 triangles, each with
+//             a bounding sphere and a normal cone in object space (see helpers/meshlet.h); a LOD's meshlets
+//             follow the levels' before it
+// Positions and attributes are separate streams back to back, so a depth-only pass fetches 8 bytes a vertex.
+const unsigned int MESH_MAGIC = 0x48534d47; // "GMSH"
+const unsigned int MESH_VERSION = 2;
+const unsigned int MESH_ALIGNMENT = 64;
+
+struct MeshHeader
+{
+    unsigned int magic, version;
+    unsigned int vertexCount, indexCount;
+    unsigned int indexSize, lodCount;
+    float positionOffset[3], positionScale;
+    float boundsMin[3], boundsMax[3];
+    float center[3], radius; // bounding sphere
+    unsigned long long lodOffset, positionsOffset, attributesOffset, indicesOffset;
+    unsigned long long meshletsOffset;
+    unsigned int meshletCount, padding;
+};
+
+struct MeshLod
+{
+    unsigned int firstIndex, indexCount;
+    float error; // object space, 0 for the original mesh
+    unsigned int meshletCount;
+};
+
+// a run of a LOD's triangles culled as one
+struct Meshlet
+{
+    unsigned int firstIndex, indexCount;
+    float center[3], radius; // bounding sphere, object space
+    float coneAxis[3];       // the triangles' average normal
+    float coneCutoff;        // sine of the widest angle from it to a triangle's normal, 1 for no cone
+};
+
+// a mesh before quantization, what the importers produce
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float texCoords[2];
+};
+
+// the GPU-ready contents of a .gmesh
+struct MeshData
+{
+    MeshHeader header;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned short> positions;  // 4 per vertex
+    std::vector<unsigned int> attributes;   // 2 per vertex: packed normal, two halfs
+    std::vector<unsigned char> indices;     // indexSize bytes each
+};
+
+
+// A .gmesh in memory: a view over the file, nothing is copied
+class MeshFile
+{
+public:
+    const MeshHeader *header;
+    const MeshLod *lods;
+    const Meshlet *meshlets;
+    const unsigned char *positions, *attributes, *indices;
+
+    MeshFile() : header(NULL), lods(NULL), meshlets(NULL), positions(NULL), attributes(NULL), indices(NULL) {}
+
+    size_t positionBytes() const { return (size_t)header->vertexCount * 8; }
+    size_t attributeBytes() const { return (size_t)header->vertexCount * 8; }
+    size_t indexBytes() const { return (size_t)header->indexCount * header->indexSize; }
+
+    // checks every section lies inside the file
+    bool open(const AssetSpan &span, const std::string &name, std::string &error)
+    {
+        file = span;
+        if (!file.valid() || file.size < sizeof(MeshHeader))
+        {
+            error = "can't read " + name;
+            return false;
+        }
+        header = (const MeshHeader *)file.data;
+        if (header->magic != MESH_MAGIC || header->version != MESH_VERSION)
+        {
+            error = name + " is not a version " + std::to_string(MESH_VERSION) + " .gmesh";
+            return false;
+        }
+        if ((header->indexSize != 2 && header->indexSize != 4) || !header->lodCount ||
+            !inside(header->lodOffset, (unsigned long long)header->lodCount * sizeof(MeshLod)) ||
+            !inside(header->meshletsOffset, (unsigned long long)header->meshletCount * sizeof(Meshlet)) ||
+            !inside(header->positionsOffset, positionBytes()) || !inside(header->attributesOffset, attributeBytes()) ||
+            !inside(header->indicesOffset, indexBytes()))
+        {
+            error = name + " is truncated";
+            return false;
+        }
+        lods = (const MeshLod *)(file.data + header->lodOffset);
+        meshlets = (const Meshlet *)(file.data + header->meshletsOffset);
+        unsigned long long meshletCount = 0;
+        for (unsigned int i = 0; i < header->lodCount; ++i)
+        {
+            if ((unsigned long long)lods[i].firstIndex + lods[i].indexCount > header->indexCount)
+            {
+                error = name + ": LOD " + std::to_string(i) + " is out of range";
+                return false;
+            }
+            // the level's meshlets lie inside it
+            for (unsigned int m = 0; m < lods[i].meshletCount && meshletCount + m < header->meshletCount; ++m)
+            {
+                const Meshlet &meshlet = meshlets[meshletCount + m];
+                if (meshlet.firstIndex < lods[i].firstIndex ||
+                    (unsigned long long)meshlet.firstIndex + meshlet.indexCount > (unsigned long long)lods[i].firstIndex + lods[i].indexCount)
+                {
+                    error = name + ": meshlet " + std::to_string(meshletCount + m) + " is out of range";
+                    return false;
+                }
+            }
+            meshletCount += lods[i].meshletCount;
+        }
+        if (meshletCount != header->meshletCount)
+        {
+            error = name + ": the LODs' meshlets don't add up";
+            return false;
+        }
+        positions = file.data + header->positionsOffset;
+        attributes = file.data + header->attributesOffset;
+        indices = file.data + header->indicesOffset;
+        return true;
+    }
+
+    // quantizes vertices (indices into them as triangles, LODs as ranges of those, meshlets as ranges of
+    // the LODs) into data
+    static void build(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices,
+                      const std::vector<MeshLod> &lods, const std::vector<Meshlet> &meshlets, MeshData &data)
+    {
+        MeshHeader &header = data.header;
+        memset(&header, 0, sizeof(header));
+        header.magic = MESH_MAGIC;
+        header.version = MESH_VERSION;
+        header.vertexCount = (unsigned int)vertices.size();
+        header.indexCount = (unsigned int)indices.size();
+        header.indexSize = vertices.size() <= 65536 ? 2 : 4;
+        header.lodCount = (unsigned int)lods.size();
+        header.meshletCount = (unsigned int)meshlets.size();
+
+        for (int c = 0; c < 3; ++c)
+        {
+            header.boundsMin[c] = vertices.empty() ? 0.0f : vertices[0].position[c];
+            header.boundsMax[c] = header.boundsMin[c];
+        }
+        for (size_t i = 0; i < vertices.size(); ++i)
+            for (int c = 0; c < 3; ++c)
+            {
+                header.boundsMin[c] = std::min(header.boundsMin[c], vertices[i].position[c]);
+                header.boundsMax[c] = std::max(header.boundsMax[c], vertices[i].position[c]);
+            }
+        float extent = 0.0f;
+        for (int c = 0; c < 3; ++c)
+        {
+            header.positionOffset[c] = header.boundsMin[c];
+            header.center[c] = (header.boundsMin[c] + header.boundsMax[c]) * 0.5f;
+            extent = std::max(extent, header.boundsMax[c] - header.boundsMin[c]);
+        }
+        header.positionScale = extent > 0.0f ? extent : 1.0f;
+
+        data.positions.resize(vertices.size() * 4);
+        data.attributes.resize(vertices.size() * 2);
+        float radius2 = 0.0f;
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            const MeshVertex &v = vertices[i];
+            float d2 = 0.0f;
+            for (int c = 0; c < 3; ++c)
+            {
+                float q = (v.position[c] - header.positionOffset[c]) / header.positionScale;
+                data.positions[i * 4 + c] = (unsigned short)std::min(std::max(q * 65535.0f + 0.5f, 0.0f), 65535.0f);
+                d2 += (v.position[c] - header.center[c]) * (v.position[c] - header.center[c]);
+            }
+            data.positions[i * 4 + 3] = 0;
+            radius2 = std::max(radius2, d2);
+            data.attributes[i * 2 + 0] = packNormal(v.normal);
+            data.attributes[i * 2 + 1] = halfFloat(v.texCoords[0]) | ((unsigned int)halfFloat(v.texCoords[1]) << 16);
+        }
+        header.radius = std::sqrt(radius2);
+
+        data.indices.resize(indices.size() * header.indexSize);
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            if (header.indexSize == 2)
+            {
+                unsigned short index = (unsigned short)indices[i];
+                memcpy(&data.indices[i * 2], &index, 2);
+            }
+            else
+                memcpy(&data.indices[i * 4], &indices[i], 4);
+        }
+        data.lods = lods;
+        data.meshlets = meshlets;
+    }
+
+    static bool write(const std::string &path, MeshData &data, std::string &error)
+    {
+        MeshHeader &header = data.header;
+        unsigned long long offset = sizeof(MeshHeader);
+        header.lodOffset = align(offset);
+        header.meshletsOffset = align(header.lodOffset + data.lods.size() * sizeof(MeshLod));
+        header.positionsOffset = align(header.meshletsOffset + data.meshlets.size() * sizeof(Meshlet));
+        header.attributesOffset = align(header.positionsOffset + data.positions.size() * 2);
+        header.indicesOffset = align(header.attributesOffset + data.attributes.size() * 4);
+
+        std::ofstream file(path.c_str(), std::ios::binary);
+        if (!file)
+        {
+            error = "can't write " + path;
+            return false;
+        }
+        file.write((const char *)&header, sizeof(header));
+        writeAt(file, header.lodOffset, data.lods.data(), data.lods.size() * sizeof(MeshLod));
+        writeAt(file, header.meshletsOffset, data.meshlets.data(), data.meshlets.size() * sizeof(Meshlet));
+        writeAt(file, header.positionsOffset, data.positions.data(), data.positions.size() * 2);
+        writeAt(file, header.attributesOffset, data.attributes.data(), data.attributes.size() * 4);
+        writeAt(file, header.indicesOffset, data.indices.data(), data.indices.size());
+        if (!file.good())
+        {
+            error = "can't write " + path;
+            return false;
+        }
+        return true;
+    }
+
+    // IEEE half, round to nearest even, overflow to infinity
+    static unsigned short halfFloat(float value)
+    {
+        unsigned int bits;
+        memcpy(&bits, &value, 4);
+        unsigned int sign = (bits >> 16) & 0x8000;
+        int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        unsigned int mantissa = bits & 0x7fffff;
+        if (((bits >> 23) & 0xff) == 0xff)
+            return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+        if (exponent >= 31)
+            return (unsigned short)(sign | 0x7c00);
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+                return (unsigned short)sign;
+            mantissa |= 0x800000;
+            unsigned int shift = (unsigned int)(14 - exponent);
+            unsigned int half = mantissa >> shift, rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                ++half;
+            return (unsigned short)(sign | half);
+        }
+        unsigned int half = ((unsigned int)exponent << 10) | (mantissa >> 13), rest = mantissa & 0x1fff;
+        // a carry out of the mantissa bumps the exponent, which is what rounding up should do
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            ++half;
+        return (unsigned short)(sign | half);
+    }
+
+    // GL_INT_2_10_10_10_REV, signed normalized
+    static unsigned int packNormal(const float normal[3])
+    {
+        float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        unsigned int packed = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            float n = length > 0.0f ? normal[c] / length : (c == 1 ? 1.0f : 0.0f);
+            int q = (int)std::floor(std::min(std::max(n, -1.0f), 1.0f) * 511.0f + 0.5f);
+            packed |= ((unsigned int)q & 0x3ff) << (c * 10);
+        }
+        return packed;
+    }
+
+private:
+    AssetSpan file;
+
+    bool inside(unsigned long long offset, unsigned long long size) const
+    {
+        return offset <= file.size && size <= file.size - offset;
+    }
+
+    static unsigned long long align(unsigned long long offset)
+    {
+        return (offset + MESH_ALIGNMENT - 1) / MESH_ALIGNMENT * MESH_ALIGNMENT;
+    }
+
+    static void writeAt(std::ofstream &file, unsigned long long offset, const void *data, size_t size)
+    {
+        std::vector<char> padding((size_t)(offset - (unsigned long long)file.tellp()), 0);
+        file.write(padding.data(), padding.size());
+        file.write((const char *)data, size);
+    }
+};
+#endif
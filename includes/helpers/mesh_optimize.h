@@ -0,0 +1,381 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <helpers/mesh_file.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// the FIFO post-transform cache the overdraw pass keeps and the statistics replay
+const int MESH_CACHE_SIZE = 16;
+
+// how well an index buffer uses the post-transform cache
+struct VertexCacheStatistics
+{
+    size_t triangles, misses, vertices; // vertices: distinct ones referenced
+    float acmr;                         // average cache miss ratio, misses a triangle: 0.5 at best on a big grid, 3 at worst
+    float atvr;                         // misses a vertex: 1 at best
+};
+
+// Index and vertex buffer clean-up for triangle lists (helpers/mesh_file.h MeshVertex). The order for
+// drawing is optimizeVertexCache, then optimizeOverdraw on its output, then optimizeVertexFetch.
+class MeshOptimizer
+{
+public:
+    // merges bit-identical vertices
+    static void weld(std::vector<MeshVertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        std::unordered_map<VertexKey, unsigned int, VertexKeyHash> unique;
+        unique.reserve(vertices.size());
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<MeshVertex> welded;
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            VertexKey key;
+            memcpy(key.bytes, &vertices[i], sizeof(MeshVertex));
+            std::pair<std::unordered_map<VertexKey, unsigned int, VertexKeyHash>::iterator, bool> found =
+                unique.insert(std::make_pair(key, (unsigned int)welded.size()));
+            if (found.second)
+                welded.push_back(vertices[i]);
+            remap[i] = found.first->second;
+        }
+        for (size_t i = 0; i < indices.size(); ++i)
+            indices[i] = remap[indices[i]];
+        vertices.swap(welded);
+    }
+
+    // area-weighted smooth normals, shared by every vertex at the same position
+    static void generateNormals(std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices)
+    {
+        std::unordered_map<PositionKey, unsigned int, PositionKeyHash> positions;
+        std::vector<unsigned int> positionOf(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            PositionKey key;
+            memcpy(key.position, vertices[i].position, sizeof(key.position));
+            positionOf[i] = positions.insert(std::make_pair(key, (unsigned int)positions.size())).first->second;
+        }
+        std::vector<float> normals(positions.size() * 3, 0.0f);
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            const float *a = vertices[indices[t]].position, *b = vertices[indices[t + 1]].position,
+                        *c = vertices[indices[t + 2]].position;
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            // the cross product's length is twice the area
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            for (int k = 0; k < 3; ++k)
+                for (int c2 = 0; c2 < 3; ++c2)
+                    normals[positionOf[indices[t + k]] * 3 + c2] += n[c2];
+        }
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            const float *n = &normals[positionOf[i] * 3];
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int c = 0; c < 3; ++c)
+                vertices[i].normal[c] = length > 0.0f ? n[c] / length : (c == 1 ? 1.0f : 0.0f);
+        }
+    }
+
+    // reorders triangles for a post-transform vertex cache (Tom Forsyth's linear-speed algorithm): each step
+    // emits the best-scoring triangle among those touching the simulated cache, vertices score higher the
+    // more recently they were used and the fewer triangles they have left
+    static void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+    {
+        const int CACHE_SIZE = 32, MAX_VALENCE = 64;
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+        float cacheScore[CACHE_SIZE], valenceScore[MAX_VALENCE];
+        for (int i = 0; i < CACHE_SIZE; ++i)
+            cacheScore[i] = i < 3 ? 0.75f : std::pow(1.0f - (float)(i - 3) / (CACHE_SIZE - 3), 1.5f);
+        for (int i = 0; i < MAX_VALENCE; ++i)
+            valenceScore[i] = i ? 2.0f / std::sqrt((float)i) : 0.0f;
+
+        // triangles of every vertex, the live ones first in its range
+        std::vector<unsigned int> valence(vertexCount, 0), first(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+            ++valence[indices[i]];
+        for (size_t v = 0; v < vertexCount; ++v)
+            first[v + 1] = first[v] + valence[v];
+        std::vector<unsigned int> triangles(triangleCount * 3), filled(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i)
+            triangles[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount), triangleScore(triangleCount, 0.0f);
+        std::vector<char> emitted(triangleCount, 0);
+        for (size_t v = 0; v < vertexCount; ++v)
+            vertexScore[v] = valence[v] ? valenceScore[std::min<unsigned int>(valence[v], MAX_VALENCE - 1)] : -1.0f;
+        for (size_t t = 0; t < triangleCount; ++t)
+            for (int k = 0; k < 3; ++k)
+                triangleScore[t] += vertexScore[indices[t * 3 + k]];
+
+        std::vector<unsigned int> output;
+        output.reserve(indices.size());
+        std::vector<unsigned int> cache, nextCache;
+        cache.reserve(CACHE_SIZE + 3);
+        nextCache.reserve(CACHE_SIZE + 3);
+        size_t cursor = 0;
+        int best = (int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+        while (output.size() < indices.size())
+        {
+            if (best < 0)
+            {
+                // dead end: nothing in the cache has triangles left, take the next one in the input
+                while (emitted[cursor])
+                    ++cursor;
+                best = (int)cursor;
+            }
+            emitted[best] = 1;
+            nextCache.clear();
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int v = indices[best * 3 + k];
+                output.push_back(v);
+                nextCache.push_back(v);
+                // drop the triangle from the vertex's live range
+                unsigned int *begin = &triangles[first[v]], *end = begin + valence[v];
+                for (unsigned int *t = begin; t != end; ++t)
+                    if (*t == (unsigned int)best)
+                    {
+                        *t = end[-1];
+                        break;
+                    }
+                --valence[v];
+            }
+            for (size_t i = 0; i < cache.size(); ++i)
+                if (cache[i] != nextCache[0] && cache[i] != nextCache[1] && cache[i] != nextCache[2])
+                    nextCache.push_back(cache[i]);
+
+            // rescore everything that moved in the cache, or fell out of it
+            best = -1;
+            float bestScore = -1.0f;
+            for (size_t i = 0; i < nextCache.size(); ++i)
+            {
+                unsigned int v = nextCache[i];
+                cachePosition[v] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+                float score = -1.0f;
+                if (valence[v])
+                {
+                    score = valenceScore[std::min<unsigned int>(valence[v], MAX_VALENCE - 1)];
+                    if (cachePosition[v] >= 0)
+                        score += cacheScore[cachePosition[v]];
+                }
+                float delta = score - vertexScore[v];
+                vertexScore[v] = score;
+                for (unsigned int j = 0; j < valence[v]; ++j)
+                {
+                    unsigned int t = triangles[first[v] + j];
+                    triangleScore[t] += delta;
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = (int)t;
+                    }
+                }
+            }
+            if (nextCache.size() > (size_t)CACHE_SIZE)
+                nextCache.resize(CACHE_SIZE);
+            cache.swap(nextCache);
+        }
+        indices.swap(output);
+    }
+
+    // reorders clusters of cache-ordered triangles (optimizeVertexCache) so that the ones facing out of the
+    // mesh come first and hide what is behind them, after Sander et al., "Fast Triangle Reordering for Vertex
+    // Locality and Reduced Overdraw": a cluster starts where the cache had nothing of a triangle, and is cut
+    // further wherever its ACMR so far has come down to threshold times the whole run's, so the cache
+    // gets at most that much worse
+    static void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<MeshVertex> &vertices, float threshold = 1.05f)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+        std::vector<unsigned int> cachedAt(vertices.size(), 0);
+        unsigned int time = 0;
+
+        // runs between cache flushes, then clusters within them
+        std::vector<size_t> runs;
+        for (size_t t = 0; t < triangleCount; ++t)
+            if (cacheMisses(&indices[t * 3], cachedAt, time) == 3 || t == 0)
+                runs.push_back(t);
+        runs.push_back(triangleCount);
+        std::vector<size_t> clusters;
+        for (size_t r = 0; r + 1 < runs.size(); ++r)
+        {
+            size_t begin = runs[r], end = runs[r + 1], misses = 0;
+            time += MESH_CACHE_SIZE + 1;
+            for (size_t t = begin; t < end; ++t)
+                misses += cacheMisses(&indices[t * 3], cachedAt, time);
+            float target = threshold * misses / (end - begin);
+            clusters.push_back(begin);
+            time += MESH_CACHE_SIZE + 1;
+            size_t clusterMisses = 0, clusterTriangles = 0;
+            for (size_t t = begin; t < end; ++t)
+            {
+                clusterMisses += cacheMisses(&indices[t * 3], cachedAt, time);
+                if ((float)clusterMisses / ++clusterTriangles <= target && t + 1 < end)
+                {
+                    // the next cluster starts on a cold cache
+                    clusters.push_back(t + 1);
+                    time += MESH_CACHE_SIZE + 1;
+                    clusterMisses = clusterTriangles = 0;
+                }
+            }
+            // a tail that never got there joins the cluster before it
+            if (clusters.back() != begin && (float)clusterMisses / clusterTriangles > target)
+                clusters.pop_back();
+        }
+        clusters.push_back(triangleCount);
+
+        // the mesh's and every cluster's area-weighted centroid and normal
+        std::vector<float> centroids((clusters.size() - 1) * 3, 0.0f), normals((clusters.size() - 1) * 3, 0.0f), areas(clusters.size() - 1, 0.0f);
+        float meshCentroid[3] = { 0.0f, 0.0f, 0.0f }, meshArea = 0.0f;
+        for (size_t c = 0; c + 1 < clusters.size(); ++c)
+        {
+            for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+            {
+                const float *a = vertices[indices[t * 3]].position, *b = vertices[indices[t * 3 + 1]].position,
+                            *d = vertices[indices[t * 3 + 2]].position;
+                float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+                float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+                float area = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int k = 0; k < 3; ++k)
+                {
+                    centroids[c * 3 + k] += area * (a[k] + b[k] + d[k]) / 3.0f;
+                    normals[c * 3 + k] += n[k];
+                }
+                areas[c] += area;
+            }
+            for (int k = 0; k < 3; ++k)
+                meshCentroid[k] += centroids[c * 3 + k];
+            meshArea += areas[c];
+        }
+        for (int k = 0; k < 3; ++k)
+            meshCentroid[k] /= meshArea > 0.0f ? meshArea : 1.0f;
+        // how far out the cluster faces: outer ones, drawn first, occlude the rest from most directions
+        std::vector<unsigned int> order(clusters.size() - 1);
+        std::vector<float> sortKeys(order.size());
+        for (size_t c = 0; c < order.size(); ++c)
+        {
+            const float *n = &normals[c * 3];
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]), key = 0.0f;
+            if (length > 0.0f && areas[c] > 0.0f)
+                for (int k = 0; k < 3; ++k)
+                    key += (centroids[c * 3 + k] / areas[c] - meshCentroid[k]) * n[k] / length;
+            sortKeys[c] = key;
+            order[c] = (unsigned int)c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+        std::vector<unsigned int> output;
+        output.reserve(indices.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            output.insert(output.end(), indices.begin() + clusters[order[i]] * 3, indices.begin() + clusters[order[i] + 1] * 3);
+        indices.swap(output);
+    }
+
+    // replays indexCount indices, a triangle list or, with strips, triangle strips separated by the largest
+    // Index as the restart index, through a FIFO cache of cacheSize vertices
+    template <typename Index>
+    static VertexCacheStatistics analyzeVertexCache(const Index *indices, size_t indexCount, size_t vertexCount, bool strips = false,
+                                                    int cacheSize = MESH_CACHE_SIZE)
+    {
+        VertexCacheStatistics statistics = { 0, 0, 0, 0.0f, 0.0f };
+        std::vector<size_t> cachedAt(vertexCount, 0); // misses so far when the vertex went in, 0: never
+        size_t stripLength = 0;
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            if (strips && indices[i] == (Index)~(Index)0)
+            {
+                stripLength = 0;
+                continue;
+            }
+            if (!strips ? i % 3 == 2 : ++stripLength >= 3)
+                ++statistics.triangles;
+            size_t &at = cachedAt[indices[i]];
+            if (at == 0)
+                ++statistics.vertices;
+            if (at == 0 || statistics.misses - at >= (size_t)cacheSize)
+                at = ++statistics.misses;
+        }
+        statistics.acmr = statistics.triangles ? (float)statistics.misses / statistics.triangles : 0.0f;
+        statistics.atvr = statistics.vertices ? (float)statistics.misses / statistics.vertices : 0.0f;
+        return statistics;
+    }
+
+    // renumbers vertices in the order the indices first use them, dropping unused ones
+    static void optimizeVertexFetch(std::vector<MeshVertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        const unsigned int UNUSED = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), UNUSED);
+        std::vector<MeshVertex> ordered;
+        ordered.reserve(vertices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            unsigned int &index = remap[indices[i]];
+            if (index == UNUSED)
+            {
+                index = (unsigned int)ordered.size();
+                ordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = index;
+        }
+        vertices.swap(ordered);
+    }
+
+private:
+    // a triangle through a FIFO cache of MESH_CACHE_SIZE kept as the time each vertex went in; moving time
+    // on by more than the size empties it
+    static int cacheMisses(const unsigned int *triangle, std::vector<unsigned int> &cachedAt, unsigned int &time)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int &at = cachedAt[triangle[k]];
+            if (at == 0 || time - at >= (unsigned int)MESH_CACHE_SIZE)
+            {
+                at = ++time;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+
+    struct VertexKey
+    {
+        unsigned char bytes[sizeof(MeshVertex)];
+        bool operator==(const VertexKey &other) const { return memcmp(bytes, other.bytes, sizeof(bytes)) == 0; }
+    };
+
+    struct PositionKey
+    {
+        float position[3];
+        bool operator==(const PositionKey &other) const { return memcmp(position, other.position, sizeof(position)) == 0; }
+    };
+
+    static size_t hashBytes(const unsigned char *bytes, size_t size)
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return (size_t)hash;
+    }
+
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey &key) const { return hashBytes(key.bytes, sizeof(key.bytes)); }
+    };
+
+    struct PositionKeyHash
+    {
+        size_t operator()(const PositionKey &key) const
+        {
+            return hashBytes((const unsigned char *)key.position, sizeof(key.position));
+        }
+    };
+};
+#endif
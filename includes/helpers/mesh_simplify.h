@@ -0,0 +1,319 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <helpers/mesh_file.h>
+#include <helpers/mesh_optimize.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Quadric error simplification (Garland & Heckbert) of triangle lists, and LOD chains built with it.
+// Edges collapse one end onto the other, cheapest first by the summed squared distance to the planes of
+// the original triangles around them, so no vertex is created or moved: every level indexes the original
+// vertex buffer, as the LODs of a .gmesh do (see helpers/mesh_file.h). Vertices on open borders, on
+// attribute seams (several vertices at one position) and on non-manifold edges stay where they are.
+// Header only, for meshcook and for meshes built at runtime alike.
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices)
+        : vertices(vertices), result(indices), positionOf(vertices.size()), locked(vertices.size(), 0), worst(0.0f)
+    {
+        // vertices sharing a position collapse together through the position's quadric
+        std::unordered_map<PositionKey, unsigned int, PositionKeyHash> positions;
+        positions.reserve(vertices.size());
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            PositionKey key;
+            memcpy(key.position, vertices[v].position, sizeof(key.position));
+            positionOf[v] = positions.insert(std::make_pair(key, (unsigned int)positions.size())).first->second;
+        }
+        std::vector<unsigned int> wedges(positions.size(), 0);
+        for (size_t v = 0; v < vertices.size(); ++v)
+            ++wedges[positionOf[v]];
+        for (size_t v = 0; v < vertices.size(); ++v)
+            locked[v] = wedges[positionOf[v]] > 1;
+        lockBorders();
+
+        quadrics.resize(positions.size());
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+        {
+            Quadric q = Quadric::plane(vertices[result[t]].position, vertices[result[t + 1]].position, vertices[result[t + 2]].position);
+            for (int k = 0; k < 3; ++k)
+                quadrics[positionOf[result[t + k]]].add(q);
+        }
+    }
+
+    // collapses more edges until at most targetIndexCount indices are left, or the cheapest collapse would
+    // put the surface further than maxError (object space) from the original; returns the error reached
+    float simplify(size_t targetIndexCount, float maxError)
+    {
+        size_t vertexCount = vertices.size();
+        std::vector<unsigned int> first, filled, triangles, remap(vertexCount);
+        std::vector<Collapse> collapses;
+        std::vector<char> touched(vertexCount);
+        float limit = maxError * maxError;
+        while (result.size() > targetIndexCount)
+        {
+            // triangles around every vertex
+            first.assign(vertexCount + 1, 0);
+            for (size_t i = 0; i < result.size(); ++i)
+                ++first[result[i] + 1];
+            for (size_t v = 0; v < vertexCount; ++v)
+                first[v + 1] += first[v];
+            triangles.resize(result.size());
+            filled.assign(first.begin(), first.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i)
+                triangles[filled[result[i]]++] = (unsigned int)(i / 3);
+
+            // every edge once (open borders are locked, so every other one is in a triangle as a < b), its cheaper way
+            collapses.clear();
+            for (size_t t = 0; t + 2 < result.size(); t += 3)
+                for (int k = 0; k < 3; ++k)
+                {
+                    unsigned int a = result[t + k], b = result[t + (k + 1) % 3];
+                    if (a > b || (locked[a] && locked[b]))
+                        continue;
+                    Collapse ab = collapse(a, b), ba = collapse(b, a);
+                    collapses.push_back(locked[a] || (!locked[b] && ba.cost < ab.cost) ? ba : ab);
+                }
+            std::sort(collapses.begin(), collapses.end());
+
+            // the cheapest collapses whose neighbourhoods don't overlap, about as many as reach the target
+            // (each takes two triangles away)
+            size_t wanted = (result.size() - targetIndexCount) / 6 + 1, done = 0;
+            std::fill(touched.begin(), touched.end(), 0);
+            for (size_t v = 0; v < vertexCount; ++v)
+                remap[v] = (unsigned int)v;
+            for (size_t c = 0; c < collapses.size() && done < wanted; ++c)
+            {
+                const Collapse &e = collapses[c];
+                if (e.cost > limit)
+                    break;
+                if (touched[e.from] || touched[e.to] || flips(first, triangles, e.from, e.to))
+                    continue;
+                remap[e.from] = e.to;
+                quadrics[positionOf[e.to]].add(quadrics[positionOf[e.from]]);
+                for (unsigned int i = first[e.from]; i < first[e.from + 1]; ++i)
+                    for (int k = 0; k < 3; ++k)
+                        touched[result[triangles[i] * 3 + k]] = 1;
+                worst = std::max(worst, e.cost);
+                ++done;
+            }
+            if (done == 0)
+                break;
+
+            // drop the triangles that lost an edge
+            size_t kept = 0;
+            for (size_t t = 0; t + 2 < result.size(); t += 3)
+            {
+                unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+            result.resize(kept);
+        }
+        return error();
+    }
+
+    const std::vector<unsigned int> &indices() const { return result; }
+
+    // of the costliest collapse so far
+    float error() const { return std::sqrt(worst); }
+
+    static float simplify(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices, size_t targetIndexCount,
+                          float maxError, std::vector<unsigned int> &result)
+    {
+        MeshSimplifier simplifier(vertices, indices);
+        float error = simplifier.simplify(targetIndexCount, maxError);
+        result = simplifier.indices();
+        return error;
+    }
+
+    // appends coarser levels after the original triangles in indices, each with ratio of the triangles of
+    // the one before, until that stops paying or maxError is reached; every level goes on from the one
+    // before, its error still measured against the original. optimize orders each level for the vertex cache
+    // and overdraw
+    static void buildLods(const std::vector<MeshVertex> &vertices, std::vector<unsigned int> &indices, std::vector<MeshLod> &lods,
+                          int maxLods, float ratio, float maxError, bool optimize)
+    {
+        MeshSimplifier simplifier(vertices, indices);
+        std::vector<unsigned int> level;
+        lods.assign(1, MeshLod());
+        lods[0].firstIndex = 0;
+        lods[0].indexCount = (unsigned int)indices.size();
+        lods[0].error = 0.0f;
+        lods[0].meshletCount = 0;
+        while ((int)lods.size() < maxLods)
+        {
+            size_t previous = simplifier.indices().size(), target = (size_t)(previous / 3 * ratio) * 3;
+            if (target < 12)
+                break;
+            float error = simplifier.simplify(target, maxError);
+            level = simplifier.indices();
+            // less than a tenth fewer triangles: the rest is locked or too far off
+            if (level.empty() || level.size() * 10 > previous * 9)
+                break;
+            if (optimize)
+            {
+                MeshOptimizer::optimizeVertexCache(level, vertices.size());
+                MeshOptimizer::optimizeOverdraw(level, vertices);
+            }
+            MeshLod lod;
+            lod.firstIndex = (unsigned int)indices.size();
+            lod.indexCount = (unsigned int)level.size();
+            lod.error = error;
+            lod.meshletCount = 0;
+            lods.push_back(lod);
+            indices.insert(indices.end(), level.begin(), level.end());
+        }
+    }
+
+private:
+    // sum of squared distances to planes, as the symmetric 4x4 matrix's upper half, and their total area
+    struct Quadric
+    {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2, weight;
+
+        Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), weight(0) {}
+
+        // the triangle's plane, weighted by its area
+        static Quadric plane(const float *p0, const float *p1, const float *p2)
+        {
+            double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] }, e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            Quadric q;
+            if (length <= 0.0)
+                return q;
+            double a = n[0] / length, b = n[1] / length, c = n[2] / length, d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+            double area = 0.5 * length;
+            q.a2 = area * a * a, q.ab = area * a * b, q.ac = area * a * c, q.ad = area * a * d;
+            q.b2 = area * b * b, q.bc = area * b * c, q.bd = area * b * d;
+            q.c2 = area * c * c, q.cd = area * c * d, q.d2 = area * d * d;
+            q.weight = area;
+            return q;
+        }
+
+        void add(const Quadric &q)
+        {
+            a2 += q.a2, ab += q.ab, ac += q.ac, ad += q.ad, b2 += q.b2, bc += q.bc, bd += q.bd;
+            c2 += q.c2, cd += q.cd, d2 += q.d2, weight += q.weight;
+        }
+
+        // mean squared distance of p to the planes
+        double error(const float *p) const
+        {
+            double x = p[0], y = p[1], z = p[2];
+            double e = a2 * x * x + b2 * y * y + c2 * z * z + d2 + 2.0 * (ab * x * y + ac * x * z + ad * x + bc * y * z + bd * y + cd * z);
+            return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        float cost;
+        unsigned int from, to;
+        bool operator<(const Collapse &other) const { return cost < other.cost; }
+    };
+
+    struct PositionKey
+    {
+        float position[3];
+        bool operator==(const PositionKey &other) const { return memcmp(position, other.position, sizeof(position)) == 0; }
+    };
+
+    struct PositionKeyHash
+    {
+        size_t operator()(const PositionKey &key) const
+        {
+            unsigned long long hash = 14695981039346656037ull;
+            const unsigned char *bytes = (const unsigned char *)key.position;
+            for (size_t i = 0; i < sizeof(key.position); ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            return (size_t)hash;
+        }
+    };
+
+    const std::vector<MeshVertex> &vertices;
+    std::vector<unsigned int> result;     // the triangles left
+    std::vector<unsigned int> positionOf; // by vertex
+    std::vector<char> locked;             // by vertex
+    std::vector<Quadric> quadrics;        // by position
+    float worst;                          // squared
+
+    Collapse collapse(unsigned int from, unsigned int to) const
+    {
+        Quadric q = quadrics[positionOf[from]];
+        q.add(quadrics[positionOf[to]]);
+        Collapse c;
+        c.cost = (float)q.error(vertices[to].position);
+        c.from = from;
+        c.to = to;
+        return c;
+    }
+
+    // locks the vertices at either end of a position-space edge with one triangle (a border) or more than two
+    void lockBorders()
+    {
+        const std::vector<unsigned int> &indices = result;
+        std::unordered_map<unsigned long long, int> edges;
+        edges.reserve(indices.size());
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            for (int k = 0; k < 3; ++k)
+                ++edges[edgeKey(positionOf[indices[t + k]], positionOf[indices[t + (k + 1) % 3]])];
+        std::vector<char> lockedPosition(positionOf.size(), 0);
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int a = positionOf[indices[t + k]], b = positionOf[indices[t + (k + 1) % 3]];
+                if (edges[edgeKey(a, b)] != 2)
+                    lockedPosition[a] = lockedPosition[b] = 1;
+            }
+        for (size_t v = 0; v < positionOf.size(); ++v)
+            if (lockedPosition[positionOf[v]])
+                locked[v] = 1;
+    }
+
+    static unsigned long long edgeKey(unsigned int a, unsigned int b)
+    {
+        return a < b ? (unsigned long long)a << 32 | b : (unsigned long long)b << 32 | a;
+    }
+
+    // whether moving from onto to turns one of from's other triangles over (or close to edge-on)
+    bool flips(const std::vector<unsigned int> &first, const std::vector<unsigned int> &triangles, unsigned int from, unsigned int to) const
+    {
+        const std::vector<unsigned int> &indices = result;
+        for (unsigned int i = first[from]; i < first[from + 1]; ++i)
+        {
+            const unsigned int *t = &indices[triangles[i] * 3];
+            if (t[0] == to || t[1] == to || t[2] == to)
+                continue; // collapses away
+            float before[3], after[3];
+            normal(vertices[t[0]].position, vertices[t[1]].position, vertices[t[2]].position, before);
+            normal(vertices[t[0] == from ? to : t[0]].position, vertices[t[1] == from ? to : t[1]].position,
+                   vertices[t[2] == from ? to : t[2]].position, after);
+            float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            float lengths = std::sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+                                      (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+            if (dot <= 0.25f * lengths)
+                return true;
+        }
+        return false;
+    }
+
+    static void normal(const float *a, const float *b, const float *c, float *n)
+    {
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+};
+#endif
@@ -0,0 +1,152 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <helpers/mesh_file.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// Meshlets: a LOD's triangles cut, in the order they are drawn, into runs of at most MESHLET_MAX_VERTICES
+// distinct vertices and MESHLET_MAX_TRIANGLES triangles. The vertex cache and overdraw orders
+// (helpers/mesh_optimize.h) keep neighbouring triangles together already, so the runs come out compact with
+// nothing reordered: a meshlet stays a range of the index buffer, and the ones that survive culling next to
+// each other still draw as one range.
+// Each meshlet has a bounding sphere and a cone around its triangles' normals. It is back-facing as a whole
+// from wherever dot(center - eye, axis) >= cutoff * |center - eye| + radius, the test meshoptimizer's
+// meshopt_computeMeshletBounds documents, with cutoff the sine of the cone's half angle; a cone wider than
+// about 84 degrees gets a cutoff of 1 and is never back-facing. Front faces are counter-clockwise, GL's and
+// glTF's default. The test drops what back-face culling would, which this renderer doesn't enable: for a
+// closed mesh that is only what the front faces hide anyway, and meshcook --double-sided leaves the cones
+// out for the rest. helpers/meshlet_culling.h tests them on the CPU.
+class MeshletBuilder
+{
+public:
+    // appends the meshlets of each of lods (ranges of indices) to meshlets and counts them in the LOD
+    static void build(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices, std::vector<MeshLod> &lods,
+                      std::vector<Meshlet> &meshlets, bool cones = true)
+    {
+        meshlets.clear();
+        // the meshlet a vertex was last counted in
+        std::vector<unsigned int> seen(vertices.size(), ~0u);
+        for (size_t l = 0; l < lods.size(); ++l)
+        {
+            size_t before = meshlets.size();
+            unsigned int end = lods[l].firstIndex + lods[l].indexCount, first = lods[l].firstIndex, count = 0;
+            for (unsigned int t = first; t + 2 < end; t += 3)
+            {
+                const unsigned int *triangle = &indices[t];
+                unsigned int stamp = (unsigned int)meshlets.size(), added = unseen(triangle, seen, stamp);
+                if (t > first && (count + added > MESHLET_MAX_VERTICES || t - first >= 3 * MESHLET_MAX_TRIANGLES))
+                {
+                    meshlets.push_back(bounds(vertices, indices, first, t - first, cones));
+                    first = t;
+                    count = 0;
+                    added = unseen(triangle, seen, ++stamp);
+                }
+                seen[triangle[0]] = seen[triangle[1]] = seen[triangle[2]] = stamp;
+                count += added;
+            }
+            if (end > first)
+                meshlets.push_back(bounds(vertices, indices, first, end - first, cones));
+            lods[l].meshletCount = (unsigned int)(meshlets.size() - before);
+        }
+    }
+
+    // the sphere around indices [first, first + count) and the cone around their triangles' normals
+    static Meshlet bounds(const std::vector<MeshVertex> &vertices, const std::vector<unsigned int> &indices, unsigned int first,
+                          unsigned int count, bool cones)
+    {
+        Meshlet meshlet;
+        meshlet.firstIndex = first;
+        meshlet.indexCount = count;
+        float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+        for (unsigned int i = first; i < first + count; ++i)
+            for (int c = 0; c < 3; ++c)
+            {
+                lo[c] = std::min(lo[c], vertices[indices[i]].position[c]);
+                hi[c] = std::max(hi[c], vertices[indices[i]].position[c]);
+            }
+        float radius2 = 0.0f;
+        for (int c = 0; c < 3; ++c)
+            meshlet.center[c] = (lo[c] + hi[c]) * 0.5f;
+        for (unsigned int i = first; i < first + count; ++i)
+        {
+            const float *p = vertices[indices[i]].position;
+            float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+            radius2 = std::max(radius2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        }
+        meshlet.radius = std::sqrt(radius2);
+
+        // the axis is the average of the unit normals, the cone as wide as the one farthest from it
+        std::vector<float> normals;
+        float axis[3] = { 0.0f, 0.0f, 0.0f };
+        for (unsigned int t = first; t + 2 < first + count; t += 3)
+        {
+            const float *a = vertices[indices[t]].position, *b = vertices[indices[t + 1]].position, *c = vertices[indices[t + 2]].position;
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length <= 0.0f)
+                continue; // degenerate, faces nowhere
+            for (int k = 0; k < 3; ++k)
+            {
+                normals.push_back(n[k] / length);
+                axis[k] += n[k] / length;
+            }
+        }
+        float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]), widest = 1.0f;
+        for (int k = 0; k < 3; ++k)
+            meshlet.coneAxis[k] = length > 0.0f ? axis[k] / length : (k == 2 ? 1.0f : 0.0f);
+        for (size_t i = 0; length > 0.0f && i < normals.size(); i += 3)
+            widest = std::min(widest, normals[i] * meshlet.coneAxis[0] + normals[i + 1] * meshlet.coneAxis[1] + normals[i + 2] * meshlet.coneAxis[2]);
+        meshlet.coneCutoff = !cones || length <= 0.0f || widest <= 0.1f ? 1.0f : std::sqrt(1.0f - widest * widest);
+        return meshlet;
+    }
+
+private:
+    // the triangle's distinct vertices not counted in meshlet stamp yet
+    static unsigned int unseen(const unsigned int *triangle, const std::vector<unsigned int> &seen, unsigned int stamp)
+    {
+        unsigned int a = triangle[0], b = triangle[1], c = triangle[2];
+        return (seen[a] != stamp) + (seen[b] != stamp && b != a) + (seen[c] != stamp && c != a && c != b);
+    }
+};
+
+
+// A mesh's meshlets as an array per field, so that the CPU tests them several at a time
+struct MeshletSet
+{
+    std::vector<float> x, y, z, radius, axisX, axisY, axisZ, cutoff;
+    std::vector<unsigned int> firstIndex, indexCount;
+
+    void assign(const Meshlet *meshlets, size_t count)
+    {
+        std::vector<float> *fields[] = { &x, &y, &z, &radius, &axisX, &axisY, &axisZ, &cutoff };
+        for (int f = 0; f < 8; ++f)
+            fields[f]->resize(count);
+        firstIndex.resize(count);
+        indexCount.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            x[i] = meshlets[i].center[0];
+            y[i] = meshlets[i].center[1];
+            z[i] = meshlets[i].center[2];
+            radius[i] = meshlets[i].radius;
+            axisX[i] = meshlets[i].coneAxis[0];
+            axisY[i] = meshlets[i].coneAxis[1];
+            axisZ[i] = meshlets[i].coneAxis[2];
+            cutoff[i] = meshlets[i].coneCutoff;
+            firstIndex[i] = meshlets[i].firstIndex;
+            indexCount[i] = meshlets[i].indexCount;
+        }
+    }
+
+    void clear() { assign(NULL, 0); }
+
+    size_t size() const { return x.size(); }
+};
+#endif
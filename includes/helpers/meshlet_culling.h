@@ -0,0 +1,99 @@
+#ifndef MESHLET_CULLING_H
+#define MESHLET_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <helpers/meshlet.h>
+
+#include <algorithm>
+#include <cmath>
+
+// a view brought into the space of one object's meshlets
+struct MeshletView
+{
+    glm::vec4 planes[6]; // inward; not normalized there, so that a distance still comes out in world units
+    glm::vec3 eye;
+    float radiusScale;   // object to world, the largest of the placement's scales
+    bool cones;          // the cone test holds only for a uniform scale that doesn't mirror
+};
+
+// Meshlets culled on the CPU against one view, in the object's space so that none of them is transformed:
+// the frustum test, then the cone test. cull() is one loop over the arrays of a MeshletSet without branches,
+// written for the compiler to vectorize.
+class MeshletCuller
+{
+public:
+    // viewProjection and eye in world space, the object placed by placement (without a decode matrix);
+    // cones: whether the view wants back-facing meshlets dropped
+    static MeshletView view(const glm::mat4 &viewProjection, const glm::vec3 &eye, bool cones, const glm::mat4 &placement)
+    {
+        MeshletView view;
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; ++r)
+            rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+        glm::mat4 transposed = glm::transpose(placement);
+        for (int i = 0; i < 3; ++i)
+        {
+            view.planes[2 * i] = rows[3] + rows[i];
+            view.planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (int i = 0; i < 6; ++i)
+            view.planes[i] = transposed * (view.planes[i] / glm::length(glm::vec3(view.planes[i])));
+        view.eye = glm::vec3(glm::inverse(placement) * glm::vec4(eye, 1.0f));
+        bool uniform;
+        view.radiusScale = scale(placement, uniform);
+        view.cones = cones && uniform;
+        return view;
+    }
+
+    // the largest of placement's scales; uniform: whether the others are the same and nothing is mirrored
+    static float scale(const glm::mat4 &placement, bool &uniform)
+    {
+        float scales[3];
+        for (int c = 0; c < 3; ++c)
+            scales[c] = glm::length(glm::vec3(placement[c]));
+        float largest = std::max(scales[0], std::max(scales[1], scales[2]));
+        uniform = std::min(scales[0], std::min(scales[1], scales[2])) >= largest * 0.999f && glm::determinant(glm::mat3(placement)) > 0.0f;
+        return largest;
+    }
+
+    // whether a sphere of the object's space is inside the view's frustum, for the whole object first
+    static bool visible(const MeshletView &view, const glm::vec3 &center, float radius)
+    {
+        for (int i = 0; i < 6; ++i)
+            if (glm::dot(glm::vec3(view.planes[i]), center) + view.planes[i].w < -radius * view.radiusScale)
+                return false;
+        return true;
+    }
+
+    // visible[i] for meshlet first + i of set, count of them; returns how many are
+    static size_t cull(const MeshletSet &set, size_t first, size_t count, const MeshletView &view, unsigned char *visible)
+    {
+        const float *x = &set.x[first], *y = &set.y[first], *z = &set.z[first], *radius = &set.radius[first];
+        const float *axisX = &set.axisX[first], *axisY = &set.axisY[first], *axisZ = &set.axisZ[first], *cutoff = &set.cutoff[first];
+        // the planes in locals: visible may alias anything, and loads in the loop would keep it scalar
+        float p[6][4];
+        for (int i = 0; i < 6; ++i)
+            for (int c = 0; c < 4; ++c)
+                p[i][c] = view.planes[i][c];
+        float ex = view.eye.x, ey = view.eye.y, ez = view.eye.z, scale = view.radiusScale;
+        int cones = view.cones ? 1 : 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            float r = -radius[i] * scale;
+            int inside = (p[0][0] * x[i] + p[0][1] * y[i] + p[0][2] * z[i] + p[0][3] >= r) & (p[1][0] * x[i] + p[1][1] * y[i] + p[1][2] * z[i] + p[1][3] >= r) &
+                         (p[2][0] * x[i] + p[2][1] * y[i] + p[2][2] * z[i] + p[2][3] >= r) & (p[3][0] * x[i] + p[3][1] * y[i] + p[3][2] * z[i] + p[3][3] >= r) &
+                         (p[4][0] * x[i] + p[4][1] * y[i] + p[4][2] * z[i] + p[4][3] >= r) & (p[5][0] * x[i] + p[5][1] * y[i] + p[5][2] * z[i] + p[5][3] >= r);
+            // the cone test squared, no square root: a >= c * |d| with a >= 0 and c >= 0
+            float dx = x[i] - ex, dy = y[i] - ey, dz = z[i] - ez;
+            float a = dx * axisX[i] + dy * axisY[i] + dz * axisZ[i] - radius[i];
+            int back = cones & (a >= 0.0f) & (a * a >= cutoff[i] * cutoff[i] * (dx * dx + dy * dy + dz * dz));
+            visible[i] = (unsigned char)(inside & (back ^ 1));
+        }
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i)
+            total += visible[i];
+        return total;
+    }
+};
+#endif
@@ -0,0 +1,156 @@
+#ifndef PRIMITIVE_MESH_H
+#define PRIMITIVE_MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <helpers/geometry_heap.h>
+#include <helpers/log.h>
+#include <helpers/primitives.h>
+
+#include <vector>
+
+// A Primitive on the GPU, and optionally coarser ones with half the segments each as its levels of detail,
+// back to back in one range of a PrimitiveHeap, which all the primitives sharing it draw from with one VAO.
+// The range is sized from the primitives and they write into it mapped, so building allocates nothing on the
+// CPU side but the LOD table. Drawn as restart-separated triangle strips; positions come out in -1..1, so
+// draw with model * decodeMatrix().
+typedef GeometryHeap<PrimitiveVertex::Layout> PrimitiveHeap;
+
+class PrimitiveMesh
+{
+public:
+    PrimitiveMesh(PrimitiveHeap &heap) : heap(heap), range(-1), indexType(GL_UNSIGNED_SHORT), restartIndex(0xFFFF), scale(1.0f) {}
+    ~PrimitiveMesh()
+    {
+        release();
+    }
+
+    // lodCount levels at most: the chain stops at the coarsest segment counts
+    bool build(const Primitive &primitive, int lodCount = 1)
+    {
+        release();
+        // the finest level decides the index type, the others are smaller
+        bool shortIndices = primitive.shortIndices();
+        size_t indexSize = shortIndices ? 2 : 4, vertexCount = 0, indexBytes = 0;
+        Primitive level = primitive;
+        for (int l = 0; l < lodCount; ++l)
+        {
+            Lod lod;
+            lod.baseVertex = (GLint)vertexCount;
+            lod.firstIndex = indexBytes / indexSize;
+            lod.indexCount = (GLsizei)level.indexCount();
+            lod.triangles = level.triangleCount();
+            lod.error = level.error();
+            lods.push_back(lod);
+            vertexCount += level.vertexCount();
+            indexBytes += level.indexCount() * indexSize;
+            Primitive next = level.coarser();
+            if (next.vertexCount() == level.vertexCount())
+                break;
+            level = next;
+        }
+        indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        restartIndex = shortIndices ? 0xFFFF : 0xFFFFFFFF;
+        scale = primitive.radius(); // every level's
+
+        range = heap.allocate(vertexCount, indexBytes);
+        if (range < 0)
+        {
+            lods.clear();
+            return false;
+        }
+        PrimitiveVertex *vertices = (PrimitiveVertex *)heap.mapVertices(range, 0);
+        unsigned char *target = (unsigned char *)heap.mapIndices(range);
+        if (vertices && target)
+        {
+            // a level's indices count from its own first vertex, glDrawElementsBaseVertex adds that
+            level = primitive;
+            for (size_t l = 0; l < lods.size(); ++l, level = level.coarser())
+            {
+                if (shortIndices)
+                    level.write(vertices + lods[l].baseVertex, (unsigned short *)(target + lods[l].firstIndex * indexSize));
+                else
+                    level.write(vertices + lods[l].baseVertex, (unsigned int *)(target + lods[l].firstIndex * indexSize));
+            }
+        }
+        // unmapping fails when the buffer's contents were lost meanwhile, which leaves it undefined
+        bool written = vertices && target;
+        if (vertices && !heap.unmapVertices(0))
+            written = false;
+        if (target && !heap.unmapIndices())
+            written = false;
+        if (!written)
+        {
+            Log::error("PRIMITIVE::BUFFER_NOT_WRITTEN: %d vertices", (int)primitive.vertexCount());
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    bool loaded() const { return range >= 0; }
+
+    // positions are stored over the primitive's radius, this takes them back to object space
+    glm::mat4 decodeMatrix() const { return glm::scale(glm::mat4(1.0f), glm::vec3(scale)); }
+
+    int lodCount() const { return (int)lods.size(); }
+
+    // object space, 0 for flat primitives
+    float lodError(int lod) const { return lods.empty() ? 0.0f : lods[clampLod(lod)].error; }
+
+    size_t triangleCount(int lod = 0) const { return lods.empty() ? 0 : lods[clampLod(lod)].triangles; }
+
+    void draw(int lod = 0) const
+    {
+        if (range < 0)
+            return;
+        const Lod &level = lods[clampLod(lod)];
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(restartIndex);
+        heap.draw(range, GL_TRIANGLE_STRIP, level.indexCount, indexType,
+                  level.firstIndex * (indexType == GL_UNSIGNED_SHORT ? 2 : 4), level.baseVertex);
+        glDisable(GL_PRIMITIVE_RESTART);
+    }
+
+    // draw() for a DrawBatch
+    GeometryDraw drawOf(int lod = 0) const
+    {
+        if (range < 0)
+            return GeometryDraw();
+        const Lod &level = lods[clampLod(lod)];
+        return heap.drawOf(range, GL_TRIANGLE_STRIP, level.indexCount, indexType,
+                           level.firstIndex * (indexType == GL_UNSIGNED_SHORT ? 2 : 4), level.baseVertex, true);
+    }
+
+    void release()
+    {
+        heap.free(range);
+        range = -1;
+        lods.clear();
+    }
+
+private:
+    struct Lod
+    {
+        GLint baseVertex;
+        size_t firstIndex;
+        GLsizei indexCount;
+        size_t triangles;
+        float error;
+    };
+
+    PrimitiveHeap &heap;
+    PrimitiveHeap::Handle range;
+    GLenum indexType;
+    GLuint restartIndex;
+    float scale;
+    std::vector<Lod> lods; // finest first
+
+    int clampLod(int lod) const { return lod < 0 ? 0 : lod >= (int)lods.size() ? (int)lods.size() - 1 : lod; }
+
+    PrimitiveMesh(const PrimitiveMesh &);
+    PrimitiveMesh &operator=(const PrimitiveMesh &);
+};
+#endif
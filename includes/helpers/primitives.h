@@ -0,0 +1,392 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <helpers/vertex_layout.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Procedural meshes (sphere, torus, box, plane, cylinder, capsule) written straight into memory the caller
+// has sized with vertexCount() and indexCount(): no containers, no second interleaving pass, so the target
+// can be a mapped GL buffer (see helpers/primitive_mesh.h). Every shape is one or more grids of quads drawn
+// as GL_TRIANGLE_STRIP, a strip per row ended by a restart index (0xFFFF or 0xFFFFFFFF, the largest value
+// of the index type), counter-clockwise seen from outside; indices are 16-bit whenever the vertex count leaves room for the restart index.
+// For the post-transform vertex cache, rows are cut into bands of at most PRIMITIVE_BAND_COLUMNS quads drawn
+// one band at a time, top to bottom, so a strip finds the row it shares with the one above still cached.
+// Rows are independent, so a large mesh is written by several threads.
+
+const float PRIMITIVE_PI = 3.14159265358979f;
+const float PRIMITIVE_TAU = 2.0f * PRIMITIVE_PI;
+
+// a mesh with fewer vertices is written on the calling thread
+const size_t PRIMITIVE_PARALLEL_VERTICES = 1 << 16;
+
+// a band's first strip misses on both of its rows, 2 (columns + 1) vertices, which a 16-entry FIFO cache
+// still holds when the strip below comes to its bottom row; strips after it miss on their bottom row only
+// (see MeshOptimizer::analyzeVertexCache)
+const int PRIMITIVE_BAND_COLUMNS = 7;
+
+// the vertex layout of the builtin meshes, locations 0, 1 and 2: the position over radius() in snorm16,
+// the normal in 10_10_10_2, texcoords in halfs; 16 bytes where floats took 32
+struct PrimitiveVertex
+{
+    short position[4];
+    unsigned int normal;
+    unsigned int uv;
+
+    typedef VertexLayout<VertexSnorm16x3, VertexSnorm1010102, VertexHalf2> Layout;
+};
+static_assert(sizeof(PrimitiveVertex) == PrimitiveVertex::Layout::bytes, "PrimitiveVertex matches its layout");
+
+enum PrimitiveKind
+{
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_TORUS,
+    PRIMITIVE_BOX,
+    PRIMITIVE_PLANE,
+    PRIMITIVE_CYLINDER,
+    PRIMITIVE_CAPSULE
+};
+
+class Primitive
+{
+public:
+    PrimitiveKind kind;
+    int segments, rings; // quads around, along
+    float a, b, c;       // sizes, as the factories take them
+
+    // unit normals, v from the north pole (+y) to the south one
+    static Primitive sphere(float radius = 1.0f, int segments = 64, int rings = 64)
+    {
+        return Primitive(PRIMITIVE_SPHERE, segments, rings, radius, 0.0f, 0.0f);
+    }
+
+    // around the y axis: the ring's radius to the middle of the tube, then the tube's
+    static Primitive torus(float radius = 0.9f, float tube = 0.4f, int segments = 64, int rings = 32)
+    {
+        return Primitive(PRIMITIVE_TORUS, segments, rings, radius, tube, 0.0f);
+    }
+
+    // centred, a face per side
+    static Primitive box(float width = 1.0f, float height = 1.0f, float depth = 1.0f)
+    {
+        return Primitive(PRIMITIVE_BOX, 1, 1, width, height, depth);
+    }
+
+    // in xz facing +y, centred
+    static Primitive plane(float width = 1.0f, float depth = 1.0f, int segments = 1, int rings = 1)
+    {
+        return Primitive(PRIMITIVE_PLANE, segments, rings, width, depth, 0.0f);
+    }
+
+    // along y, centred, with caps
+    static Primitive cylinder(float radius = 0.5f, float height = 1.0f, int segments = 32, int rings = 1)
+    {
+        return Primitive(PRIMITIVE_CYLINDER, segments, rings, radius, height, 0.0f);
+    }
+
+    // a cylinder of height between two hemispheres, rings quads along each
+    static Primitive capsule(float radius = 0.5f, float height = 1.0f, int segments = 32, int rings = 8)
+    {
+        return Primitive(PRIMITIVE_CAPSULE, segments, rings, radius, height, 0.0f);
+    }
+
+    size_t vertexCount() const
+    {
+        size_t count = 0;
+        for (int p = 0; p < patchCount(); ++p)
+            count += (size_t)(patchColumns(p) + 1) * (patchRows(p) + 1);
+        return count;
+    }
+
+    size_t indexCount() const
+    {
+        size_t count = 0;
+        for (int p = 0; p < patchCount(); ++p)
+            count += (size_t)patchRows(p) * rowIndices(p);
+        return count;
+    }
+
+    // whether 16-bit indices reach every vertex; 0xFFFF is the restart index
+    bool shortIndices() const
+    {
+        return vertexCount() < 0xFFFF;
+    }
+
+    // writes vertexCount() vertices and indexCount() indices (unsigned short when shortIndices(), unsigned
+    // int otherwise), large meshes on up to threads threads (0: one per core)
+    template <typename Index> void write(PrimitiveVertex *vertices, Index *indices, int threads = 0) const
+    {
+        int rows = 0;
+        for (int p = 0; p < patchCount(); ++p)
+            rows += patchRows(p) + 1;
+        if (threads <= 0)
+            threads = std::max(1, (int)std::thread::hardware_concurrency());
+        if (vertexCount() < PRIMITIVE_PARALLEL_VERTICES)
+            threads = 1;
+        threads = std::min(threads, rows);
+        if (threads == 1)
+        {
+            writeRows(vertices, indices, 0, rows);
+            return;
+        }
+        // threads - 1 helpers, the calling thread takes the first share
+        std::thread helpers[64];
+        threads = std::min(threads, 64);
+        for (int t = 1; t < threads; ++t)
+            helpers[t] = std::thread(&Primitive::writeRows<Index>, this, vertices, indices, rows * t / threads, rows * (t + 1) / threads);
+        writeRows(vertices, indices, 0, rows / threads);
+        for (int t = 1; t < threads; ++t)
+            helpers[t].join();
+    }
+
+    // the next level of detail: half the segments and rings (the minimums allowing)
+    Primitive coarser() const
+    {
+        return Primitive(kind, segments / 2, rings / 2, a, b, c);
+    }
+
+    // how far the facets get from the curved surface they stand for: a circle of radius r cut into n
+    // chords is off by r (1 - cos(pi / n)) in their middles
+    float error() const
+    {
+        switch (kind)
+        {
+        case PRIMITIVE_SPHERE:
+            return chord(a, segments) + chord(a, 2 * rings);
+        case PRIMITIVE_TORUS:
+            return chord(a + b, segments) + chord(b, rings);
+        case PRIMITIVE_CYLINDER:
+            return chord(a, segments);
+        case PRIMITIVE_CAPSULE:
+            return chord(a, segments) + chord(a, 4 * rings);
+        default:
+            return 0.0f;
+        }
+    }
+
+    // triangles drawn, those the restarts leave out not counted
+    size_t triangleCount() const
+    {
+        size_t count = 0;
+        for (int p = 0; p < patchCount(); ++p)
+            count += (size_t)patchRows(p) * patchColumns(p) * 2;
+        return count;
+    }
+
+    // radius of the bounding sphere around the origin
+    float radius() const
+    {
+        switch (kind)
+        {
+        case PRIMITIVE_SPHERE:
+            return a;
+        case PRIMITIVE_TORUS:
+            return a + b;
+        case PRIMITIVE_BOX:
+            return 0.5f * std::sqrt(a * a + b * b + c * c);
+        case PRIMITIVE_PLANE:
+            return 0.5f * std::sqrt(a * a + b * b);
+        case PRIMITIVE_CYLINDER:
+            return std::sqrt(a * a + 0.25f * b * b);
+        default:
+            return a + 0.5f * b;
+        }
+    }
+
+private:
+    Primitive(PrimitiveKind kind, int segments, int rings, float a, float b, float c)
+        : kind(kind), segments(std::max(segments, 1)), rings(std::max(rings, 1)), a(a), b(b), c(c)
+    {
+        if (kind == PRIMITIVE_SPHERE || kind == PRIMITIVE_TORUS || kind == PRIMITIVE_CYLINDER || kind == PRIMITIVE_CAPSULE)
+            this->segments = std::max(this->segments, 3);
+        if (kind == PRIMITIVE_SPHERE || kind == PRIMITIVE_TORUS)
+            this->rings = std::max(this->rings, 2);
+    }
+
+    static float chord(float radius, int n)
+    {
+        return radius * (1.0f - std::cos(PRIMITIVE_PI / n));
+    }
+
+    // sides of the box, side and caps of the cylinder
+    int patchCount() const
+    {
+        return kind == PRIMITIVE_BOX ? 6 : kind == PRIMITIVE_CYLINDER ? 3 : 1;
+    }
+
+    int patchColumns(int) const
+    {
+        return segments;
+    }
+
+    int patchRows(int patch) const
+    {
+        if (kind == PRIMITIVE_CYLINDER && patch > 0)
+            return 1; // caps: centre to rim
+        return kind == PRIMITIVE_CAPSULE ? 2 * rings + 1 : rings;
+    }
+
+    int patchBands(int patch) const
+    {
+        return (patchColumns(patch) + PRIMITIVE_BAND_COLUMNS - 1) / PRIMITIVE_BAND_COLUMNS;
+    }
+
+    // the first column of a band, the columns spread evenly over the bands
+    int bandColumn(int patch, int band) const
+    {
+        return patchColumns(patch) * band / patchBands(patch);
+    }
+
+    // a row's strips, a strip and its restart index per band
+    size_t rowIndices(int patch) const
+    {
+        return 2 * (size_t)patchColumns(patch) + 3 * patchBands(patch);
+    }
+
+    // rows [first, last) of all patches' vertex rows counted one after the other; vertex row r of a patch
+    // comes with strips r, between vertex rows r and r + 1, when there are: one in each band's part of the
+    // patch's indices, which holds the band's strips of all rows
+    template <typename Index> void writeRows(PrimitiveVertex *vertices, Index *indices, int first, int last) const
+    {
+        size_t vertexBase = 0, indexBase = 0;
+        int row = 0;
+        for (int p = 0; p < patchCount() && row < last; ++p)
+        {
+            int columns = patchColumns(p), rows = patchRows(p), bands = patchBands(p);
+            size_t width = columns + 1;
+            for (int r = 0; r <= rows; ++r, ++row)
+            {
+                if (row < first || row >= last)
+                    continue;
+                writeVertexRow(p, r, vertices + vertexBase + r * width);
+                if (r == rows)
+                    continue;
+                Index top = (Index)(vertexBase + r * width), bottom = (Index)(top + width);
+                for (int b = 0; b < bands; ++b)
+                {
+                    // bands before this one take 2 (columns + 1) + 1 indices a row
+                    int begin = bandColumn(p, b), end = bandColumn(p, b + 1);
+                    size_t strip = 2 * (size_t)(end - begin + 1) + 1;
+                    Index *out = indices + indexBase + (2 * (size_t)begin + 3 * b) * rows + r * strip;
+                    for (int x = begin; x <= end; ++x)
+                    {
+                        *out++ = (Index)(top + x);
+                        *out++ = (Index)(bottom + x);
+                    }
+                    *out = (Index)~(Index)0;
+                }
+            }
+            vertexBase += width * (rows + 1);
+            indexBase += rowIndices(p) * rows;
+        }
+    }
+
+    // quantize: 32767 / radius(); everything is in range already, so this packs without vertexSnorm*'s clamping
+    static void set(PrimitiveVertex &v, float quantize, float px, float py, float pz, float nx, float ny, float nz, float s, float t)
+    {
+        v.position[0] = (short)vertexRound(px * quantize);
+        v.position[1] = (short)vertexRound(py * quantize);
+        v.position[2] = (short)vertexRound(pz * quantize);
+        v.position[3] = 0;
+        v.normal = ((unsigned int)vertexRound(nx * 511.0f) & 0x3FF) | ((unsigned int)vertexRound(ny * 511.0f) & 0x3FF) << 10 |
+                   ((unsigned int)vertexRound(nz * 511.0f) & 0x3FF) << 20;
+        v.uv = (unsigned int)vertexHalfBits(s) | (unsigned int)vertexHalfBits(t) << 16;
+    }
+
+    // the segments + 1 vertices of one row of a patch, with what depends on the row worked out once
+    void writeVertexRow(int patch, int row, PrimitiveVertex *out) const
+    {
+        int columns = patchColumns(patch), rows = patchRows(patch);
+        float v = (float)row / rows, quantize = 32767.0f / radius();
+        switch (kind)
+        {
+        case PRIMITIVE_SPHERE:
+        case PRIMITIVE_CAPSULE:
+        {
+            // latitude from the north pole; a capsule has its equator stretched into the cylinder
+            float phi, offset = 0.0f;
+            if (kind == PRIMITIVE_SPHERE)
+                phi = v * PRIMITIVE_PI;
+            else if (row <= rings)
+            {
+                phi = 0.5f * PRIMITIVE_PI * row / rings;
+                offset = 0.5f * b;
+            }
+            else
+            {
+                phi = 0.5f * PRIMITIVE_PI * (1.0f + (float)(row - rings - 1) / rings);
+                offset = -0.5f * b;
+            }
+            float y = std::cos(phi), ring = std::sin(phi);
+            for (int x = 0; x <= columns; ++x)
+            {
+                float u = (float)x / columns, theta = u * PRIMITIVE_TAU;
+                float nx = std::cos(theta) * ring, nz = -std::sin(theta) * ring;
+                set(out[x], quantize, a * nx, a * y + offset, a * nz, nx, y, nz, u, v);
+            }
+            break;
+        }
+        case PRIMITIVE_TORUS:
+        {
+            // around the tube, from the outer equator down
+            float phi = v * PRIMITIVE_TAU, cosPhi = std::cos(phi), sinPhi = -std::sin(phi);
+            float distance = a + b * cosPhi;
+            for (int x = 0; x <= columns; ++x)
+            {
+                float u = (float)x / columns, theta = u * PRIMITIVE_TAU;
+                float cosTheta = std::cos(theta), sinTheta = -std::sin(theta);
+                set(out[x], quantize, distance * cosTheta, b * sinPhi, distance * sinTheta, cosPhi * cosTheta, sinPhi, cosPhi * sinTheta, u, v);
+            }
+            break;
+        }
+        case PRIMITIVE_PLANE:
+            for (int x = 0; x <= columns; ++x)
+            {
+                float u = (float)x / columns;
+                set(out[x], quantize, (u - 0.5f) * a, 0.0f, (v - 0.5f) * b, 0.0f, 1.0f, 0.0f, u, v);
+            }
+            break;
+        case PRIMITIVE_BOX:
+        {
+            // per side: the normal and the axes u and v run along, with v x u = normal so strips face out
+            static const float sides[6][3][3] = {
+                { { 1, 0, 0 }, { 0, 0, -1 }, { 0, -1, 0 } }, { { -1, 0, 0 }, { 0, 0, 1 }, { 0, -1, 0 } },
+                { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },   { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+                { { 0, 0, 1 }, { 1, 0, 0 }, { 0, -1, 0 } },  { { 0, 0, -1 }, { -1, 0, 0 }, { 0, -1, 0 } } };
+            const float(*side)[3] = sides[patch];
+            float half[3] = { 0.5f * a, 0.5f * b, 0.5f * c };
+            for (int x = 0; x <= columns; ++x)
+            {
+                float u = (float)x / columns, su = 2.0f * u - 1.0f, sv = 2.0f * v - 1.0f;
+                float p[3];
+                for (int i = 0; i < 3; ++i)
+                    p[i] = (side[0][i] + su * side[1][i] + sv * side[2][i]) * half[i];
+                set(out[x], quantize, p[0], p[1], p[2], side[0][0], side[0][1], side[0][2], u, v);
+            }
+            break;
+        }
+        case PRIMITIVE_CYLINDER:
+        {
+            // the side, then the top and bottom caps from the centre out
+            float y = patch == 0 ? (0.5f - v) * b : patch == 1 ? 0.5f * b : -0.5f * b;
+            float ny = patch == 0 ? 0.0f : patch == 1 ? 1.0f : -1.0f;
+            float scale = patch == 0 ? 1.0f : v;
+            for (int x = 0; x <= columns; ++x)
+            {
+                float u = (float)x / columns, theta = (patch == 2 ? u : -u) * PRIMITIVE_TAU;
+                float cx = std::cos(theta), cz = std::sin(theta);
+                if (patch == 0)
+                    set(out[x], quantize, a * cx, y, a * cz, cx, 0.0f, cz, u, v);
+                else
+                    set(out[x], quantize, a * scale * cx, y, a * scale * cz, 0.0f, ny, 0.0f, 0.5f + 0.5f * scale * cx, 0.5f + 0.5f * scale * cz);
+            }
+            break;
+        }
+        }
+    }
+};
+#endif
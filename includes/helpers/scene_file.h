@@ -0,0 +1,786 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <helpers/filesystem.h>
+#include <helpers/mesh_file.h>
+#include <helpers/primitives.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// .gscene: a scene compiled from its text form (.scene) by scenecook, laid out so loading it is one map and a
+// few pointer fix-ups.
+//   header | assets (sorted by id) | objects | lights | cells | cell assets | path table | strings, each
+//   section 64-byte aligned
+// Objects reference meshes and textures by asset ID, the 64-bit hash of the asset's name (sceneAssetId), and
+// find() looks them up with a binary search over the asset table; assets list their files as paths relative
+// to the source root (resolve() makes them absolute).
+// The world is cut into square cells on the xz plane (cellSize apart, one cell holding everything when it's
+// 0) for helpers/world_streamer.h: the objects of a cell are contiguous, and every cell lists the streamed
+// assets (2D textures and cooked meshes) its objects use, as indices into the asset table.
+//
+// The text form, one directive a line, # starts a comment (angles in radians):
+//   texture  <name> <image>                         TextureStreamer::load
+//   packed   <name> <cooked.dds> <source>...        TextureStreamer::loadPacked (sources as in texture_pack.h)
+//   normal   <name> <cooked.dds> <source>           TextureStreamer::loadNormal
+//   virtual  <name> <.vtex>                         VirtualTexture
+//   cubemap  <name> <+x> <-x> <+y> <-y> <+z> <-z>
+//   mesh     <name> <.gmesh | builtin:floor | builtin:cube | builtin:wall | builtin:sphere | builtin:torus |
+//                   builtin:cylinder | builtin:capsule>
+//   skybox   <cubemap>
+//   camera   <x> <y> <z>
+//   cells    <size>
+//   light    [position x y z] [color r g b] [attenuation constant linear quadratic]
+//   object   <mesh> <lit | parallax> [material t] [emission t] [normal t] [surface t] [virtual t]
+//            [position x y z] [scale s | scale x y z] [rotate ax ay az angle] [spin radians/s] [light index]
+//   repeat   <nx> <ny> <nz> <dx> <dy> <dz> object ...   an nx*ny*nz grid of the object, dx apart along x and so on
+const unsigned int SCENE_MAGIC = 0x4e435347; // "GSCN"
+const unsigned int SCENE_VERSION = 2;
+const unsigned int SCENE_ALIGNMENT = 64;
+
+enum SceneAssetKind
+{
+    SCENE_TEXTURE,
+    SCENE_PACKED,
+    SCENE_NORMAL,
+    SCENE_VIRTUAL,
+    SCENE_CUBEMAP,
+    SCENE_MESH
+};
+
+enum ScenePass
+{
+    SCENE_LIT,     // lights_frag.glsl / shadow_mapping_frag.glsl: material (rgb + specular) and emission
+    SCENE_PARALLAX // parallax_mapping_frag.glsl: material (albedo), normal and surface maps
+};
+
+struct SceneHeader
+{
+    unsigned int magic, version;
+    unsigned int assetCount, objectCount, lightCount, pathCount;
+    unsigned long long skybox; // cubemap asset, 0 for none
+    float camera[3];
+    unsigned int hasCamera;
+    float cellSize;
+    unsigned int cellCount, cellAssetCount;
+    unsigned int padding;
+    unsigned long long assetsOffset, objectsOffset, lightsOffset, cellsOffset, cellAssetsOffset;
+    unsigned long long pathsOffset, stringsOffset, stringsSize;
+};
+
+struct SceneAsset
+{
+    unsigned long long id;
+    unsigned int kind;
+    unsigned int name;                // offset into the strings
+    unsigned int firstPath, pathCount; // range of the path table
+};
+
+struct SceneObject
+{
+    unsigned long long mesh;
+    unsigned long long material, emission, normal, surface, virtualTexture; // 0 for none
+    float position[3], scale[3];
+    float axis[3], angle, spin; // model = translate(position) * rotate(angle + spin * time, axis) * scale
+    unsigned int pass;
+    unsigned int light; // the light a parallax object is lit by
+    float radius;       // of a sphere around position holding the object however it turns
+};
+
+struct SceneCell
+{
+    int x, z;                       // position in the grid, the cell spans x * cellSize to (x + 1) * cellSize
+    float boundsMin[3], boundsMax[3]; // of its objects, which may reach past the cell
+    unsigned int firstObject, objectCount;
+    unsigned int firstAsset, assetCount; // range of the cell assets
+};
+
+struct SceneLight
+{
+    float position[3], color[3];
+    float constant, linear, quadratic;
+    float reserved[3];
+};
+
+inline unsigned long long sceneAssetId(const std::string &name)
+{
+    return archiveHash(name.data(), name.size());
+}
+
+// the builtin meshes generated at load time, NULL for any other mesh
+inline const Primitive *scenePrimitive(const std::string &mesh)
+{
+    static const Primitive sphere = Primitive::sphere(1.0f), torus = Primitive::torus(0.9f, 0.4f);
+    static const Primitive cylinder = Primitive::cylinder(0.5f, 1.0f), capsule = Primitive::capsule(0.5f, 1.0f);
+    if (mesh == "builtin:sphere")
+        return &sphere;
+    if (mesh == "builtin:torus")
+        return &torus;
+    if (mesh == "builtin:cylinder")
+        return &cylinder;
+    if (mesh == "builtin:capsule")
+        return &capsule;
+    return NULL;
+}
+
+
+// A .gscene in memory: a view over the file, nothing is copied
+class SceneFile
+{
+public:
+    const SceneHeader *header;
+    const SceneAsset *assets;
+    const SceneObject *objects;
+    const SceneLight *lights;
+    const SceneCell *cells;
+    const unsigned int *cellAssets;
+
+    SceneFile() : header(NULL), assets(NULL), objects(NULL), lights(NULL), cells(NULL), cellAssets(NULL), paths(NULL),
+                  strings(NULL) {}
+
+    // a .gscene, or a .scene: its cooked .gscene (cooked/<name>.gscene next to it) when there is one,
+    // otherwise the text compiled in memory
+    bool load(const std::string &path, std::string &error)
+    {
+        std::string cooked = path;
+        if (endsWith(path, ".scene"))
+        {
+            size_t slash = path.find_last_of("/\\");
+            size_t start = slash == std::string::npos ? 0 : slash + 1;
+            cooked = path.substr(0, start) + "cooked/" + path.substr(start, path.size() - start - 6) + ".gscene";
+        }
+        AssetSpan span = FileSystem::map(cooked);
+        if (span.valid() || cooked == path)
+            return open(span, cooked, error);
+        AssetSpan text = FileSystem::read(path);
+        if (!text.valid())
+        {
+            error = "can't read " + path;
+            return false;
+        }
+        std::shared_ptr<std::vector<unsigned char> > compiled(new std::vector<unsigned char>());
+        if (!compile((const char *)text.data, text.size, path, *compiled, error))
+            return false;
+        AssetSpan memory;
+        memory.storage = compiled;
+        memory.data = compiled->data();
+        memory.size = compiled->size();
+        return open(memory, path, error);
+    }
+
+    // checks every section lies inside the file and points the tables at it
+    bool open(const AssetSpan &span, const std::string &name, std::string &error)
+    {
+        file = span;
+        if (!file.valid() || file.size < sizeof(SceneHeader))
+        {
+            error = "can't read " + name;
+            return false;
+        }
+        header = (const SceneHeader *)file.data;
+        if (header->magic != SCENE_MAGIC || header->version != SCENE_VERSION)
+        {
+            error = name + " is not a version " + std::to_string(SCENE_VERSION) + " .gscene";
+            return false;
+        }
+        if (!inside(header->assetsOffset, (unsigned long long)header->assetCount * sizeof(SceneAsset)) ||
+            !inside(header->objectsOffset, (unsigned long long)header->objectCount * sizeof(SceneObject)) ||
+            !inside(header->lightsOffset, (unsigned long long)header->lightCount * sizeof(SceneLight)) ||
+            !inside(header->cellsOffset, (unsigned long long)header->cellCount * sizeof(SceneCell)) ||
+            !inside(header->cellAssetsOffset, (unsigned long long)header->cellAssetCount * 4) ||
+            !inside(header->pathsOffset, (unsigned long long)header->pathCount * 4) ||
+            !inside(header->stringsOffset, header->stringsSize) || !header->stringsSize ||
+            file.data[header->stringsOffset + header->stringsSize - 1] != 0)
+        {
+            error = name + " is truncated";
+            return false;
+        }
+        assets = (const SceneAsset *)(file.data + header->assetsOffset);
+        objects = (const SceneObject *)(file.data + header->objectsOffset);
+        lights = (const SceneLight *)(file.data + header->lightsOffset);
+        cells = (const SceneCell *)(file.data + header->cellsOffset);
+        cellAssets = (const unsigned int *)(file.data + header->cellAssetsOffset);
+        paths = (const unsigned int *)(file.data + header->pathsOffset);
+        strings = (const char *)(file.data + header->stringsOffset);
+        for (unsigned int i = 0; i < header->assetCount; ++i)
+            if (assets[i].name >= header->stringsSize ||
+                (unsigned long long)assets[i].firstPath + assets[i].pathCount > header->pathCount)
+            {
+                error = name + ": asset " + std::to_string(i) + " is out of range";
+                return false;
+            }
+        for (unsigned int i = 0; i < header->cellCount; ++i)
+            if ((unsigned long long)cells[i].firstObject + cells[i].objectCount > header->objectCount ||
+                (unsigned long long)cells[i].firstAsset + cells[i].assetCount > header->cellAssetCount)
+            {
+                error = name + ": cell " + std::to_string(i) + " is out of range";
+                return false;
+            }
+        for (unsigned int i = 0; i < header->cellAssetCount; ++i)
+            if (cellAssets[i] >= header->assetCount)
+            {
+                error = name + ": a cell asset is out of range";
+                return false;
+            }
+        for (unsigned int i = 0; i < header->pathCount; ++i)
+            if (paths[i] >= header->stringsSize)
+            {
+                error = name + ": path " + std::to_string(i) + " is out of range";
+                return false;
+            }
+        return true;
+    }
+
+    // index of the asset with this id, -1 when there's none (or id is 0)
+    int find(unsigned long long id) const
+    {
+        if (!id)
+            return -1;
+        const SceneAsset *end = assets + header->assetCount;
+        const SceneAsset *asset = std::lower_bound(assets, end, id,
+            [](const SceneAsset &a, unsigned long long id) { return a.id < id; });
+        return asset != end && asset->id == id ? (int)(asset - assets) : -1;
+    }
+
+    // index of the cell at x, z in the grid, -1 when it has no objects
+    int findCell(int x, int z) const
+    {
+        const SceneCell *end = cells + header->cellCount;
+        const SceneCell *cell = std::lower_bound(cells, end, std::make_pair(x, z),
+            [](const SceneCell &c, const std::pair<int, int> &key) { return c.x != key.first ? c.x < key.first : c.z < key.second; });
+        return cell != end && cell->x == x && cell->z == z ? (int)(cell - cells) : -1;
+    }
+
+    const char *name(const SceneAsset &asset) const { return strings + asset.name; }
+    const char *path(const SceneAsset &asset, unsigned int i) const { return strings + paths[asset.firstPath + i]; }
+
+    // textures and cooked meshes are streamed by cell, cubemaps and virtual textures (which page themselves)
+    // stay loaded
+    static bool streamed(const SceneAsset &asset, const char *firstPath)
+    {
+        return asset.kind == SCENE_TEXTURE || asset.kind == SCENE_PACKED || asset.kind == SCENE_NORMAL ||
+               (asset.kind == SCENE_MESH && strncmp(firstPath, "builtin:", 8) != 0);
+    }
+
+    // asset paths are relative to the source root unless absolute; packed sources may be constants ("0.2"),
+    // which stay as they are
+    static std::string resolve(const char *path)
+    {
+        return strchr(path, '/') && path[0] != '/' ? FileSystem::getPath(path) : std::string(path);
+    }
+
+    // the text form to a .gscene image; errors name the line. The cooked meshes read to size the objects
+    // go to dependencies.
+    static bool compile(const char *text, size_t size, const std::string &name, std::vector<unsigned char> &out,
+                        std::string &error, std::vector<std::string> *dependencies = NULL)
+    {
+        Compiler compiler(name);
+        std::string line;
+        const char *p = text, *end = text + size;
+        while (p < end)
+        {
+            const char *eol = p;
+            while (eol < end && *eol != '\n')
+                ++eol;
+            line.assign(p, eol);
+            p = eol + 1;
+            ++compiler.lineNumber;
+            if (!compiler.directive(line, error))
+                return false;
+        }
+        if (!compiler.finish(out, error))
+            return false;
+        if (dependencies)
+            dependencies->insert(dependencies->end(), compiler.meshFiles.begin(), compiler.meshFiles.end());
+        return true;
+    }
+
+    static bool write(const std::string &path, const std::vector<unsigned char> &data, std::string &error)
+    {
+        std::ofstream file(path.c_str(), std::ios::binary);
+        if (!file || !file.write((const char *)data.data(), data.size()))
+        {
+            error = "can't write " + path;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const unsigned int *paths;
+    const char *strings;
+    AssetSpan file;
+
+    bool inside(unsigned long long offset, unsigned long long size) const
+    {
+        return offset <= file.size && size <= file.size - offset;
+    }
+
+    static bool endsWith(const std::string &s, const char *suffix)
+    {
+        size_t length = strlen(suffix);
+        return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+    }
+
+    struct Reference
+    {
+        int line;
+        std::string name;
+        int kind; // -1 for any 2D texture
+    };
+
+    struct Compiler
+    {
+        std::string name;
+        int lineNumber;
+        std::vector<SceneAsset> assets;
+        std::vector<std::string> assetNames;
+        std::vector<SceneObject> objects;
+        std::vector<Reference> references; // checked at the end, assets may come after the objects using them
+        std::vector<SceneLight> lights;
+        std::vector<std::pair<int, unsigned int> > parallaxLights; // line, light
+        std::vector<unsigned int> paths;
+        std::string strings;
+        std::string skybox;
+        float camera[3];
+        bool hasCamera;
+        float cellSize;
+        std::vector<std::string> meshFiles; // read by radiusOf
+
+        explicit Compiler(const std::string &name) : name(name), lineNumber(0), hasCamera(false), cellSize(0.0f)
+        {
+            camera[0] = camera[1] = camera[2] = 0.0f;
+            strings.push_back('\0'); // offset 0 is the empty string
+        }
+
+        bool fail(std::string &error, const std::string &message) const
+        {
+            error = name + ":" + std::to_string(lineNumber) + ": " + message;
+            return false;
+        }
+
+        static bool number(const std::string &token, float &value)
+        {
+            char *end;
+            value = strtof(token.c_str(), &end);
+            return !token.empty() && *end == 0;
+        }
+
+        bool numbers(const std::vector<std::string> &tokens, size_t &i, float *values, int count, std::string &error) const
+        {
+            size_t start = i;
+            for (int k = 0; k < count; ++k)
+                if (++i >= tokens.size() || !number(tokens[i], values[k]))
+                    return fail(error, tokens[start] + " takes " + std::to_string(count) + (count > 1 ? " numbers" : " number"));
+            return true;
+        }
+
+        unsigned int string(const std::string &s)
+        {
+            unsigned int offset = (unsigned int)strings.size();
+            strings += s;
+            strings.push_back('\0');
+            return offset;
+        }
+
+        bool directive(const std::string &line, std::string &error)
+        {
+            std::vector<std::string> tokens;
+            std::istringstream stream(line.substr(0, line.find('#')));
+            std::string token;
+            while (stream >> token)
+                tokens.push_back(token);
+            if (tokens.empty())
+                return true;
+            const std::string &kind = tokens[0];
+            static const char *assetKinds[] = { "texture", "packed", "normal", "virtual", "cubemap", "mesh" };
+            for (int k = 0; k < 6; ++k)
+                if (kind == assetKinds[k])
+                    return asset((SceneAssetKind)k, tokens, error);
+            if (kind == "skybox")
+            {
+                if (tokens.size() != 2)
+                    return fail(error, "skybox takes a cubemap");
+                skybox = tokens[1];
+                return true;
+            }
+            if (kind == "camera")
+            {
+                size_t i = 0;
+                hasCamera = true;
+                return numbers(tokens, i, camera, 3, error);
+            }
+            if (kind == "cells")
+            {
+                size_t i = 0;
+                return numbers(tokens, i, &cellSize, 1, error);
+            }
+            if (kind == "light")
+                return light(tokens, error);
+            if (kind == "object")
+                return object(tokens, 0, NULL, error);
+            if (kind == "repeat")
+            {
+                float grid[6];
+                size_t i = 0;
+                if (!numbers(tokens, i, grid, 6, error))
+                    return false;
+                if (tokens.size() < 8 || tokens[7] != "object")
+                    return fail(error, "repeat takes a grid and an object");
+                return object(tokens, 7, grid, error);
+            }
+            return fail(error, "unknown directive " + kind);
+        }
+
+        bool asset(SceneAssetKind kind, const std::vector<std::string> &tokens, std::string &error)
+        {
+            static const int minPaths[] = { 1, 2, 2, 1, 6, 1 }, maxPaths[] = { 1, 64, 2, 1, 6, 1 };
+            int count = (int)tokens.size() - 2;
+            if (count < minPaths[kind] || count > maxPaths[kind])
+                return fail(error, tokens[0] + " takes a name and " + std::to_string(minPaths[kind]) +
+                                       (minPaths[kind] == maxPaths[kind] ? "" : " or more") + " paths");
+            if (std::find(assetNames.begin(), assetNames.end(), tokens[1]) != assetNames.end())
+                return fail(error, "asset " + tokens[1] + " is defined twice");
+            SceneAsset asset;
+            asset.id = sceneAssetId(tokens[1]);
+            for (size_t i = 0; i < assets.size(); ++i)
+                if (assets[i].id == asset.id)
+                    return fail(error, "the ids of " + tokens[1] + " and " + assetNames[i] + " collide, rename one");
+            asset.kind = kind;
+            asset.name = string(tokens[1]);
+            asset.firstPath = (unsigned int)paths.size();
+            asset.pathCount = (unsigned int)count;
+            for (int i = 0; i < count; ++i)
+                paths.push_back(string(tokens[2 + i]));
+            if (kind == SCENE_MESH && tokens[2].compare(0, 8, "builtin:") == 0 && tokens[2] != "builtin:floor" &&
+                tokens[2] != "builtin:cube" && tokens[2] != "builtin:wall" && !scenePrimitive(tokens[2]))
+                return fail(error, "unknown builtin mesh " + tokens[2]);
+            assets.push_back(asset);
+            assetNames.push_back(tokens[1]);
+            return true;
+        }
+
+        bool light(const std::vector<std::string> &tokens, std::string &error)
+        {
+            SceneLight light;
+            memset(&light, 0, sizeof(light));
+            light.color[0] = light.color[1] = light.color[2] = 1.0f;
+            light.constant = 1.0f;
+            light.linear = 0.09f;
+            light.quadratic = 0.032f;
+            for (size_t i = 1; i < tokens.size(); ++i)
+            {
+                bool read;
+                if (tokens[i] == "position")
+                    read = numbers(tokens, i, light.position, 3, error);
+                else if (tokens[i] == "color")
+                    read = numbers(tokens, i, light.color, 3, error);
+                else if (tokens[i] == "attenuation")
+                    read = numbers(tokens, i, &light.constant, 3, error);
+                else
+                    return fail(error, "unknown light property " + tokens[i]);
+                if (!read)
+                    return false;
+            }
+            lights.push_back(light);
+            return true;
+        }
+
+        bool object(const std::vector<std::string> &tokens, size_t first, const float *grid, std::string &error)
+        {
+            if (tokens.size() < first + 3)
+                return fail(error, "object takes a mesh and a pass");
+            SceneObject object;
+            memset(&object, 0, sizeof(object));
+            object.mesh = sceneAssetId(tokens[first + 1]);
+            reference(tokens[first + 1], SCENE_MESH);
+            if (tokens[first + 2] == "lit")
+                object.pass = SCENE_LIT;
+            else if (tokens[first + 2] == "parallax")
+                object.pass = SCENE_PARALLAX;
+            else
+                return fail(error, "unknown pass " + tokens[first + 2]);
+            object.scale[0] = object.scale[1] = object.scale[2] = 1.0f;
+            object.axis[1] = 1.0f;
+            for (size_t i = first + 3; i < tokens.size(); ++i)
+            {
+                const std::string &key = tokens[i];
+                unsigned long long *texture = key == "material" ? &object.material : key == "emission" ? &object.emission :
+                                              key == "normal" ? &object.normal : key == "surface" ? &object.surface :
+                                              key == "virtual" ? &object.virtualTexture : NULL;
+                bool read = true;
+                if (texture)
+                {
+                    if (++i >= tokens.size())
+                        return fail(error, key + " takes a texture");
+                    *texture = sceneAssetId(tokens[i]);
+                    reference(tokens[i], key == "virtual" ? SCENE_VIRTUAL : -1);
+                }
+                else if (key == "position")
+                    read = numbers(tokens, i, object.position, 3, error);
+                else if (key == "scale")
+                {
+                    float s[3];
+                    int count = 0;
+                    while (count < 3 && i + 1 < tokens.size() && number(tokens[i + 1], s[count]))
+                        ++i, ++count;
+                    if (count != 1 && count != 3)
+                        return fail(error, "scale takes 1 or 3 numbers");
+                    for (int c = 0; c < 3; ++c)
+                        object.scale[c] = s[count == 1 ? 0 : c];
+                }
+                else if (key == "rotate")
+                {
+                    float rotation[4];
+                    read = numbers(tokens, i, rotation, 4, error);
+                    memcpy(object.axis, rotation, sizeof(object.axis));
+                    object.angle = rotation[3];
+                }
+                else if (key == "spin")
+                    read = numbers(tokens, i, &object.spin, 1, error);
+                else if (key == "light")
+                {
+                    float index;
+                    read = numbers(tokens, i, &index, 1, error);
+                    object.light = (unsigned int)std::max(index, 0.0f);
+                }
+                else
+                    return fail(error, "unknown object property " + key);
+                if (!read)
+                    return false;
+            }
+            float length = std::sqrt(object.axis[0] * object.axis[0] + object.axis[1] * object.axis[1] + object.axis[2] * object.axis[2]);
+            if (length == 0.0f)
+                return fail(error, "the rotation axis is zero");
+            for (int c = 0; c < 3; ++c)
+                object.axis[c] /= length;
+
+            int counts[3] = { 1, 1, 1 };
+            if (grid)
+                for (int c = 0; c < 3; ++c)
+                {
+                    counts[c] = (int)grid[c];
+                    if (counts[c] < 1)
+                        return fail(error, "repeat counts must be at least 1");
+                }
+            for (int x = 0; x < counts[0]; ++x)
+                for (int y = 0; y < counts[1]; ++y)
+                    for (int z = 0; z < counts[2]; ++z)
+                    {
+                        SceneObject copy = object;
+                        if (grid)
+                        {
+                            copy.position[0] += x * grid[3];
+                            copy.position[1] += y * grid[4];
+                            copy.position[2] += z * grid[5];
+                        }
+                        objects.push_back(copy);
+                    }
+            if (object.pass == SCENE_PARALLAX)
+                parallaxLights.push_back(std::make_pair(lineNumber, object.light));
+            return true;
+        }
+
+        void reference(const std::string &asset, int kind)
+        {
+            Reference r = { lineNumber, asset, kind };
+            references.push_back(r);
+        }
+
+        // resolves references, then lays the file out
+        bool finish(std::vector<unsigned char> &out, std::string &error)
+        {
+            if (!skybox.empty())
+                reference(skybox, SCENE_CUBEMAP);
+            for (size_t i = 0; i < references.size(); ++i)
+            {
+                lineNumber = references[i].line;
+                if (!check(references[i].name, references[i].kind, error))
+                    return false;
+            }
+            for (size_t i = 0; i < parallaxLights.size(); ++i)
+                if (parallaxLights[i].second >= lights.size())
+                {
+                    lineNumber = parallaxLights[i].first;
+                    return fail(error, "the scene has no light " + std::to_string(parallaxLights[i].second));
+                }
+            if (cellSize < 0.0f)
+                return fail(error, "the cell size is negative");
+            std::vector<std::pair<unsigned long long, std::string> > meshPaths; // id, first path
+            for (size_t i = 0; i < assets.size(); ++i)
+                meshPaths.push_back(std::make_pair(assets[i].id, strings.c_str() + paths[assets[i].firstPath]));
+            std::sort(assets.begin(), assets.end(), [](const SceneAsset &a, const SceneAsset &b) { return a.id < b.id; });
+            std::sort(meshPaths.begin(), meshPaths.end());
+            std::vector<float> meshRadius(assets.size());
+            for (size_t i = 0; i < assets.size(); ++i)
+                meshRadius[i] = assets[i].kind == SCENE_MESH ? radiusOf(meshPaths[i].second) : 0.0f;
+
+            std::vector<unsigned int> cellAssets;
+            std::vector<SceneCell> cells;
+            layoutCells(meshRadius, cells, cellAssets);
+
+            SceneHeader header;
+            memset(&header, 0, sizeof(header));
+            header.magic = SCENE_MAGIC;
+            header.version = SCENE_VERSION;
+            header.assetCount = (unsigned int)assets.size();
+            header.objectCount = (unsigned int)objects.size();
+            header.lightCount = (unsigned int)lights.size();
+            header.pathCount = (unsigned int)paths.size();
+            header.skybox = skybox.empty() ? 0 : sceneAssetId(skybox);
+            memcpy(header.camera, camera, sizeof(camera));
+            header.hasCamera = hasCamera;
+            header.cellSize = cellSize;
+            header.cellCount = (unsigned int)cells.size();
+            header.cellAssetCount = (unsigned int)cellAssets.size();
+            header.assetsOffset = align(sizeof(SceneHeader));
+            header.objectsOffset = align(header.assetsOffset + assets.size() * sizeof(SceneAsset));
+            header.lightsOffset = align(header.objectsOffset + objects.size() * sizeof(SceneObject));
+            header.cellsOffset = align(header.lightsOffset + lights.size() * sizeof(SceneLight));
+            header.cellAssetsOffset = align(header.cellsOffset + cells.size() * sizeof(SceneCell));
+            header.pathsOffset = align(header.cellAssetsOffset + cellAssets.size() * 4);
+            header.stringsOffset = align(header.pathsOffset + paths.size() * 4);
+            header.stringsSize = strings.size();
+
+            out.assign((size_t)(header.stringsOffset + header.stringsSize), 0);
+            memcpy(&out[0], &header, sizeof(header));
+            copy(out, header.assetsOffset, assets.data(), assets.size() * sizeof(SceneAsset));
+            copy(out, header.objectsOffset, objects.data(), objects.size() * sizeof(SceneObject));
+            copy(out, header.lightsOffset, lights.data(), lights.size() * sizeof(SceneLight));
+            copy(out, header.cellsOffset, cells.data(), cells.size() * sizeof(SceneCell));
+            copy(out, header.cellAssetsOffset, cellAssets.data(), cellAssets.size() * 4);
+            copy(out, header.pathsOffset, paths.data(), paths.size() * 4);
+            copy(out, header.stringsOffset, strings.data(), strings.size());
+            return true;
+        }
+
+        bool check(const std::string &asset, int kind, std::string &error) const
+        {
+            static const char *kinds[] = { "texture", "packed texture", "normal map", "virtual texture", "cubemap", "mesh" };
+            for (size_t i = 0; i < assets.size(); ++i)
+                if (assetNames[i] == asset)
+                {
+                    bool texture = assets[i].kind == SCENE_TEXTURE || assets[i].kind == SCENE_PACKED || assets[i].kind == SCENE_NORMAL;
+                    if (kind < 0 ? !texture : assets[i].kind != (unsigned int)kind)
+                        return fail(error, asset + " is a " + kinds[assets[i].kind] + ", not a " + (kind < 0 ? "texture" : kinds[kind]));
+                    return true;
+                }
+            return fail(error, "undefined asset " + asset);
+        }
+
+        // bounding sphere radius around the origin of a mesh, in its own units; a cooked mesh that isn't
+        // there yet counts as 1
+        float radiusOf(const std::string &mesh)
+        {
+            if (mesh == "builtin:floor")
+                return std::sqrt(7.0f * 7.0f + 0.5f * 0.5f + 10.0f * 10.0f);
+            if (mesh == "builtin:cube")
+                return std::sqrt(3.0f);
+            if (mesh == "builtin:wall")
+                return std::sqrt(2.0f);
+            if (const Primitive *primitive = scenePrimitive(mesh))
+                return primitive->radius();
+            MeshFile file;
+            std::string error;
+            meshFiles.push_back(resolve(mesh.c_str()));
+            if (!file.open(FileSystem::map(meshFiles.back()), mesh, error))
+                return 1.0f;
+            const float *c = file.header->center;
+            return std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]) + file.header->radius;
+        }
+
+        // sorts the objects (with assets already sorted) by cell and fills in the cells
+        void layoutCells(const std::vector<float> &meshRadius, std::vector<SceneCell> &cells, std::vector<unsigned int> &cellAssets)
+        {
+            std::vector<std::pair<std::pair<int, int>, unsigned int> > keys(objects.size()); // cell, object
+            for (size_t i = 0; i < objects.size(); ++i)
+            {
+                SceneObject &o = objects[i];
+                int mesh = indexOf(o.mesh);
+                float scale = std::max(std::fabs(o.scale[0]), std::max(std::fabs(o.scale[1]), std::fabs(o.scale[2])));
+                o.radius = meshRadius[mesh] * scale;
+                keys[i].first = cellSize > 0.0f ? std::make_pair((int)std::floor(o.position[0] / cellSize), (int)std::floor(o.position[2] / cellSize))
+                                                : std::make_pair(0, 0);
+                keys[i].second = (unsigned int)i;
+            }
+            std::sort(keys.begin(), keys.end()); // by cell, then by the order of the text
+            std::vector<SceneObject> sorted(objects.size());
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                sorted[i] = objects[keys[i].second];
+                if (i == 0 || keys[i].first != keys[i - 1].first)
+                {
+                    SceneCell cell;
+                    memset(&cell, 0, sizeof(cell));
+                    cell.x = keys[i].first.first;
+                    cell.z = keys[i].first.second;
+                    cell.firstObject = (unsigned int)i;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        cell.boundsMin[c] = sorted[i].position[c] - sorted[i].radius;
+                        cell.boundsMax[c] = sorted[i].position[c] + sorted[i].radius;
+                    }
+                    cells.push_back(cell);
+                }
+                SceneCell &cell = cells.back();
+                ++cell.objectCount;
+                for (int c = 0; c < 3; ++c)
+                {
+                    cell.boundsMin[c] = std::min(cell.boundsMin[c], sorted[i].position[c] - sorted[i].radius);
+                    cell.boundsMax[c] = std::max(cell.boundsMax[c], sorted[i].position[c] + sorted[i].radius);
+                }
+            }
+            objects.swap(sorted);
+
+            for (size_t c = 0; c < cells.size(); ++c)
+            {
+                SceneCell &cell = cells[c];
+                std::vector<unsigned int> used;
+                for (unsigned int i = cell.firstObject; i < cell.firstObject + cell.objectCount; ++i)
+                {
+                    const SceneObject &o = objects[i];
+                    const unsigned long long references[] = { o.mesh, o.material, o.emission, o.normal, o.surface };
+                    for (int r = 0; r < 5; ++r)
+                    {
+                        int asset = indexOf(references[r]);
+                        if (asset >= 0 && streamed(assets[asset], strings.c_str() + paths[assets[asset].firstPath]))
+                            used.push_back((unsigned int)asset);
+                    }
+                }
+                std::sort(used.begin(), used.end());
+                used.erase(std::unique(used.begin(), used.end()), used.end());
+                cell.firstAsset = (unsigned int)cellAssets.size();
+                cell.assetCount = (unsigned int)used.size();
+                cellAssets.insert(cellAssets.end(), used.begin(), used.end());
+            }
+        }
+
+        // in the sorted asset table
+        int indexOf(unsigned long long id) const
+        {
+            if (!id)
+                return -1;
+            std::vector<SceneAsset>::const_iterator asset = std::lower_bound(assets.begin(), assets.end(), id,
+                [](const SceneAsset &a, unsigned long long id) { return a.id < id; });
+            return asset != assets.end() && asset->id == id ? (int)(asset - assets.begin()) : -1;
+        }
+
+        static unsigned long long align(unsigned long long offset)
+        {
+            return (offset + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT;
+        }
+
+        static void copy(std::vector<unsigned char> &out, unsigned long long offset, const void *data, size_t size)
+        {
+            if (size)
+                memcpy(&out[(size_t)offset], data, size);
+        }
+    };
+};
+#endif
@@ -4,96 +4,197 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
-#include <string>
+#include <helpers/async_io.h>
+#include <helpers/filesystem.h>
+#include <helpers/log.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
-#include <sstream>
-#include <iostream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// KHR_parallel_shader_compile (and ARB_, same values), not in the generated glad
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+const char SHADER_BINARY_MAGIC[4] = { 'G', 'S', 'H', 'B' };
+
+// A linked program as glGetProgramBinary gave it, in <cache>/<key in hex>.bin:
+//   header | length bytes of the driver's binary
+// The key hashes the sources of every stage with GL_RENDERER and GL_VERSION, so an edited shader or another
+// driver simply misses; a binary the driver rejects anyway (an update that kept the version string) is
+// compiled from source again and replaced.
+struct ShaderBinaryHeader
+{
+    char magic[4];
+    unsigned int format;  // GLenum from glGetProgramBinary
+    unsigned long long key;
+    unsigned int length;
+    unsigned int reserved;
+};
+
+// #defines put in front of a shader's source, right after its #version line, in the order they're set:
+//   Shader lit("basic_vert.glsl", "lights_frag.glsl", nullptr, ShaderDefines().set("NR_POINT_LIGHTS", 4));
+class ShaderDefines
+{
+public:
+    ShaderDefines& set(const std::string& name, const std::string& value = "1")
+    {
+        for(size_t i = 0; i < defines.size(); ++i)
+            if(defines[i].first == name)
+            {
+                defines[i].second = value;
+                return *this;
+            }
+        defines.push_back(std::make_pair(name, value));
+        return *this;
+    }
+
+    ShaderDefines& set(const std::string& name, int value)
+    {
+        return set(name, std::to_string(value));
+    }
+
+    std::string source() const
+    {
+        std::string lines;
+        for(size_t i = 0; i < defines.size(); ++i)
+            lines += "#define " + defines[i].first + " " + defines[i].second + "\n";
+        return lines;
+    }
+
+private:
+    std::vector<std::pair<std::string, std::string> > defines;
+};
+
+// programs built since the start
+struct ShaderCacheStats
+{
+    int programs;
+    int cached;   // loaded from the binary cache, without compiling anything
+    int rejected; // found in the cache but refused by the driver
+    int linking;  // submitted and not ready() yet
+};
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    // constructor generates the shader. Sources may #include "file.glsl" (relative to the including file, each
+    // file once) and are compiled with defines in front of them. Unless it waits, the compilation and link are
+    // only submitted: the driver works on them while the caller goes on, and the program can be used once
+    // ready() says so
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const ShaderDefines& defines = ShaderDefines(), bool wait = true)
+        : ID(0), cacheKey(0), linking(false), linkFailed(false)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
+        // 1. retrieve the vertex/fragment source code from filePath (or the mounted asset archive), all files at once
+        std::vector<std::string> paths;
+        paths.push_back(vertexPath);
+        paths.push_back(fragmentPath);
+        // if geometry shader path is present, also load a geometry shader
+        if(geometryPath != nullptr)
+            paths.push_back(geometryPath);
+        std::vector<std::shared_future<AssetSpan> > sources = fetch(paths);
+        std::vector<std::string> vertexFiles, fragmentFiles, geometryFiles;
+        std::string vertexCode = preprocess(paths[0], readSource(paths[0], sources[0]), defines, vertexFiles);
+        std::string fragmentCode = preprocess(paths[1], readSource(paths[1], sources[1]), defines, fragmentFiles);
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read each file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure e)
+        if(geometryPath != nullptr)
+            geometryCode = preprocess(paths[2], readSource(paths[2], sources[2]), defines, geometryFiles);
+        // 2. a program linked by an earlier run from the same sources on the same driver is loaded as it is
+        cacheKey = binaryKey(vertexCode, fragmentCode, geometryCode);
+        ++cacheStats().programs;
+        if(loadBinary(cacheKey))
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            ++cacheStats().cached;
+            return;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        // 3. compile shaders; no status is asked for until the link is done, which would wait for each in turn
+        stages.push_back(compile(GL_VERTEX_SHADER, vertexCode, "VERTEX" + sourceList(vertexFiles)));
+        stages.push_back(compile(GL_FRAGMENT_SHADER, fragmentCode, "FRAGMENT" + sourceList(fragmentFiles)));
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry = 0;
         if(geometryPath != nullptr)
+            stages.push_back(compile(GL_GEOMETRY_SHADER, geometryCode, "GEOMETRY" + sourceList(geometryFiles)));
+        link(wait);
+    }
+
+    // a compute program (GL 4.3) from one source, #included files and defines as above, through the same
+    // binary cache
+    explicit Shader(const char* computePath, const ShaderDefines& defines = ShaderDefines(), bool wait = true)
+        : ID(0), cacheKey(0), linking(false), linkFailed(false)
+    {
+        std::vector<std::string> paths(1, computePath);
+        std::vector<std::shared_future<AssetSpan> > sources = fetch(paths);
+        std::vector<std::string> computeFiles;
+        std::string computeCode = preprocess(paths[0], readSource(paths[0], sources[0]), defines, computeFiles);
+        cacheKey = binaryKey(computeCode, std::string(), "COMPUTE");
+        ++cacheStats().programs;
+        if(loadBinary(cacheKey))
         {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            ++cacheStats().cached;
+            return;
         }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
+        stages.push_back(compile(GL_COMPUTE_SHADER, computeCode, "COMPUTE" + sourceList(computeFiles)));
+        link(wait);
+    }
 
+    // whether the program can be used. With parallel compilation (see enableParallelCompile) the driver is
+    // asked without waiting; without it this waits for the link
+    bool ready()
+    {
+        if(!linking)
+            return true;
+        if(parallelCompile())
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+            if(!done)
+                return false;
+        }
+        finish();
+        return true;
+    }
+
+    // whether, once ready(), the program failed to compile or link and can't be drawn with
+    bool failed() const { return linkFailed; }
+
+    // lets the driver compile and link on threads of its own when it can (KHR_ or ARB_parallel_shader_compile);
+    // load is what glad was loaded with
+    static bool enableParallelCompile(GLADloadproc load)
+    {
+        typedef void (APIENTRYP MaxShaderCompilerThreads)(GLuint count);
+        static const char* extensions[][2] = { { "GL_KHR_parallel_shader_compile", "glMaxShaderCompilerThreadsKHR" },
+                                               { "GL_ARB_parallel_shader_compile", "glMaxShaderCompilerThreadsARB" } };
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for(int e = 0; e < 2; ++e)
+            for(GLint i = 0; i < count; ++i)
+                if(strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), extensions[e][0]) == 0)
+                {
+                    MaxShaderCompilerThreads maxThreads = (MaxShaderCompilerThreads)load(extensions[e][1]);
+                    if(!maxThreads)
+                        break;
+                    maxThreads(0xFFFFFFFFu); // as many as the driver likes
+                    parallelCompile() = true;
+                    return true;
+                }
+        return false;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -160,10 +261,292 @@ public:
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // starts reading the sources of programs built later, so every file is in flight at once; they stay
+    // around for all the programs that share them
+    static void preload(const std::vector<std::string>& paths)
+    {
+        std::vector<std::shared_future<AssetSpan> > sources = AsyncIO::shared().submit(paths);
+        for(size_t i = 0; i < paths.size(); ++i)
+            preloaded()[paths[i]] = sources[i];
+    }
+
+    static ShaderCacheStats& cacheStats()
+    {
+        static ShaderCacheStats stats = { 0, 0, 0, 0 };
+        return stats;
+    }
+
+    // where linked programs are kept between runs
+    static std::string& cacheDirectory()
+    {
+        static std::string directory = FileSystem::getPath(".shadercache");
+        return directory;
+    }
+
 private:
+    // a compiled stage until the link is done, and what to call it in errors
+    struct Stage
+    {
+        unsigned int shader;
+        std::string type;
+    };
+
+    unsigned long long cacheKey;
+    std::vector<Stage> stages;
+    bool linking;
+    bool linkFailed;
+
+    static bool& parallelCompile()
+    {
+        static bool enabled = false;
+        return enabled;
+    }
+
+    static Stage compile(GLenum type, const std::string& code, const std::string& name)
+    {
+        Stage stage = { glCreateShader(type), name };
+        const char* source = code.c_str();
+        glShaderSource(stage.shader, 1, &source, NULL);
+        glCompileShader(stage.shader);
+        return stage;
+    }
+
+    // links the compiled stages into a new program
+    void link(bool wait)
+    {
+        ID = glCreateProgram();
+        for(int i = 0; i < (int)stages.size(); ++i)
+            glAttachShader(ID, stages[i].shader);
+        if(binarySupported())
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+        linking = true;
+        ++cacheStats().linking;
+        if(wait)
+            finish();
+    }
+
+    // reports what failed, keeps the binary of what linked
+    void finish()
+    {
+        linking = false;
+        --cacheStats().linking;
+        for(size_t i = 0; i < stages.size(); ++i)
+            checkCompileErrors(stages[i].shader, stages[i].type);
+        linkFailed = !checkCompileErrors(ID, "PROGRAM");
+        if(!linkFailed)
+            saveBinary(cacheKey);
+        // delete the shaders as they're linked into our program now and no longer necessery
+        for(size_t i = 0; i < stages.size(); ++i)
+            glDeleteShader(stages[i].shader);
+        stages.clear();
+    }
+
+    static std::map<std::string, std::shared_future<AssetSpan> >& preloaded()
+    {
+        static std::map<std::string, std::shared_future<AssetSpan> > sources;
+        return sources;
+    }
+
+    // preloaded sources, and one batch of reads for the rest
+    static std::vector<std::shared_future<AssetSpan> > fetch(const std::vector<std::string>& paths)
+    {
+        std::vector<std::shared_future<AssetSpan> > sources(paths.size());
+        std::vector<std::string> missing;
+        for(size_t i = 0; i < paths.size(); ++i)
+        {
+            std::map<std::string, std::shared_future<AssetSpan> >::iterator found = preloaded().find(paths[i]);
+            if(found != preloaded().end())
+                sources[i] = found->second;
+            else
+                missing.push_back(paths[i]);
+        }
+        std::vector<std::shared_future<AssetSpan> > read = AsyncIO::shared().submit(missing);
+        for(size_t i = 0, j = 0; i < paths.size(); ++i)
+            if(!sources[i].valid())
+                sources[i] = read[j++];
+        return sources;
+    }
+
+    // source with the files it #includes spliced in and defines after its #version line. Every file gets a
+    // source string number in #line directives, so the compiler's "2:14(3): error" means line 14 of files[2]
+    static std::string preprocess(const std::string& path, const std::string& source, const ShaderDefines& defines,
+                                  std::vector<std::string>& files)
+    {
+        files.assign(1, path);
+        std::string out;
+        expand(path, source, 0, &defines, files, out);
+        return out;
+    }
+
+    static void expand(const std::string& path, const std::string& source, int file, const ShaderDefines* defines,
+                       std::vector<std::string>& files, std::string& out)
+    {
+        int line = 1;
+        for(size_t start = 0; start < source.size(); ++line)
+        {
+            size_t end = source.find('\n', start);
+            if(end == std::string::npos)
+                end = source.size();
+            std::string text = source.substr(start, end - start);
+            start = end + 1;
+
+            size_t first = text.find_first_not_of(" \t");
+            std::string directive = first == std::string::npos ? std::string() : text.substr(first);
+            if(defines && directive.compare(0, 8, "#version") == 0)
+            {
+                out += text + "\n" + defines->source() + "#line " + std::to_string(line + 1) + " " + std::to_string(file) + "\n";
+                continue;
+            }
+            if(directive.compare(0, 8, "#include") != 0)
+            {
+                out += text + "\n";
+                continue;
+            }
+            size_t open = directive.find('"'), close = directive.find('"', open + 1);
+            if(open == std::string::npos || close == std::string::npos)
+            {
+                Log::error("SHADER::BAD_INCLUDE: %s:%d: %s", path, line, directive);
+                out += "\n";
+                continue;
+            }
+            size_t slash = path.find_last_of("/\\");
+            std::string included = (slash == std::string::npos ? std::string() : path.substr(0, slash + 1)) +
+                                   directive.substr(open + 1, close - open - 1);
+            if(std::find(files.begin(), files.end(), included) == files.end())
+            {
+                files.push_back(included);
+                int index = (int)files.size() - 1;
+                std::vector<std::string> one(1, included);
+                out += "#line 1 " + std::to_string(index) + "\n";
+                expand(included, readSource(included, fetch(one)[0]), index, NULL, files, out);
+            }
+            out += "#line " + std::to_string(line + 1) + " " + std::to_string(file) + "\n";
+        }
+    }
+
+    static std::string sourceList(const std::vector<std::string>& files)
+    {
+        std::string list;
+        for(size_t i = 0; i < files.size(); ++i)
+            list += (i ? ", " : " (") + std::to_string(i) + " " + files[i];
+        return list + ")";
+    }
+
+    static std::string readSource(const std::string& path, const std::shared_future<AssetSpan>& file)
+    {
+        AssetSpan source = file.get();
+        if(!source.valid())
+        {
+            Log::error("SHADER::FILE_NOT_SUCCESFULLY_READ: %s", path);
+            return std::string();
+        }
+        return std::string((const char*)source.data, source.size);
+    }
+
+    // program binaries need GL 4.1 (ARB_get_program_binary), and a driver that has at least one format
+    static bool binarySupported()
+    {
+        static int supported = -1;
+        if(supported < 0)
+        {
+            GLint formats = 0;
+            if(GLAD_GL_VERSION_4_1)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            supported = formats > 0;
+        }
+        return supported != 0;
+    }
+
+    static unsigned long long mix(unsigned long long hash, const std::string& s)
+    {
+        return archiveHash(s.c_str(), s.size() + 1) ^ (hash * 1099511628211ull);
+    }
+
+    static unsigned long long binaryKey(const std::string& vertex, const std::string& fragment, const std::string& geometry)
+    {
+        const GLubyte* renderer = glGetString(GL_RENDERER);
+        const GLubyte* version = glGetString(GL_VERSION);
+        unsigned long long key = mix(0, renderer ? (const char*)renderer : "");
+        key = mix(key, version ? (const char*)version : "");
+        return mix(mix(mix(key, vertex), fragment), geometry);
+    }
+
+    static std::string binaryPath(unsigned long long key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", key);
+        return cacheDirectory() + name;
+    }
+
+    bool loadBinary(unsigned long long key)
+    {
+        if(!binarySupported())
+            return false;
+        AssetSpan file = FileSystem::read(binaryPath(key));
+        ShaderBinaryHeader header;
+        if(!file.valid() || file.size < sizeof(header))
+            return false;
+        memcpy(&header, file.data, sizeof(header));
+        if(memcmp(header.magic, SHADER_BINARY_MAGIC, sizeof(header.magic)) != 0 || header.key != key ||
+           header.length != file.size - sizeof(header))
+            return false;
+        ID = glCreateProgram();
+        glProgramBinary(ID, header.format, file.data + sizeof(header), header.length);
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if(success)
+            return true;
+        // a format the driver doesn't take anymore leaves GL_INVALID_ENUM behind
+        while(glGetError() != GL_NO_ERROR)
+            ;
+        glDeleteProgram(ID);
+        ID = 0;
+        ++cacheStats().rejected;
+        return false;
+    }
+
+    void saveBinary(unsigned long long key) const
+    {
+        if(!binarySupported())
+            return;
+        GLint length = 0;
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0)
+            return;
+        std::vector<char> data(sizeof(ShaderBinaryHeader) + length);
+        ShaderBinaryHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SHADER_BINARY_MAGIC, sizeof(header.magic));
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, &length, &format, &data[sizeof(header)]);
+        header.format = format;
+        header.key = key;
+        header.length = (unsigned int)length;
+        memcpy(&data[0], &header, sizeof(header));
+        data.resize(sizeof(header) + length);
+
+#ifdef _WIN32
+        _mkdir(cacheDirectory().c_str());
+#else
+        mkdir(cacheDirectory().c_str(), 0755);
+#endif
+        // written aside and renamed, so another instance never reads half a file
+        std::string path = binaryPath(key), temporary = path + ".tmp";
+        std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        if(!out.write(&data[0], data.size()))
+        {
+            Log::warning("SHADER::BINARY_NOT_SUCCESFULLY_WRITTEN: %s", path);
+            return;
+        }
+        out.close();
+        std::remove(path.c_str());
+        std::rename(temporary.c_str(), path.c_str());
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    static void checkCompileErrors(GLuint shader, std::string type)
+    static bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -173,7 +556,7 @@ private:
             if(!success)
             {
                 glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                Log::error("SHADER_COMPILATION_ERROR of type: %s\n%s\n -- --------------------------------------------------- -- ", type, infoLog);
             }
         }
         else
@@ -182,9 +565,130 @@ private:
             if(!success)
             {
                 glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                Log::error("PROGRAM_LINKING_ERROR of type: %s\n%s\n -- --------------------------------------------------- -- ", type, infoLog);
             }
         }
+        return success != 0;
+    }
+};
+
+// A family of programs from the same files specialized by #defines: the features a draw has (an emission
+// map, a virtual material) are compiled in rather than tested on uniforms. A combination is submitted when
+// it's first asked for (or all of them up front, with submitAll) and compiles while frames go on; until it's
+// ready, or when it fails to build, get() gives the working variant with the most of its features, or the
+// fallback.
+//   ShaderVariants lit("basic_vert.glsl", "lights_frag.glsl", nullptr, {"WITH_EMISSION", "WITH_VIRTUAL_MATERIAL"});
+//   if (Shader *shader = lit.get(2)) // WITH_VIRTUAL_MATERIAL defined
+//       shader->use();
+class ShaderVariants
+{
+public:
+    // bit i of a variant defines features[i] on top of defines
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, const char* geometryPath,
+                   const std::vector<std::string>& features, const ShaderDefines& defines = ShaderDefines())
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath ? geometryPath : ""),
+          features(features), defines(defines), fallback(nullptr)
+    {
+    }
+
+    // called on every variant once it's ready, for the uniforms that never change (sampler units)
+    void configure(const std::function<void(Shader&)>& configuration)
+    {
+        this->configuration = configuration;
+        for(std::map<unsigned int, Variant>::iterator variant = variants.begin(); variant != variants.end(); ++variant)
+            variant->second.configured = false;
+    }
+
+    // drawn with while no variant that fits is ready; a program taking the same vertex inputs and sampling
+    // unit 0, or none to draw nothing meanwhile
+    void setFallback(Shader* shader)
+    {
+        fallback = shader;
+    }
+
+    void submit(unsigned int mask)
+    {
+        if(variants.count(mask))
+            return;
+        ShaderDefines variantDefines = defines;
+        for(size_t i = 0; i < features.size(); ++i)
+            if(mask & (1u << i))
+                variantDefines.set(features[i]);
+        variants[mask].shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(),
+                                               geometryPath.empty() ? nullptr : geometryPath.c_str(), variantDefines, false));
+    }
+
+    // every combination, so they compile together
+    void submitAll()
+    {
+        for(unsigned int mask = 0; mask < 1u << features.size(); ++mask)
+            submit(mask);
+    }
+
+    // the program for mask, or what stands in for it while it compiles; NULL when nothing can
+    Shader* get(unsigned int mask)
+    {
+        submit(mask);
+        if(Shader* shader = readyVariant(mask))
+            return shader;
+        // fewer features: an emission-less look beats a missing object
+        Shader* best = nullptr;
+        int bestFeatures = -1;
+        for(std::map<unsigned int, Variant>::iterator variant = variants.begin(); variant != variants.end(); ++variant)
+        {
+            int count = bitCount(variant->first);
+            if((variant->first & ~mask) == 0 && count > bestFeatures && readyVariant(variant->first))
+            {
+                best = variant->second.shader.get();
+                bestFeatures = count;
+            }
+        }
+        if(best)
+            return best;
+        return fallback && fallback->ready() && !fallback->failed() ? fallback : nullptr;
+    }
+
+    // variants submitted so far
+    int built() const { return (int)variants.size(); }
+
+private:
+    struct Variant
+    {
+        std::unique_ptr<Shader> shader;
+        bool configured;
+        Variant() : configured(false) {}
+    };
+
+    std::string vertexPath, fragmentPath, geometryPath;
+    std::vector<std::string> features;
+    ShaderDefines defines;
+    std::function<void(Shader&)> configuration;
+    std::map<unsigned int, Variant> variants;
+    Shader* fallback;
+
+    ShaderVariants(const ShaderVariants&);
+    ShaderVariants& operator=(const ShaderVariants&);
+
+    Shader* readyVariant(unsigned int mask)
+    {
+        Variant& variant = variants[mask];
+        if(!variant.shader || !variant.shader->ready() || variant.shader->failed())
+            return nullptr;
+        if(!variant.configured && configuration)
+        {
+            variant.shader->use();
+            configuration(*variant.shader);
+        }
+        variant.configured = true;
+        return variant.shader.get();
+    }
+
+    static int bitCount(unsigned int mask)
+    {
+        int count = 0;
+        for(; mask; mask &= mask - 1)
+            ++count;
+        return count;
     }
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,457 @@
+#ifndef SOFTWARE_OCCLUSION_H
+#define SOFTWARE_OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <helpers/log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const int OCCLUSION_TILE = 8;            // pixels across the tiles whose farthest depth a box is tested against first
+const int OCCLUSION_BAND_ROWS = 16;      // rows of the depth buffer a worker takes at a time, whole tiles
+const size_t OCCLUSION_TEST_BOXES = 256; // and boxes to test
+static_assert(OCCLUSION_BAND_ROWS % OCCLUSION_TILE == 0, "a band reduces its own tiles");
+
+// an occluder's triangles, few of them: a box or a quad standing in for what it hides
+struct OccluderMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned short> indices;
+    bool closed; // wound counter-clockwise around a closed volume: its front faces hide the back ones, which are left out
+};
+
+// occluders drawn and boxes tested, summed over the frames since the last report
+struct SoftwareOcclusionStats
+{
+    long long frames, occluders, triangles, tested, hidden;
+    double rasterMs, testMs;
+};
+
+
+// Occlusion culling on the CPU alone, with nothing read back from the GPU and so without one: occluders are
+// drawn into a coarse depth buffer and the bounding boxes of objects tested against it before they are
+// batched. A pixel is written where a triangle covers its centre, with the farthest depth the triangle has over
+// the pixel. Edge functions are worked out from the pixel's own coordinates, the same operations for every
+// triangle: the two triangles sharing an edge get exactly opposite values for it, and a centre on it goes to
+// both rather than neither, so they leave no crack between them. An occluder's edge may leave
+// part of a pixel it was written to uncovered, but not the neighbour across the edge: a box is tested against
+// one pixel more all around than it touches, and is hidden only where something really is in front of it,
+// but for gaps between occluders narrower than a pixel, which close up.
+// Triangles are clipped against the near plane; only a closed occluder's back faces are culled, a quad
+// occludes from both sides.
+// Each tile of OCCLUSION_TILE x OCCLUSION_TILE pixels keeps the farthest of its depths as well: a box is
+// tested against the tiles it touches, and only the pixels of those that don't hide it on their own.
+// rasterize() sets the occluders' triangles up and draws them in bands of rows, test() goes through boxes in
+// runs, both on a pool of workers with the calling thread taking its share. Their inner loops do four
+// pixels at a time with SSE2 where the compiler targets it (any x86-64), one otherwise.
+// Depth is GL's window depth, 0 at the near plane to 1 at the far one; row 0 is the bottom of the view.
+class SoftwareOcclusion
+{
+public:
+    // threads: 0 for one per core, the calling thread counted
+    SoftwareOcclusion(int width, int height, int threads = 0)
+        : bufferWidth((std::max(width, 1) + OCCLUSION_TILE - 1) / OCCLUSION_TILE * OCCLUSION_TILE), bufferHeight(std::max(height, 1)),
+          tilesX(bufferWidth / OCCLUSION_TILE), tilesY((bufferHeight + OCCLUSION_TILE - 1) / OCCLUSION_TILE),
+          depth((size_t)bufferWidth * bufferHeight, 1.0f), tiles((size_t)tilesX * tilesY, 1.0f), job(NULL), parts(0), next(0),
+          busy(0), generation(0), stopping(false)
+    {
+        resetStats();
+        if (threads <= 0)
+            threads = (int)std::max(1u, std::thread::hardware_concurrency());
+        setup.resize(threads);
+        for (int i = 1; i < threads; ++i)
+            workers.push_back(std::thread(&SoftwareOcclusion::serve, this));
+    }
+    ~SoftwareOcclusion()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    // starts a frame seen through viewProjection: no occluders, nothing in the buffer
+    void begin(const glm::mat4 &viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        occluders.clear();
+        std::fill(depth.begin(), depth.end(), 1.0f);
+        std::fill(tiles.begin(), tiles.end(), 1.0f);
+    }
+
+    // mesh placed by model, to be drawn by rasterize(); the mesh has to stay valid until then
+    void addOccluder(const OccluderMesh &mesh, const glm::mat4 &model)
+    {
+        Occluder occluder = { &mesh, viewProjection * model };
+        occluders.push_back(occluder);
+    }
+
+    // draws the occluders added since begin()
+    void rasterize()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int setupParts = (int)std::min(setup.size(), std::max<size_t>(occluders.size(), 1));
+        parallel(setupParts, [&](int part) {
+            std::vector<Triangle> &triangles = setup[part];
+            triangles.clear();
+            for (size_t i = occluders.size() * part / setupParts; i < occluders.size() * (part + 1) / setupParts; ++i)
+                addTriangles(occluders[i], triangles);
+        });
+        long long triangles = 0;
+        for (int part = 0; part < setupParts; ++part)
+            triangles += (long long)setup[part].size();
+        parallel((bufferHeight + OCCLUSION_BAND_ROWS - 1) / OCCLUSION_BAND_ROWS, [&](int band) {
+            int first = band * OCCLUSION_BAND_ROWS, last = std::min(bufferHeight, first + OCCLUSION_BAND_ROWS) - 1;
+            for (int part = 0; part < setupParts; ++part)
+                for (size_t t = 0; t < setup[part].size(); ++t)
+                    draw(setup[part][t], first, last);
+            reduceTiles(first / OCCLUSION_TILE, last / OCCLUSION_TILE);
+        });
+        counters.frames++;
+        counters.occluders += (long long)occluders.size();
+        counters.triangles += triangles;
+        counters.rasterMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // hidden[i]: whether the world space box boxMin[i]..boxMax[i] is behind the occluders; returns how many are
+    size_t test(const glm::vec3 *boxMin, const glm::vec3 *boxMax, size_t count, unsigned char *hidden)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::atomic<size_t> total(0);
+        parallel((int)((count + OCCLUSION_TEST_BOXES - 1) / OCCLUSION_TEST_BOXES), [&](int run) {
+            size_t found = 0;
+            for (size_t i = run * OCCLUSION_TEST_BOXES; i < std::min(count, (run + 1) * OCCLUSION_TEST_BOXES); ++i)
+                found += hidden[i] = occluded(boxMin[i], boxMax[i]);
+            total += found;
+        });
+        counters.tested += (long long)count;
+        counters.hidden += (long long)total;
+        counters.testMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return total;
+    }
+
+    // a box crossing the near plane, or off the buffer, is never behind anything
+    bool occluded(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+    {
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1.0f;
+        // the corners from one of them and the edges along each axis
+        glm::vec3 size = boxMax - boxMin;
+        glm::vec4 origin = viewProjection * glm::vec4(boxMin, 1.0f);
+        glm::vec4 edges[3] = { viewProjection[0] * size.x, viewProjection[1] * size.y, viewProjection[2] * size.z };
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec4 clip = origin;
+            for (int axis = 0; axis < 3; ++axis)
+                if (corner & (1 << axis))
+                    clip += edges[axis];
+            if (clip.z + clip.w <= 0.0f)
+                return false;
+            float scale = 0.5f / clip.w;
+            float x = (clip.x * scale + 0.5f) * bufferWidth, y = (clip.y * scale + 0.5f) * bufferHeight;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearest = std::min(nearest, clip.z * scale + 0.5f);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX >= bufferWidth || minY >= bufferHeight)
+            return false;
+        // every pixel the box's rectangle touches and the ones around, a tile at a time
+        int x0 = std::max((int)std::floor(minX) - 1, 0), x1 = std::min((int)std::floor(maxX) + 1, bufferWidth - 1);
+        int y0 = std::max((int)std::floor(minY) - 1, 0), y1 = std::min((int)std::floor(maxY) + 1, bufferHeight - 1);
+        for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ++ty)
+            for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; ++tx)
+                if (tiles[(size_t)ty * tilesX + tx] >= nearest &&
+                    !behind(nearest, std::max(x0, tx * OCCLUSION_TILE), std::min(x1, tx * OCCLUSION_TILE + OCCLUSION_TILE - 1),
+                            std::max(y0, ty * OCCLUSION_TILE), std::min(y1, ty * OCCLUSION_TILE + OCCLUSION_TILE - 1)))
+                    return false;
+        return true;
+    }
+
+    int width() const { return bufferWidth; }
+    int height() const { return bufferHeight; }
+    // the buffer, row by row from the bottom
+    const float *depthBuffer() const { return depth.data(); }
+    int threads() const { return (int)workers.size() + 1; }
+
+    SoftwareOcclusionStats stats() const { return counters; }
+    void resetStats() { memset(&counters, 0, sizeof(counters)); }
+
+private:
+    struct Occluder
+    {
+        const OccluderMesh *mesh;
+        glm::mat4 clip; // viewProjection * model
+    };
+
+    // set up for pixel (x, y): inside where all three a * x + b * y + c >= 0 at its centre; depth
+    // zx * x + zy * y + z is the farthest over the pixel
+    struct Triangle
+    {
+        float a[3], b[3], c[3];
+        float zx, zy, z;
+        int minX, maxX, minY, maxY;
+    };
+
+    int bufferWidth, bufferHeight; // the width whole tiles, so that rows are whole runs of four
+    int tilesX, tilesY;
+    std::vector<float> depth, tiles; // tiles: the farthest depth of each, row by row
+    glm::mat4 viewProjection;
+    std::vector<Occluder> occluders;
+    std::vector<std::vector<Triangle> > setup; // by part of rasterize()'s setup
+    SoftwareOcclusionStats counters;
+
+    // the pool: parallel() hands parts of a job out, to whoever takes the next one
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const std::function<void(int)> *job;
+    int parts;
+    std::atomic<int> next;
+    int busy;
+    unsigned long long generation;
+    bool stopping;
+
+    SoftwareOcclusion(const SoftwareOcclusion &);
+    SoftwareOcclusion &operator=(const SoftwareOcclusion &);
+
+    // runs work(0) to work(count - 1) on the workers and the calling thread, returns once all are done
+    void parallel(int count, const std::function<void(int)> &work)
+    {
+        if (workers.empty() || count <= 1)
+        {
+            for (int i = 0; i < count; ++i)
+                work(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &work;
+            parts = count;
+            next = 0;
+            busy = (int)workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+        take();
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return busy == 0; });
+    }
+
+    void take()
+    {
+        for (int i; (i = next++) < parts;)
+            (*job)(i);
+    }
+
+    void serve()
+    {
+        Log::nameThread("occlusion");
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            take();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                finished.notify_one();
+        }
+    }
+
+    // the occluder's triangles in clip space, cut by the near plane into up to two each, set up for draw()
+    void addTriangles(const Occluder &occluder, std::vector<Triangle> &triangles) const
+    {
+        const OccluderMesh &mesh = *occluder.mesh;
+        std::vector<glm::vec4> clip(mesh.positions.size());
+        for (size_t i = 0; i < clip.size(); ++i)
+            clip[i] = occluder.clip * glm::vec4(mesh.positions[i], 1.0f);
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+        {
+            glm::vec4 polygon[4];
+            int corners = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                const glm::vec4 &p = clip[mesh.indices[t + k]], &q = clip[mesh.indices[t + (k + 1) % 3]];
+                float dp = p.z + p.w, dq = q.z + q.w;
+                if (dp >= 0.0f)
+                    polygon[corners++] = p;
+                // from the corner in front either way, so that the triangle across the edge gets the same point
+                if (dp >= 0.0f && dq < 0.0f)
+                    polygon[corners++] = p + (q - p) * (dp / (dp - dq));
+                else if (dp < 0.0f && dq >= 0.0f)
+                    polygon[corners++] = q + (p - q) * (dq / (dq - dp));
+            }
+            for (int k = 1; k + 1 < corners; ++k)
+                setUp(polygon[0], polygon[k], polygon[k + 1], mesh.closed, triangles);
+        }
+    }
+
+    void setUp(const glm::vec4 &p0, const glm::vec4 &p1, const glm::vec4 &p2, bool cullBack, std::vector<Triangle> &triangles) const
+    {
+        glm::vec3 v[3];
+        const glm::vec4 *clip[3] = { &p0, &p1, &p2 };
+        for (int k = 0; k < 3; ++k)
+        {
+            float w = std::max(clip[k]->w, 1e-6f);
+            v[k] = glm::vec3((clip[k]->x / w * 0.5f + 0.5f) * bufferWidth, (clip[k]->y / w * 0.5f + 0.5f) * bufferHeight,
+                             clip[k]->z / w * 0.5f + 0.5f);
+        }
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (std::fabs(area) < 1e-6f || (cullBack && area < 0.0f))
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+        Triangle triangle;
+        triangle.minX = std::max((int)std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x))), 0);
+        triangle.maxX = std::min((int)std::floor(std::max(v[0].x, std::max(v[1].x, v[2].x))), bufferWidth - 1);
+        triangle.minY = std::max((int)std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y))), 0);
+        triangle.maxY = std::min((int)std::floor(std::max(v[0].y, std::max(v[1].y, v[2].y))), bufferHeight - 1);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY || std::min(v[0].z, std::min(v[1].z, v[2].z)) >= 1.0f)
+            return;
+        // edge k runs from v[k] to v[k + 1]; its function is the area the point makes with it, v[k + 2]'s weight.
+        // c is worked out the same way round whichever way the edge runs and negated when it runs backwards: a
+        // fused multiply-add may round from.x * to.y - to.x * from.y and its negation differently
+        float c[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            const glm::vec3 &from = v[k], &to = v[(k + 1) % 3];
+            triangle.a[k] = from.y - to.y;
+            triangle.b[k] = to.x - from.x;
+            bool forward = from.x < to.x || (from.x == to.x && from.y < to.y);
+            const glm::vec3 &p = forward ? from : to, &q = forward ? to : from;
+            c[k] = p.x * q.y - q.x * p.y;
+            if (!forward)
+                c[k] = -c[k];
+        }
+        // depth from the weights: v[1]'s is edge 2's, v[2]'s edge 0's
+        float dz1 = (v[1].z - v[0].z) / area, dz2 = (v[2].z - v[0].z) / area;
+        float zx = dz1 * triangle.a[2] + dz2 * triangle.a[0], zy = dz1 * triangle.b[2] + dz2 * triangle.b[0];
+        float z = v[0].z + dz1 * c[2] + dz2 * c[0];
+        // from pixel (x, y) to its centre, and for depth on to the far corner
+        for (int k = 0; k < 3; ++k)
+            triangle.c[k] = c[k] + 0.5f * (triangle.a[k] + triangle.b[k]);
+        triangle.zx = zx;
+        triangle.zy = zy;
+        triangle.z = z + std::max(zx, 0.0f) + std::max(zy, 0.0f);
+        triangles.push_back(triangle);
+    }
+
+    // whether pixels x0..x1, y0..y1 all have something nearer than depth z
+    bool behind(float z, int x0, int x1, int y0, int y1) const
+    {
+        for (int y = y0; y <= y1; ++y)
+        {
+            const float *row = &depth[(size_t)y * bufferWidth];
+            int x = x0;
+#ifdef __SSE2__
+            __m128 box = _mm_set1_ps(z);
+            for (; x + 3 <= x1; x += 4)
+                if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), box)))
+                    return false;
+#endif
+            for (; x <= x1; ++x)
+                if (row[x] >= z)
+                    return false;
+        }
+        return true;
+    }
+
+    // the farthest depth of the tiles in tile rows first..last
+    void reduceTiles(int first, int last)
+    {
+        for (int ty = first; ty <= last; ++ty)
+        {
+            int y0 = ty * OCCLUSION_TILE, y1 = std::min(bufferHeight, y0 + OCCLUSION_TILE);
+            for (int tx = 0; tx < tilesX; ++tx)
+            {
+                float farthest = 0.0f;
+                for (int y = y0; y < y1; ++y)
+                {
+                    const float *row = &depth[(size_t)y * bufferWidth + tx * OCCLUSION_TILE];
+                    for (int x = 0; x < OCCLUSION_TILE; ++x)
+                        farthest = std::max(farthest, row[x]);
+                }
+                tiles[(size_t)ty * tilesX + tx] = farthest;
+            }
+        }
+    }
+
+    // the triangle's pixels in rows first..last, nearer than what is there
+    void draw(const Triangle &triangle, int first, int last)
+    {
+        int y0 = std::max(triangle.minY, first), y1 = std::min(triangle.maxY, last);
+        for (int y = y0; y <= y1; ++y)
+        {
+            // the row's span inside all three edges, a pixel wider against rounding: the edges are tested anyway
+            float left = (float)triangle.minX, right = (float)triangle.maxX;
+            for (int k = 0; k < 3; ++k)
+            {
+                float a = triangle.a[k], e = triangle.b[k] * y + triangle.c[k];
+                if (a > 0.0f)
+                    left = std::max(left, -e / a - 1.0f);
+                else if (a < 0.0f)
+                    right = std::min(right, -e / a + 1.0f);
+                else if (e < 0.0f)
+                    right = -1.0f;
+            }
+            if (left > right)
+                continue;
+            int x0 = (int)left & ~3, x1 = (int)right;
+            float *row = &depth[(size_t)y * bufferWidth];
+            // evaluated afresh at every x rather than stepped, so that a shared edge gets exactly opposite values
+            float e0 = triangle.b[0] * y + triangle.c[0];
+            float e1 = triangle.b[1] * y + triangle.c[1];
+            float e2 = triangle.b[2] * y + triangle.c[2];
+            float z = triangle.zy * y + triangle.z;
+            int x = x0;
+#ifdef __SSE2__
+            const __m128 zero = _mm_setzero_ps(), four = _mm_set1_ps(4.0f);
+            const __m128 a0 = _mm_set1_ps(triangle.a[0]), a1 = _mm_set1_ps(triangle.a[1]), a2 = _mm_set1_ps(triangle.a[2]);
+            const __m128 zx = _mm_set1_ps(triangle.zx);
+            const __m128 edge0 = _mm_set1_ps(e0), edge1 = _mm_set1_ps(e1), edge2 = _mm_set1_ps(e2), depth0 = _mm_set1_ps(z);
+            __m128 xs = _mm_add_ps(_mm_set1_ps((float)x0), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+            for (; x <= x1; x += 4, xs = _mm_add_ps(xs, four))
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, xs), edge0), zero),
+                                                      _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, xs), edge1), zero)),
+                                           _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, xs), edge2), zero));
+                if (_mm_movemask_ps(inside))
+                {
+                    __m128 old = _mm_loadu_ps(row + x), depths = _mm_add_ps(_mm_mul_ps(zx, xs), depth0);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, depths)), _mm_andnot_ps(inside, old)));
+                }
+            }
+#else
+            for (; x <= x1; ++x)
+                if (triangle.a[0] * x + e0 >= 0.0f && triangle.a[1] * x + e1 >= 0.0f && triangle.a[2] * x + e2 >= 0.0f)
+                    row[x] = std::min(row[x], triangle.zx * x + z);
+#endif
+        }
+    }
+};
+#endif
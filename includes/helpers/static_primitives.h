@@ -0,0 +1,270 @@
+#ifndef STATIC_PRIMITIVES_H
+#define STATIC_PRIMITIVES_H
+
+#include <helpers/vertex_layout.h>
+
+#include <array>
+#include <cstddef>
+
+// Indexed primitives generated at compile time: a shape (StaticPlane, StaticBox) says what point and index
+// i are as constexpr functions of i, and staticMesh<Vertex>(shape) expands them into std::arrays, so a
+// constexpr mesh sits in read-only data and is uploaded from there as it is. The vertex type picks the
+// layout (StaticPositionVertex, StaticVertex, StaticTangentVertex) out of the point and packs it: half
+// positions and texcoords, 10_10_10_2 normals and tangents (see helpers/vertex_layout.h). Segment counts are
+// template arguments, sizes constructor arguments. Triangles are counter-clockwise seen from outside;
+// the texture's t runs up, as in GL.
+
+// everything a shape knows about one of its points; vertex types keep what they need
+struct StaticPoint
+{
+    float position[3];
+    float normal[3];
+    float uv[2];
+    float tangent[3];   // along u
+    float bitangent[3]; // along t
+};
+
+constexpr unsigned short staticHalfOne = 0x3C00;
+
+// half positions: the shapes here are sized so their corners are exact in half precision (see staticHalfExact)
+struct StaticPositionVertex
+{
+    unsigned short position[4];
+
+    typedef VertexLayout<VertexHalf3> Layout;
+    static constexpr StaticPositionVertex make(const StaticPoint &p)
+    {
+        return StaticPositionVertex{ { vertexHalf(p.position[0]), vertexHalf(p.position[1]), vertexHalf(p.position[2]), staticHalfOne } };
+    }
+};
+
+struct StaticVertex
+{
+    unsigned short position[4];
+    unsigned int normal;
+    unsigned int uv;
+
+    typedef VertexLayout<VertexHalf3, VertexSnorm1010102, VertexHalf2> Layout;
+    static constexpr StaticVertex make(const StaticPoint &p)
+    {
+        return StaticVertex{ { vertexHalf(p.position[0]), vertexHalf(p.position[1]), vertexHalf(p.position[2]), staticHalfOne },
+                             vertexSnorm1010102(p.normal[0], p.normal[1], p.normal[2]), vertexHalf2(p.uv[0], p.uv[1]) };
+    }
+};
+
+// the bitangent is cross(normal, tangent) times the tangent's w
+constexpr float staticBitangentSign(const StaticPoint &p)
+{
+    return (p.normal[1] * p.tangent[2] - p.normal[2] * p.tangent[1]) * p.bitangent[0] +
+                       (p.normal[2] * p.tangent[0] - p.normal[0] * p.tangent[2]) * p.bitangent[1] +
+                       (p.normal[0] * p.tangent[1] - p.normal[1] * p.tangent[0]) * p.bitangent[2] < 0.0f
+               ? -1.0f
+               : 1.0f;
+}
+
+struct StaticTangentVertex
+{
+    unsigned short position[4];
+    unsigned int normal;
+    unsigned int uv;
+    unsigned int tangent;
+
+    typedef VertexLayout<VertexHalf3, VertexSnorm1010102, VertexHalf2, VertexSnorm1010102> Layout;
+    static constexpr StaticTangentVertex make(const StaticPoint &p)
+    {
+        return StaticTangentVertex{ { vertexHalf(p.position[0]), vertexHalf(p.position[1]), vertexHalf(p.position[2]), staticHalfOne },
+                                    vertexSnorm1010102(p.normal[0], p.normal[1], p.normal[2]), vertexHalf2(p.uv[0], p.uv[1]),
+                                    vertexSnorm1010102(p.tangent[0], p.tangent[1], p.tangent[2], staticBitangentSign(p)) };
+    }
+};
+
+static_assert(sizeof(StaticPositionVertex) == StaticPositionVertex::Layout::bytes && sizeof(StaticVertex) == StaticVertex::Layout::bytes &&
+                  sizeof(StaticTangentVertex) == StaticTangentVertex::Layout::bytes,
+              "static vertices match their layouts");
+
+template <typename Vertex, size_t Vertices, size_t Indices> struct StaticMesh
+{
+    std::array<Vertex, Vertices> vertices;
+    std::array<unsigned short, Indices> indices;
+};
+
+// the faces of an axis-aligned box: a face's normal, the axis u runs along and the one rows run along
+// (down the face seen from outside, so t = 1 - v)
+enum StaticFace
+{
+    STATIC_RIGHT,  // +x
+    STATIC_LEFT,   // -x
+    STATIC_UP,     // +y
+    STATIC_DOWN,   // -y
+    STATIC_FRONT,  // +z
+    STATIC_BACK    // -z
+};
+
+constexpr float STATIC_FACE_AXES[6][3][3] = {
+    { { 1, 0, 0 }, { 0, 0, -1 }, { 0, -1, 0 } }, { { -1, 0, 0 }, { 0, 0, 1 }, { 0, -1, 0 } },
+    { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },   { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+    { { 0, 0, 1 }, { 1, 0, 0 }, { 0, -1, 0 } },  { { 0, 0, -1 }, { -1, 0, 0 }, { 0, -1, 0 } } };
+
+// index j of patches of columns x rows quads, two triangles a quad; a patch's vertices come row by row
+constexpr unsigned short staticGridIndex(size_t columns, size_t rows, size_t j, bool inward)
+{
+    // corner k of the quad's triangles, 1 bit a corner: outward (x,y) (x,y+1) (x+1,y) (x+1,y) (x,y+1) (x+1,y+1)
+    return (unsigned short)((j / 6 / (columns * rows)) * (columns + 1) * (rows + 1) +
+                            ((j / 6 % (columns * rows)) / columns + (((inward ? 52 : 50) >> (j % 6)) & 1)) * (columns + 1) +
+                            (j / 6 % (columns * rows)) % columns + (((inward ? 26 : 44) >> (j % 6)) & 1));
+}
+
+constexpr StaticPoint staticPoint(float px, float py, float pz, float nx, float ny, float nz, float u, float t, const float *tangent, const float *down)
+{
+    return StaticPoint{ { px, py, pz }, { nx, ny, nz }, { u, t }, { tangent[0], tangent[1], tangent[2] }, { -down[0], -down[1], -down[2] } };
+}
+
+// a rectangle facing out of one of the box faces' directions, offset along it, centred on that axis
+template <size_t Columns, size_t Rows> class StaticPlane
+{
+public:
+    static const size_t vertexCount = (Columns + 1) * (Rows + 1);
+    static const size_t indexCount = Columns * Rows * 6;
+    static_assert(Columns > 0 && Rows > 0 && vertexCount <= 0x10000, "StaticPlane: 1 to 65536 vertices");
+
+    // texture coordinates run 0..uScale along the width and 0..tScale along the height
+    constexpr StaticPlane(StaticFace face, float width, float height, float offset = 0.0f, float uScale = 1.0f, float tScale = 1.0f)
+        : face(face), width(width), height(height), offset(offset), uScale(uScale), tScale(tScale)
+    {
+    }
+
+    constexpr StaticPoint point(size_t i) const
+    {
+        return at(STATIC_FACE_AXES[face], (float)(i % (Columns + 1)) / Columns, (float)(i / (Columns + 1)) / Rows);
+    }
+
+    constexpr unsigned short index(size_t j) const
+    {
+        return staticGridIndex(Columns, Rows, j, false);
+    }
+
+private:
+    StaticFace face;
+    float width, height, offset, uScale, tScale;
+
+    constexpr float coordinate(const float (*axes)[3], float u, float v, int c) const
+    {
+        return axes[0][c] * offset + (u - 0.5f) * width * axes[1][c] + (v - 0.5f) * height * axes[2][c];
+    }
+
+    constexpr StaticPoint at(const float (*axes)[3], float u, float v) const
+    {
+        return staticPoint(coordinate(axes, u, v, 0), coordinate(axes, u, v, 1), coordinate(axes, u, v, 2), axes[0][0], axes[0][1], axes[0][2],
+                           u * uScale, (1.0f - v) * tScale, axes[1], axes[2]);
+    }
+};
+
+// an axis-aligned box around the origin, Segments x Segments quads a face; an inward one (a skybox) faces
+// and winds into the box
+template <size_t Segments> class StaticBox
+{
+public:
+    static const size_t faceVertices = (Segments + 1) * (Segments + 1);
+    static const size_t vertexCount = 6 * faceVertices;
+    static const size_t indexCount = 6 * Segments * Segments * 6;
+    static_assert(Segments > 0 && vertexCount <= 0x10000, "StaticBox: 1 to 65536 vertices");
+
+    constexpr StaticBox(float width, float height, float depth, bool inward = false) : width(width), height(height), depth(depth), inward(inward)
+    {
+    }
+
+    constexpr StaticPoint point(size_t i) const
+    {
+        return at(STATIC_FACE_AXES[i / faceVertices], (float)(i % faceVertices % (Segments + 1)) / Segments,
+                  (float)(i % faceVertices / (Segments + 1)) / Segments);
+    }
+
+    constexpr unsigned short index(size_t j) const
+    {
+        return staticGridIndex(Segments, Segments, j, inward);
+    }
+
+private:
+    float width, height, depth;
+    bool inward;
+
+    constexpr float coordinate(const float (*axes)[3], float u, float v, int c) const
+    {
+        return (axes[0][c] + (2.0f * u - 1.0f) * axes[1][c] + (2.0f * v - 1.0f) * axes[2][c]) * 0.5f * (c == 0 ? width : c == 1 ? height : depth);
+    }
+
+    constexpr StaticPoint at(const float (*axes)[3], float u, float v) const
+    {
+        return staticPoint(coordinate(axes, u, v, 0), coordinate(axes, u, v, 1), coordinate(axes, u, v, 2), inward ? -axes[0][0] : axes[0][0],
+                           inward ? -axes[0][1] : axes[0][1], inward ? -axes[0][2] : axes[0][2], u, 1.0f - v, axes[1], axes[2]);
+    }
+};
+
+// 0, 1 ... N - 1 as a parameter pack, built in log N steps
+template <size_t... I> struct StaticSequence
+{
+    typedef StaticSequence type;
+};
+
+template <typename A, typename B> struct StaticConcat;
+template <size_t... A, size_t... B> struct StaticConcat<StaticSequence<A...>, StaticSequence<B...> >
+{
+    typedef StaticSequence<A..., (sizeof...(A) + B)...> type;
+};
+
+template <size_t N>
+struct StaticMakeSequence : StaticConcat<typename StaticMakeSequence<N / 2>::type, typename StaticMakeSequence<N - N / 2>::type>
+{
+};
+template <> struct StaticMakeSequence<0>
+{
+    typedef StaticSequence<> type;
+};
+template <> struct StaticMakeSequence<1>
+{
+    typedef StaticSequence<0> type;
+};
+
+template <typename Vertex, typename Shape, size_t... V, size_t... I>
+constexpr StaticMesh<Vertex, sizeof...(V), sizeof...(I)> staticMeshOf(const Shape &shape, StaticSequence<V...>, StaticSequence<I...>)
+{
+    return StaticMesh<Vertex, sizeof...(V), sizeof...(I)>{ { { Vertex::make(shape.point(V))... } }, { { shape.index(I)... } } };
+}
+
+template <typename Vertex, typename Shape> constexpr StaticMesh<Vertex, Shape::vertexCount, Shape::indexCount> staticMesh(const Shape &shape)
+{
+    return staticMeshOf<Vertex>(shape, typename StaticMakeSequence<Shape::vertexCount>::type(), typename StaticMakeSequence<Shape::indexCount>::type());
+}
+
+// for static_asserts on a shape, evaluated on the points and indices the mesh is made of (an std::array
+// can't be read in a C++11 constant expression), halving the range so the recursion stays shallow
+
+constexpr float staticAbs(float x) { return x < 0.0f ? -x : x; }
+constexpr float staticMax(float a, float b) { return a < b ? b : a; }
+
+// the largest |coordinate| of points [first, last)
+template <typename Shape> constexpr float staticExtent(const Shape &shape, size_t first = 0, size_t last = Shape::vertexCount)
+{
+    return last - first == 1 ? staticMax(staticAbs(shape.point(first).position[0]),
+                                         staticMax(staticAbs(shape.point(first).position[1]), staticAbs(shape.point(first).position[2])))
+                             : staticMax(staticExtent(shape, first, (first + last) / 2), staticExtent(shape, (first + last) / 2, last));
+}
+
+// whether points [first, last) keep their positions and texcoords exactly in half precision
+template <typename Shape> constexpr bool staticHalfExact(const Shape &shape, size_t first = 0, size_t last = Shape::vertexCount)
+{
+    return last - first == 1 ? vertexHalfValue(vertexHalf(shape.point(first).position[0])) == shape.point(first).position[0] &&
+                                   vertexHalfValue(vertexHalf(shape.point(first).position[1])) == shape.point(first).position[1] &&
+                                   vertexHalfValue(vertexHalf(shape.point(first).position[2])) == shape.point(first).position[2] &&
+                                   vertexHalfValue(vertexHalf(shape.point(first).uv[0])) == shape.point(first).uv[0] &&
+                                   vertexHalfValue(vertexHalf(shape.point(first).uv[1])) == shape.point(first).uv[1]
+                             : staticHalfExact(shape, first, (first + last) / 2) && staticHalfExact(shape, (first + last) / 2, last);
+}
+
+// whether indices [first, last) are all vertices of the shape
+template <typename Shape> constexpr bool staticIndicesInRange(const Shape &shape, size_t first = 0, size_t last = Shape::indexCount)
+{
+    return last - first == 1 ? shape.index(first) < Shape::vertexCount
+                             : staticIndicesInRange(shape, first, (first + last) / 2) && staticIndicesInRange(shape, (first + last) / 2, last);
+}
+#endif
@@ -0,0 +1,459 @@
+#ifndef TEXTURE_PACK_H
+#define TEXTURE_PACK_H
+
+#include <stb_image.h>
+#include <helpers/filesystem.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Channel-packed layouts the shaders expect:
+//   material: rgb = diffuse, a = specular                                  (lights_frag.glsl)
+//   surface:  r = specular, g = ambient occlusion, b = roughness, a = depth (parallax_mapping_frag.glsl)
+//   normal:   rg = tangent-space x and y, z is rebuilt in the shader      (parallax_mapping_frag.glsl)
+// texcook writes them to .dds files ahead of time, with mips and normals compressed to BC5. TextureStreamer
+// loads those, or packs the source images itself when nothing has been cooked.
+
+
+// An RGBA8, RG8 or BC5 image with its mip chain, level 0 first. A single level leaves the mips to glGenerateMipmap.
+struct PackedImage
+{
+    enum Format { RGBA8, RG8, BC5 };
+
+    Format format;
+    int width;
+    int height;
+    std::vector<std::vector<unsigned char> > levels;
+
+    PackedImage() : format(RGBA8), width(0), height(0) {}
+
+    int levelWidth(int level) const { return std::max(1, width >> level); }
+    int levelHeight(int level) const { return std::max(1, height >> level); }
+};
+
+
+// Packs, mips, compresses and (de)serializes PackedImages
+class TexturePacker
+{
+public:
+    typedef std::map<std::string, AssetSpan> SourceFiles;
+
+    // the image files pack() reads for sources, each once
+    static std::vector<std::string> sourcePaths(const std::vector<std::string> &sources)
+    {
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            std::string path, channels;
+            if (!isConstant(sources[i]) && splitSource(sources[i], path, channels) &&
+                std::find(paths.begin(), paths.end(), path) == paths.end())
+                paths.push_back(path);
+        }
+        return paths;
+    }
+
+    // packs sources into the four RGBA channels, in order. a source is "path:channels" with channels made of
+    // r, g, b, a and l (luminance), e.g. "albedo.jpg:rgb" fills three channels; without ":channels" it is one
+    // luminance channel. a number in 0..1 fills one channel with a constant. images are resampled to the size
+    // of the first one, scaleLog2 decodes everything at 1/2^scaleLog2 size (see stbi_load_scaled).
+    // files holds images already read by path (sourcePaths), anything missing is read here.
+    static bool pack(const std::vector<std::string> &sources, int scaleLog2, PackedImage &out, std::string &error,
+                     const SourceFiles *files = NULL)
+    {
+        std::map<std::string, Image> images;
+        std::vector<const Image *> channelImages;
+        std::vector<int> channelIndices;
+        std::vector<unsigned char> constants;
+        out.format = PackedImage::RGBA8;
+        out.width = out.height = 0;
+
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            if (isConstant(sources[i]))
+            {
+                double value = strtod(sources[i].c_str(), NULL);
+                channelImages.push_back(NULL);
+                channelIndices.push_back(0);
+                constants.push_back((unsigned char)(std::min(std::max(value, 0.0), 1.0) * 255.0 + 0.5));
+                continue;
+            }
+
+            std::string path, channels;
+            splitSource(sources[i], path, channels);
+            Image &image = images[path];
+            if (image.pixels.empty() && !loadImage(path, scaleLog2, image, error, files))
+                return false;
+            if (out.width == 0)
+            {
+                out.width = image.width;
+                out.height = image.height;
+            }
+            for (size_t c = 0; c < channels.size(); ++c)
+            {
+                channelImages.push_back(&image);
+                channelIndices.push_back((int)std::string("rgbal").find(channels[c]));
+                constants.push_back(0);
+            }
+        }
+        if (channelImages.size() != 4)
+        {
+            error = "sources give " + std::to_string(channelImages.size()) + " channels, not 4";
+            return false;
+        }
+        if (out.width == 0)
+        {
+            error = "no source image";
+            return false;
+        }
+
+        out.levels.assign(1, std::vector<unsigned char>(out.width * out.height * 4));
+        unsigned char *dst = &out.levels[0][0];
+        for (int c = 0; c < 4; ++c)
+        {
+            if (!channelImages[c])
+            {
+                for (int p = 0; p < out.width * out.height; ++p)
+                    dst[p * 4 + c] = constants[c];
+                continue;
+            }
+            std::vector<unsigned char> plane;
+            channelImages[c]->extract(channelIndices[c], plane);
+            resample(plane, channelImages[c]->width, channelImages[c]->height, out.width, out.height);
+            for (int p = 0; p < out.width * out.height; ++p)
+                dst[p * 4 + c] = plane[p];
+        }
+        return true;
+    }
+
+    // a tangent-space normal map (rgb) to RG8
+    static bool packNormal(const std::string &source, int scaleLog2, PackedImage &out, std::string &error,
+                           const SourceFiles *files = NULL)
+    {
+        Image image;
+        if (!loadImage(source, scaleLog2, image, error, files))
+            return false;
+        out.format = PackedImage::RG8;
+        out.width = image.width;
+        out.height = image.height;
+        out.levels.assign(1, std::vector<unsigned char>(out.width * out.height * 2));
+        for (int p = 0; p < out.width * out.height; ++p)
+        {
+            out.levels[0][p * 2 + 0] = image.pixels[p * 4 + 0];
+            out.levels[0][p * 2 + 1] = image.pixels[p * 4 + 1];
+        }
+        return true;
+    }
+
+    // fills in the mip chain below level 0 with 2x2 box filtering. RG8 is treated as a normal map: the averaged
+    // normal is renormalized before its xy is stored
+    static void buildMips(PackedImage &image)
+    {
+        int channels = image.format == PackedImage::RGBA8 ? 4 : 2;
+        image.levels.resize(1);
+        for (int level = 1; image.levelWidth(level - 1) > 1 || image.levelHeight(level - 1) > 1; ++level)
+        {
+            int sw = image.levelWidth(level - 1), sh = image.levelHeight(level - 1);
+            int dw = image.levelWidth(level), dh = image.levelHeight(level);
+            image.levels.push_back(std::vector<unsigned char>(dw * dh * channels));
+            const unsigned char *src = &image.levels[level - 1][0];
+            unsigned char *dst = &image.levels[level][0];
+            for (int y = 0; y < dh; ++y)
+            {
+                int y0 = std::min(y * 2, sh - 1), y1 = std::min(y * 2 + 1, sh - 1);
+                for (int x = 0; x < dw; ++x)
+                {
+                    int x0 = std::min(x * 2, sw - 1), x1 = std::min(x * 2 + 1, sw - 1);
+                    const unsigned char *taps[4] = {
+                        src + (y0 * sw + x0) * channels, src + (y0 * sw + x1) * channels,
+                        src + (y1 * sw + x0) * channels, src + (y1 * sw + x1) * channels
+                    };
+                    unsigned char *out = dst + (y * dw + x) * channels;
+                    if (channels == 4)
+                    {
+                        for (int c = 0; c < 4; ++c)
+                            out[c] = (unsigned char)((taps[0][c] + taps[1][c] + taps[2][c] + taps[3][c] + 2) / 4);
+                        continue;
+                    }
+                    float n[3] = { 0.0f, 0.0f, 0.0f };
+                    for (int t = 0; t < 4; ++t)
+                    {
+                        float nx = taps[t][0] / 127.5f - 1.0f, ny = taps[t][1] / 127.5f - 1.0f;
+                        n[0] += nx;
+                        n[1] += ny;
+                        n[2] += std::sqrt(std::max(1.0f - nx * nx - ny * ny, 0.0f));
+                    }
+                    float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (length == 0.0f)
+                        length = 1.0f;
+                    for (int c = 0; c < 2; ++c)
+                        out[c] = (unsigned char)std::min(std::max((n[c] / length + 1.0f) * 127.5f + 0.5f, 0.0f), 255.0f);
+                }
+            }
+        }
+    }
+
+    // RG8 -> BC5 (two BC4 blocks per 4x4 texels), every level
+    static void compressBC5(PackedImage &image)
+    {
+        for (size_t level = 0; level < image.levels.size(); ++level)
+        {
+            int w = image.levelWidth((int)level), h = image.levelHeight((int)level);
+            int bw = (w + 3) / 4, bh = (h + 3) / 4;
+            std::vector<unsigned char> blocks(bw * bh * 16);
+            const unsigned char *src = &image.levels[level][0];
+            for (int by = 0; by < bh; ++by)
+                for (int bx = 0; bx < bw; ++bx)
+                    for (int c = 0; c < 2; ++c)
+                    {
+                        unsigned char texels[16];
+                        for (int t = 0; t < 16; ++t)
+                        {
+                            int x = std::min(bx * 4 + t % 4, w - 1), y = std::min(by * 4 + t / 4, h - 1);
+                            texels[t] = src[(y * w + x) * 2 + c];
+                        }
+                        encodeBC4(texels, &blocks[(by * bw + bx) * 16 + c * 8]);
+                    }
+            image.levels[level].swap(blocks);
+        }
+        image.format = PackedImage::BC5;
+    }
+
+    // .dds with a DX10 header: R8G8B8A8_UNORM, R8G8_UNORM or BC5_UNORM
+    static bool writeDDS(const std::string &path, const PackedImage &image, std::string &error)
+    {
+        unsigned int header[32 + 5];
+        memset(header, 0, sizeof(header));
+        header[0] = fourCC("DDS ");
+        header[1] = 124;                                      // dwSize
+        header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;       // caps, height, width, pixel format, mip count
+        header[2] |= image.format == PackedImage::BC5 ? 0x80000 : 0x8; // linear size or pitch
+        header[3] = image.height;
+        header[4] = image.width;
+        header[5] = image.format == PackedImage::BC5 ? (unsigned int)image.levels[0].size()
+                                                     : image.width * (image.format == PackedImage::RGBA8 ? 4 : 2);
+        header[7] = (unsigned int)image.levels.size();
+        header[19] = 32;                                      // ddspf.dwSize
+        header[20] = 0x4;                                     // DDPF_FOURCC
+        header[21] = fourCC("DX10");
+        header[27] = 0x1000 | 0x8 | 0x400000;                 // texture, complex, mipmap
+        header[32] = dxgiFormat(image.format);
+        header[33] = 3;                                       // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+        header[35] = 1;                                       // array size
+
+        std::ofstream file(path.c_str(), std::ios::binary);
+        file.write((const char *)header, sizeof(header));
+        for (size_t level = 0; level < image.levels.size(); ++level)
+            file.write((const char *)&image.levels[level][0], image.levels[level].size());
+        if (!file.good())
+        {
+            error = "can't write " + path;
+            return false;
+        }
+        return true;
+    }
+
+    static bool readDDS(const std::string &path, PackedImage &image, std::string &error)
+    {
+        return parseDDS(FileSystem::read(path), path, image, error);
+    }
+
+    // a .dds already in memory, path only names it in errors
+    static bool parseDDS(const AssetSpan &file, const std::string &path, PackedImage &image, std::string &error)
+    {
+        if (!file.valid())
+        {
+            error = "can't open " + path;
+            return false;
+        }
+        unsigned int header[32 + 5];
+        if (file.size < sizeof(header))
+        {
+            error = path + " is not a DX10 dds";
+            return false;
+        }
+        memcpy(header, file.data, sizeof(header));
+        if (header[0] != fourCC("DDS ") || header[21] != fourCC("DX10"))
+        {
+            error = path + " is not a DX10 dds";
+            return false;
+        }
+        if (header[32] == dxgiFormat(PackedImage::RGBA8))
+            image.format = PackedImage::RGBA8;
+        else if (header[32] == dxgiFormat(PackedImage::RG8))
+            image.format = PackedImage::RG8;
+        else if (header[32] == dxgiFormat(PackedImage::BC5))
+            image.format = PackedImage::BC5;
+        else
+        {
+            error = path + ": unsupported dxgi format " + std::to_string(header[32]);
+            return false;
+        }
+        image.height = header[3];
+        image.width = header[4];
+        int levels = std::max(1, (int)header[7]);
+        image.levels.resize(levels);
+        size_t offset = sizeof(header);
+        for (int level = 0; level < levels; ++level)
+        {
+            size_t size = levelSize(image, level);
+            if (size > file.size - offset)
+            {
+                error = path + " is truncated";
+                return false;
+            }
+            image.levels[level].assign(file.data + offset, file.data + offset + size);
+            offset += size;
+        }
+        return true;
+    }
+
+    static size_t levelSize(const PackedImage &image, int level)
+    {
+        int w = image.levelWidth(level), h = image.levelHeight(level);
+        if (image.format == PackedImage::BC5)
+            return (size_t)((w + 3) / 4) * ((h + 3) / 4) * 16;
+        return (size_t)w * h * (image.format == PackedImage::RGBA8 ? 4 : 2);
+    }
+
+private:
+    struct Image
+    {
+        int width, height;
+        std::vector<unsigned char> pixels; // rgba
+
+        void extract(int channel, std::vector<unsigned char> &plane) const
+        {
+            plane.resize(width * height);
+            for (int p = 0; p < width * height; ++p)
+            {
+                const unsigned char *rgba = &pixels[p * 4];
+                plane[p] = channel < 4 ? rgba[channel]
+                                       : (unsigned char)((rgba[0] * 77 + rgba[1] * 150 + rgba[2] * 29 + 128) >> 8);
+            }
+        }
+    };
+
+    static bool isConstant(const std::string &source)
+    {
+        char *end;
+        strtod(source.c_str(), &end);
+        return !source.empty() && *end == '\0';
+    }
+
+    // "path:channels" to its parts, channels default to l; true for anything but a constant
+    static bool splitSource(const std::string &source, std::string &path, std::string &channels)
+    {
+        path = source;
+        channels = "l";
+        size_t colon = source.find_last_of(':');
+        if (colon != std::string::npos && colon + 1 < source.size() &&
+            source.find_first_not_of("rgbal", colon + 1) == std::string::npos)
+        {
+            path = source.substr(0, colon);
+            channels = source.substr(colon + 1);
+        }
+        return !isConstant(source);
+    }
+
+    static bool loadImage(const std::string &path, int scaleLog2, Image &image, std::string &error,
+                          const SourceFiles *files)
+    {
+        int channels;
+        SourceFiles::const_iterator found = files ? files->find(path) : SourceFiles::const_iterator();
+        AssetSpan file = files && found != files->end() ? found->second : FileSystem::read(path);
+        if (!file.valid())
+        {
+            error = "can't open " + path;
+            return false;
+        }
+        unsigned char *data = stbi_load_from_memory_scaled(file.data, (int)file.size, scaleLog2,
+                                                           &image.width, &image.height, &channels, 4);
+        if (!data)
+        {
+            error = path + ": " + stbi_failure_reason();
+            return false;
+        }
+        image.pixels.assign(data, data + image.width * image.height * 4);
+        stbi_image_free(data);
+        return true;
+    }
+
+    // bilinear when growing; when shrinking, every output texel averages the bilinear taps it covers
+    static void resample(std::vector<unsigned char> &plane, int sw, int sh, int dw, int dh)
+    {
+        if (sw == dw && sh == dh)
+            return;
+        int tapsX = std::max(1, (sw + dw - 1) / dw), tapsY = std::max(1, (sh + dh - 1) / dh);
+        std::vector<unsigned char> out(dw * dh);
+        for (int y = 0; y < dh; ++y)
+            for (int x = 0; x < dw; ++x)
+            {
+                float sum = 0.0f;
+                for (int ty = 0; ty < tapsY; ++ty)
+                    for (int tx = 0; tx < tapsX; ++tx)
+                    {
+                        float u = ((x + (tx + 0.5f) / tapsX) * sw) / dw - 0.5f;
+                        float v = ((y + (ty + 0.5f) / tapsY) * sh) / dh - 0.5f;
+                        int x0 = std::min(std::max((int)std::floor(u), 0), sw - 1), x1 = std::min(x0 + 1, sw - 1);
+                        int y0 = std::min(std::max((int)std::floor(v), 0), sh - 1), y1 = std::min(y0 + 1, sh - 1);
+                        float fx = std::min(std::max(u - x0, 0.0f), 1.0f), fy = std::min(std::max(v - y0, 0.0f), 1.0f);
+                        float top = plane[y0 * sw + x0] + (plane[y0 * sw + x1] - plane[y0 * sw + x0]) * fx;
+                        float bottom = plane[y1 * sw + x0] + (plane[y1 * sw + x1] - plane[y1 * sw + x0]) * fx;
+                        sum += top + (bottom - top) * fy;
+                    }
+                out[y * dw + x] = (unsigned char)(sum / (tapsX * tapsY) + 0.5f);
+            }
+        plane.swap(out);
+    }
+
+    // min/max endpoints in the 8-value mode, each texel snapped to the nearest of the 8 steps
+    static void encodeBC4(const unsigned char texels[16], unsigned char *block)
+    {
+        int lo = 255, hi = 0;
+        for (int t = 0; t < 16; ++t)
+        {
+            lo = std::min(lo, (int)texels[t]);
+            hi = std::max(hi, (int)texels[t]);
+        }
+        block[0] = (unsigned char)hi;
+        block[1] = (unsigned char)lo;
+        unsigned long long bits = 0;
+        if (hi > lo)
+        {
+            for (int t = 0; t < 16; ++t)
+            {
+                // step 7 is hi (index 0), step 0 is lo (index 1), steps 6..1 are indices 2..7
+                int step = ((texels[t] - lo) * 14 + (hi - lo)) / ((hi - lo) * 2);
+                int index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+                bits |= (unsigned long long)index << (t * 3);
+            }
+        }
+        for (int b = 0; b < 6; ++b)
+            block[2 + b] = (unsigned char)(bits >> (b * 8));
+    }
+
+    static unsigned int fourCC(const char *code)
+    {
+        return code[0] | (code[1] << 8) | (code[2] << 16) | ((unsigned int)code[3] << 24);
+    }
+
+    static unsigned int dxgiFormat(PackedImage::Format format)
+    {
+        switch (format)
+        {
+        case PackedImage::RG8:
+            return 49; // DXGI_FORMAT_R8G8_UNORM
+        case PackedImage::BC5:
+            return 83; // DXGI_FORMAT_BC5_UNORM
+        default:
+            return 28; // DXGI_FORMAT_R8G8B8A8_UNORM
+        }
+    }
+};
+#endif
@@ -0,0 +1,331 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <helpers/async_io.h>
+#include <helpers/log.h>
+#include <helpers/texture_pack.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Preview scale: the first version of a texture is decoded at 1/8 size (a DC-only decode for jpegs)
+const int STREAM_PREVIEW_SCALE = 3;
+
+
+// Loads 2D textures in the background. load() returns a texture straight away (a grey texel), a worker
+// thread decodes a 1/8 preview of every queued texture first and the full images after that, and update()
+// uploads whatever is ready. Must be created and updated on the thread that owns the GL context.
+// loadPacked() and loadNormal() take the channel-packed layouts of helpers/texture_pack.h: a cooked .dds is
+// uploaded as it is, without one the sources are packed on the worker (a 1/8 preview first, as for load()).
+// Every file is read through AsyncIO as soon as its texture is queued, so reads overlap each other and the
+// decodes ahead of them; the sources of a packed texture are read together once there's no cooked file.
+// unload() deletes a texture and drops whatever is still queued for it, for streamers that page textures in
+// and out (helpers/world_streamer.h).
+class TextureStreamer
+{
+public:
+    TextureStreamer() : stop(false), pendingCount(0), nextTicket(1)
+    {
+        worker = std::thread(&TextureStreamer::run, this);
+    }
+
+    ~TextureStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        worker.join();
+        for (size_t i = 0; i < done.size(); ++i)
+            stbi_image_free(done[i].data);
+    }
+
+    // creates the texture and queues its decode
+    unsigned int load(const std::string &path)
+    {
+        Request request;
+        request.layout = IMAGE;
+        request.path = path;
+        return queue(request);
+    }
+
+    // RGBA from TexturePacker::pack sources, or the cooked .dds at cookedPath when there is one
+    unsigned int loadPacked(const std::string &cookedPath, const std::vector<std::string> &sources)
+    {
+        Request request;
+        request.layout = PACKED;
+        request.path = cookedPath;
+        request.sources = sources;
+        return queue(request);
+    }
+
+    // xy of a normal map: BC5 from the cooked .dds, or RG8 packed from source
+    unsigned int loadNormal(const std::string &cookedPath, const std::string &source)
+    {
+        Request request;
+        request.layout = NORMAL;
+        request.path = cookedPath;
+        request.sources.push_back(source);
+        return queue(request);
+    }
+
+    // deletes the texture; previews and full images still to come for it are dropped
+    void unload(unsigned int texture)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::map<unsigned int, unsigned long long>::iterator live = tickets.find(texture);
+            if (live == tickets.end())
+                return;
+            tickets.erase(live);
+            uploadedTextures.erase(texture);
+            // queued decodes go now, the one being decoded when it's done
+            for (std::deque<Request> *queue : { &previews, &fulls })
+                for (size_t i = 0; i < queue->size();)
+                    if ((*queue)[i].texture == texture)
+                    {
+                        pendingCount -= queue == &previews ? 2 : 1;
+                        queue->erase(queue->begin() + i);
+                    }
+                    else
+                        ++i;
+        }
+        glDeleteTextures(1, &texture);
+    }
+
+    // uploads up to maxUploads decoded images, and stops early once maxBytes have gone to the GPU (an image is
+    // never split, so the first one may go over); returns the bytes uploaded. Call once per frame.
+    size_t update(int maxUploads = 1, size_t maxBytes = ~(size_t)0)
+    {
+        size_t bytes = 0;
+        for (int i = 0; i < maxUploads && bytes < maxBytes; ++i)
+        {
+            Decoded image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (done.empty())
+                    return bytes;
+                image = done.front();
+                done.pop_front();
+                --pendingCount;
+                // unloaded since, and the name may belong to another texture by now
+                std::map<unsigned int, unsigned long long>::iterator live = tickets.find(image.texture);
+                if (live == tickets.end() || live->second != image.ticket)
+                {
+                    stbi_image_free(image.data);
+                    --i;
+                    continue;
+                }
+            }
+            uploadedTextures.insert(image.texture);
+            glBindTexture(GL_TEXTURE_2D, image.texture);
+            // previews rarely have rows that are a multiple of 4 bytes
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            if (image.data)
+            {
+                GLenum format = GL_RGB;
+                if (image.channels == 1)
+                    format = GL_RED;
+                else if (image.channels == 4)
+                    format = GL_RGBA;
+                glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+                glGenerateMipmap(GL_TEXTURE_2D);
+                stbi_image_free(image.data);
+                bytes += (size_t)image.width * image.height * image.channels;
+            }
+            else if (!image.packed.levels.empty())
+            {
+                uploadPacked(image.packed);
+                for (size_t level = 0; level < image.packed.levels.size(); ++level)
+                    bytes += image.packed.levels[level].size();
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        return bytes;
+    }
+
+    // true once a preview or full image (or the failure to load one) replaced the grey placeholder
+    bool uploaded(unsigned int texture) const
+    {
+        return uploadedTextures.count(texture) != 0;
+    }
+
+    // number of previews and full images not uploaded yet
+    int pending()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pendingCount;
+    }
+
+private:
+    enum Layout { IMAGE, PACKED, NORMAL };
+
+    struct Request
+    {
+        unsigned int texture;
+        unsigned long long ticket; // tells this load of the texture apart from a later one reusing its name
+        Layout layout;
+        std::string path; // the image for IMAGE, the cooked .dds otherwise
+        std::vector<std::string> sources;
+        std::shared_future<AssetSpan> file; // path
+        std::shared_ptr<TexturePacker::SourceFiles> sourceFiles; // read for the preview, kept for the full image
+    };
+
+    struct Decoded
+    {
+        unsigned int texture;
+        unsigned long long ticket;
+        int width, height, channels;
+        unsigned char *data; // IMAGE
+        PackedImage packed;  // PACKED and NORMAL
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Request> previews;
+    std::deque<Request> fulls;
+    std::deque<Decoded> done;
+    bool stop;
+    int pendingCount;
+    std::set<unsigned int> uploadedTextures; // past their grey placeholder, on the GL thread
+    std::map<unsigned int, unsigned long long> tickets; // of the textures loaded and not unloaded
+    unsigned long long nextTicket;
+
+    unsigned int queue(Request request)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        unsigned char grey[3] = { 128, 128, 128 };
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        request.texture = textureID;
+        request.file = AsyncIO::shared().submit(request.path);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            request.ticket = nextTicket++;
+            tickets[textureID] = request.ticket;
+            previews.push_back(request);
+            pendingCount += 2;
+        }
+        wake.notify_one();
+        return textureID;
+    }
+
+    // cooked files carry the whole mip chain, a runtime pack only level 0
+    void uploadPacked(const PackedImage &image)
+    {
+        for (size_t level = 0; level < image.levels.size(); ++level)
+        {
+            int w = image.levelWidth((int)level), h = image.levelHeight((int)level);
+            const unsigned char *data = &image.levels[level][0];
+            if (image.format == PackedImage::BC5)
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_COMPRESSED_RG_RGTC2, w, h, 0,
+                                       (GLsizei)image.levels[level].size(), data);
+            else if (image.format == PackedImage::RG8)
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RG8, w, h, 0, GL_RG, GL_UNSIGNED_BYTE, data);
+            else
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+        if (image.levels.size() == 1)
+            glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    // a cooked file is the whole texture at once, true when it was found
+    bool decodePacked(Request &request, bool preview, PackedImage &image)
+    {
+        std::string error;
+        if (preview && TexturePacker::parseDDS(request.file.get(), request.path, image, error))
+            return true;
+        if (!request.sourceFiles)
+        {
+            std::vector<std::string> paths = TexturePacker::sourcePaths(request.sources);
+            std::vector<std::shared_future<AssetSpan> > files = AsyncIO::shared().submit(paths);
+            request.sourceFiles = std::make_shared<TexturePacker::SourceFiles>();
+            for (size_t i = 0; i < paths.size(); ++i)
+                (*request.sourceFiles)[paths[i]] = files[i].get();
+        }
+        const TexturePacker::SourceFiles *files = request.sourceFiles.get();
+        bool packed = request.layout == NORMAL
+                          ? TexturePacker::packNormal(request.sources[0], preview ? STREAM_PREVIEW_SCALE : 0, image, error, files)
+                          : TexturePacker::pack(request.sources, preview ? STREAM_PREVIEW_SCALE : 0, image, error, files);
+        if (!packed)
+        {
+            image.levels.clear();
+            Log::warning("Texture failed to pack: %s", error);
+        }
+        return false;
+    }
+
+    void run()
+    {
+        Log::nameThread("textures");
+        for (;;)
+        {
+            Request request;
+            bool preview;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stop && previews.empty() && fulls.empty())
+                    wake.wait(lock);
+                if (stop)
+                    return;
+                // every preview goes before any full image
+                preview = !previews.empty();
+                std::deque<Request> &queue = preview ? previews : fulls;
+                request = queue.front();
+                queue.pop_front();
+            }
+
+            Decoded image;
+            image.texture = request.texture;
+            image.ticket = request.ticket;
+            image.data = NULL;
+            bool loaded, cooked = false;
+            if (request.layout == IMAGE)
+            {
+                AssetSpan file = request.file.get();
+                if (file.valid())
+                    image.data = stbi_load_from_memory_scaled(file.data, (int)file.size, preview ? STREAM_PREVIEW_SCALE : 0,
+                                                              &image.width, &image.height, &image.channels, 0);
+                if (!image.data)
+                    Log::warning("Texture failed to load at path: %s", request.path);
+                loaded = image.data != NULL;
+            }
+            else
+            {
+                cooked = decodePacked(request, preview, image.packed);
+                loaded = !image.packed.levels.empty();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            done.push_back(image);
+            // a file that can't be previewed won't load in full either, a cooked one is already full size;
+            // nor is there a full image to come for one unloaded while its preview was decoded
+            std::map<unsigned int, unsigned long long>::iterator live = tickets.find(request.texture);
+            if (preview && loaded && !cooked && live != tickets.end() && live->second == request.ticket)
+                fulls.push_back(request);
+            else if (preview)
+                --pendingCount;
+        }
+    }
+};
+#endif
@@ -0,0 +1,176 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstring>
+
+// Vertex layouts described at compile time: a vertex struct names its attributes' formats in order as
+// VertexLayout<Format...>, which knows the stride and sets the VAO up, so no glVertexAttribPointer is
+// written by hand. Formats are what the vertex fetch decodes to floats, so the shaders read vec2/vec3/vec4
+// whatever the bytes are:
+//   VertexFloat2, VertexFloat3   full floats
+//   VertexHalf2                  two halfs (texcoords)
+//   VertexHalf3                  three halfs and a pad, 8 bytes (positions that are exact in half precision)
+//   VertexSnorm16x3, Unorm16x3   16-bit fixed point and a pad, 8 bytes (positions scaled into -1..1 / 0..1)
+//   VertexSnorm1010102           x, y, z in 10 bits and w in 2, snorm (a normal, or a tangent with the
+//                                bitangent's sign in w)
+// The vertex* functions pack values into those formats; they are constexpr so that compile-time meshes
+// (helpers/static_primitives.h) come out packed; vertexHalfBits is the quick one for meshes built at run time.
+
+struct VertexFloat2
+{
+    static const GLint components = 2;
+    static const GLenum type = GL_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+    static const size_t bytes = 8;
+};
+
+struct VertexFloat3
+{
+    static const GLint components = 3;
+    static const GLenum type = GL_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+    static const size_t bytes = 12;
+};
+
+struct VertexHalf2
+{
+    static const GLint components = 2;
+    static const GLenum type = GL_HALF_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+    static const size_t bytes = 4;
+};
+
+struct VertexHalf3
+{
+    static const GLint components = 3;
+    static const GLenum type = GL_HALF_FLOAT;
+    static const GLboolean normalized = GL_FALSE;
+    static const size_t bytes = 8;
+};
+
+struct VertexSnorm16x3
+{
+    static const GLint components = 3;
+    static const GLenum type = GL_SHORT;
+    static const GLboolean normalized = GL_TRUE;
+    static const size_t bytes = 8;
+};
+
+struct VertexUnorm16x3
+{
+    static const GLint components = 3;
+    static const GLenum type = GL_UNSIGNED_SHORT;
+    static const GLboolean normalized = GL_TRUE;
+    static const size_t bytes = 8;
+};
+
+struct VertexSnorm1010102
+{
+    static const GLint components = 4;
+    static const GLenum type = GL_INT_2_10_10_10_REV;
+    static const GLboolean normalized = GL_TRUE;
+    static const size_t bytes = 4;
+};
+
+template <typename... Formats> struct VertexLayout;
+
+template <> struct VertexLayout<>
+{
+    static const int count = 0;
+    static const size_t bytes = 0;
+
+    static void setup(GLuint, size_t, GLsizei) {}
+};
+
+template <typename Format, typename... Rest> struct VertexLayout<Format, Rest...>
+{
+    static const int count = 1 + VertexLayout<Rest...>::count;
+    static const size_t bytes = Format::bytes + VertexLayout<Rest...>::bytes;
+
+    // enables attributes location, location + 1 ... on the bound VAO, reading the bound GL_ARRAY_BUFFER
+    // from offset on; a stream of its own unless stride says otherwise
+    static void setup(GLuint location = 0, size_t offset = 0, GLsizei stride = (GLsizei)bytes)
+    {
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, Format::components, Format::type, Format::normalized, stride, (void *)offset);
+        VertexLayout<Rest...>::setup(location + 1, offset + Format::bytes, stride);
+    }
+};
+
+constexpr int vertexRound(float x)
+{
+    return x < 0.0f ? (int)(x - 0.5f) : (int)(x + 0.5f);
+}
+
+constexpr float vertexClamp(float x)
+{
+    return x < -1.0f ? -1.0f : x > 1.0f ? 1.0f : x;
+}
+
+// 2^e
+constexpr float vertexPow2(int e)
+{
+    return e == 0 ? 1.0f : e > 0 ? 2.0f * vertexPow2(e - 1) : 0.5f * vertexPow2(e + 1);
+}
+
+// e with 1 <= x / 2^e < 2, for x > 0
+constexpr int vertexExponent(float x, int e = 0)
+{
+    return x >= 2.0f ? vertexExponent(x * 0.5f, e + 1) : x < 1.0f ? vertexExponent(x * 2.0f, e - 1) : e;
+}
+
+// the mantissa rounds to nearest; rounding up to 1024 carries into the exponent, which is right
+constexpr unsigned short vertexHalfMagnitude(float x, int e)
+{
+    return (unsigned short)(((e + 15) << 10) + vertexRound((x / vertexPow2(e) - 1.0f) * 1024.0f));
+}
+
+// IEEE half: magnitudes below the smallest normal one flush to zero, above the largest one clamp to it
+constexpr unsigned short vertexHalf(float x)
+{
+    return x < 0.0f ? (unsigned short)(0x8000 | vertexHalf(-x))
+                    : x < 6.103515625e-5f ? 0 : x >= 65504.0f ? 0x7BFF : vertexHalfMagnitude(x, vertexExponent(x));
+}
+
+// vertexHalf on the float's bits, for packing at run time; the same results
+inline unsigned short vertexHalfBits(float x)
+{
+    unsigned int f;
+    memcpy(&f, &x, sizeof(f));
+    unsigned int sign = (f >> 16) & 0x8000, magnitude = f & 0x7FFFFFFF;
+    if (magnitude < 0x38800000) // below 2^-14
+        return (unsigned short)sign;
+    if (magnitude >= 0x477FE000) // 65504
+        return (unsigned short)(sign | 0x7BFF);
+    // rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits
+    return (unsigned short)(sign | ((magnitude - 0x38000000 + 0x1000) >> 13));
+}
+
+// back to float, for checking what a format keeps
+constexpr float vertexHalfValue(unsigned short h)
+{
+    return (h & 0x8000) ? -vertexHalfValue(h & 0x7FFF)
+                        : (h & 0x7C00) == 0 ? 0.0f : (1.0f + (h & 0x3FF) / 1024.0f) * vertexPow2(((h >> 10) & 0x1F) - 15);
+}
+
+// s in the low half, t in the high one, as GL reads them on a little-endian machine
+constexpr unsigned int vertexHalf2(float s, float t)
+{
+    return (unsigned int)vertexHalf(s) | (unsigned int)vertexHalf(t) << 16;
+}
+
+constexpr short vertexSnorm16(float x)
+{
+    return (short)vertexRound(vertexClamp(x) * 32767.0f);
+}
+
+// x in the low bits; w is -1, 0 or 1
+constexpr unsigned int vertexSnorm1010102(float x, float y, float z, float w = 0.0f)
+{
+    return ((unsigned int)vertexRound(vertexClamp(x) * 511.0f) & 0x3FF) | ((unsigned int)vertexRound(vertexClamp(y) * 511.0f) & 0x3FF) << 10 |
+           ((unsigned int)vertexRound(vertexClamp(z) * 511.0f) & 0x3FF) << 20 | ((unsigned int)vertexRound(vertexClamp(w)) & 0x3) << 30;
+}
+#endif
@@ -0,0 +1,526 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <helpers/log.h>
+#include <helpers/shader.h>
+#include <helpers/virtual_texture_file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// must match VT_MAX_LEVELS in the shaders
+const int VT_MAX_LEVELS = 16;
+
+
+// page residency and latency since the last report
+struct VirtualTextureStats
+{
+    int residentPages, cachePages, pinnedPages;
+    int visiblePages;  // distinct pages in the last feedback
+    int missingPages;  // of those, not resident yet
+    int queuedPages;
+    long long uploads, evictions;
+    double latencyAvgMs, latencyMaxMs; // feedback request to upload
+    size_t residentBytes; // cache + indirection, fixed whatever the size of the virtual texture
+    size_t virtualBytes;  // every page of the .vtex
+};
+
+
+// A sparse virtual texture streamed from a .vtex (see helpers/virtual_texture_file.h).
+// Only a fixed cache of pages lives on the GPU: a cachePages x cachePages atlas of physical pages and an
+// indirection texture with one texel per virtual page (every level stacked in rows) holding the atlas slot
+// of that page, or of its closest resident ancestor while it is missing. Each frame the objects using it
+// are drawn into a small integer feedback buffer that records the page and mip every pixel wants; the
+// buffer is read back through a pixel buffer a frame later, missing pages are queued coarse levels first,
+// a worker thread reads them from the file, and update() uploads a few per frame, evicting the least
+// recently seen. The coarsest levels are pinned so every texel always has something to show.
+// Must be created and updated on the thread that owns the GL context.
+class VirtualTexture
+{
+public:
+    VirtualTexture(const std::string &path, int cachePages = 16, int feedbackDivisor = 8, int maxUploads = 16)
+        : cachePages(cachePages), feedbackDivisor(feedbackDivisor), maxUploads(maxUploads), frame(0),
+          feedbackWidth(0), feedbackHeight(0), feedbackFBO(0), feedbackColor(0), feedbackDepth(0),
+          cacheTexture(0), indirectionTexture(0), indirectionDirty(true), latencySumMs(0.0), latencyCount(0), stop(false)
+    {
+        pbo[0] = pbo[1] = 0;
+        pboFrame[0] = pboFrame[1] = -1;
+        memset(&counters, 0, sizeof(counters));
+        std::string error;
+        if (!file.open(path, error))
+        {
+            Log::error("VIRTUAL_TEXTURE::FILE_NOT_SUCCESFULLY_READ: %s", error);
+            return;
+        }
+        if (file.levels.size() > (size_t)VT_MAX_LEVELS || cachePages > 256)
+        {
+            Log::error("VIRTUAL_TEXTURE::TOO_LARGE: %s", path);
+            file.levels.clear();
+            return;
+        }
+        int pages = file.pageCount();
+        slotOfPage.assign(pages, -1);
+        pageState.assign(pages, IDLE);
+        wantedFrame.assign(pages, -1);
+        requestedAt.assign(pages, Clock::time_point());
+        pageOfSlot.assign(cachePages * cachePages, -1);
+        lastUsed.assign(cachePages * cachePages, -1);
+        pinned.assign(cachePages * cachePages, false);
+        for (int slot = cachePages * cachePages - 1; slot >= 0; --slot)
+            freeSlots.push_back(slot);
+
+        // physical pages
+        glGenTextures(1, &cacheTexture);
+        glBindTexture(GL_TEXTURE_2D, cacheTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cachePages * file.pageSize, cachePages * file.pageSize, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // page table: level l occupies rows indirectionRow[l] .. + pagesY
+        int rows = 0;
+        for (size_t l = 0; l < file.levels.size(); ++l)
+        {
+            indirectionRow.push_back(rows);
+            rows += file.levels[l].pagesY;
+        }
+        indirection.assign((size_t)file.levels[0].pagesX * rows * 4, 0);
+        glGenTextures(1, &indirectionTexture);
+        glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, file.levels[0].pagesX, rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // pin the coarsest levels that fit in a quarter of the cache and load them first
+        int pinnedPages = 0;
+        for (int l = (int)file.levels.size() - 1; l >= 0; --l)
+        {
+            int levelPages = file.levels[l].pagesX * file.levels[l].pagesY;
+            if (pinnedPages + levelPages > cachePages * cachePages / 4 && pinnedPages > 0)
+                break;
+            for (int page = 0; page < levelPages; ++page)
+            {
+                pinnedPage.push_back(file.levels[l].firstPage + page);
+                pageState[pinnedPage.back()] = QUEUED;
+                requestedAt[pinnedPage.back()] = Clock::now();
+                queue.push_back(pinnedPage.back());
+            }
+            pinnedPages += levelPages;
+        }
+        worker = std::thread(&VirtualTexture::run, this, path);
+    }
+
+    ~VirtualTexture()
+    {
+        if (!ready())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        worker.join();
+        glDeleteTextures(1, &cacheTexture);
+        glDeleteTextures(1, &indirectionTexture);
+        if (feedbackFBO)
+        {
+            glDeleteFramebuffers(1, &feedbackFBO);
+            glDeleteTextures(1, &feedbackColor);
+            glDeleteRenderbuffers(1, &feedbackDepth);
+            glDeleteBuffers(2, pbo);
+        }
+    }
+
+    // false when the .vtex couldn't be opened
+    bool ready() const { return !file.levels.empty(); }
+
+    // sets the VirtualTexture struct uniform `name` and binds the cache and indirection textures
+    void bind(const Shader &shader, const std::string &name, int cacheUnit, int indirectionUnit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + cacheUnit);
+        glBindTexture(GL_TEXTURE_2D, cacheTexture);
+        glActiveTexture(GL_TEXTURE0 + indirectionUnit);
+        glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+        setUniforms(shader, name);
+        shader.setInt(name + ".cache", cacheUnit);
+        shader.setInt(name + ".indirection", indirectionUnit);
+    }
+
+    // renders into the feedback buffer until endFeedback(); draw everything that samples this texture with a
+    // shader using virtual_feedback_frag.glsl. width and height are the size of the main framebuffer
+    void beginFeedback(Shader &shader, const std::string &name, int width, int height)
+    {
+        resizeFeedback(std::max(1, width / feedbackDivisor), std::max(1, height / feedbackDivisor));
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glViewport(0, 0, feedbackWidth, feedbackHeight);
+        GLuint none[4] = { 0, 0, 0, 0 };
+        glClearBufferuiv(GL_COLOR, 0, none);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        shader.use();
+        setUniforms(shader, name);
+        // derivatives are feedbackDivisor times larger here than on screen
+        shader.setFloat("lodBias", -std::log2((float)feedbackDivisor));
+    }
+
+    // starts the asynchronous read back of the feedback, it is used by the next update()
+    void endFeedback()
+    {
+        int index = frame & 1;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[index]);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        pboFrame[index] = frame;
+    }
+
+    // reads last frame's feedback, queues missing pages and uploads loaded ones; call once per frame
+    void update()
+    {
+        if (!ready())
+            return;
+        ++frame;
+        processFeedback();
+        uploadPages();
+        if (indirectionDirty)
+            updateIndirection();
+    }
+
+    VirtualTextureStats stats()
+    {
+        VirtualTextureStats stats = counters;
+        stats.cachePages = cachePages * cachePages;
+        stats.residentPages = stats.cachePages - (int)freeSlots.size();
+        stats.pinnedPages = (int)pinnedPage.size();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.queuedPages = (int)queue.size();
+        }
+        stats.latencyAvgMs = latencyCount ? latencySumMs / latencyCount : 0.0;
+        stats.residentBytes = (size_t)stats.cachePages * file.pageBytes() + indirection.size();
+        stats.virtualBytes = (size_t)file.pageCount() * file.pageBytes();
+        return stats;
+    }
+
+    // prints stats() and starts a new latency window
+    void report()
+    {
+        VirtualTextureStats s = stats();
+        Log::info("virtual texture: %d/%d pages resident (%d pinned), %d visible, %d missing, %d queued, "
+                    "%lld uploads, %lld evictions, latency avg %.1f ms max %.1f ms, %.1f MB resident for %.1f MB",
+                    s.residentPages, s.cachePages, s.pinnedPages, s.visiblePages, s.missingPages, s.queuedPages,
+                    s.uploads, s.evictions, s.latencyAvgMs, s.latencyMaxMs,
+                    s.residentBytes / 1048576.0, s.virtualBytes / 1048576.0);
+        latencySumMs = 0.0;
+        latencyCount = 0;
+        counters.latencyMaxMs = 0.0;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    enum PageState { IDLE, QUEUED, LOADED };
+
+    struct LoadedPage
+    {
+        int page;
+        std::vector<unsigned char> data;
+    };
+
+    VirtualTextureFile file;
+    int cachePages, feedbackDivisor, maxUploads;
+    int frame;
+
+    int feedbackWidth, feedbackHeight;
+    unsigned int feedbackFBO, feedbackColor, feedbackDepth;
+    unsigned int pbo[2];
+    int pboFrame[2];
+    std::vector<unsigned short> feedback;
+
+    unsigned int cacheTexture, indirectionTexture;
+    std::vector<int> indirectionRow;
+    std::vector<unsigned char> indirection;
+    bool indirectionDirty;
+
+    // per virtual page / per cache slot
+    std::vector<int> slotOfPage, wantedFrame;
+    std::vector<unsigned char> pageState;
+    std::vector<Clock::time_point> requestedAt;
+    std::vector<int> pageOfSlot, lastUsed;
+    std::vector<bool> pinned;
+    std::vector<int> freeSlots, pinnedPage;
+
+    VirtualTextureStats counters;
+    double latencySumMs;
+    long long latencyCount;
+
+    // worker
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<int> queue;
+    std::deque<LoadedPage> loaded;
+    bool stop;
+
+    void setUniforms(const Shader &shader, const std::string &name) const
+    {
+        for (size_t l = 0; l < file.levels.size(); ++l)
+            shader.setVec4(name + ".levels[" + std::to_string(l) + "]",
+                           glm::vec4(file.levels[l].width, file.levels[l].height, indirectionRow[l], 0.0f));
+        shader.setInt(name + ".levelCount", (int)file.levels.size());
+        shader.setVec2(name + ".uvScale", 1.0f / file.tilesX, 1.0f / file.tilesY);
+        shader.setFloat(name + ".pageContent", (float)file.pageContent());
+        shader.setFloat(name + ".pageSize", (float)file.pageSize);
+        shader.setFloat(name + ".border", (float)file.border);
+        shader.setFloat(name + ".cacheSize", (float)(cachePages * file.pageSize));
+    }
+
+    void resizeFeedback(int width, int height)
+    {
+        if (feedbackFBO && width == feedbackWidth && height == feedbackHeight)
+            return;
+        if (!feedbackFBO)
+        {
+            glGenFramebuffers(1, &feedbackFBO);
+            glGenTextures(1, &feedbackColor);
+            glGenRenderbuffers(1, &feedbackDepth);
+            glGenBuffers(2, pbo);
+        }
+        feedbackWidth = width;
+        feedbackHeight = height;
+        glBindTexture(GL_TEXTURE_2D, feedbackColor);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            Log::error("VIRTUAL_TEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        for (int i = 0; i < 2; ++i)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 8, NULL, GL_STREAM_READ);
+            pboFrame[i] = -1;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    void processFeedback()
+    {
+        // the read back started a frame before the latest one, so mapping it doesn't wait for the GPU
+        int index = frame & 1;
+        if (pboFrame[index] != frame - 2)
+            return;
+        pboFrame[index] = -1;
+        feedback.resize((size_t)feedbackWidth * feedbackHeight * 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[index]);
+        void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, feedback.size() * 2, GL_MAP_READ_BIT);
+        if (mapped)
+            memcpy(feedback.data(), mapped, feedback.size() * 2);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (!mapped)
+            return;
+
+        std::vector<int> wanted;
+        counters.visiblePages = 0;
+        for (size_t i = 0; i < feedback.size(); i += 4)
+        {
+            // r, g = page, b = level, a = 0 where nothing virtual was drawn
+            if (!feedback[i + 3] || feedback[i + 2] >= file.levels.size())
+                continue;
+            const VirtualTextureLevel &level = file.levels[feedback[i + 2]];
+            if (feedback[i] >= level.pagesX || feedback[i + 1] >= level.pagesY)
+                continue;
+            int page = level.firstPage + feedback[i + 1] * level.pagesX + feedback[i];
+            if (wantedFrame[page] == frame)
+                continue;
+            wantedFrame[page] = frame;
+            ++counters.visiblePages;
+            if (slotOfPage[page] >= 0)
+                lastUsed[slotOfPage[page]] = frame;
+            else
+                wanted.push_back(page);
+        }
+        counters.missingPages = (int)wanted.size();
+
+        // coarse pages first: they cover the most pixels and stand in for their descendants
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < queue.size();)
+        {
+            // pages nobody looks at any more leave the queue, except the pinned ones
+            int page = queue[i];
+            if (wantedFrame[page] != frame && !isPinnedPage(page))
+            {
+                pageState[page] = IDLE;
+                queue.erase(queue.begin() + i);
+            }
+            else
+                ++i;
+        }
+        for (size_t i = 0; i < wanted.size(); ++i)
+            if (pageState[wanted[i]] == IDLE)
+            {
+                pageState[wanted[i]] = QUEUED;
+                if (requestedAt[wanted[i]] == Clock::time_point())
+                    requestedAt[wanted[i]] = Clock::now();
+                queue.push_back(wanted[i]);
+            }
+        std::stable_sort(queue.begin(), queue.end(), [this](int a, int b) { return levelOf(a) > levelOf(b); });
+        if (!queue.empty())
+            wake.notify_one();
+    }
+
+    void uploadPages()
+    {
+        glBindTexture(GL_TEXTURE_2D, cacheTexture);
+        for (int i = 0; i < maxUploads; ++i)
+        {
+            LoadedPage page;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (loaded.empty())
+                    break;
+                page.page = loaded.front().page;
+                page.data.swap(loaded.front().data);
+                loaded.pop_front();
+            }
+            pageState[page.page] = IDLE;
+            if (page.data.empty())
+                continue;
+            int slot = allocateSlot();
+            if (slot < 0)
+                continue; // everything in the cache is in view; asked for again next frame
+            glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % cachePages) * file.pageSize, (slot / cachePages) * file.pageSize,
+                            file.pageSize, file.pageSize, GL_RGBA, GL_UNSIGNED_BYTE, page.data.data());
+            slotOfPage[page.page] = slot;
+            pageOfSlot[slot] = page.page;
+            lastUsed[slot] = frame;
+            pinned[slot] = isPinnedPage(page.page);
+            indirectionDirty = true;
+
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - requestedAt[page.page]).count();
+            requestedAt[page.page] = Clock::time_point();
+            latencySumMs += ms;
+            ++latencyCount;
+            counters.latencyMaxMs = std::max(counters.latencyMaxMs, ms);
+            ++counters.uploads;
+        }
+    }
+
+    // a free slot, or the least recently seen page that isn't pinned or in view
+    int allocateSlot()
+    {
+        if (!freeSlots.empty())
+        {
+            int slot = freeSlots.back();
+            freeSlots.pop_back();
+            return slot;
+        }
+        int victim = -1;
+        for (int slot = 0; slot < (int)pageOfSlot.size(); ++slot)
+            if (!pinned[slot] && lastUsed[slot] < frame && (victim < 0 || lastUsed[slot] < lastUsed[victim]))
+                victim = slot;
+        if (victim >= 0)
+        {
+            slotOfPage[pageOfSlot[victim]] = -1;
+            ++counters.evictions;
+        }
+        return victim;
+    }
+
+    // every page maps to its own slot or to its closest resident ancestor's, coarse levels first
+    void updateIndirection()
+    {
+        int stride = file.levels[0].pagesX;
+        for (int l = (int)file.levels.size() - 1; l >= 0; --l)
+        {
+            const VirtualTextureLevel &level = file.levels[l];
+            for (unsigned int y = 0; y < level.pagesY; ++y)
+                for (unsigned int x = 0; x < level.pagesX; ++x)
+                {
+                    unsigned char *entry = &indirection[((indirectionRow[l] + y) * stride + x) * 4];
+                    int slot = slotOfPage[level.firstPage + y * level.pagesX + x];
+                    if (slot >= 0)
+                    {
+                        entry[0] = (unsigned char)(slot % cachePages);
+                        entry[1] = (unsigned char)(slot / cachePages);
+                        entry[2] = (unsigned char)l;
+                        entry[3] = 255;
+                    }
+                    else if (l + 1 < (int)file.levels.size())
+                    {
+                        const VirtualTextureLevel &parent = file.levels[l + 1];
+                        unsigned int px = std::min(x / 2, parent.pagesX - 1), py = std::min(y / 2, parent.pagesY - 1);
+                        memcpy(entry, &indirection[((indirectionRow[l + 1] + py) * stride + px) * 4], 4);
+                    }
+                    else
+                        memset(entry, 0, 4);
+                }
+        }
+        glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, stride, (GLsizei)(indirection.size() / 4 / stride),
+                        GL_RGBA, GL_UNSIGNED_BYTE, indirection.data());
+        indirectionDirty = false;
+    }
+
+    int levelOf(int page) const
+    {
+        int l = 0;
+        while (l + 1 < (int)file.levels.size() && (int)file.levels[l + 1].firstPage <= page)
+            ++l;
+        return l;
+    }
+
+    bool isPinnedPage(int page) const
+    {
+        return std::find(pinnedPage.begin(), pinnedPage.end(), page) != pinnedPage.end();
+    }
+
+    void run(std::string path)
+    {
+        Log::nameThread("virtual texture");
+        VirtualTextureFile pages;
+        std::string error;
+        if (!pages.open(path, error))
+            return;
+        for (;;)
+        {
+            LoadedPage page;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stop && queue.empty())
+                    wake.wait(lock);
+                if (stop)
+                    return;
+                page.page = queue.front();
+                queue.pop_front();
+            }
+            page.data.resize(pages.pageBytes());
+            if (!pages.readPage(page.page, page.data.data()))
+            {
+                Log::error("VIRTUAL_TEXTURE::PAGE_NOT_SUCCESFULLY_READ: %u", page.page);
+                page.data.clear();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded.push_back(LoadedPage());
+            loaded.back().page = page.page;
+            loaded.back().data.swap(page.data);
+        }
+    }
+};
+#endif
@@ -0,0 +1,177 @@
+#ifndef VIRTUAL_TEXTURE_FILE_H
+#define VIRTUAL_TEXTURE_FILE_H
+
+#include <helpers/texture_pack.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// .vtex: an RGBA8 mip chain cut into square pages for virtual texturing (see helpers/virtual_texture.h).
+// Every page is pageSize x pageSize texels: pageSize - 2 * border texels of content plus a border copied
+// from its neighbours (clamped at the edges), so bilinear filtering never reads across pages. Pages are
+// stored uncompressed one after another from a 4096-byte aligned offset, level 0 first and row by row in
+// a level, so page i sits at dataOffset + i * pageBytes() and can be read with a single seek.
+const unsigned int VTEX_MAGIC = 0x58455456; // "VTEX"
+const unsigned int VTEX_VERSION = 1;
+const unsigned int VTEX_ALIGNMENT = 4096;
+
+struct VirtualTextureLevel
+{
+    unsigned int width, height;   // texels
+    unsigned int pagesX, pagesY;
+    unsigned int firstPage;
+};
+
+class VirtualTextureFile
+{
+public:
+    unsigned int width, height;   // level 0
+    unsigned int tilesX, tilesY;  // the source image was repeated tilesX x tilesY times, texcoords run 0..tiles
+    unsigned int pageSize, border;
+    unsigned int dataOffset;
+    std::vector<VirtualTextureLevel> levels;
+
+    VirtualTextureFile() : width(0), height(0), tilesX(1), tilesY(1), pageSize(0), border(0), dataOffset(0) {}
+
+    unsigned int pageContent() const { return pageSize - 2 * border; }
+    size_t pageBytes() const { return (size_t)pageSize * pageSize * 4; }
+    unsigned int pageCount() const
+    {
+        return levels.empty() ? 0 : levels.back().firstPage + levels.back().pagesX * levels.back().pagesY;
+    }
+
+    // pages come straight out of the mounted asset archive when it holds the file (assetpack stores .vtex
+    // uncompressed, so that's the mapping itself), from the file on disk otherwise
+    bool open(const std::string &path, std::string &error)
+    {
+        mapped = FileSystem::readMounted(path);
+        if (!mapped.valid())
+        {
+            file.open(path.c_str(), std::ios::binary);
+            if (!file)
+            {
+                error = "can't open " + path;
+                return false;
+            }
+        }
+        unsigned int header[10];
+        if (!read(0, header, sizeof(header)) || header[0] != VTEX_MAGIC || header[1] != VTEX_VERSION)
+        {
+            error = path + " is not a version " + std::to_string(VTEX_VERSION) + " .vtex";
+            return false;
+        }
+        width = header[2];
+        height = header[3];
+        tilesX = header[4];
+        tilesY = header[5];
+        pageSize = header[6];
+        border = header[7];
+        dataOffset = header[9];
+        levels.resize(header[8]);
+        if (!levels.empty() && !read(sizeof(header), &levels[0], levels.size() * sizeof(VirtualTextureLevel)))
+        {
+            error = path + " is truncated";
+            return false;
+        }
+        if (levels.empty() || pageSize <= 2 * border)
+        {
+            error = path + " has no pages";
+            return false;
+        }
+        return true;
+    }
+
+    // reads page index (pageBytes() of RGBA8)
+    bool readPage(unsigned int index, unsigned char *data)
+    {
+        return read((size_t)dataOffset + (size_t)index * pageBytes(), data, pageBytes());
+    }
+
+    // cuts an RGBA8 image with its full mip chain (TexturePacker::buildMips) into pages
+    static bool write(const std::string &path, const PackedImage &image, unsigned int tilesX, unsigned int tilesY,
+                      unsigned int pageSize, unsigned int border, std::string &error)
+    {
+        if (image.format != PackedImage::RGBA8 || pageSize <= 2 * border)
+        {
+            error = "virtual textures need RGBA8 and pages larger than their borders";
+            return false;
+        }
+        unsigned int content = pageSize - 2 * border;
+        std::vector<VirtualTextureLevel> levels;
+        unsigned int pages = 0;
+        for (size_t i = 0; i < image.levels.size(); ++i)
+        {
+            VirtualTextureLevel level;
+            level.width = image.levelWidth((int)i);
+            level.height = image.levelHeight((int)i);
+            level.pagesX = (level.width + content - 1) / content;
+            level.pagesY = (level.height + content - 1) / content;
+            level.firstPage = pages;
+            pages += level.pagesX * level.pagesY;
+            levels.push_back(level);
+            // the coarsest level is a single page
+            if (level.pagesX == 1 && level.pagesY == 1)
+                break;
+        }
+
+        unsigned int header[10] = { VTEX_MAGIC, VTEX_VERSION, (unsigned int)image.width, (unsigned int)image.height,
+                                    tilesX, tilesY, pageSize, border, (unsigned int)levels.size(), 0 };
+        size_t headerBytes = sizeof(header) + levels.size() * sizeof(VirtualTextureLevel);
+        header[9] = (unsigned int)((headerBytes + VTEX_ALIGNMENT - 1) / VTEX_ALIGNMENT * VTEX_ALIGNMENT);
+
+        std::ofstream file(path.c_str(), std::ios::binary);
+        file.write((const char *)header, sizeof(header));
+        file.write((const char *)&levels[0], levels.size() * sizeof(VirtualTextureLevel));
+        std::vector<char> padding(header[9] - headerBytes, 0);
+        file.write(padding.data(), padding.size());
+
+        std::vector<unsigned char> page((size_t)pageSize * pageSize * 4);
+        for (size_t i = 0; i < levels.size(); ++i)
+        {
+            const VirtualTextureLevel &level = levels[i];
+            const unsigned char *src = &image.levels[i][0];
+            for (unsigned int py = 0; py < level.pagesY; ++py)
+                for (unsigned int px = 0; px < level.pagesX; ++px)
+                {
+                    for (unsigned int y = 0; y < pageSize; ++y)
+                    {
+                        int sy = std::min(std::max((int)(py * content + y) - (int)border, 0), (int)level.height - 1);
+                        for (unsigned int x = 0; x < pageSize; ++x)
+                        {
+                            int sx = std::min(std::max((int)(px * content + x) - (int)border, 0), (int)level.width - 1);
+                            memcpy(&page[(y * pageSize + x) * 4], src + ((size_t)sy * level.width + sx) * 4, 4);
+                        }
+                    }
+                    file.write((const char *)page.data(), page.size());
+                }
+        }
+        if (!file.good())
+        {
+            error = "can't write " + path;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    AssetSpan mapped;
+    std::ifstream file;
+
+    bool read(size_t offset, void *data, size_t size)
+    {
+        if (mapped.valid())
+        {
+            if (offset > mapped.size || size > mapped.size - offset)
+                return false;
+            memcpy(data, mapped.data + offset, size);
+            return true;
+        }
+        file.clear();
+        file.seekg((std::streamoff)offset);
+        return (bool)file.read((char *)data, size);
+    }
+};
+#endif
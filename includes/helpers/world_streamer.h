@@ -0,0 +1,439 @@
+#ifndef WORLD_STREAMER_H
+#define WORLD_STREAMER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <helpers/async_io.h>
+#include <helpers/log.h>
+#include <helpers/mesh.h>
+#include <helpers/scene_file.h>
+#include <helpers/texture_streamer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// an object's asset references resolved to asset indices, -1 for none
+struct SceneBinding
+{
+    int mesh, material, emission, normal, surface, virtualTexture;
+};
+
+// an object of a resident cell
+struct WorldObject
+{
+    const SceneObject *object;
+    SceneBinding binding;
+};
+
+
+// residency and latency since the last report
+struct WorldStreamerStats
+{
+    int cells;                      // in the scene
+    int residentCells, loadingCells; // loading: requested, some of its assets not on the GPU yet
+    int residentObjects, residentAssets;
+    long long loads, unloads;
+    double latencyAvgMs, latencyMaxMs;   // cell requested to every asset of it uploaded
+    long long frames, framesOverBudget;   // frames that uploaded more than the budget (one texture too big for it)
+    size_t uploadedBytes, maxFrameBytes;
+    size_t meshBytes; // GPU memory of the resident meshes
+    size_t meshHeapBytes; // of the heap they are allocated from
+};
+
+
+// Pages the cells of a scene (see helpers/scene_file.h) in and out around the camera.
+// Every update() the cells within loadRadius of the camera, and of where it will be prefetchSeconds from now
+// at its current (smoothed) velocity, are requested nearest first, and the cells past unloadRadius of both
+// let go; the gap between the two radii keeps a camera on a cell border from loading and unloading it every
+// frame. A requested cell refcounts its textures and cooked meshes: textures go through the TextureStreamer,
+// meshes are read with AsyncIO and copied to the GPU piece by piece, and textures and meshes together upload
+// at most uploadBudget bytes a frame, so a cell coming in is spread over as many frames as it takes. A cell's
+// objects are drawn once all of its assets are in (objects()). The meshes share one MeshHeap, and so one VAO.
+// At most maxCells cells are resident, so memory is bounded by the largest cells whatever the size of the
+// world; per object state only exists for resident cells. Cubemaps, virtual textures and builtin meshes are
+// not streamed and stay with the caller.
+// Must be created and updated on the thread that owns the GL context.
+class WorldStreamer
+{
+public:
+    WorldStreamer(const SceneFile &scene, TextureStreamer &textureStreamer, float loadRadius = 40.0f,
+                  float unloadRadius = 50.0f, size_t uploadBudget = 4 * 1024 * 1024, int maxCells = 64,
+                  float prefetchSeconds = 1.0f)
+        : scene(scene), textureStreamer(textureStreamer), loadRadius(loadRadius),
+          unloadRadius(std::max(unloadRadius, loadRadius)), uploadBudget(uploadBudget), maxCells(maxCells),
+          prefetchSeconds(prefetchSeconds), hasPosition(false), velocity(0.0f), objectsDirty(false),
+          latencySumMs(0.0), latencyCount(0)
+    {
+        memset(&counters, 0, sizeof(counters));
+    }
+
+    ~WorldStreamer()
+    {
+        while (!cells.empty())
+            unloadCell(cells.begin()->first);
+    }
+
+    // streams around position, call once per frame before drawing
+    void update(const glm::vec3 &position, float deltaTime)
+    {
+        if (hasPosition && deltaTime > 0.0f)
+            velocity = glm::mix(velocity, (position - lastPosition) / deltaTime, std::min(deltaTime * 4.0f, 1.0f));
+        lastPosition = position;
+        hasPosition = true;
+        glm::vec3 ahead = position + velocity * prefetchSeconds;
+
+        // cells still wanted stay, the others go once they are past the unload radius
+        std::vector<std::pair<float, int> > wanted;
+        select(position, ahead, loadRadius, wanted);
+        std::vector<int> leaving;
+        for (std::map<int, Cell>::iterator cell = cells.begin(); cell != cells.end(); ++cell)
+            if (distance(scene.cells[cell->first], position, ahead) > unloadRadius)
+                leaving.push_back(cell->first);
+        for (size_t i = 0; i < leaving.size(); ++i)
+            unloadCell(leaving[i]);
+        std::set<int> wantedCells;
+        for (size_t i = 0; i < wanted.size(); ++i)
+            wantedCells.insert(wanted[i].second);
+        for (size_t i = 0; i < wanted.size(); ++i)
+        {
+            if (cells.count(wanted[i].second))
+                continue;
+            // full: the farthest cell that isn't wanted makes room, there is one as long as fewer than
+            // maxCells are wanted
+            if ((int)cells.size() >= maxCells)
+            {
+                int farthest = -1;
+                float farthestDistance = -1.0f;
+                for (std::map<int, Cell>::iterator cell = cells.begin(); cell != cells.end(); ++cell)
+                {
+                    float d = distance(scene.cells[cell->first], position, ahead);
+                    if (!wantedCells.count(cell->first) && d > farthestDistance)
+                        farthest = cell->first, farthestDistance = d;
+                }
+                if (farthest < 0)
+                    break;
+                unloadCell(farthest);
+            }
+            loadCell(wanted[i].second);
+        }
+
+        upload();
+        finishCells();
+        if (objectsDirty)
+            gatherObjects();
+    }
+
+    // the objects of the resident cells, by cell
+    const std::vector<WorldObject> &objects() const { return residentObjects; }
+
+    // 0 while the texture isn't resident; textures show a grey texel until their first image is in
+    unsigned int texture(int asset) const
+    {
+        std::map<int, Asset>::const_iterator found = assets.find(asset);
+        return found != assets.end() ? found->second.texture : 0;
+    }
+
+    // NULL while the mesh isn't resident, or isn't a cooked one
+    const Mesh *mesh(int asset) const
+    {
+        std::map<int, Asset>::const_iterator found = assets.find(asset);
+        return found != assets.end() && found->second.mesh && found->second.mesh->ready() ? found->second.mesh.get() : NULL;
+    }
+
+    // every cell requested so far is resident
+    bool idle() const
+    {
+        for (std::map<int, Cell>::const_iterator cell = cells.begin(); cell != cells.end(); ++cell)
+            if (!cell->second.resident)
+                return false;
+        return true;
+    }
+
+    WorldStreamerStats stats() const
+    {
+        WorldStreamerStats stats = counters;
+        stats.cells = (int)scene.header->cellCount;
+        stats.residentCells = stats.loadingCells = 0;
+        for (std::map<int, Cell>::const_iterator cell = cells.begin(); cell != cells.end(); ++cell)
+            ++(cell->second.resident ? stats.residentCells : stats.loadingCells);
+        stats.residentObjects = (int)residentObjects.size();
+        stats.residentAssets = (int)assets.size();
+        stats.latencyAvgMs = latencyCount ? latencySumMs / latencyCount : 0.0;
+        stats.meshBytes = 0;
+        stats.meshHeapBytes = meshHeap.bytes();
+        for (std::map<int, Asset>::const_iterator asset = assets.begin(); asset != assets.end(); ++asset)
+            if (asset->second.mesh)
+                stats.meshBytes += asset->second.mesh->bytes();
+        return stats;
+    }
+
+    // prints stats() and starts a new window
+    void report()
+    {
+        WorldStreamerStats s = stats();
+        Log::info("world: %d/%d cells resident, %d loading, %d objects, %d assets, %.1f MB of meshes (heap %.1f MB), "
+                    "%lld loads, %lld unloads, cell latency avg %.1f ms max %.1f ms, "
+                    "%lld/%lld frames over the %.1f MB budget, %.1f MB uploaded (max %.2f MB a frame)",
+                    s.residentCells, s.cells, s.loadingCells, s.residentObjects, s.residentAssets,
+                    s.meshBytes / 1048576.0, s.meshHeapBytes / 1048576.0, s.loads, s.unloads, s.latencyAvgMs, s.latencyMaxMs,
+                    s.framesOverBudget, s.frames, uploadBudget / 1048576.0, s.uploadedBytes / 1048576.0,
+                    s.maxFrameBytes / 1048576.0);
+        memset(&counters, 0, sizeof(counters));
+        latencySumMs = 0.0;
+        latencyCount = 0;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Cell
+    {
+        std::vector<SceneBinding> bindings; // of its objects
+        Clock::time_point requestedAt;
+        bool resident;
+    };
+
+    // a streamed asset used by at least one requested cell
+    struct Asset
+    {
+        int references;
+        unsigned int texture;
+        std::unique_ptr<Mesh> mesh;
+        std::shared_future<AssetSpan> file; // the .gmesh until it's read
+        bool failed;
+
+        Asset() : references(0), texture(0), failed(false) {}
+    };
+
+    const SceneFile &scene;
+    TextureStreamer &textureStreamer;
+    float loadRadius, unloadRadius;
+    size_t uploadBudget;
+    int maxCells;
+    float prefetchSeconds;
+
+    bool hasPosition;
+    glm::vec3 lastPosition, velocity;
+
+    MeshHeap meshHeap; // before assets, which free their ranges in it
+    std::map<int, Cell> cells; // requested, by cell index
+    std::map<int, Asset> assets; // by asset index
+    std::deque<int> uploads;     // meshes to read and upload, in request order
+    std::vector<WorldObject> residentObjects;
+    bool objectsDirty;
+
+    WorldStreamerStats counters;
+    double latencySumMs;
+    long long latencyCount;
+
+    // xz distance from a point to the bounds of a cell's objects, the nearer of position and ahead
+    static float distance(const SceneCell &cell, const glm::vec3 &position, const glm::vec3 &ahead)
+    {
+        return std::min(distance(cell, position), distance(cell, ahead));
+    }
+
+    static float distance(const SceneCell &cell, const glm::vec3 &point)
+    {
+        float dx = std::max(std::max(cell.boundsMin[0] - point.x, point.x - cell.boundsMax[0]), 0.0f);
+        float dz = std::max(std::max(cell.boundsMin[2] - point.z, point.z - cell.boundsMax[2]), 0.0f);
+        return std::sqrt(dx * dx + dz * dz);
+    }
+
+    // the cells within radius of either point, nearest first, at most maxCells
+    void select(const glm::vec3 &position, const glm::vec3 &ahead, float radius, std::vector<std::pair<float, int> > &wanted) const
+    {
+        float size = scene.header->cellSize;
+        if (size <= 0.0f)
+        {
+            // not cut into cells, the single one holds everything
+            for (unsigned int c = 0; c < scene.header->cellCount; ++c)
+                wanted.push_back(std::make_pair(0.0f, (int)c));
+            return;
+        }
+        // objects reach a little past their cell, one more cell around catches them
+        glm::vec3 points[2] = { position, ahead };
+        for (int p = 0; p < 2; ++p)
+        {
+            int x0 = (int)std::floor((points[p].x - radius) / size) - 1, x1 = (int)std::floor((points[p].x + radius) / size) + 1;
+            int z0 = (int)std::floor((points[p].z - radius) / size) - 1, z1 = (int)std::floor((points[p].z + radius) / size) + 1;
+            for (int x = x0; x <= x1; ++x)
+                for (int z = z0; z <= z1; ++z)
+                {
+                    int c = scene.findCell(x, z);
+                    if (c >= 0 && distance(scene.cells[c], position, ahead) <= radius)
+                        wanted.push_back(std::make_pair(distance(scene.cells[c], position, ahead), c));
+                }
+        }
+        std::sort(wanted.begin(), wanted.end());
+        wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+        if ((int)wanted.size() > maxCells)
+            wanted.resize(maxCells);
+    }
+
+    void loadCell(int index)
+    {
+        const SceneCell &sceneCell = scene.cells[index];
+        Cell &cell = cells[index];
+        cell.requestedAt = Clock::now();
+        cell.resident = false;
+        cell.bindings.resize(sceneCell.objectCount);
+        for (unsigned int i = 0; i < sceneCell.objectCount; ++i)
+        {
+            const SceneObject &object = scene.objects[sceneCell.firstObject + i];
+            SceneBinding &binding = cell.bindings[i];
+            binding.mesh = scene.find(object.mesh);
+            binding.material = scene.find(object.material);
+            binding.emission = scene.find(object.emission);
+            binding.normal = scene.find(object.normal);
+            binding.surface = scene.find(object.surface);
+            binding.virtualTexture = scene.find(object.virtualTexture);
+        }
+        for (unsigned int i = 0; i < sceneCell.assetCount; ++i)
+            acquire((int)scene.cellAssets[sceneCell.firstAsset + i]);
+        ++counters.loads;
+    }
+
+    void unloadCell(int index)
+    {
+        const SceneCell &sceneCell = scene.cells[index];
+        for (unsigned int i = 0; i < sceneCell.assetCount; ++i)
+            release((int)scene.cellAssets[sceneCell.firstAsset + i]);
+        if (cells[index].resident)
+            objectsDirty = true;
+        cells.erase(index);
+        ++counters.unloads;
+    }
+
+    void acquire(int index)
+    {
+        Asset &asset = assets[index];
+        if (asset.references++)
+            return;
+        const SceneAsset &sceneAsset = scene.assets[index];
+        asset.texture = 0;
+        asset.failed = false;
+        switch (sceneAsset.kind)
+        {
+        case SCENE_TEXTURE:
+            asset.texture = textureStreamer.load(SceneFile::resolve(scene.path(sceneAsset, 0)));
+            break;
+        case SCENE_PACKED:
+        {
+            std::vector<std::string> sources;
+            for (unsigned int i = 1; i < sceneAsset.pathCount; ++i)
+                sources.push_back(SceneFile::resolve(scene.path(sceneAsset, i)));
+            asset.texture = textureStreamer.loadPacked(SceneFile::resolve(scene.path(sceneAsset, 0)), sources);
+            break;
+        }
+        case SCENE_NORMAL:
+            asset.texture = textureStreamer.loadNormal(SceneFile::resolve(scene.path(sceneAsset, 0)),
+                                                       SceneFile::resolve(scene.path(sceneAsset, 1)));
+            break;
+        case SCENE_MESH:
+            asset.file = AsyncIO::shared().submit(SceneFile::resolve(scene.path(sceneAsset, 0)));
+            uploads.push_back(index);
+            break;
+        }
+    }
+
+    void release(int index)
+    {
+        std::map<int, Asset>::iterator asset = assets.find(index);
+        if (--asset->second.references)
+            return;
+        if (asset->second.texture)
+            textureStreamer.unload(asset->second.texture);
+        // a read still in flight finishes on its own and is dropped
+        uploads.erase(std::remove(uploads.begin(), uploads.end(), index), uploads.end());
+        assets.erase(asset);
+    }
+
+    // textures first, then meshes in the order they were requested, until the budget is spent
+    void upload()
+    {
+        size_t bytes = textureStreamer.update(4, uploadBudget);
+        while (!uploads.empty() && bytes < uploadBudget)
+        {
+            int index = uploads.front();
+            Asset &asset = assets[index];
+            if (!asset.mesh)
+            {
+                if (asset.file.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                    break;
+                asset.mesh.reset(new Mesh(meshHeap));
+                if (!asset.mesh->begin(asset.file.get(), scene.path(scene.assets[index], 0)))
+                {
+                    asset.mesh.reset();
+                    asset.failed = true;
+                }
+                asset.file = std::shared_future<AssetSpan>();
+            }
+            if (asset.mesh)
+                bytes += asset.mesh->upload(uploadBudget - bytes);
+            if (!asset.mesh || asset.mesh->ready())
+                uploads.pop_front();
+        }
+        ++counters.frames;
+        counters.uploadedBytes += bytes;
+        counters.maxFrameBytes = std::max(counters.maxFrameBytes, bytes);
+        if (bytes > uploadBudget)
+            ++counters.framesOverBudget;
+    }
+
+    bool resident(int index) const
+    {
+        const Asset &asset = assets.find(index)->second;
+        if (scene.assets[index].kind == SCENE_MESH)
+            return asset.failed || (asset.mesh && asset.mesh->ready());
+        return textureStreamer.uploaded(asset.texture);
+    }
+
+    // cells whose assets are all in become visible
+    void finishCells()
+    {
+        for (std::map<int, Cell>::iterator cell = cells.begin(); cell != cells.end(); ++cell)
+        {
+            if (cell->second.resident)
+                continue;
+            const SceneCell &sceneCell = scene.cells[cell->first];
+            bool ready = true;
+            for (unsigned int i = 0; i < sceneCell.assetCount && ready; ++i)
+                ready = resident((int)scene.cellAssets[sceneCell.firstAsset + i]);
+            if (!ready)
+                continue;
+            cell->second.resident = true;
+            objectsDirty = true;
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - cell->second.requestedAt).count();
+            latencySumMs += ms;
+            ++latencyCount;
+            counters.latencyMaxMs = std::max(counters.latencyMaxMs, ms);
+        }
+    }
+
+    void gatherObjects()
+    {
+        residentObjects.clear();
+        for (std::map<int, Cell>::const_iterator cell = cells.begin(); cell != cells.end(); ++cell)
+        {
+            if (!cell->second.resident)
+                continue;
+            const SceneCell &sceneCell = scene.cells[cell->first];
+            for (unsigned int i = 0; i < sceneCell.objectCount; ++i)
+            {
+                WorldObject object = { &scene.objects[sceneCell.firstObject + i], cell->second.bindings[i] };
+                residentObjects.push_back(object);
+            }
+        }
+        objectsDirty = false;
+    }
+};
+#endif
@@ -510,6 +510,23 @@ extern "C" {
     // flip the image vertically, so the first pixel in the output array is the bottom left
     STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+    // png/zlib fast paths: SIMD unfiltering and an inflate with a 64-bit bit buffer
+    // and multi-symbol huffman tables. on by default; turn off to get the reference
+    // decoder (the output is identical, this exists for benchmarking)
+    STBIDEF void stbi_set_png_fast_decode(int flag_true_if_fast);
+
+    // decode jpeg restart intervals (DRI/RSTn) on up to this many threads. only
+    // images that carry restart markers and are decoded from memory benefit;
+    // stbi_load reads the whole file up front when this is above 1. no-op when
+    // the implementation isn't compiled as C++
+    STBIDEF void stbi_set_jpeg_decode_threads(int num_threads);
+
+    // load at 1/2^scale_log2 of the full size (scale_log2 0..3, the result is
+    // rounded up). jpegs are reduced in the DCT domain, running a 4x4, 2x2 or
+    // DC-only IDCT per block; other formats are decoded in full and box filtered
+    STBIDEF stbi_uc *stbi_load_scaled(char const *filename, int scale_log2, int *x, int *y, int *channels_in_file, int desired_channels);
+    STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int scale_log2, int *x, int *y, int *channels_in_file, int desired_channels);
+
     // ZLIB client - used by PNG, available for other purposes
 
     STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -589,6 +606,13 @@ extern "C" {
 #define STBI_ASSERT(x) assert(x)
 #endif
 
+// restart intervals of a jpeg scan can be decoded on several threads; this
+// needs std::thread, so it's only available when compiled as C++
+#if defined(__cplusplus) && !defined(STBI_NO_THREADS) && !defined(STBI_NO_JPEG)
+#define STBI__JPEG_THREADS
+#include <thread>
+#endif
+
 
 #ifndef _MSC_VER
 #ifdef __cplusplus
@@ -658,6 +682,12 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32) == 4 ? 1 : -1];
 #define STBI__X86_TARGET
 #endif
 
+// 64-bit little-endian targets get the wide-bit-buffer inflate
+#if !defined(STBI_NO_ZLIB) && (defined(STBI__X64_TARGET) || defined(__aarch64__) || defined(_M_ARM64))
+#define STBI__ZFAST64
+typedef unsigned long long stbi__uint64;
+#endif
+
 #if defined(__GNUC__) && (defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET)) && !defined(__SSE2__) && !defined(STBI_NO_SIMD)
 // NOTE: not clear do we actually need this for the 64-bit path?
 // gcc doesn't support sse2 intrinsics unless you compile with -msse2,
@@ -768,6 +798,8 @@ typedef struct
 
     stbi_uc *img_buffer, *img_buffer_end;
     stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+    int scale_log2; // requested output reduction, see stbi_load_scaled
 } stbi__context;
 
 
@@ -780,6 +812,7 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
     s->read_from_callbacks = 0;
     s->img_buffer = s->img_buffer_original = (stbi_uc *)buffer;
     s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *)buffer + len;
+    s->scale_log2 = 0;
 }
 
 // initialize a callback-based context
@@ -792,6 +825,7 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
     s->img_buffer_original = s->buffer_start;
     stbi__refill_buffer(s);
     s->img_buffer_original_end = s->img_buffer_end;
+    s->scale_log2 = 0;
 }
 
 #ifndef STBI_NO_STDIO
@@ -847,6 +881,7 @@ typedef struct
     int bits_per_channel;
     int num_channels;
     int channel_order;
+    int scale_log2; // reduction the decoder already applied
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -1028,6 +1063,19 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
     stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
+#ifdef STBI__JPEG_THREADS
+static int stbi__jpeg_decode_threads;
+#endif
+
+STBIDEF void stbi_set_jpeg_decode_threads(int num_threads)
+{
+#ifdef STBI__JPEG_THREADS
+    stbi__jpeg_decode_threads = num_threads;
+#else
+    STBI_NOTUSED(num_threads);
+#endif
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
     memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1105,6 +1153,37 @@ static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int chan
     return enlarged;
 }
 
+// average 2^scale_log2 x 2^scale_log2 blocks; edge blocks average what's there
+static stbi_uc *stbi__downsample_box(stbi_uc *data, int *x, int *y, int channels, int scale_log2)
+{
+    int w = *x, h = *y, f = 1 << scale_log2;
+    int ow = (w + f - 1) >> scale_log2, oh = (h + f - 1) >> scale_log2;
+    int i, j, c, u, v;
+    stbi_uc *out = (stbi_uc *)stbi__malloc_mad3(ow, oh, channels, 0);
+    if (!out) {
+        STBI_FREE(data);
+        return stbi__errpuc("outofmem", "Out of memory");
+    }
+    for (j = 0; j < oh; ++j) {
+        int y0 = j << scale_log2, y1 = y0 + f < h ? y0 + f : h;
+        for (i = 0; i < ow; ++i) {
+            int x0 = i << scale_log2, x1 = x0 + f < w ? x0 + f : w;
+            int area = (x1 - x0) * (y1 - y0);
+            for (c = 0; c < channels; ++c) {
+                int sum = 0;
+                for (v = y0; v < y1; ++v)
+                    for (u = x0; u < x1; ++u)
+                        sum += data[(v * w + u) * channels + c];
+                out[(j * ow + i) * channels + c] = (stbi_uc)((sum + area / 2) / area);
+            }
+        }
+    }
+    STBI_FREE(data);
+    *x = ow;
+    *y = oh;
+    return out;
+}
+
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
     stbi__result_info ri;
@@ -1119,6 +1198,12 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
         ri.bits_per_channel = 8;
     }
 
+    if (ri.scale_log2 < s->scale_log2) {
+        result = stbi__downsample_box((stbi_uc *)result, x, y, req_comp == 0 ? *comp : req_comp, s->scale_log2 - ri.scale_log2);
+        if (result == NULL)
+            return NULL;
+    }
+
     // @TODO: move stbi__convert_format to here
 
     if (stbi__vertically_flip_on_load) {
@@ -1219,11 +1304,39 @@ static FILE *stbi__fopen(char const *filename, char const *mode)
 
 
 STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+    return stbi_load_scaled(filename, 0, x, y, comp, req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_scaled(char const *filename, int scale_log2, int *x, int *y, int *comp, int req_comp)
 {
     FILE *f = stbi__fopen(filename, "rb");
     unsigned char *result;
+    stbi__context s;
     if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
-    result = stbi_load_from_file(f, x, y, comp, req_comp);
+#ifdef STBI__JPEG_THREADS
+    // the threaded jpeg path has to look ahead for restart markers, so hand
+    // it the whole file instead of a streaming buffer
+    if (stbi__jpeg_decode_threads > 1) {
+        long len;
+        stbi_uc *buffer = NULL;
+        if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) > 0 && len < INT_MAX && fseek(f, 0, SEEK_SET) == 0)
+            buffer = (stbi_uc *)stbi__malloc(len);
+        if (buffer) {
+            if (fread(buffer, 1, len, f) == (size_t)len)
+                result = stbi_load_from_memory_scaled(buffer, (int)len, scale_log2, x, y, comp, req_comp);
+            else
+                result = stbi__errpuc("can't fread", "Unable to read file");
+            STBI_FREE(buffer);
+            fclose(f);
+            return result;
+        }
+        fseek(f, 0, SEEK_SET);
+    }
+#endif
+    stbi__start_file(&s, f);
+    s.scale_log2 = scale_log2 < 0 ? 0 : scale_log2 > 3 ? 3 : scale_log2;
+    result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
     fclose(f);
     return result;
 }
@@ -1274,6 +1387,14 @@ STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, i
     return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int scale_log2, int *x, int *y, int *comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_mem(&s, buffer, len);
+    s.scale_log2 = scale_log2 < 0 ? 0 : scale_log2 > 3 ? 3 : scale_log2;
+    return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+}
+
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
     stbi__context s;
@@ -1773,6 +1894,9 @@ typedef struct
     int scan_n, order[4];
     int restart_interval, todo;
 
+    // output is reduced by 1<<scale_log2; each 8x8 block becomes (8>>scale_log2)^2 pixels
+    int scale_log2;
+
     // kernels
     void(*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
     void(*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
@@ -2237,6 +2361,63 @@ stbi_inline static stbi_uc stbi__clamp(int x)
    t1 += p2+p4;                                \
    t0 += p1+p3;
 
+// reduced-size IDCTs for scaled decoding. the NxN output is the box filter of
+// the full 8x8 IDCT restricted to the lowest NxN frequencies: averaging output
+// pixels in pairs multiplies coefficient u by cos(u*pi/16) (then cos(u*pi/8),
+// ...) and leaves an N-point IDCT. tables are c(u)/2 times those factors
+static const int stbi__idct4_m[4][4] = {
+    { stbi__f2f(0.353553391f), stbi__f2f( 0.453063723f), stbi__f2f( 0.326640741f), stbi__f2f( 0.159094823f) },
+    { stbi__f2f(0.353553391f), stbi__f2f( 0.187665139f), stbi__f2f(-0.326640741f), stbi__f2f(-0.384088878f) },
+    { stbi__f2f(0.353553391f), stbi__f2f(-0.187665139f), stbi__f2f(-0.326640741f), stbi__f2f( 0.384088878f) },
+    { stbi__f2f(0.353553391f), stbi__f2f(-0.453063723f), stbi__f2f( 0.326640741f), stbi__f2f(-0.159094823f) }
+};
+
+static const int stbi__idct2_m[2][2] = {
+    { stbi__f2f(0.353553391f), stbi__f2f( 0.320364431f) },
+    { stbi__f2f(0.353553391f), stbi__f2f(-0.320364431f) }
+};
+
+// separable NxN IDCT over the low-frequency corner of 'data'. the row pass
+// keeps 2 fractional bits, the column pass removes the rest and adds the
+// +128 level shift
+static void stbi__idct_reduced(stbi_uc *out, int out_stride, short data[64], const int *m, int size)
+{
+    int tmp[16], u, v, x, y;
+    for (v = 0; v < size; ++v) {
+        for (x = 0; x < size; ++x) {
+            int sum = 0;
+            for (u = 0; u < size; ++u)
+                sum += m[x * size + u] * data[v * 8 + u];
+            tmp[v * size + x] = (sum + (1 << 9)) >> 10;
+        }
+    }
+    for (y = 0; y < size; ++y, out += out_stride) {
+        for (x = 0; x < size; ++x) {
+            int sum = (128 << 14) + (1 << 13);
+            for (v = 0; v < size; ++v)
+                sum += m[y * size + v] * tmp[v * size + x];
+            out[x] = stbi__clamp(sum >> 14);
+        }
+    }
+}
+
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+    stbi__idct_reduced(out, out_stride, data, &stbi__idct4_m[0][0], 4);
+}
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+    stbi__idct_reduced(out, out_stride, data, &stbi__idct2_m[0][0], 2);
+}
+
+// the block average is just the DC term
+static void stbi__idct_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+    STBI_NOTUSED(out_stride);
+    out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
 {
     int i, val[64], *v = val;
@@ -2720,134 +2901,242 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
     // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// number of MCUs in the current scan and how many of them make up one row;
+// a non-interleaved scan has one data block per MCU
+static int stbi__jpeg_scan_mcus(stbi__jpeg *z, int *row)
 {
-    stbi__jpeg_reset(z);
+    if (z->scan_n == 1) {
+        int n = z->order[0];
+        int w = (z->img_comp[n].x + 7) >> 3;
+        int h = (z->img_comp[n].y + 7) >> 3;
+        *row = w;
+        return w * h;
+    }
+    *row = z->img_mcu_x;
+    return z->img_mcu_x * z->img_mcu_y;
+}
+
+// decode the MCUs [first, last) of the current scan. the entropy decoder must
+// have been reset at the start of a restart interval containing 'first'
+static int stbi__parse_entropy_coded_mcus(stbi__jpeg *z, int first, int last)
+{
+    int row, m, i, j;
+    int bs = 8 >> z->scale_log2; // output pixels per block side
+    stbi__jpeg_scan_mcus(z, &row);
+    i = first % row;
+    j = first / row;
     if (!z->progressive) {
         if (z->scan_n == 1) {
-            int i, j;
             STBI_SIMD_ALIGN(short, data[64]);
             int n = z->order[0];
             // non-interleaved data, we just need to process one block at a time,
             // in trivial scanline order
             // number of blocks to do just depends on how many actual "pixels" this
             // component has, independent of interleaved MCU blocking and such
-            int w = (z->img_comp[n].x + 7) >> 3;
-            int h = (z->img_comp[n].y + 7) >> 3;
-            for (j = 0; j < h; ++j) {
-                for (i = 0; i < w; ++i) {
-                    int ha = z->img_comp[n].ha;
-                    if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data);
-                    // every data block is an MCU, so countdown the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        // if it's NOT a restart, then just bail, so we get corrupt data
-                        // rather than no data
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
-                    }
+            for (m = first; m < last; ++m) {
+                int ha = z->img_comp[n].ha;
+                if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * bs + i * bs, z->img_comp[n].w2, data);
+                // every data block is an MCU, so countdown the restart interval
+                if (--z->todo <= 0) {
+                    if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                    // if it's NOT a restart, then just bail, so we get corrupt data
+                    // rather than no data
+                    if (!STBI__RESTART(z->marker)) return 1;
+                    stbi__jpeg_reset(z);
                 }
+                if (++i == row) { i = 0; ++j; }
             }
             return 1;
         }
         else { // interleaved
-            int i, j, k, x, y;
+            int k, x, y;
             STBI_SIMD_ALIGN(short, data[64]);
-            for (j = 0; j < z->img_mcu_y; ++j) {
-                for (i = 0; i < z->img_mcu_x; ++i) {
-                    // scan an interleaved mcu... process scan_n components in order
-                    for (k = 0; k < z->scan_n; ++k) {
-                        int n = z->order[k];
-                        // scan out an mcu's worth of this component; that's just determined
-                        // by the basic H and V specified for the component
-                        for (y = 0; y < z->img_comp[n].v; ++y) {
-                            for (x = 0; x < z->img_comp[n].h; ++x) {
-                                int x2 = (i*z->img_comp[n].h + x) * 8;
-                                int y2 = (j*z->img_comp[n].v + y) * 8;
-                                int ha = z->img_comp[n].ha;
-                                if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                                z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data);
-                            }
+            for (m = first; m < last; ++m) {
+                // scan an interleaved mcu... process scan_n components in order
+                for (k = 0; k < z->scan_n; ++k) {
+                    int n = z->order[k];
+                    // scan out an mcu's worth of this component; that's just determined
+                    // by the basic H and V specified for the component
+                    for (y = 0; y < z->img_comp[n].v; ++y) {
+                        for (x = 0; x < z->img_comp[n].h; ++x) {
+                            int x2 = (i*z->img_comp[n].h + x) * bs;
+                            int y2 = (j*z->img_comp[n].v + y) * bs;
+                            int ha = z->img_comp[n].ha;
+                            if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                            z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data);
                         }
                     }
-                    // after all interleaved components, that's an interleaved MCU,
-                    // so now count down the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
-                    }
                 }
+                // after all interleaved components, that's an interleaved MCU,
+                // so now count down the restart interval
+                if (--z->todo <= 0) {
+                    if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                    if (!STBI__RESTART(z->marker)) return 1;
+                    stbi__jpeg_reset(z);
+                }
+                if (++i == row) { i = 0; ++j; }
             }
             return 1;
         }
     }
     else {
         if (z->scan_n == 1) {
-            int i, j;
             int n = z->order[0];
             // non-interleaved data, we just need to process one block at a time,
             // in trivial scanline order
             // number of blocks to do just depends on how many actual "pixels" this
             // component has, independent of interleaved MCU blocking and such
-            int w = (z->img_comp[n].x + 7) >> 3;
-            int h = (z->img_comp[n].y + 7) >> 3;
-            for (j = 0; j < h; ++j) {
-                for (i = 0; i < w; ++i) {
-                    short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-                    if (z->spec_start == 0) {
-                        if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
-                            return 0;
-                    }
-                    else {
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block_prog_ac(z, data, &z->huff_ac[ha], z->fast_ac[ha]))
-                            return 0;
-                    }
-                    // every data block is an MCU, so countdown the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
-                    }
+            for (m = first; m < last; ++m) {
+                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+                if (z->spec_start == 0) {
+                    if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
+                        return 0;
+                }
+                else {
+                    int ha = z->img_comp[n].ha;
+                    if (!stbi__jpeg_decode_block_prog_ac(z, data, &z->huff_ac[ha], z->fast_ac[ha]))
+                        return 0;
+                }
+                // every data block is an MCU, so countdown the restart interval
+                if (--z->todo <= 0) {
+                    if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                    if (!STBI__RESTART(z->marker)) return 1;
+                    stbi__jpeg_reset(z);
                 }
+                if (++i == row) { i = 0; ++j; }
             }
             return 1;
         }
         else { // interleaved
-            int i, j, k, x, y;
-            for (j = 0; j < z->img_mcu_y; ++j) {
-                for (i = 0; i < z->img_mcu_x; ++i) {
-                    // scan an interleaved mcu... process scan_n components in order
-                    for (k = 0; k < z->scan_n; ++k) {
-                        int n = z->order[k];
-                        // scan out an mcu's worth of this component; that's just determined
-                        // by the basic H and V specified for the component
-                        for (y = 0; y < z->img_comp[n].v; ++y) {
-                            for (x = 0; x < z->img_comp[n].h; ++x) {
-                                int x2 = (i*z->img_comp[n].h + x);
-                                int y2 = (j*z->img_comp[n].v + y);
-                                short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
-                                if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
-                                    return 0;
-                            }
+            int k, x, y;
+            for (m = first; m < last; ++m) {
+                // scan an interleaved mcu... process scan_n components in order
+                for (k = 0; k < z->scan_n; ++k) {
+                    int n = z->order[k];
+                    // scan out an mcu's worth of this component; that's just determined
+                    // by the basic H and V specified for the component
+                    for (y = 0; y < z->img_comp[n].v; ++y) {
+                        for (x = 0; x < z->img_comp[n].h; ++x) {
+                            int x2 = (i*z->img_comp[n].h + x);
+                            int y2 = (j*z->img_comp[n].v + y);
+                            short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
+                            if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
+                                return 0;
                         }
                     }
-                    // after all interleaved components, that's an interleaved MCU,
-                    // so now count down the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
-                    }
                 }
+                // after all interleaved components, that's an interleaved MCU,
+                // so now count down the restart interval
+                if (--z->todo <= 0) {
+                    if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                    if (!STBI__RESTART(z->marker)) return 1;
+                    stbi__jpeg_reset(z);
+                }
+                if (++i == row) { i = 0; ++j; }
             }
             return 1;
         }
     }
 }
 
+#ifdef STBI__JPEG_THREADS
+typedef struct
+{
+    stbi__jpeg j;
+    stbi__context s;
+    int first, last;
+    int result;
+} stbi__jpeg_worker;
+
+static void stbi__jpeg_worker_run(stbi__jpeg_worker *w)
+{
+    w->result = stbi__parse_entropy_coded_mcus(&w->j, w->first, w->last);
+}
+
+// split a scan at its RSTn markers and decode the restart intervals on
+// several threads. every interval starts with a fresh entropy decoder and dc
+// prediction, and writes a disjoint set of blocks, so workers only share the
+// read-only tables. returns -1 if the scan can't be split and must be decoded
+// serially
+static int stbi__parse_entropy_coded_data_mt(stbi__jpeg *z)
+{
+    stbi_uc *start = z->s->img_buffer, *end = z->s->img_buffer_end, *p, *scan_end;
+    stbi_uc **seg;
+    stbi__jpeg_worker *workers;
+    std::thread *threads;
+    int row, total, nseg = 1, expected, nthreads, t, ok = 1;
+
+    if (stbi__jpeg_decode_threads < 2 || z->restart_interval == 0 || z->s->io.read) return -1;
+    total = stbi__jpeg_scan_mcus(z, &row);
+    expected = (total + z->restart_interval - 1) / z->restart_interval;
+    if (expected < 2) return -1;
+
+    seg = (stbi_uc **)stbi__malloc(sizeof(stbi_uc *) * expected);
+    if (!seg) return -1;
+    seg[0] = start;
+    // find the restart markers; 0xff00 is a stuffed byte and repeated 0xff is
+    // fill before a marker, anything else ends the scan
+    p = start;
+    scan_end = end;
+    while (p + 1 < end) {
+        int c;
+        if (*p != 0xff) { ++p; continue; }
+        c = p[1];
+        if (c == 0x00) { p += 2; continue; }
+        if (c == 0xff) { ++p; continue; }
+        if (!STBI__RESTART(c)) { scan_end = p; break; }
+        if (nseg == expected || (c & 7) != ((nseg - 1) & 7)) { STBI_FREE(seg); return -1; }
+        seg[nseg++] = p + 2;
+        p += 2;
+    }
+    if (nseg != expected) { STBI_FREE(seg); return -1; }
+
+    nthreads = stbi__jpeg_decode_threads < nseg ? stbi__jpeg_decode_threads : nseg;
+    workers = (stbi__jpeg_worker *)stbi__malloc(sizeof(stbi__jpeg_worker) * nthreads);
+    if (!workers) { STBI_FREE(seg); return -1; }
+    threads = new std::thread[nthreads];
+    for (t = 0; t < nthreads; ++t) {
+        stbi__jpeg_worker *w = &workers[t];
+        int s0 = t * nseg / nthreads;
+        int s1 = (t + 1) * nseg / nthreads;
+        w->j = *z;
+        w->j.s = &w->s;
+        stbi__start_mem(&w->s, seg[s0], (int)(scan_end - seg[s0]));
+        stbi__jpeg_reset(&w->j);
+        w->first = s0 * z->restart_interval;
+        w->last = s1 * z->restart_interval < total ? s1 * z->restart_interval : total;
+        // the calling thread takes the first share itself
+        if (t > 0) threads[t] = std::thread(stbi__jpeg_worker_run, w);
+    }
+    stbi__jpeg_worker_run(&workers[0]);
+    for (t = 0; t < nthreads; ++t) {
+        if (t > 0) threads[t].join();
+        ok &= workers[t].result;
+    }
+    delete[] threads;
+    STBI_FREE(workers);
+    STBI_FREE(seg);
+
+    // leave the stream on the marker that ended the scan
+    z->s->img_buffer = scan_end;
+    stbi__jpeg_reset(z);
+    return ok;
+}
+#endif
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+    int row, total;
+#ifdef STBI__JPEG_THREADS
+    int r = stbi__parse_entropy_coded_data_mt(z);
+    if (r >= 0) return r;
+#endif
+    stbi__jpeg_reset(z);
+    total = stbi__jpeg_scan_mcus(z, &row);
+    return stbi__parse_entropy_coded_mcus(z, 0, total);
+}
+
 static void stbi__jpeg_dequantize(short *data, stbi_uc *dequant)
 {
     int i;
@@ -2860,6 +3149,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
     if (z->progressive) {
         // dequantize and idct the data
         int i, j, n;
+        int bs = 8 >> z->scale_log2;
         for (n = 0; n < z->s->img_n; ++n) {
             int w = (z->img_comp[n].x + 7) >> 3;
             int h = (z->img_comp[n].y + 7) >> 3;
@@ -2867,7 +3157,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
                 for (i = 0; i < w; ++i) {
                     short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                     stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data);
+                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * bs + i * bs, z->img_comp[n].w2, data);
                 }
             }
         }
@@ -3065,8 +3355,8 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
         //
         // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
         // so these muls can't overflow with 32-bit ints (which we require)
-        z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-        z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+        z->img_comp[i].w2 = (z->img_mcu_x * z->img_comp[i].h * 8) >> z->scale_log2;
+        z->img_comp[i].h2 = (z->img_mcu_y * z->img_comp[i].v * 8) >> z->scale_log2;
         z->img_comp[i].coeff = 0;
         z->img_comp[i].raw_coeff = 0;
         z->img_comp[i].linebuf = NULL;
@@ -3076,10 +3366,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
         // align blocks for idct using mmx/sse
         z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
         if (z->progressive) {
-            // w2, h2 are multiples of 8 (see above)
-            z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-            z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-            z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+            // coefficients are kept for every block, whatever the output scale
+            z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+            z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+            z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
             if (z->img_comp[i].raw_coeff == NULL)
                 return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
             z->img_comp[i].coeff = (short*)(((size_t)z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3564,6 +3854,7 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+    j->scale_log2 = 0;
     j->idct_block_kernel = stbi__idct_block;
     j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
     j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
@@ -3603,6 +3894,141 @@ typedef struct
     int ypos;    // which pre-expansion row we're on
 } stbi__resample;
 
+// resample and color-convert output rows [j0, j1); res_comp must already be
+// positioned at row j0. the converters write one byte past the end of a row,
+// so if last_row is given the final row goes through it instead of spilling
+// into a row another thread owns
+static void stbi__jpeg_resample_rows(stbi__jpeg *z, stbi__resample *res_comp, stbi_uc **linebuf, stbi_uc *output, int n, int decode_n, unsigned int j0, unsigned int j1, stbi_uc *last_row)
+{
+    int k;
+    unsigned int i, j;
+    stbi_uc *coutput[4];
+    for (j = j0; j < j1; ++j) {
+        stbi_uc *out = (last_row && j + 1 == j1) ? last_row : output + n * z->s->img_x * j;
+        for (k = 0; k < decode_n; ++k) {
+            stbi__resample *r = &res_comp[k];
+            int y_bot = r->ystep >= (r->vs >> 1);
+            coutput[k] = r->resample(linebuf[k],
+                y_bot ? r->line1 : r->line0,
+                y_bot ? r->line0 : r->line1,
+                r->w_lores, r->hs);
+            if (++r->ystep >= r->vs) {
+                r->ystep = 0;
+                r->line0 = r->line1;
+                if (++r->ypos < z->img_comp[k].y)
+                    r->line1 += z->img_comp[k].w2;
+            }
+        }
+        if (n >= 3) {
+            stbi_uc *y = coutput[0];
+            if (z->s->img_n == 3) {
+                if (z->rgb == 3) {
+                    for (i = 0; i < z->s->img_x; ++i) {
+                        out[0] = y[i];
+                        out[1] = coutput[1][i];
+                        out[2] = coutput[2][i];
+                        out[3] = 255;
+                        out += n;
+                    }
+                }
+                else {
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                }
+            }
+            else
+                for (i = 0; i < z->s->img_x; ++i) {
+                    out[0] = out[1] = out[2] = y[i];
+                    out[3] = 255; // not used if n==3
+                    out += n;
+                }
+        }
+        else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+                for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+                for (i = 0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
+        }
+    }
+    if (last_row && j1 > j0)
+        memcpy(output + n * z->s->img_x * (j1 - 1), last_row, n * z->s->img_x);
+}
+
+#ifdef STBI__JPEG_THREADS
+typedef struct
+{
+    stbi__jpeg *z;
+    stbi__resample res_comp[4];
+    stbi_uc *linebuf[4];
+    stbi_uc *last_row;
+    stbi_uc *output;
+    int n, decode_n;
+    unsigned int j0, j1;
+} stbi__jpeg_band;
+
+static void stbi__jpeg_band_run(stbi__jpeg_band *b)
+{
+    stbi__jpeg_resample_rows(b->z, b->res_comp, b->linebuf, b->output, b->n, b->decode_n, b->j0, b->j1, b->last_row);
+}
+
+// the same conversion split into horizontal bands, one per thread. each band
+// replays the resampler's row stepping up to its first row and gets its own
+// line buffers
+static void stbi__jpeg_resample_mt(stbi__jpeg *z, stbi__resample *res_comp, stbi_uc *output, int n, int decode_n)
+{
+    int nbands = stbi__jpeg_decode_threads, b, k;
+    unsigned int j;
+    stbi__jpeg_band *bands;
+    stbi_uc *linebufs;
+    std::thread *threads;
+    if (nbands > (int)z->s->img_y / 16) nbands = z->s->img_y / 16;
+    bands = (stbi__jpeg_band *)stbi__malloc(sizeof(stbi__jpeg_band) * nbands);
+    // per band: a line buffer for each component plus a spare output row
+    linebufs = (stbi_uc *)stbi__malloc_mad3(nbands, decode_n + n, z->s->img_x + 3, 0);
+    if (!bands || !linebufs) {
+        stbi_uc *linebuf[4];
+        STBI_FREE(bands);
+        STBI_FREE(linebufs);
+        for (k = 0; k < decode_n; ++k)
+            linebuf[k] = z->img_comp[k].linebuf;
+        stbi__jpeg_resample_rows(z, res_comp, linebuf, output, n, decode_n, 0, z->s->img_y, NULL);
+        return;
+    }
+    for (b = 0; b < nbands; ++b) {
+        stbi__jpeg_band *band = &bands[b];
+        band->z = z;
+        band->output = output;
+        band->n = n;
+        band->decode_n = decode_n;
+        band->j0 = z->s->img_y * b / nbands;
+        band->j1 = z->s->img_y * (b + 1) / nbands;
+        band->last_row = linebufs + (b * (decode_n + n) + decode_n) * (z->s->img_x + 3);
+        for (k = 0; k < decode_n; ++k) {
+            stbi__resample *r = &band->res_comp[k];
+            *r = res_comp[k];
+            band->linebuf[k] = linebufs + (b * (decode_n + n) + k) * (z->s->img_x + 3);
+            for (j = 0; j < band->j0; ++j) {
+                if (++r->ystep >= r->vs) {
+                    r->ystep = 0;
+                    r->line0 = r->line1;
+                    if (++r->ypos < z->img_comp[k].y)
+                        r->line1 += z->img_comp[k].w2;
+                }
+            }
+        }
+    }
+    threads = new std::thread[nbands];
+    for (b = 1; b < nbands; ++b)
+        threads[b] = std::thread(stbi__jpeg_band_run, &bands[b]);
+    stbi__jpeg_band_run(&bands[0]);
+    for (b = 1; b < nbands; ++b)
+        threads[b].join();
+    delete[] threads;
+    STBI_FREE(linebufs);
+    STBI_FREE(bands);
+}
+#endif
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
     int n, decode_n;
@@ -3614,6 +4040,18 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
     // load a jpeg image from whichever source, but leave in YCbCr format
     if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+    // the component planes hold reduced blocks; from here on the image and
+    // components are treated as if they were that size
+    if (z->scale_log2) {
+        int round = (1 << z->scale_log2) - 1;
+        z->s->img_x = (z->s->img_x + round) >> z->scale_log2;
+        z->s->img_y = (z->s->img_y + round) >> z->scale_log2;
+        for (n = 0; n < z->s->img_n; ++n) {
+            z->img_comp[n].x = (z->img_comp[n].x + round) >> z->scale_log2;
+            z->img_comp[n].y = (z->img_comp[n].y + round) >> z->scale_log2;
+        }
+    }
+
     // determine actual number of components to generate
     n = req_comp ? req_comp : z->s->img_n;
 
@@ -3625,9 +4063,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
     // resample and color-convert
     {
         int k;
-        unsigned int i, j;
         stbi_uc *output;
-        stbi_uc *coutput[4];
 
         stbi__resample res_comp[4];
 
@@ -3658,52 +4094,16 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
         // now go ahead and resample
-        for (j = 0; j < z->s->img_y; ++j) {
-            stbi_uc *out = output + n * z->s->img_x * j;
-            for (k = 0; k < decode_n; ++k) {
-                stbi__resample *r = &res_comp[k];
-                int y_bot = r->ystep >= (r->vs >> 1);
-                coutput[k] = r->resample(z->img_comp[k].linebuf,
-                    y_bot ? r->line1 : r->line0,
-                    y_bot ? r->line0 : r->line1,
-                    r->w_lores, r->hs);
-                if (++r->ystep >= r->vs) {
-                    r->ystep = 0;
-                    r->line0 = r->line1;
-                    if (++r->ypos < z->img_comp[k].y)
-                        r->line1 += z->img_comp[k].w2;
-                }
-            }
-            if (n >= 3) {
-                stbi_uc *y = coutput[0];
-                if (z->s->img_n == 3) {
-                    if (z->rgb == 3) {
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            out[0] = y[i];
-                            out[1] = coutput[1][i];
-                            out[2] = coutput[2][i];
-                            out[3] = 255;
-                            out += n;
-                        }
-                    }
-                    else {
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                    }
-                }
-                else
-                    for (i = 0; i < z->s->img_x; ++i) {
-                        out[0] = out[1] = out[2] = y[i];
-                        out[3] = 255; // not used if n==3
-                        out += n;
-                    }
-            }
-            else {
-                stbi_uc *y = coutput[0];
-                if (n == 1)
-                    for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
-                else
-                    for (i = 0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
-            }
+#ifdef STBI__JPEG_THREADS
+        if (stbi__jpeg_decode_threads > 1 && z->s->img_y >= 64)
+            stbi__jpeg_resample_mt(z, res_comp, output, n, decode_n);
+        else
+#endif
+        {
+            stbi_uc *linebuf[4];
+            for (k = 0; k < decode_n; ++k)
+                linebuf[k] = z->img_comp[k].linebuf;
+            stbi__jpeg_resample_rows(z, res_comp, linebuf, output, n, decode_n, 0, z->s->img_y, NULL);
         }
         stbi__cleanup_jpeg(z);
         *out_x = z->s->img_x;
@@ -3719,7 +4119,15 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
     stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
     j->s = s;
     stbi__setup_jpeg(j);
+    if (s->scale_log2 > 0) {
+        static void(*scaled_idct[4])(stbi_uc *out, int out_stride, short data[64]) = {
+            stbi__idct_block, stbi__idct_4x4, stbi__idct_2x2, stbi__idct_1x1
+        };
+        j->scale_log2 = s->scale_log2;
+        j->idct_block_kernel = scaled_idct[j->scale_log2];
+    }
     result = load_jpeg_image(j, x, y, comp, req_comp);
+    if (result) ri->scale_log2 = j->scale_log2;
     STBI_FREE(j);
     return result;
 }
@@ -3771,6 +4179,13 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// multi-symbol tables for the 64-bit inflate: one lookup resolves up to two
+// literals, or a length/distance together with its extra bits
+#define STBI__ZMULTI_BITS 11
+#define STBI__ZMULTI_MASK ((1 << STBI__ZMULTI_BITS) - 1)
+
+static int stbi__png_fast_decode = 1;
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -3865,6 +4280,10 @@ typedef struct
     int   z_expandable;
 
     stbi__zhuffman z_length, z_distance;
+#ifdef STBI__ZFAST64
+    stbi__uint32 zmulti_length[1 << STBI__ZMULTI_BITS];
+    stbi__uint32 zmulti_distance[1 << STBI__ZMULTI_BITS];
+#endif
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -3957,6 +4376,261 @@ static int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
 static int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
 
+#ifdef STBI__ZFAST64
+// multi table entries: bits 0-7 are the number of bits the entry consumes
+// (0 = code longer than STBI__ZMULTI_BITS, use the slow path), bits 8-9 the kind
+enum {
+    STBI__ZMULTI_SYMBOL = 0,  // bits 16-31: symbol whose extra bits still need reading
+    STBI__ZMULTI_LIT1 = 1,    // bits 16-23: literal
+    STBI__ZMULTI_LIT2 = 2,    // bits 16-23, 24-31: two literals
+    STBI__ZMULTI_RESOLVED = 3 // bits 16-31: match length or distance, extra bits included
+};
+
+// table[i] = (symbol << 16) | length for every code that fits in STBI__ZMULTI_BITS
+// bits, or 0. the sizes were validated by stbi__zbuild_huffman
+static void stbi__zbuild_single(stbi__uint32 *table, stbi_uc *sizelist, int num)
+{
+    int i, code, next_code[16], sizes[17];
+    memset(sizes, 0, sizeof(sizes));
+    memset(table, 0, sizeof(stbi__uint32) << STBI__ZMULTI_BITS);
+    for (i = 0; i < num; ++i)
+        ++sizes[sizelist[i]];
+    sizes[0] = 0;
+    code = 0;
+    for (i = 1; i < 16; ++i) {
+        next_code[i] = code;
+        code = (code + sizes[i]) << 1;
+    }
+    for (i = 0; i < num; ++i) {
+        int s = sizelist[i];
+        if (s) {
+            if (s <= STBI__ZMULTI_BITS) {
+                int j = stbi__bit_reverse(next_code[s], s);
+                while (j < (1 << STBI__ZMULTI_BITS)) {
+                    table[j] = ((stbi__uint32)i << 16) | s;
+                    j += (1 << s);
+                }
+            }
+            ++next_code[s];
+        }
+    }
+}
+
+static void stbi__zbuild_multi_length(stbi__uint32 *table, stbi_uc *sizelist, int num)
+{
+    int i;
+    stbi__zbuild_single(table, sizelist, num);
+    // in place, from the top: the second literal of entry i is looked up at
+    // i >> len1, which is never above i
+    for (i = (1 << STBI__ZMULTI_BITS) - 1; i >= 0; --i) {
+        stbi__uint32 e = table[i];
+        int len = e & 255, sym = e >> 16;
+        if (!len)
+            continue;
+        if (sym < 256) {
+            stbi__uint32 e2 = table[i >> len];
+            int len2 = e2 & 255, sym2 = e2 >> 16;
+            if (len2 && sym2 < 256 && len + len2 <= STBI__ZMULTI_BITS)
+                table[i] = ((stbi__uint32)sym2 << 24) | (sym << 16) | (STBI__ZMULTI_LIT2 << 8) | (len + len2);
+            else
+                table[i] = (sym << 16) | (STBI__ZMULTI_LIT1 << 8) | len;
+        }
+        else if (sym > 256 && sym < 286) {
+            int extra = stbi__zlength_extra[sym - 257];
+            if (len + extra <= STBI__ZMULTI_BITS) {
+                int length = stbi__zlength_base[sym - 257] + ((i >> len) & ((1 << extra) - 1));
+                table[i] = ((stbi__uint32)length << 16) | (STBI__ZMULTI_RESOLVED << 8) | (len + extra);
+            }
+        }
+    }
+}
+
+static void stbi__zbuild_multi_distance(stbi__uint32 *table, stbi_uc *sizelist, int num)
+{
+    int i;
+    stbi__zbuild_single(table, sizelist, num);
+    for (i = 0; i < (1 << STBI__ZMULTI_BITS); ++i) {
+        stbi__uint32 e = table[i];
+        int len = e & 255, sym = e >> 16;
+        if (len && sym < 30) {
+            int extra = stbi__zdist_extra[sym];
+            if (len + extra <= STBI__ZMULTI_BITS) {
+                int dist = stbi__zdist_base[sym] + ((i >> len) & ((1 << extra) - 1));
+                table[i] = ((stbi__uint32)dist << 16) | (STBI__ZMULTI_RESOLVED << 8) | (len + extra);
+            }
+        }
+    }
+}
+
+// canonical decode of a code longer than the tables, from the low 16 bits
+static int stbi__zhuffman_decode_long(stbi__zhuffman *z, unsigned int bits, int *len)
+{
+    int b, s, k;
+    k = stbi__bit_reverse(bits & 0xffff, 16);
+    for (s = STBI__ZFAST_BITS + 1; ; ++s)
+        if (k < z->maxcode[s])
+            break;
+    if (s == 16) return -1; // invalid code!
+    b = (k >> (16 - s)) - z->firstcode[s] + z->firstsymbol[s];
+    *len = s;
+    return z->value[b];
+}
+
+// output slack the unchecked writes need: a longest match plus an 8-byte copy overrun
+#define STBI__ZFAST_MARGIN (258 + 8)
+
+// decodes a huffman block with a 64-bit bit buffer, refilled once per symbol
+// (56+ bits covers a length and a distance with all their extra bits). within
+// STBI__ZFAST_MARGIN of the end of the output every write is checked and grows
+// the buffer only as far as needed, like stbi__parse_huffman_block; png sizes
+// its output exactly, so this avoids a realloc on every image
+static int stbi__parse_huffman_block_fast(stbi__zbuf *a)
+{
+    stbi_uc *in = a->zbuffer;
+    stbi__uint64 bits = a->code_buffer;
+    int num_bits = a->num_bits;
+    int past_end = 0; // zero bytes fed in beyond zbuffer_end
+    char *zout = a->zout;
+    int done = 0, n;
+
+#define STBI__ZRESERVE(count) \
+    if (checked && a->zout_end - zout < (count)) { \
+        if (!stbi__zexpand(a, zout, (count))) return 0; \
+        zout = a->zout; \
+    }
+
+    for (;;) {
+        stbi__uint32 e;
+        int len, dist, sym, checked;
+        stbi_uc *p;
+
+        if (a->zbuffer_end - in >= 8) {
+            stbi__uint64 v;
+            memcpy(&v, in, 8);
+            bits |= v << num_bits;
+            in += (63 - num_bits) >> 3;
+            num_bits |= 56;
+        }
+        else {
+            for (; num_bits <= 56; num_bits += 8) {
+                if (in < a->zbuffer_end)
+                    bits |= (stbi__uint64)*in++ << num_bits;
+                else
+                    ++past_end;
+            }
+            if (past_end > 8) return stbi__err("unexpected end", "Corrupt PNG");
+        }
+
+        checked = a->zout_end - zout < STBI__ZFAST_MARGIN;
+
+        e = a->zmulti_length[bits & STBI__ZMULTI_MASK];
+        switch ((e >> 8) & 3) {
+        case STBI__ZMULTI_LIT2:
+            STBI__ZRESERVE(2);
+            bits >>= e & 255;
+            num_bits -= e & 255;
+            zout[0] = (char)(e >> 16);
+            zout[1] = (char)(e >> 24);
+            zout += 2;
+            continue;
+        case STBI__ZMULTI_LIT1:
+            STBI__ZRESERVE(1);
+            bits >>= e & 255;
+            num_bits -= e & 255;
+            *zout++ = (char)(e >> 16);
+            continue;
+        case STBI__ZMULTI_RESOLVED:
+            bits >>= e & 255;
+            num_bits -= e & 255;
+            len = e >> 16;
+            break;
+        default:
+            if (e) {
+                sym = e >> 16;
+                n = e & 255;
+            }
+            else {
+                sym = stbi__zhuffman_decode_long(&a->z_length, (unsigned int)bits, &n);
+                if (sym < 0) return stbi__err("bad huffman code", "Corrupt PNG");
+            }
+            bits >>= n;
+            num_bits -= n;
+            if (sym < 256) {
+                STBI__ZRESERVE(1);
+                *zout++ = (char)sym;
+                continue;
+            }
+            if (sym == 256) {
+                done = 1;
+                break;
+            }
+            if (sym >= 286) return stbi__err("bad huffman code", "Corrupt PNG");
+            sym -= 257;
+            n = stbi__zlength_extra[sym];
+            len = stbi__zlength_base[sym] + (int)(bits & ((1 << n) - 1));
+            bits >>= n;
+            num_bits -= n;
+            break;
+        }
+        if (done) break;
+
+        e = a->zmulti_distance[bits & STBI__ZMULTI_MASK];
+        if (((e >> 8) & 3) == STBI__ZMULTI_RESOLVED) {
+            bits >>= e & 255;
+            num_bits -= e & 255;
+            dist = e >> 16;
+        }
+        else {
+            if (e) {
+                sym = e >> 16;
+                n = e & 255;
+            }
+            else {
+                sym = stbi__zhuffman_decode_long(&a->z_distance, (unsigned int)bits, &n);
+                if (sym < 0) return stbi__err("bad huffman code", "Corrupt PNG");
+            }
+            if (sym >= 30) return stbi__err("bad huffman code", "Corrupt PNG");
+            bits >>= n;
+            num_bits -= n;
+            n = stbi__zdist_extra[sym];
+            dist = stbi__zdist_base[sym] + (int)(bits & ((1 << n) - 1));
+            bits >>= n;
+            num_bits -= n;
+        }
+        if (zout - a->zout_start < dist) return stbi__err("bad dist", "Corrupt PNG");
+        STBI__ZRESERVE(len);
+
+        p = (stbi_uc *)(zout - dist);
+        if (dist >= 8 && !checked) { // 8-byte chunks never overlap their source; overrun lands in the margin
+            char *end = zout + len;
+            do {
+                memcpy(zout, p, 8);
+                zout += 8;
+                p += 8;
+            } while (zout < end);
+            zout = end;
+        }
+        else if (dist == 1) { // run of one byte; common in images.
+            memset(zout, *p, len);
+            zout += len;
+        }
+        else {
+            do *zout++ = *p++; while (--len);
+        }
+    }
+#undef STBI__ZRESERVE
+
+    // give back the whole bytes still buffered, the zero padding first
+    n = (num_bits >> 3) - past_end;
+    if (n < 0) return stbi__err("unexpected end", "Corrupt PNG");
+    a->zbuffer = in - n;
+    a->num_bits = num_bits & 7;
+    a->code_buffer = (stbi__uint32)(bits & ((1 << a->num_bits) - 1));
+    a->zout = zout;
+    return 1;
+}
+#endif
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
     char *zout = a->zout;
@@ -4048,6 +4722,12 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
     if (n != ntot) return stbi__err("bad codelengths", "Corrupt PNG");
     if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
     if (!stbi__zbuild_huffman(&a->z_distance, lencodes + hlit, hdist)) return 0;
+#ifdef STBI__ZFAST64
+    if (stbi__png_fast_decode) {
+        stbi__zbuild_multi_length(a->zmulti_length, lencodes, hlit);
+        stbi__zbuild_multi_distance(a->zmulti_distance, lencodes + hlit, hdist);
+    }
+#endif
     return 1;
 }
 
@@ -4128,10 +4808,22 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
                 if (!stbi__zdefault_distance[31]) stbi__init_zdefaults();
                 if (!stbi__zbuild_huffman(&a->z_length, stbi__zdefault_length, 288)) return 0;
                 if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance, 32)) return 0;
+#ifdef STBI__ZFAST64
+                if (stbi__png_fast_decode) {
+                    stbi__zbuild_multi_length(a->zmulti_length, stbi__zdefault_length, 288);
+                    stbi__zbuild_multi_distance(a->zmulti_distance, stbi__zdefault_distance, 32);
+                }
+#endif
             }
             else {
                 if (!stbi__compute_huffman_codes(a)) return 0;
             }
+#ifdef STBI__ZFAST64
+            if (stbi__png_fast_decode) {
+                if (!stbi__parse_huffman_block_fast(a)) return 0;
+                continue;
+            }
+#endif
             if (!stbi__parse_huffman_block(a)) return 0;
         }
     } while (!final);
@@ -4302,6 +4994,100 @@ static int stbi__paeth(int a, int b, int c)
 
 static stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+// 8-bit rows with 3 or 4 bytes per pixel. sub, avg and paeth depend on the
+// pixel to the left, so (like libpng) the vector holds one pixel and walks
+// the row; paeth runs in 16 bits. 3-byte pixels are read and written a byte
+// at a time so they never touch memory past the row
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int n)
+{
+    int v;
+    if (n == 4)
+        memcpy(&v, p, 4);
+    else
+        v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int n)
+{
+    int x = _mm_cvtsi128_si32(v);
+    if (n == 4)
+        memcpy(p, &x, 4);
+    else {
+        p[0] = (stbi_uc)x;
+        p[1] = (stbi_uc)(x >> 8);
+        p[2] = (stbi_uc)(x >> 16);
+    }
+}
+
+// floor((a + b) / 2) per byte; _mm_avg_epu8 rounds up
+stbi_inline static __m128i stbi__png_avg_floor(__m128i a, __m128i b)
+{
+    __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+    return _mm_sub_epi8(_mm_avg_epu8(a, b), odd);
+}
+
+stbi_inline static __m128i stbi__png_abs16(__m128i x)
+{
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+// unfilter 'count' pixels; cur[-out_n] and prior[-out_n] are the pixels to the
+// left. out_n may be img_n + 1, in which case alpha is set to 255
+static void stbi__png_unfilter_row_sse2(int filter, stbi_uc *cur, stbi_uc *prior, stbi_uc *raw, int count, int img_n, int out_n)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i alpha = _mm_cvtsi32_si128(img_n == out_n ? 0 : (int)0xff000000);
+    __m128i a = stbi__png_load_pixel(cur - out_n, img_n);
+    __m128i b, c = zero;
+    int i;
+
+    if (filter == STBI__F_paeth)
+        c = _mm_unpacklo_epi8(stbi__png_load_pixel(prior - out_n, img_n), zero);
+
+    for (i = 0; i < count; ++i, cur += out_n, prior += out_n, raw += img_n) {
+        __m128i x = stbi__png_load_pixel(raw, img_n);
+        switch (filter) {
+        case STBI__F_sub:
+        case STBI__F_paeth_first: // paeth(a, 0, 0) == a
+            a = _mm_add_epi8(x, a);
+            break;
+        case STBI__F_up:
+            a = _mm_add_epi8(x, stbi__png_load_pixel(prior, img_n));
+            break;
+        case STBI__F_avg:
+            a = _mm_add_epi8(x, stbi__png_avg_floor(a, stbi__png_load_pixel(prior, img_n)));
+            break;
+        case STBI__F_avg_first:
+            a = _mm_add_epi8(x, stbi__png_avg_floor(a, zero));
+            break;
+        case STBI__F_paeth: {
+            __m128i a16 = _mm_unpacklo_epi8(a, zero);
+            __m128i pa, pb, pc, smallest, nearest;
+            b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior, img_n), zero);
+            pa = _mm_sub_epi16(b, c);   // p - a
+            pb = _mm_sub_epi16(a16, c); // p - b
+            pc = _mm_add_epi16(pa, pb); // p - c
+            pa = stbi__png_abs16(pa);
+            pb = stbi__png_abs16(pb);
+            pc = stbi__png_abs16(pc);
+            smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            // pa first, then pb, then c: the same tie-break as stbi__paeth
+            pb = _mm_cmpeq_epi16(pb, smallest);
+            nearest = _mm_or_si128(_mm_and_si128(pb, b), _mm_andnot_si128(pb, c));
+            pa = _mm_cmpeq_epi16(pa, smallest);
+            nearest = _mm_or_si128(_mm_and_si128(pa, a16), _mm_andnot_si128(pa, nearest));
+            a = _mm_add_epi8(x, _mm_packus_epi16(nearest, zero));
+            c = b;
+            break;
+        }
+        }
+        stbi__png_store_pixel(cur, _mm_or_si128(a, alpha), out_n);
+    }
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4315,6 +5101,9 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
     int output_bytes = out_n*bytes;
     int filter_bytes = img_n*bytes;
     int width = x;
+#ifdef STBI_SSE2
+    int simd = depth == 8 && (img_n == 3 || img_n == 4) && stbi__png_fast_decode && stbi__sse2_available();
+#endif
 
     STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
     a->out = (stbi_uc *)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4382,6 +5171,16 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
             prior += 1;
         }
 
+#ifdef STBI_SSE2
+        // up without an added alpha has no dependency along the row, the
+        // byte loop below already vectorizes better than one pixel at a time
+        if (simd && filter != STBI__F_none && (filter != STBI__F_up || img_n != out_n)) {
+            stbi__png_unfilter_row_sse2(filter, cur, prior, raw, x - 1, img_n, out_n);
+            raw += (x - 1) * img_n;
+            continue;
+        }
+#endif
+
         // this is a little gross, so that we don't switch per-pixel or per-component
         if (depth < 8 || img_n == out_n) {
             int nk = (width - 1)*filter_bytes;
@@ -4663,6 +5462,11 @@ STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultipl
     stbi__unpremultiply_on_load = flag_true_if_should_unpremultiply;
 }
 
+STBIDEF void stbi_set_png_fast_decode(int flag_true_if_fast)
+{
+    stbi__png_fast_decode = flag_true_if_fast;
+}
+
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert)
 {
     stbi__de_iphone_flag = flag_true_if_should_convert;
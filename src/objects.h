@@ -5,131 +5,29 @@
 #ifndef OPENGLPRACTICE_OBJECTS_H
 #define OPENGLPRACTICE_OBJECTS_H
 
-
-float floorVertices[] = {
-        // positions            // normals         // texcoords
-        7.0f, -0.5f,  10.0f,  0.0f, 1.0f, 0.0f,  7.0f,  0.0f,
-        -7.0f, -0.5f,  10.0f,  0.0f, 1.0f, 0.0f,   0.0f,  0.0f,
-        -7.0f, -0.5f, -10.0f,  0.0f, 1.0f, 0.0f,   0.0f, 10.0f,
-
-        7.0f, -0.5f,  10.0f,  0.0f, 1.0f, 0.0f,  7.0f,  0.0f,
-        -7.0f, -0.5f, -10.0f,  0.0f, 1.0f, 0.0f,   0.0f, 10.0f,
-        7.0f, -0.5f, -10.0f,  0.0f, 1.0f, 0.0f,  7.0f, 10.0f
-};
-
-float skyboxVertices[] = {
-        // positions
-        -1.0f,  1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f,  1.0f,
-        1.0f,  1.0f,  1.0f,
-        1.0f,  1.0f,  1.0f,
-        1.0f,  1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-        1.0f,  1.0f,  1.0f,
-        1.0f,  1.0f,  1.0f,
-        1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-        -1.0f,  1.0f, -1.0f,
-        1.0f,  1.0f, -1.0f,
-        1.0f,  1.0f,  1.0f,
-        1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-        1.0f, -1.0f, -1.0f,
-        1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-        1.0f, -1.0f,  1.0f
-};
-
-float cubeVertices[] = {
-        // back face
-        -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
-        1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
-        1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 0.0f, // bottom-right
-        1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 1.0f, 1.0f, // top-right
-        -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 0.0f, // bottom-left
-        -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, -1.0f, 0.0f, 1.0f, // top-left
-        // front face
-        -1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
-        1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 0.0f, // bottom-right
-        1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
-        1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, 1.0f, // top-right
-        -1.0f,  1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 1.0f, // top-left
-        -1.0f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, 0.0f, // bottom-left
-        // left face
-        -1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
-        -1.0f,  1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-left
-        -1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
-        -1.0f, -1.0f, -1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-left
-        -1.0f, -1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-right
-        -1.0f,  1.0f,  1.0f, -1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-right
-        // right face
-        1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
-        1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
-        1.0f,  1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 1.0f, // top-right
-        1.0f, -1.0f, -1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 1.0f, // bottom-right
-        1.0f,  1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 1.0f, 0.0f, // top-left
-        1.0f, -1.0f,  1.0f,  1.0f,  0.0f,  0.0f, 0.0f, 0.0f, // bottom-left
-        // bottom face
-        -1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
-        1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 1.0f, // top-left
-        1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
-        1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 1.0f, 0.0f, // bottom-left
-        -1.0f, -1.0f,  1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f, // bottom-right
-        -1.0f, -1.0f, -1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 1.0f, // top-right
-        // top face
-        -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
-        1.0f,  1.0f , 1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
-        1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 1.0f, // top-right
-        1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 1.0f, 0.0f, // bottom-right
-        -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
-        -1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left
-};
-
-glm::vec3 cubePositions[] = {
-        glm::vec3(2.0f, 2.0f, 2.0f),
-        glm::vec3(4.0f, 1.5f, -2.0f),
-        glm::vec3(3.0f, 1.5f, 5.0f),
-        glm::vec3(2.0f, 4.0f, 5.5f),
-        glm::vec3(-2.0f,2.0f,-2.0f),
-        glm::vec3(-2.0f,1.0f, 2.0f),
-        glm::vec3(-2.0f,3.0f, 6.0f)
-};
-
-glm::vec3 wallPosition = glm::vec3( 3.0f,  1.5f, -10.0f);
-
-glm::vec3 pointLightPositions[] = {
-        glm::vec3( 0.0f,  0.5f, -6.0f),
-        glm::vec3( 5.7f,  5.0f,  2.0f),
-        glm::vec3( 2.3f, 5.0f, -4.0f),
-        glm::vec3(-2.0f, 5.0f, 5.5f)
-};
-glm::vec3 pointLightColors[] = {
-        glm::vec3(0.87f, 0.63f, 0.87f),
-        glm::vec3(0.6f, 0.196f, 0.8f),
-        glm::vec3(0.54f, 0.17f, 0.886f),
-        glm::vec3(1.0f, 0.0f, 1.0f)
-};
+#include <helpers/static_primitives.h>
+
+// 14x20 at y = -0.5, the texture repeated every 2 units
+constexpr StaticPlane<1, 1> FLOOR(STATIC_UP, 14.0f, 20.0f, -0.5f, 7.0f, 10.0f);
+constexpr StaticMesh<StaticVertex, 4, 6> floorMesh = staticMesh<StaticVertex>(FLOOR);
+static_assert(staticExtent(FLOOR) == 10.0f && staticIndicesInRange(FLOOR) && staticHalfExact(FLOOR), "floor: 14x20 quad");
+
+// 2x2 in the xy plane facing +z, with tangents for normal mapping
+constexpr StaticPlane<1, 1> WALL(STATIC_FRONT, 2.0f, 2.0f);
+constexpr StaticMesh<StaticTangentVertex, 4, 6> wallMesh = staticMesh<StaticTangentVertex>(WALL);
+static_assert(staticExtent(WALL) == 1.0f && staticIndicesInRange(WALL) && staticHalfExact(WALL), "wall: 2x2 quad");
+
+constexpr StaticBox<1> CUBE(2.0f, 2.0f, 2.0f);
+constexpr StaticMesh<StaticVertex, 24, 36> cubeMesh = staticMesh<StaticVertex>(CUBE);
+static_assert(staticExtent(CUBE) == 1.0f && staticIndicesInRange(CUBE) && staticHalfExact(CUBE), "cube: -1..1");
+
+// seen from inside
+constexpr StaticBox<1> SKYBOX(2.0f, 2.0f, 2.0f, true);
+constexpr StaticMesh<StaticPositionVertex, 24, 36> skyboxMesh = staticMesh<StaticPositionVertex>(SKYBOX);
+static_assert(staticExtent(SKYBOX) == 1.0f && staticIndicesInRange(SKYBOX) && staticHalfExact(SKYBOX), "skybox: -1..1");
+
+// 16, 20 and 8 bytes a vertex, from 32, 56 and 12 as floats
+static_assert(sizeof(floorMesh.vertices) == 4 * 16 && sizeof(wallMesh.vertices) == 4 * 20 && sizeof(skyboxMesh.vertices) == 24 * 8,
+              "static vertices are packed");
 
 #endif //OPENGLPRACTICE_OBJECTS_H
@@ -3,19 +3,23 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+#include "draw_data.glsl"
+
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out vec4 Parameters;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
+	mat4 model = DrawModel();
 	FragPos = vec3(model * vec4(aPos, 1.0));
 	Normal = mat3(transpose(inverse(model))) * aNormal;
 	TexCoords = aTexCoords;
+	Parameters = DrawParameters();
 
 	gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
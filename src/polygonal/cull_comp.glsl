@@ -0,0 +1,79 @@
+#version 430 core
+// GPU culling (see helpers/gpu_culling.h): a draw per invocation, appended to its group's commands if its
+// bounding sphere is in the frustum and, with occlusion, not behind the last frame's depth, and with cones
+// if its normal cone doesn't face away from the eye
+layout (local_size_x = 64) in;
+
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Commands { Command commands[]; };
+layout (std430, binding = 1) readonly buffer Bounds { vec4 bounds[]; }; // center, radius; no radius: never culled
+layout (std430, binding = 2) readonly buffer Groups { uvec2 groups[]; }; // the group's first command, its index
+layout (std430, binding = 3) writeonly buffer Culled { Command culled[]; };
+layout (std430, binding = 4) buffer Counts { uint counts[]; };      // per group
+layout (std430, binding = 5) buffer Total { uint total; };          // this frame's, read back later
+layout (std430, binding = 6) readonly buffer Cones { vec4 normalCones[]; }; // axis, cutoff; a cutoff of 1: none
+
+uniform int drawCount;
+uniform vec4 planes[6]; // inward facing
+uniform bool occlusion;
+uniform mat4 occluderViewProjection;
+uniform sampler2D pyramid; // max depth, level 0 half the screen
+uniform int pyramidLevels;
+uniform bool cones;
+uniform vec3 eye;
+
+bool Occluded(vec3 center, float radius)
+{
+    // the screen rectangle and nearest depth of the sphere's box
+    vec3 rectMin = vec3(1.0), rectMax = vec3(-1.0);
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = occluderViewProjection * vec4(corner, 1.0);
+        if (clip.w <= 1e-4)
+            return false; // crosses the near plane
+        vec3 ndc = clip.xyz / clip.w;
+        rectMin = min(rectMin, ndc);
+        rectMax = max(rectMax, ndc);
+    }
+    vec2 uvMin = clamp(rectMin.xy * 0.5 + 0.5, 0.0, 1.0), uvMax = clamp(rectMax.xy * 0.5 + 0.5, 0.0, 1.0);
+    float nearest = rectMin.z * 0.5 + 0.5;
+    // the level where the rectangle spans at most 2x2 texels, whose max depth covers it
+    vec2 size = (uvMax - uvMin) * vec2(textureSize(pyramid, 0));
+    int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, pyramidLevels - 1);
+    ivec2 levelSize = textureSize(pyramid, level);
+    ivec2 low = min(ivec2(uvMin * vec2(levelSize)), levelSize - 1), high = min(ivec2(uvMax * vec2(levelSize)), levelSize - 1);
+    float farthest = max(max(texelFetch(pyramid, low, level).r, texelFetch(pyramid, ivec2(high.x, low.y), level).r),
+                         max(texelFetch(pyramid, ivec2(low.x, high.y), level).r, texelFetch(pyramid, high, level).r));
+    return nearest > farthest;
+}
+
+void main()
+{
+    uint draw = gl_GlobalInvocationID.x;
+    if (draw >= uint(drawCount))
+        return;
+    vec4 sphere = bounds[draw];
+    if (sphere.w > 0.0)
+    {
+        for (int i = 0; i < 6; ++i)
+            if (dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w)
+                return;
+        vec4 cone = normalCones[draw];
+        vec3 toCenter = sphere.xyz - eye;
+        if (cones && dot(toCenter, cone.xyz) >= cone.w * length(toCenter) + sphere.w)
+            return; // every triangle faces away
+        if (occlusion && Occluded(sphere.xyz, sphere.w))
+            return;
+    }
+    uvec2 group = groups[draw];
+    culled[group.x + atomicAdd(counts[group.y], 1u)] = commands[draw];
+    atomicAdd(total, 1u);
+}
@@ -0,0 +1,17 @@
+// per-draw data of a DrawBatch (see helpers/draw_batch.h): the draw's index comes in as an instanced
+// attribute, and DRAW_DATA_TEXELS texels of drawData per draw hold its model matrix and parameters
+layout (location = 7) in uint aDrawID;
+
+uniform samplerBuffer drawData;
+
+mat4 DrawModel()
+{
+    int base = int(aDrawID) * 5;
+    return mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+}
+
+// what the pass puts there: the lamp's color, the parallax light's position
+vec4 DrawParameters()
+{
+    return texelFetch(drawData, int(aDrawID) * 5 + 4);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+// drawn with while a pass's own program is still compiling (see ShaderVariants in helpers/shader.h)
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+uniform sampler2D diffuse; // unit 0, where every pass has its diffuse map
+
+void main()
+{
+    // one light from above, enough to make out shapes
+    float light = 0.35 + 0.65 * max(dot(normalize(Normal), normalize(vec3(0.4, 1.0, 0.3))), 0.0);
+    FragColor = vec4(texture(diffuse, TexCoords).rgb * light, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 430 core
+// a level of the depth pyramid (see helpers/gpu_culling.h): each texel the farthest of the 2x2 source
+// texels under it, 3 wide where the source is odd and this is the last column (row)
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f) writeonly uniform image2D target;
+
+uniform sampler2D source;
+uniform int sourceLevel;
+uniform ivec2 sourceSize;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 targetSize = imageSize(target);
+    if (any(greaterThanEqual(texel, targetSize)))
+        return;
+    ivec2 first = texel * 2;
+    ivec2 last = min(first + 1 + ivec2(equal(texel, targetSize - 1)) * (sourceSize & 1), sourceSize - 1);
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; ++y)
+        for (int x = first.x; x <= last.x; ++x)
+            farthest = max(farthest, texelFetch(source, ivec2(x, y), sourceLevel).r);
+    imageStore(target, texel, vec4(farthest));
+}
@@ -1,8 +1,8 @@
 #version 330 core
-uniform vec3 lightColor;
+flat in vec4 Parameters; // the lamp's color
 out vec4 FragColor;
 
 void main()
 {
-    FragColor = vec4(lightColor, 1.0);
+    FragColor = vec4(Parameters.rgb, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,26 @@
+// lighting terms shared by the lit passes
+
+// Lambert
+float Diffuse(vec3 normal, vec3 lightDir)
+{
+    return max(dot(normal, lightDir), 0.0);
+}
+
+// Phong: the view direction against the light reflected about the normal
+float PhongSpecular(vec3 normal, vec3 lightDir, vec3 viewDir, float shininess)
+{
+    vec3 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+}
+
+// Blinn-Phong: the normal against the vector halfway between the light and the eye
+float BlinnSpecular(vec3 normal, vec3 lightDir, vec3 viewDir, float shininess)
+{
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    return pow(max(dot(normal, halfwayDir), 0.0), shininess);
+}
+
+float Attenuation(float constant, float linear, float quadratic, float distance)
+{
+    return 1.0 / (constant + linear * distance + quadratic * (distance * distance));
+}
@@ -1,9 +1,16 @@
 #version 330 core
 out vec4 FragColor;
 
+// compiled per variant (see ShaderVariants in helpers/shader.h):
+//   NR_POINT_LIGHTS        the lights of the scene
+//   WITH_EMISSION          the object has an emission map
+//   WITH_VIRTUAL_MATERIAL  its material is streamed from a virtual texture
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 4
+#endif
+
 struct Material {
-    sampler2D diffuse;
-    sampler2D specular;
+    sampler2D diffuse; // rgb: diffuse, a: specular (see helpers/texture_pack.h)
     sampler2D emission;
     float shininess;
 };
@@ -20,49 +27,34 @@ struct PointLight {
     float quadratic;
 };
 
-#define NR_POINT_LIGHTS 4
+#include "lighting.glsl"
+#include "virtual_texture.glsl"
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
 uniform vec3 viewPos;
+#if NR_POINT_LIGHTS > 0
 uniform PointLight pointLights[NR_POINT_LIGHTS];
+#endif
 uniform Material material;
+#ifdef WITH_EMISSION
 uniform float time;
-uniform bool withEmission;
+#endif
+#ifdef WITH_VIRTUAL_MATERIAL
+uniform VirtualTexture virtualMaterial; // streamed instead of material.diffuse
+#endif
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec4 surface, vec3 emission)
 {
-    // ambient
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
-
-    // diffuse
-    vec3 lightDir = normalize(light.position - FragPos);
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;
-
-    // specular
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;
-
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    // pulsating & floating emission
-    vec3 emission = vec3(0.0);
-    if (withEmission &&  (texture(material.specular, TexCoords).r == 0.0))
-    {
-        emission = texture(material.emission, TexCoords + vec2(0.0, time)).rgb;   //floating
-        emission = emission * (sin(2*time) * 0.5 + 0.5);                     //pulsating
-    }
-    return (ambient + diffuse + specular + emission);
+    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 ambient = light.ambient * surface.rgb;
+    vec3 diffuse = light.diffuse * Diffuse(normal, lightDir) * surface.rgb;
+    vec3 specular = light.specular * PhongSpecular(normal, lightDir, viewDir, material.shininess) * surface.a;
+    float attenuation = Attenuation(light.constant, light.linear, light.quadratic, length(light.position - fragPos));
+    return (ambient + diffuse + specular) * attenuation + emission;
 }
 
 void main()
@@ -71,8 +63,26 @@ void main()
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 result = vec3(0.0, 0.0, 0.0);
+    // one fetch of the packed material for all lights
+#ifdef WITH_VIRTUAL_MATERIAL
+    vec4 surface = SampleVirtual(virtualMaterial, TexCoords);
+#else
+    vec4 surface = texture(material.diffuse, TexCoords);
+#endif
+
+    // pulsating & floating emission
+    vec3 emission = vec3(0.0);
+#ifdef WITH_EMISSION
+    if (surface.a == 0.0)
+    {
+        emission = texture(material.emission, TexCoords + vec2(0.0, time)).rgb;   //floating
+        emission = emission * (sin(2*time) * 0.5 + 0.5);                     //pulsating
+    }
+#endif
     //point lights
+#if NR_POINT_LIGHTS > 0
     for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir, surface, emission);
+#endif
     FragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+}
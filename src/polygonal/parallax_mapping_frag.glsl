@@ -1,6 +1,18 @@
 #version 330 core
 out vec4 FragColor;
 
+// depth layers the view ray is marched through, more at grazing angles, and the binary search steps after
+// them (set by the loader, see helpers/shader.h)
+#ifndef PARALLAX_MIN_LAYERS
+#define PARALLAX_MIN_LAYERS 8
+#endif
+#ifndef PARALLAX_MAX_LAYERS
+#define PARALLAX_MAX_LAYERS 32
+#endif
+#ifndef PARALLAX_RELIEF_STEPS
+#define PARALLAX_RELIEF_STEPS 6
+#endif
+
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
@@ -10,16 +22,18 @@ in VS_OUT {
 } fs_in;
 
 uniform sampler2D diffuseMap;
-uniform sampler2D normalMap;
-uniform sampler2D depthMap;
+uniform sampler2D normalMap;  // rg: normal xy, z is rebuilt (BC5 when cooked)
+uniform sampler2D surfaceMap; // r: specular, g: ambient occlusion, b: roughness, a: depth
 
 uniform float heightScale;
 
+#include "lighting.glsl"
+
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 {
     // number of depth layers
-    const float minLayers = 8;
-    const float maxLayers = 32;
+    const float minLayers = PARALLAX_MIN_LAYERS;
+    const float maxLayers = PARALLAX_MAX_LAYERS;
     float numLayers = mix(maxLayers, minLayers, abs(dot(vec3(0.0, 0.0, 1.0), viewDir)));
     // calculate the size of each layer
     float layerDepth = 1.0 / numLayers;
@@ -31,23 +45,23 @@ vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 
     // get initial values
     vec2  currentTexCoords     = texCoords;
-    float currentDepthMapValue = texture(depthMap, currentTexCoords).r;
+    float currentDepthMapValue = texture(surfaceMap, currentTexCoords).a;
 
     while(currentLayerDepth < currentDepthMapValue)
     {
         // shift texture coordinates along direction of P
         currentTexCoords -= deltaTexCoords;
         // get depthmap value at current texture coordinates
-        currentDepthMapValue = texture(depthMap, currentTexCoords).r;
+        currentDepthMapValue = texture(surfaceMap, currentTexCoords).a;
         // get depth of next layer
         currentLayerDepth += layerDepth;
     }
 
     //relief PM
-    const int reliefSteps = 6;
+    const int reliefSteps = PARALLAX_RELIEF_STEPS;
     int currentStep = reliefSteps;
     while (currentStep > 0) {
-        currentDepthMapValue = texture(depthMap, currentTexCoords).r;
+        currentDepthMapValue = texture(surfaceMap, currentTexCoords).a;
         deltaTexCoords *= 0.5;
         layerDepth *= 0.5;
         // move to the left part of interval,
@@ -77,23 +91,22 @@ void main()
     discard;
 
     // obtain normal from normal map
-    vec3 normal = texture(normalMap, texCoords).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
+    vec3 normal;
+    normal.xy = texture(normalMap, texCoords).rg * 2.0 - 1.0;
+    normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
+    vec4 surface = texture(surfaceMap, texCoords);
 
     // get diffuse color
     vec3 color = texture(diffuseMap, texCoords).rgb;
     // ambient
-    vec3 ambient = 0.1 * color;
+    vec3 ambient = 0.1 * surface.g * color;
     // diffuse
     vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.TangentFragPos);
-    float diff = max(dot(lightDir, normal), 0.0);
-    vec3 diffuse = diff * color;
+    vec3 diffuse = Diffuse(normal, lightDir) * color;
     // specular    
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+    float spec = BlinnSpecular(normal, lightDir, viewDir, mix(64.0, 4.0, surface.b));
 
-    vec3 specular = vec3(0.2) * spec;
+    vec3 specular = vec3(surface.r) * spec;
     FragColor = vec4(ambient + diffuse + specular, 1.0);
 }
 
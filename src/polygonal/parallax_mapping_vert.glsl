@@ -2,8 +2,7 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
+layout (location = 3) in vec4 aTangent; // w: the bitangent's sign
 
 out VS_OUT {
     vec3 FragPos;
@@ -13,20 +12,22 @@ out VS_OUT {
     vec3 TangentFragPos;
 } vs_out;
 
+#include "draw_data.glsl"
+
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
 
-uniform vec3 lightPos;
 uniform vec3 viewPos;
 
 void main()
 {
+    mat4 model = DrawModel();
+    vec3 lightPos = DrawParameters().xyz; // the object's light
     vs_out.FragPos = vec3(model * vec4(aPos, 1.0));   
     vs_out.TexCoords = aTexCoords;   
     
-    vec3 T = normalize(mat3(model) * aTangent);
-    vec3 B = normalize(mat3(model) * aBitangent);
+    vec3 T = normalize(mat3(model) * aTangent.xyz);
+    vec3 B = normalize(mat3(model) * (cross(aNormal, aTangent.xyz) * aTangent.w));
     vec3 N = normalize(mat3(model) * aNormal);
     mat3 TBN = transpose(mat3(T, B, N));
 
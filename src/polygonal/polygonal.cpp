@@ -10,41 +10,123 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <helpers/filesystem.h>
+#include <helpers/async_io.h>
 #include <helpers/shader.h>
 #include <helpers/camera.h>
+#include <helpers/draw_batch.h>
+#include <helpers/gpu_culling.h>
+#include <helpers/geometry_heap.h>
+#include <helpers/mesh.h>
+#include <helpers/primitive_mesh.h>
+#include <helpers/scene_file.h>
+#include <helpers/software_occlusion.h>
+#include <helpers/texture_streamer.h>
+#include <helpers/virtual_texture.h>
+#include <helpers/world_streamer.h>
 
 #include "../objects.h"
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+// what the scene's assets turned into, by asset index; 2D textures and cooked meshes are streamed with
+// the cells using them
+struct SceneAssets
+{
+    std::vector<unsigned int> cubemaps;
+    std::vector<std::unique_ptr<VirtualTexture> > virtualTextures;
+    std::vector<GeometryDraw (*)()> builtins;                      // builtin:floor, builtin:cube, builtin:wall
+    std::vector<const OccluderMesh *> occluders;                   // the same, their triangles for the CPU to occlude with
+    PrimitiveHeap primitiveHeap;                                   // all the primitives', one VAO
+    std::vector<std::unique_ptr<PrimitiveMesh> > primitives;       // builtin:sphere, builtin:torus... with their LODs
+    const SceneObject *objects;                                    // the scene's
+    std::vector<unsigned char> lods;                               // by scene object, the level of detail it's drawn at
+    std::vector<unsigned char> hidden;                             // by scene object, whether it's behind the occluders from the camera
+    std::unique_ptr<WorldStreamer> world;
+};
+
+// what the lit passes compile into their shader variants rather than test on uniforms; bit i of a variant
+// defines LIT_FEATURES[i]
+enum LitFeature
+{
+    LIT_EMISSION = 1,        // an emission map on unit 1
+    LIT_VIRTUAL_MATERIAL = 2 // the material streamed from a virtual texture
+};
+const std::vector<std::string> LIT_FEATURES = {"WITH_EMISSION", "WITH_VIRTUAL_MATERIAL"};
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 unsigned int loadTexture(const char *path);
 unsigned int loadCubemap(std::vector<std::string> faces);
-void renderFloor();
-void renderCube();
-void renderWall();
-void renderScene(const Shader &shader, unsigned int flDiffuse, unsigned int flSpecular,
-                 unsigned int cDiffuse, unsigned int cSpecular, unsigned int cEmission);
+void loadStaticGeometry();
+void releaseStaticGeometry();
+GeometryDraw floorDraw();
+GeometryDraw cubeDraw();
+GeometryDraw wallDraw();
+template <typename Shape> OccluderMesh occluderMesh(const Shape &shape, bool closed);
+bool loadScene(const std::string &path, SceneFile &scene, SceneAssets &assets, TextureStreamer &textureStreamer);
+glm::mat4 objectPlacement(const SceneObject &object, float time);
+glm::mat4 objectModel(const SceneObject &object, const SceneAssets &assets, int mesh, float time);
+void batchObject(DrawBatch &batch, const SceneAssets &assets, const SceneObject &object, int mesh, float time,
+                 const std::vector<CullView> &views, const glm::vec4 &parameters = glm::vec4(0.0f));
+void batchMeshlets(DrawBatch &batch, const Mesh &mesh, int lod, const glm::mat4 &placement, const std::vector<CullView> &views,
+                   const glm::vec4 &parameters);
+void selectLods(SceneAssets &assets, const glm::vec3 &eye, float pixelsPerUnit, bool report);
+void cullHidden(SoftwareOcclusion &occlusion, SceneAssets &assets, const glm::mat4 &viewProjection, const glm::vec3 &eye,
+                float pixelsPerUnit, float time);
+unsigned int litFeatures(const SceneBinding &binding, const SceneAssets &assets, unsigned int features);
+template <typename Setup>
+void renderScene(ShaderVariants &shaders, unsigned int features, const Setup &setup, const SceneAssets &assets, DrawBatch &batch,
+                 const std::vector<CullView> &views, float time);
+void submitViews(DrawBatch &batch, Shader &shader, const std::vector<CullView> &views);
 void renderSkybox();
-void renderSphere(int xSeg = 64, int ySeg = 64);
-void renderTorus(double r = 0.2, double c = 0.45,
-                 int rSeg = 64, int cSeg = 32);
 
 // settings
 const unsigned int SCR_WIDTH = 1920;
 const unsigned int SCR_HEIGHT = 1000;
 float heightScale = 0.1;
+const unsigned int MAX_POINT_LIGHTS = 16; // the lighting pass is compiled for the scene's lights, up to this
+const int SHADOW_PCF_SAMPLES = 20;        // shadow cubemap taps
+const int PARALLAX_MIN_LAYERS = 8;        // depth layers parallax mapping marches looking straight on
+const int PARALLAX_MAX_LAYERS = 32;       // and at grazing angles
+const int PRIMITIVE_LODS = 5;             // builtin spheres, tori... from 64 segments down to 4
+const float LOD_PIXEL_ERROR = 1.0f;       // a level of detail is drawn while its error projects to at most this
+const float LOD_HYSTERESIS = 0.5f;        // and a coarser one replaces it once within this much of that
+const int OCCLUSION_WIDTH = 384;          // the depth buffer objects are occlusion culled against on the CPU,
+const int OCCLUSION_HEIGHT = 200;         // a fifth of the viewport across
+const float OCCLUDER_MIN_PIXELS = 12.0f;  // a builtin floor, wall or cube occludes once this many of those pixels across
+const size_t OCCLUDER_MAX_COUNT = 256;    // the biggest of them on screen, at most this many
 const float PI = 3.14159265359;
 const float TAU = 2 * PI;
 
 bool filling = false; //press SPACE to see scene without textures
 bool shadows = true;
 bool shadowsKeyPressed = false; //press H to enable/disable shadows
+bool virtualReport = false;
+bool virtualReportKeyPressed = false; //press V to print virtual texture residency and latency
+bool worldReport = false;
+bool worldReportKeyPressed = false; //press C to print cell streaming residency and latency
+bool occlusionCulling = true;
+bool occlusionKeyPressed = false; //press O to enable/disable occlusion culling against the last frame's depth
+bool meshletCulling = true;
+bool meshletKeyPressed = false; //press K to cull cooked meshes by meshlet or as whole objects
+bool softwareOcclusion = true;
+bool softwareOcclusionKeyPressed = false; //press B to enable/disable occlusion culling on the CPU behind floors, walls and cubes
+
+// meshlets of cooked meshes since the last report: tested and drawn on the CPU in how many ranges, or sent
+// to the GPU to cull
+struct MeshletStats
+{
+    long long tested, drawn, ranges, sent;
+} meshletStats;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 5.0f));
@@ -56,7 +138,9 @@ bool firstMouse = true;
 float deltaTime = 0.0f;    // time between current frame and last frame
 float lastFrame = 0.0f;
 
-int main() {
+int main(int argc, char **argv) {
+    Log::nameThread("main");
+
     // glfw: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -70,7 +154,7 @@ int main() {
     // glfw window creation
     GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Shmitov mach_graph", nullptr, nullptr);
     if (window == nullptr) {
-        std::cout << "Failed to create GLFW window" << std::endl;
+        Log::error("Failed to create GLFW window");
         glfwTerminate();
         return -1;
     }
@@ -86,20 +170,28 @@ int main() {
 
     // glad: load all OpenGL function pointers
     if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+        Log::error("Failed to initialize GLAD");
         return -1;
     }
+    // programs compile on the driver's threads while the first frames are drawn
+    if (Shader::enableParallelCompile((GLADloadproc) glfwGetProcAddress))
+        Log::info("Shaders compile in parallel (KHR_parallel_shader_compile)");
 
     // configure global opengl state
     glEnable(GL_DEPTH_TEST);
+    loadStaticGeometry();
 
-    // build and compile shaders
-    Shader skyboxShader("skybox_vert.glsl", "skybox_frag.glsl");
-    Shader lightingShader("basic_vert.glsl", "lights_frag.glsl");
-    Shader lampShader("basic_vert.glsl", "lamp_frag.glsl");
-    Shader shadowShader("shadow_mapping_vert.glsl", "shadow_mapping_frag.glsl");
-    Shader shadowDepthShader("shadow_mapping_depth_vert.glsl", "shadow_mapping_depth_frag.glsl", "shadow_mapping_depth_geom.glsl");
-    Shader parallaxShader("parallax_mapping_vert.glsl", "parallax_mapping_frag.glsl");
+    // shaders and textures come out of one mapped archive when it's been built (`cmake --build . --target pack`),
+    // from the loose files otherwise
+    if (FileSystem::mount(FileSystem::getPath("assets.pak")))
+        Log::info("Mounted assets.pak");
+
+    // shader sources are read all at once while the scene loads; the shared files they #include too
+    Shader::preload({"skybox_vert.glsl", "skybox_frag.glsl", "basic_vert.glsl", "lights_frag.glsl", "lamp_frag.glsl",
+                     "shadow_mapping_vert.glsl", "shadow_mapping_frag.glsl", "shadow_mapping_depth_vert.glsl",
+                     "shadow_mapping_depth_frag.glsl", "shadow_mapping_depth_geom.glsl", "parallax_mapping_vert.glsl",
+                     "parallax_mapping_frag.glsl", "virtual_feedback_frag.glsl", "lighting.glsl", "virtual_texture.glsl",
+                     "draw_data.glsl", "fallback_frag.glsl", "cull_comp.glsl", "hiz_comp.glsl"});
 
     // configure depth map FBO
     const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
@@ -124,56 +216,89 @@ int main() {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
-    //shader configuration
-    shadowShader.use();
-    shadowShader.setInt("diffuseTexture", 0);
-    shadowShader.setInt("shadowMap", 1);
-
     //load textures
-    //unsigned int floorTexture     = loadTexture(FileSystem::getPath("resources/textures/wood.png").c_str());
-    unsigned int floorTexture     = loadTexture(FileSystem::getPath("resources/textures/whitefloor.jpg").c_str());
-    unsigned int floorSpecularMap = loadTexture(FileSystem::getPath("resources/textures/wood_specular.png").c_str());
-
-    unsigned int boxDiffuseMap  = loadTexture(FileSystem::getPath("resources/textures/container3.jpg").c_str());
-    unsigned int boxSpecularMap = loadTexture(FileSystem::getPath("resources/textures/container2_specular.png").c_str());
-    unsigned int boxEmissionMap = loadTexture(FileSystem::getPath("resources/textures/container2_neon2.jpg").c_str());
-
-    unsigned int groundDiffuseMap = loadTexture(FileSystem::getPath("resources/textures/acoustic/albedo.jpg").c_str());
-    unsigned int groundNormalMap  = loadTexture(FileSystem::getPath("resources/textures/acoustic/normal.jpg").c_str());
-    unsigned int groundHeightMap  = loadTexture(FileSystem::getPath("resources/textures/acoustic/displacement.png").c_str());
-
-    // shader configuration
-    shadowShader.use();
-    shadowShader.setInt("diffuseTexture", 0);
-    shadowShader.setInt("depthMap", 1);
-
-    lightingShader.use();
-    lightingShader.setInt("material.diffuse", 0);
-    lightingShader.setInt("material.specular", 1);
-    lightingShader.setInt("material.emission", 2);
-
-    parallaxShader.use();
-    parallaxShader.setInt("diffuseMap", 0);
-    parallaxShader.setInt("normalMap", 1);
-    parallaxShader.setInt("depthMap", 2);
-
-    lampShader.use();
-    lampShader.setInt("lightColor", 0);
-
-    //load skybox textures
-    std::vector<std::string> faces
-            {
-                    FileSystem::getPath("resources/textures/underwater/uw_lf.jpg"),
-                    //FileSystem::getPath("resources/textures/underwater/uw_lf1.jpg"), //unconmment this and comment the line before to unsee clown face
-                    FileSystem::getPath("resources/textures/underwater/uw_rt.jpg"),
-                    FileSystem::getPath("resources/textures/underwater/uw_up.jpg"),
-                    FileSystem::getPath("resources/textures/underwater/uw_dn.jpg"),
-                    FileSystem::getPath("resources/textures/underwater/uw_ft.jpg"),
-                    FileSystem::getPath("resources/textures/underwater/uw_bk.jpg")
-            };
-    unsigned int cubemapTexture = loadCubemap(faces);
-    skyboxShader.use();
-    skyboxShader.setInt("skybox", 0);
+    // jpegs with restart markers (see texcook) decode on all cores
+    stbi_set_jpeg_decode_threads(std::thread::hardware_concurrency());
+    // 1/8 previews come in within the first frames, full sizes after them
+    TextureStreamer textureStreamer;
+
+    // the scene: its layout, lights and the textures and meshes they use (see helpers/scene_file.h),
+    // `polygonal resources/scenes/stress.scene` loads another one; its cells stream in around the camera
+    SceneFile scene;
+    SceneAssets assets;
+    if (!loadScene(argc > 1 ? std::string(argv[1]) : FileSystem::getPath("resources/scenes/seabed.scene"),
+                   scene, assets, textureStreamer)) {
+        glfwTerminate();
+        return -1;
+    }
+    int skybox = scene.find(scene.header->skybox);
+
+    // build and compile shaders; a warm start loads the programs linked by the last run from .shadercache
+    // instead. Every program is submitted here and compiles while frames are drawn: passes whose program
+    // isn't ready draw with the fallback one (or not at all). The lit passes are variants (see ShaderVariants
+    // in helpers/shader.h) specialized to the scene's lights and to what each object has
+    std::chrono::steady_clock::time_point shadersStart = std::chrono::steady_clock::now();
+    Shader fallbackShader("basic_vert.glsl", "fallback_frag.glsl");
+    ShaderDefines litDefines;
+    litDefines.set("NR_POINT_LIGHTS", (int)std::min(scene.header->lightCount, MAX_POINT_LIGHTS));
+    litDefines.set("PCF_SAMPLES", SHADOW_PCF_SAMPLES);
+    ShaderVariants lightingShaders("basic_vert.glsl", "lights_frag.glsl", nullptr, LIT_FEATURES, litDefines);
+    ShaderVariants shadowShaders("shadow_mapping_vert.glsl", "shadow_mapping_frag.glsl", nullptr, LIT_FEATURES, litDefines);
+    ShaderVariants shadowDepthShaders("shadow_mapping_depth_vert.glsl", "shadow_mapping_depth_frag.glsl", "shadow_mapping_depth_geom.glsl",
+                                      std::vector<std::string>());
+    ShaderVariants parallaxShaders("parallax_mapping_vert.glsl", "parallax_mapping_frag.glsl", nullptr, std::vector<std::string>(),
+                                   ShaderDefines().set("PARALLAX_MIN_LAYERS", PARALLAX_MIN_LAYERS).set("PARALLAX_MAX_LAYERS", PARALLAX_MAX_LAYERS));
+    lightingShaders.submitAll();
+    // the shadow pass samples no emission map (renderScene leaves LIT_EMISSION out of its variants), so only
+    // its variants with and without the virtual material are compiled
+    shadowShaders.submit(0);
+    shadowShaders.submit(LIT_VIRTUAL_MATERIAL);
+    shadowDepthShaders.submitAll();
+    parallaxShaders.submitAll();
+    Shader skyboxShader("skybox_vert.glsl", "skybox_frag.glsl", nullptr, ShaderDefines(), false);
+    Shader lampShader("basic_vert.glsl", "lamp_frag.glsl", nullptr, ShaderDefines(), false);
+    Shader virtualFeedbackShader("basic_vert.glsl", "virtual_feedback_frag.glsl", nullptr, ShaderDefines(), false);
+    Log::info("Shaders submitted in %.1f ms",
+              std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shadersStart).count());
+    int fallbackFrames = 0;
+    bool shadersReported = false;
+
+    // shader configuration, on each program once it's ready; the skybox and lamps sample unit 0, the default
+    lightingShaders.setFallback(&fallbackShader);
+    shadowShaders.setFallback(&fallbackShader);
+    parallaxShaders.setFallback(&fallbackShader);
+    shadowShaders.configure([](Shader &shader) {
+        shader.setInt("diffuseTexture", 0);
+        shader.setInt("depthMap", 1);
+    });
+
+    lightingShaders.configure([](Shader &shader) {
+        shader.setInt("material.diffuse", 0);
+        shader.setInt("material.emission", 1);
+    });
+
+    parallaxShaders.configure([](Shader &shader) {
+        shader.setInt("diffuseMap", 0);
+        shader.setInt("normalMap", 1);
+        shader.setInt("surfaceMap", 2);
+    });
+
+    bool startupReported = false;
+    long long framesSinceReport = 0;
+    // every object draw of a pass goes through it, one call per VAO (see helpers/draw_batch.h), culled on
+    // the GPU where compute shaders are there (see helpers/gpu_culling.h)
+    DrawBatch batch;
+    std::unique_ptr<Shader> cullShader, reduceShader;
+    std::unique_ptr<GpuCulling> culling;
+    if (GpuCulling::supported() && batch.multiDraw()) {
+        cullShader.reset(new Shader("cull_comp.glsl", ShaderDefines(), false));
+        reduceShader.reset(new Shader("hiz_comp.glsl", ShaderDefines(), false));
+        culling.reset(new GpuCulling(*cullShader, *reduceShader));
+        batch.setCulling(culling.get());
+    }
+    // and on the CPU before that, against a coarse depth buffer of the biggest builtin occluders in view
+    // (see helpers/software_occlusion.h), which needs no GPU
+    SoftwareOcclusion occlusion(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
 
     // render loop
     while (!glfwWindowShouldClose(window)) {
@@ -185,6 +310,60 @@ int main() {
         // input
         processInput(window);
 
+        // request and drop cells around the camera, upload what came in (texture previews / full sizes,
+        // meshes) within the frame's budget
+        assets.world->update(camera.Position, deltaTime);
+        if (!startupReported && assets.world->idle() && textureStreamer.pending() == 0) {
+            // every startup file has been read by now
+            AsyncIO::shared().report();
+            assets.world->report();
+            startupReported = true;
+        }
+        if (worldReport) {
+            assets.world->report();
+            VertexArrayState &vertexArrays = vertexArrayState();
+            DrawBatchStats draws = batch.stats();
+            double frames = (double)std::max(framesSinceReport, 1LL);
+            Log::info("geometry: %.1f draws in %.1f calls (%s) and %.1f VAO switches a frame, primitive heap %.1f of %.1f MB in %d holes, %.1f MB moved",
+                      draws.draws / frames, draws.calls / frames, batch.multiDraw() ? "multi-draw indirect" : "a draw each",
+                      vertexArrays.switches / frames, assets.primitiveHeap.usedBytes() / 1048576.0,
+                      assets.primitiveHeap.bytes() / 1048576.0, (int)assets.primitiveHeap.holes(), assets.primitiveHeap.moved() / 1048576.0);
+            double meshletFrames = (double)std::max(framesSinceReport, 1LL);
+            Log::info("meshlets: %.1f of %.1f drawn in %.1f ranges a frame on the CPU, %.1f a frame culled on the GPU",
+                      meshletStats.drawn / meshletFrames, meshletStats.tested / meshletFrames, meshletStats.ranges / meshletFrames,
+                      meshletStats.sent / meshletFrames);
+            memset(&meshletStats, 0, sizeof(meshletStats));
+            if (culling) {
+                GpuCullingStats culled = culling->stats();
+                double cullFrames = (double)std::max(culled.frames, 1LL);
+                Log::info("culling: %.1f of %.1f instances a frame drawn (frustum%s), over %lld frames read back",
+                          culled.instancesOut / cullFrames, culled.instancesIn / cullFrames,
+                          culled.occlusion ? " and occlusion" : "", culled.frames);
+                culling->resetStats();
+            }
+            SoftwareOcclusionStats hidden = occlusion.stats();
+            double hiddenFrames = (double)std::max(hidden.frames, 1LL);
+            Log::info("software occlusion: %.1f occluders (%.1f triangles) drawn in %.2f ms, %.1f of %.1f objects hidden in %.2f ms a frame (%.0f%%) on %d threads",
+                      hidden.occluders / hiddenFrames, hidden.triangles / hiddenFrames, hidden.rasterMs / hiddenFrames,
+                      hidden.hidden / hiddenFrames, hidden.tested / hiddenFrames, hidden.testMs / hiddenFrames,
+                      100.0 * hidden.hidden / std::max(hidden.tested, 1LL), occlusion.threads());
+            occlusion.resetStats();
+            vertexArrays.switches = 0;
+            batch.resetStats();
+            framesSinceReport = 0;
+        }
+        ++framesSinceReport;
+        const std::vector<WorldObject> &objects = assets.world->objects();
+        if (!shadersReported && Shader::cacheStats().linking == 0) {
+            ShaderCacheStats shaderStats = Shader::cacheStats();
+            Log::info("Shaders ready in %.1f ms (%s start, %d frames drawn with fallbacks): %d of %d programs from the binary cache, %d rejected",
+                      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shadersStart).count(),
+                      shaderStats.cached == shaderStats.programs ? "warm" : "cold", fallbackFrames, shaderStats.cached,
+                      shaderStats.programs, shaderStats.rejected);
+            shadersReported = true;
+        }
+        fallbackFrames += !shadersReported;
+
         // render
         glClearColor(0.2f, 0.6f, 0.8f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -194,6 +373,48 @@ int main() {
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
 
+        float time = glfwGetTime();
+
+        // the camera passes' objects are culled against its frustum and, once there is one, the last frame's depth
+        if (culling)
+            culling->beginFrame();
+        std::vector<CullView> cameraViews(1), feedbackViews(1);
+        cameraViews[0].viewProjection = projection * view;
+        cameraViews[0].eye = camera.Position;
+        cameraViews[0].occlusion = occlusionCulling;
+        cameraViews[0].cones = true;
+        feedbackViews[0] = cameraViews[0];
+        feedbackViews[0].occlusion = false; // pages for what's behind an occluder are wanted when it moves
+
+        // levels of detail for every pass of the frame, by how big their error looks from the camera
+        selectLods(assets, camera.Position, SCR_HEIGHT * 2 / (2.0f * tanf(glm::radians(camera.Zoom) / 2.0f)), worldReport);
+        worldReport = false;
+
+        // what the camera passes leave out, behind the floors, walls and cubes in front of it
+        std::fill(assets.hidden.begin(), assets.hidden.end(), 0);
+        if (occlusionCulling && softwareOcclusion)
+            cullHidden(occlusion, assets, projection * view, camera.Position,
+                       OCCLUSION_HEIGHT / (2.0f * tanf(glm::radians(camera.Zoom) / 2.0f)), time);
+
+        // virtual texture feedback: which pages the objects using one need, they stream in over the next frames
+        for (unsigned int a = 0; a < scene.header->assetCount; a++) {
+            VirtualTexture *virtualTexture = assets.virtualTextures[a].get();
+            if (!virtualTexture || !virtualTexture->ready() || !virtualFeedbackShader.ready())
+                continue;
+            virtualTexture->beginFeedback(virtualFeedbackShader, "virtualTexture", SCR_WIDTH * 2, SCR_HEIGHT * 2);
+            virtualFeedbackShader.setMat4("projection", projection);
+            virtualFeedbackShader.setMat4("view", view);
+            for (size_t i = 0; i < objects.size(); i++)
+                if (objects[i].binding.virtualTexture == (int)a)
+                    batchObject(batch, assets, *objects[i].object, objects[i].binding.mesh, time, feedbackViews);
+            submitViews(batch, virtualFeedbackShader, feedbackViews);
+            virtualTexture->endFeedback();
+            virtualTexture->update();
+            if (virtualReport)
+                virtualTexture->report();
+        }
+        virtualReport = false;
+
         if (shadows) {
             // 0. create depth cubemap transformation matrices
             // only ONE light source used for shadow!
@@ -208,120 +429,146 @@ int main() {
             shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)));
             shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
             shadowTransforms.push_back(shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
+            // each face culls on its own, with nothing to occlude against; faces turned from the light cast
+            // shadows too, as nothing is back-face culled
+            std::vector<CullView> shadowViews(6);
+            for (unsigned int i = 0; i < 6; ++i) {
+                shadowViews[i].viewProjection = shadowTransforms[i];
+                shadowViews[i].eye = lightPos;
+                shadowViews[i].occlusion = false;
+                shadowViews[i].cones = false;
+            }
 
             // 1. render scene to depth cubemap
             glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
             glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
             glClear(GL_DEPTH_BUFFER_BIT);
-            shadowDepthShader.use();
-            for (unsigned int i = 0; i < 6; ++i)
-                shadowDepthShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
-            shadowDepthShader.setFloat("far_plane", far_plane);
-            shadowDepthShader.setVec3("lightPos", lightPos);
-            renderScene(shadowDepthShader, floorTexture, floorSpecularMap, boxDiffuseMap, boxSpecularMap, boxEmissionMap);
+            renderScene(shadowDepthShaders, 0, [&](Shader &shader) {
+                for (unsigned int i = 0; i < 6; ++i)
+                    shader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+                shader.setFloat("far_plane", far_plane);
+                shader.setVec3("lightPos", lightPos);
+            }, assets, batch, shadowViews, time);
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
             // 2.1 render scene using the generated depth/shadow map
             glViewport(0, 0, SCR_WIDTH * 2, SCR_HEIGHT * 2);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            shadowShader.use();
-            shadowShader.setMat4("projection", projection);
-            shadowShader.setMat4("view", view);
-            shadowShader.setVec3("lightPos", lightPos);
-            shadowShader.setVec3("viewPos", camera.Position);
-            shadowShader.setFloat("far_plane", far_plane);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, floorTexture);
             glActiveTexture(GL_TEXTURE1);
             glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-            //render floor
-            model = glm::mat4(1.0f);
-            shadowShader.setMat4("model", model);
-            renderFloor();
-
-            // bind cubes diffuse map
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, boxDiffuseMap);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-            // render boxes
-            for (unsigned int i = 0; i < 7; i++) {
-                float angle = 15.0f;
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, cubePositions[i]);
-                model = glm::rotate(model,i * ((i & 1) ? (float)glfwGetTime() : angle), glm::vec3(1.0f, 0.3f, 0.5f));
-                shadowShader.setMat4("model", model);
-                renderCube();
-            }
+            // the shadow map has unit 1, no emission here
+            renderScene(shadowShaders, LIT_VIRTUAL_MATERIAL, [&](Shader &shader) {
+                shader.setMat4("projection", projection);
+                shader.setMat4("view", view);
+                shader.setVec3("lightPos", lightPos);
+                shader.setVec3("viewPos", camera.Position);
+                shader.setFloat("far_plane", far_plane);
+            }, assets, batch, cameraViews, time);
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
         } else {
             // 2.2 render scene with other lights
             glViewport(0, 0, SCR_WIDTH * 2, SCR_HEIGHT * 2);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            lightingShader.use();
-            lightingShader.setMat4("projection", projection);
-            lightingShader.setMat4("view", view);
-            lightingShader.setVec3("viewPos", camera.Position);
-            lightingShader.setFloat("material.shininess", 64.0f);
-            lightingShader.setFloat("time", glfwGetTime());
-            //point lights
-            for (int i = 0; i < 4; i++) {
-                lightingShader.setVec3("pointLights[" + std::to_string(i) + "].position", pointLightPositions[i]);
-                lightingShader.setVec3("pointLights["  + std::to_string(i) + "].ambient", pointLightColors[i].x * 0.1,  pointLightColors[i].y  * 0.1,  pointLightColors[i].z * 0.1);
-                lightingShader.setVec3("pointLights["  + std::to_string(i) + "].diffuse", pointLightColors[i].x,  pointLightColors[i].y,  pointLightColors[i].z);
-                lightingShader.setVec3("pointLights["  + std::to_string(i) + "].specular", pointLightColors[i].x,  pointLightColors[i].y,  pointLightColors[i].z);
-                lightingShader.setFloat("pointLights["  + std::to_string(i) + "].constant", 1.0f);
-                lightingShader.setFloat("pointLights["  + std::to_string(i) + "].linear", 0.09);
-                lightingShader.setFloat("pointLights["  + std::to_string(i) + "].quadratic", 0.032);
-            }
-            renderScene(lightingShader, floorTexture, floorSpecularMap, boxDiffuseMap, boxSpecularMap, boxEmissionMap);
+            renderScene(lightingShaders, LIT_EMISSION | LIT_VIRTUAL_MATERIAL, [&](Shader &shader) {
+                shader.setMat4("projection", projection);
+                shader.setMat4("view", view);
+                shader.setVec3("viewPos", camera.Position);
+                shader.setFloat("material.shininess", 64.0f);
+                shader.setFloat("time", time);
+                //point lights, as many as the shader was compiled for
+                for (unsigned int i = 0; i < std::min(scene.header->lightCount, MAX_POINT_LIGHTS); i++) {
+                    const SceneLight &light = scene.lights[i];
+                    glm::vec3 color(light.color[0], light.color[1], light.color[2]);
+                    shader.setVec3("pointLights[" + std::to_string(i) + "].position", glm::vec3(light.position[0], light.position[1], light.position[2]));
+                    shader.setVec3("pointLights["  + std::to_string(i) + "].ambient", color * 0.1f);
+                    shader.setVec3("pointLights["  + std::to_string(i) + "].diffuse", color);
+                    shader.setVec3("pointLights["  + std::to_string(i) + "].specular", color);
+                    shader.setFloat("pointLights["  + std::to_string(i) + "].constant", light.constant);
+                    shader.setFloat("pointLights["  + std::to_string(i) + "].linear", light.linear);
+                    shader.setFloat("pointLights["  + std::to_string(i) + "].quadratic", light.quadratic);
+                }
+            }, assets, batch, cameraViews, time);
 
             // 3. render lamps
-            lampShader.use();
-            lampShader.setMat4("projection", projection);
-            lampShader.setMat4("view", view);
-            for (int i = 0; i < 4; i++) {
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, pointLightPositions[i]);
-                model = glm::scale(model, glm::vec3(0.2f));
-                lampShader.setVec3("lightColor", pointLightColors[i]);
-                lampShader.setMat4("model", model);
-                renderCube();
+            if (lampShader.ready()) {
+                lampShader.use();
+                lampShader.setMat4("projection", projection);
+                lampShader.setMat4("view", view);
+                for (unsigned int i = 0; i < scene.header->lightCount; i++) {
+                    const SceneLight &light = scene.lights[i];
+                    model = glm::mat4(1.0f);
+                    model = glm::translate(model, glm::vec3(light.position[0], light.position[1], light.position[2]));
+                    model = glm::scale(model, glm::vec3(0.2f));
+                    batch.add(cubeDraw(), model, glm::vec4(light.color[0], light.color[1], light.color[2], 1.0f),
+                              glm::vec4(light.position[0], light.position[1], light.position[2], 0.2f * sqrtf(3.0f)));
+                }
+                submitViews(batch, lampShader, cameraViews);
             }
 
-            // 4. render parallax-mapped wall
-            parallaxShader.use();
-            parallaxShader.setMat4("projection", projection);
-            parallaxShader.setMat4("view", view);
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, wallPosition);
-            model = glm::rotate(model, glm::radians((float)glfwGetTime() * -5.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0))); // rotate the quad to show parallax mapping from multiple directions
-            parallaxShader.setMat4("model", model);
-            parallaxShader.setVec3("viewPos", camera.Position);
-            parallaxShader.setVec3("lightPos", pointLightPositions[2]);
-            parallaxShader.setFloat("heightScale", heightScale); // adjust with Q and E keys
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, groundDiffuseMap);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, groundNormalMap);
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, groundHeightMap);
-            renderWall();
+            // 4. render parallax-mapped objects
+            if (Shader *parallaxShader = parallaxShaders.get(0)) {
+                parallaxShader->use();
+                parallaxShader->setMat4("projection", projection);
+                parallaxShader->setMat4("view", view);
+                parallaxShader->setVec3("viewPos", camera.Position);
+                parallaxShader->setFloat("heightScale", heightScale); // adjust with Q and E keys
+                // a batch per set of maps, each object's light in its parameters
+                std::vector<size_t> parallax;
+                for (size_t i = 0; i < objects.size(); i++)
+                    if (objects[i].object->pass == SCENE_PARALLAX)
+                        parallax.push_back(i);
+                std::sort(parallax.begin(), parallax.end(), [&](size_t a, size_t b) {
+                    const SceneBinding &x = objects[a].binding, &y = objects[b].binding;
+                    return std::make_tuple(x.material, x.normal, x.surface) < std::make_tuple(y.material, y.normal, y.surface);
+                });
+                for (size_t p = 0; p < parallax.size(); p++) {
+                    const SceneObject &object = *objects[parallax[p]].object;
+                    const SceneBinding &binding = objects[parallax[p]].binding;
+                    const SceneBinding *previous = p > 0 ? &objects[parallax[p - 1]].binding : nullptr;
+                    if (!previous || previous->material != binding.material || previous->normal != binding.normal ||
+                        previous->surface != binding.surface) {
+                        submitViews(batch, *parallaxShader, cameraViews);
+                        glActiveTexture(GL_TEXTURE0);
+                        glBindTexture(GL_TEXTURE_2D, assets.world->texture(binding.material));
+                        glActiveTexture(GL_TEXTURE1);
+                        glBindTexture(GL_TEXTURE_2D, assets.world->texture(binding.normal));
+                        glActiveTexture(GL_TEXTURE2);
+                        glBindTexture(GL_TEXTURE_2D, assets.world->texture(binding.surface));
+                    }
+                    const SceneLight &light = scene.lights[object.light];
+                    batchObject(batch, assets, object, binding.mesh, time, cameraViews,
+                                glm::vec4(light.position[0], light.position[1], light.position[2], 1.0f));
+                }
+                submitViews(batch, *parallaxShader, cameraViews);
+            }
+        }
+
+        // the pyramid next frame's camera passes are occlusion culled against; the depth matches the view only
+        // where the framebuffer is the viewport's size
+        if (culling) {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            if (occlusionCulling && width == (int)SCR_WIDTH * 2 && height == (int)SCR_HEIGHT * 2)
+                culling->updatePyramid(width, height, projection * view);
+            else
+                culling->invalidatePyramid();
         }
 
         // 4. render skybox as last
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        //glDepthMask(GL_FALSE);
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        renderSkybox();
-        //glDepthMask(GL_TRUE);
-        glDepthFunc(GL_FALSE); // set depth function back to default
+        if (skybox >= 0 && skyboxShader.ready()) {
+            glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+            skyboxShader.use();
+            //glDepthMask(GL_FALSE);
+            view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
+            skyboxShader.setMat4("view", view);
+            skyboxShader.setMat4("projection", projection);
+            // skybox cube
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, assets.cubemaps[skybox]);
+            renderSkybox();
+            //glDepthMask(GL_TRUE);
+            glDepthFunc(GL_FALSE); // set depth function back to default
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         glfwSwapBuffers(window);
@@ -329,6 +576,7 @@ int main() {
     }
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
+    releaseStaticGeometry();
     glfwTerminate();
     return 0;
 }
@@ -367,6 +615,51 @@ void processInput(GLFWwindow *window) {
     {
         shadowsKeyPressed = false;
     }
+    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS && !virtualReportKeyPressed)
+    {
+        virtualReport = true;
+        virtualReportKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_RELEASE)
+    {
+        virtualReportKeyPressed = false;
+    }
+    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS && !worldReportKeyPressed)
+    {
+        worldReport = true;
+        worldReportKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE)
+    {
+        worldReportKeyPressed = false;
+    }
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !occlusionKeyPressed)
+    {
+        occlusionCulling = !occlusionCulling;
+        occlusionKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+    {
+        occlusionKeyPressed = false;
+    }
+    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS && !softwareOcclusionKeyPressed)
+    {
+        softwareOcclusion = !softwareOcclusion;
+        softwareOcclusionKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE)
+    {
+        softwareOcclusionKeyPressed = false;
+    }
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && !meshletKeyPressed)
+    {
+        meshletCulling = !meshletCulling;
+        meshletKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_RELEASE)
+    {
+        meshletKeyPressed = false;
+    }
 
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
     {
@@ -414,401 +707,407 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     camera.ProcessMouseScroll(yoffset);
 }
 
-// renders the 3D scene
-void renderScene(const Shader &shader, unsigned int flDiffuse, unsigned int flSpecular,
-                 unsigned int cDiffuse, unsigned int cSpecular, unsigned int cEmission)
+// loads the scene and what isn't streamed by cell: cubemaps, virtual textures and the builtin meshes
+bool loadScene(const std::string &path, SceneFile &scene, SceneAssets &assets, TextureStreamer &textureStreamer)
 {
-    //bind floor diffuse map
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, flDiffuse);
-    // bind floor specular map
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, flSpecular);
-    //render floor
-    glm::mat4 model = glm::mat4(1.0f);
-    shader.setMat4("model", model);
-    shader.setBool("withEmission", false);
-    renderFloor();
-
-    // bind cubes diffuse map
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, cDiffuse);
-    // bind cubes specular map
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, cSpecular);
-    // bind cubes emission map
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, cEmission);
-    // render boxes
-    for (unsigned int i = 0; i < 7; i++) {
-        float angle = 15.0f;
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, cubePositions[i]);
-        model = glm::rotate(model,i * ((i & 1) ? (float)glfwGetTime() : angle), glm::vec3(1.0f, 0.3f, 0.5f));
-        shader.setMat4("model", model);
-        shader.setBool("withEmission", i & 2);
-        renderCube();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string error;
+    if (!scene.load(path, error)) {
+        Log::error("SCENE::FILE_NOT_SUCCESFULLY_READ: %s", error);
+        return false;
     }
+    unsigned int assetCount = scene.header->assetCount;
+    assets.cubemaps.assign(assetCount, 0);
+    assets.virtualTextures.resize(assetCount);
+    assets.builtins.assign(assetCount, nullptr);
+    assets.occluders.assign(assetCount, nullptr);
+    assets.primitives.resize(assetCount);
+    assets.objects = scene.objects;
+    assets.lods.assign(scene.header->objectCount, 0);
+    assets.hidden.assign(scene.header->objectCount, 0);
+    for (unsigned int a = 0; a < assetCount; a++) {
+        const SceneAsset &asset = scene.assets[a];
+        if (asset.kind == SCENE_VIRTUAL)
+            assets.virtualTextures[a].reset(new VirtualTexture(SceneFile::resolve(scene.path(asset, 0))));
+        else if (asset.kind == SCENE_CUBEMAP) {
+            std::vector<std::string> faces;
+            for (unsigned int i = 0; i < asset.pathCount; i++)
+                faces.push_back(SceneFile::resolve(scene.path(asset, i)));
+            assets.cubemaps[a] = loadCubemap(faces);
+        } else if (asset.kind == SCENE_MESH) {
+            std::string mesh = scene.path(asset, 0);
+            static const OccluderMesh floorOccluder = occluderMesh(FLOOR, false), cubeOccluder = occluderMesh(CUBE, true),
+                                      wallOccluder = occluderMesh(WALL, false);
+            if (mesh == "builtin:floor") {
+                assets.builtins[a] = floorDraw;
+                assets.occluders[a] = &floorOccluder;
+            } else if (mesh == "builtin:cube") {
+                assets.builtins[a] = cubeDraw;
+                assets.occluders[a] = &cubeOccluder;
+            } else if (mesh == "builtin:wall") {
+                assets.builtins[a] = wallDraw;
+                assets.occluders[a] = &wallOccluder;
+            } else if (const Primitive *primitive = scenePrimitive(mesh)) {
+                assets.primitives[a].reset(new PrimitiveMesh(assets.primitiveHeap));
+                assets.primitives[a]->build(*primitive, PRIMITIVE_LODS);
+            }
+        }
+    }
+    assets.world.reset(new WorldStreamer(scene, textureStreamer));
+
+    if (scene.header->hasCamera)
+        camera.Position = glm::vec3(scene.header->camera[0], scene.header->camera[1], scene.header->camera[2]);
+    Log::info("Loaded %s: %u objects in %u cells, %u lights in %g ms", path, scene.header->objectCount,
+              scene.header->cellCount, scene.header->lightCount,
+              std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return true;
 }
 
-// renders floor
-unsigned int floorVAO = 0;
-void renderFloor() {
-    if (floorVAO == 0) {
-        unsigned int floorVBO;
-        glGenVertexArrays(1, &floorVAO);
-        glGenBuffers(1, &floorVBO);
-        glBindVertexArray(floorVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, floorVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(floorVertices), floorVertices, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) 0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *) (6 * sizeof(float)));
-        glBindVertexArray(0);
-    }
-    glBindVertexArray(floorVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+// object space to world space
+glm::mat4 objectPlacement(const SceneObject &object, float time)
+{
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(object.position[0], object.position[1], object.position[2]));
+    if (object.angle != 0.0f || object.spin != 0.0f)
+        model = glm::rotate(model, object.angle + object.spin * time, glm::vec3(object.axis[0], object.axis[1], object.axis[2]));
+    return glm::scale(model, glm::vec3(object.scale[0], object.scale[1], object.scale[2]));
 }
 
-// renders cube
-unsigned int cubeVAO = 0;
-void renderCube()
+// cooked meshes store positions in 0..1 and builtin primitives in -1..1, their decode matrices take them back to object space
+glm::mat4 objectModel(const SceneObject &object, const SceneAssets &assets, int mesh, float time)
 {
-    if (cubeVAO == 0) {
-        unsigned int cubeVBO = 0;
-        glGenVertexArrays(1, &cubeVAO);
-        glGenBuffers(1, &cubeVBO);
-        // fill buffer
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
-        // link vertex attributes
-        glBindVertexArray(cubeVAO);
-        // position attribute
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        // normal attribute
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        // texture coord attribute
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-    }
-    glBindVertexArray(cubeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+    glm::mat4 model = objectPlacement(object, time);
+    if (mesh >= 0 && assets.primitives[mesh])
+        model = model * assets.primitives[mesh]->decodeMatrix();
+    else if (const Mesh *cooked = mesh >= 0 ? assets.world->mesh(mesh) : nullptr)
+        model = model * cooked->decodeMatrix();
+    return model;
 }
 
-
-// renders a 1x1 wall with tangent vectors
-unsigned int wallVAO = 0;
-unsigned int wallVBO;
-void renderWall()
+// adds the object at its level of detail to batch, for views; a cooked mesh goes by meshlet
+void batchObject(DrawBatch &batch, const SceneAssets &assets, const SceneObject &object, int mesh, float time,
+                 const std::vector<CullView> &views, const glm::vec4 &parameters)
 {
-    if (wallVAO == 0) {
-        // positions
-        glm::vec3 pos1(-1.0f,  1.0f, 0.0f);
-        glm::vec3 pos2(-1.0f, -1.0f, 0.0f);
-        glm::vec3 pos3( 1.0f, -1.0f, 0.0f);
-        glm::vec3 pos4( 1.0f,  1.0f, 0.0f);
-        // texture coordinates
-        glm::vec2 uv1(0.0f, 1.0f);
-        glm::vec2 uv2(0.0f, 0.0f);
-        glm::vec2 uv3(1.0f, 0.0f);
-        glm::vec2 uv4(1.0f, 1.0f);
-        // normal vector
-        glm::vec3 nm(0.0f, 0.0f, 1.0f);
-
-        // calculate tangent/bitangent vectors of both triangles
-        glm::vec3 tangent1, bitangent1;
-        glm::vec3 tangent2, bitangent2;
-        // triangle 1
-        glm::vec3 edge1 = pos2 - pos1;
-        glm::vec3 edge2 = pos3 - pos1;
-        glm::vec2 deltaUV1 = uv2 - uv1;
-        glm::vec2 deltaUV2 = uv3 - uv1;
-
-        float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-        tangent1 = glm::normalize(tangent1);
-
-        bitangent1.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent1.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent1.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-        bitangent1 = glm::normalize(bitangent1);
-
-        // triangle 2
-        edge1 = pos3 - pos1;
-        edge2 = pos4 - pos1;
-        deltaUV1 = uv3 - uv1;
-        deltaUV2 = uv4 - uv1;
-
-        f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-        tangent2.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tangent2.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tangent2.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-        tangent2 = glm::normalize(tangent2);
-
-
-        bitangent2.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-        bitangent2.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-        bitangent2.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-        bitangent2 = glm::normalize(bitangent2);
-
-
-        float wallVertices[] = {
-                // positions            // normal         // texcoords  // tangent                          // bitangent
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-
-                pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-                pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z
-        };
-        // configure plane VAO
-        glGenVertexArrays(1, &wallVAO);
-        glGenBuffers(1, &wallVBO);
-        glBindVertexArray(wallVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, wallVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(wallVertices), &wallVertices, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)nullptr);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
-    }
-    glBindVertexArray(wallVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+    // the camera's passes leave what's behind the occluders out
+    if (mesh < 0 || (views.size() == 1 && views[0].occlusion && assets.hidden[&object - assets.objects]))
+        return;
+    int lod = assets.lods[&object - assets.objects];
+    GeometryDraw draw = GeometryDraw();
+    if (assets.builtins[mesh])
+        draw = assets.builtins[mesh]();
+    else if (assets.primitives[mesh])
+        draw = assets.primitives[mesh]->drawOf(lod);
+    else if (const Mesh *cooked = assets.world->mesh(mesh)) {
+        if (meshletCulling && cooked->ready() && cooked->meshletCount(lod) > 1) {
+            batchMeshlets(batch, *cooked, lod, objectPlacement(object, time), views, parameters);
+            return;
+        }
+        draw = cooked->drawOf(lod);
+    }
+    if (draw.count)
+        batch.add(draw, objectModel(object, assets, mesh, time), parameters,
+                  glm::vec4(object.position[0], object.position[1], object.position[2], object.radius));
 }
 
-// renders skybox
-unsigned int skyboxVAO = 0;
-void renderSkybox()
+// a cooked mesh's meshlets at lod rather than the whole of it. When the batch culls on the GPU each is a draw
+// of its own with its world space sphere and cone; otherwise the CPU culls them against the one view, the
+// whole object first, and the ones left next to each other go out as one draw. Several views (a shadow
+// cubemap's faces) without the GPU draw the object whole
+void batchMeshlets(DrawBatch &batch, const Mesh &mesh, int lod, const glm::mat4 &placement, const std::vector<CullView> &views,
+                   const glm::vec4 &parameters)
 {
-    if (skyboxVAO == 0) {
-        unsigned int skyboxVBO = 0;
-        glGenVertexArrays(1, &skyboxVAO);
-        glGenBuffers(1, &skyboxVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-        glBindVertexArray(skyboxVAO);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) nullptr);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-    }
-    glBindVertexArray(skyboxVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+    glm::mat4 model = placement * mesh.decodeMatrix();
+    const MeshletSet &meshlets = mesh.meshletSet();
+    size_t first = mesh.firstMeshlet(lod), count = mesh.meshletCount(lod);
+    if (batch.culls()) {
+        // the cones only turn with the object under a uniform scale
+        bool uniform;
+        float scale = MeshletCuller::scale(placement, uniform);
+        glm::mat3 rotation = glm::mat3(placement) / scale;
+        for (size_t m = first; m < first + count; m++) {
+            glm::vec3 center = glm::vec3(placement * glm::vec4(meshlets.x[m], meshlets.y[m], meshlets.z[m], 1.0f));
+            glm::vec4 cone(0.0f, 0.0f, 0.0f, 1.0f);
+            if (uniform && meshlets.cutoff[m] < 1.0f)
+                cone = glm::vec4(rotation * glm::vec3(meshlets.axisX[m], meshlets.axisY[m], meshlets.axisZ[m]), meshlets.cutoff[m]);
+            batch.add(mesh.meshletDraw(m, 1), model, parameters, glm::vec4(center, meshlets.radius[m] * scale), cone);
+        }
+        meshletStats.sent += count;
+        return;
+    }
+    if (views.size() != 1) {
+        batch.add(mesh.drawOf(lod), model, parameters);
+        return;
+    }
+    MeshletView view = MeshletCuller::view(views[0].viewProjection, views[0].eye, views[0].cones, placement);
+    meshletStats.tested += count;
+    if (!MeshletCuller::visible(view, mesh.center(), mesh.radius()))
+        return;
+    static std::vector<unsigned char> visible;
+    visible.resize(count);
+    meshletStats.drawn += MeshletCuller::cull(meshlets, first, count, view, visible.data());
+    for (size_t i = 0, end; i < count; i = end) {
+        for (end = i + 1; end < count && visible[end] == visible[i];)
+            end++;
+        if (visible[i]) {
+            batch.add(mesh.meshletDraw(first + i, end - i), model, parameters);
+            meshletStats.ranges++;
+        }
+    }
 }
 
-
-
-// renders (and builds at first invocation) a sphere
-unsigned int sphereIndexCount = 0;
-unsigned int sphereVAO = 0;
-void renderSphere(int xSeg, int ySeg)
+// per resident object, the coarsest level of detail whose object-space error, scaled with the object and
+// seen from its nearest point, stays within LOD_PIXEL_ERROR pixels. Levels only get coarser once within
+// LOD_HYSTERESIS of that, so an object on the boundary doesn't switch back and forth as it moves.
+// pixelsPerUnit: what a unit at distance 1 projects to
+void selectLods(SceneAssets &assets, const glm::vec3 &eye, float pixelsPerUnit, bool report)
 {
-    if (sphereVAO == 0) {
-        glGenVertexArrays(1, &sphereVAO);
-
-        unsigned int vbo, ebo;
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
+    const std::vector<WorldObject> &objects = assets.world->objects();
+    size_t triangles = 0, fullTriangles = 0;
+    int coarsened = 0;
+    for (size_t i = 0; i < objects.size(); i++) {
+        const SceneObject &object = *objects[i].object;
+        int mesh = objects[i].binding.mesh;
+        const PrimitiveMesh *primitive = mesh >= 0 ? assets.primitives[mesh].get() : nullptr;
+        const Mesh *cooked = mesh >= 0 && !primitive ? assets.world->mesh(mesh) : nullptr;
+        int count = primitive ? primitive->lodCount() : cooked ? cooked->lodCount() : 1;
+        unsigned char &lod = assets.lods[&object - assets.objects];
+        if (count <= 1) {
+            lod = 0;
+            continue;
+        }
+        float scale = std::max(std::fabs(object.scale[0]), std::max(std::fabs(object.scale[1]), std::fabs(object.scale[2])));
+        float distance = std::max(glm::length(glm::vec3(object.position[0], object.position[1], object.position[2]) - eye) - object.radius, 0.1f);
+        float pixelsPerError = scale * pixelsPerUnit / distance;
+        int level = std::min((int)lod, count - 1);
+        while (level > 0 && (primitive ? primitive->lodError(level) : cooked->lodError(level)) * pixelsPerError > LOD_PIXEL_ERROR)
+            level--;
+        while (level + 1 < count &&
+               (primitive ? primitive->lodError(level + 1) : cooked->lodError(level + 1)) * pixelsPerError <= LOD_PIXEL_ERROR * LOD_HYSTERESIS)
+            level++;
+        lod = (unsigned char)level;
+        coarsened += level > 0;
+        triangles += primitive ? primitive->triangleCount(level) : cooked->triangleCount(level);
+        fullTriangles += primitive ? primitive->triangleCount(0) : cooked->triangleCount(0);
+    }
+    if (report)
+        Log::info("LOD: %d of %d objects coarser than their original, %zu of %zu triangles drawn", coarsened, (int)objects.size(),
+                  triangles, fullTriangles);
+}
 
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec2> uv;
-        std::vector<glm::vec3> normals;
-        std::vector<unsigned int> indices;
+// draws the builtin floors, walls and cubes that look big enough from eye into occlusion, the biggest
+// OCCLUDER_MAX_COUNT of them, and marks the resident objects whose bounding boxes are behind them in
+// assets.hidden. An object without a radius is never hidden. pixelsPerUnit: what a unit at distance 1
+// projects to in occlusion's buffer
+void cullHidden(SoftwareOcclusion &occlusion, SceneAssets &assets, const glm::mat4 &viewProjection, const glm::vec3 &eye,
+                float pixelsPerUnit, float time)
+{
+    const std::vector<WorldObject> &objects = assets.world->objects();
+    static std::vector<std::pair<float, size_t> > candidates;
+    candidates.clear();
+    for (size_t i = 0; i < objects.size(); i++) {
+        const SceneObject &object = *objects[i].object;
+        if (objects[i].binding.mesh < 0 || !assets.occluders[objects[i].binding.mesh])
+            continue;
+        float distance = std::max(glm::length(glm::vec3(object.position[0], object.position[1], object.position[2]) - eye) - object.radius, 0.1f);
+        float pixels = 2.0f * object.radius * pixelsPerUnit / distance;
+        if (pixels >= OCCLUDER_MIN_PIXELS)
+            candidates.push_back(std::make_pair(-pixels, i));
+    }
+    if (candidates.size() > OCCLUDER_MAX_COUNT) {
+        std::nth_element(candidates.begin(), candidates.begin() + OCCLUDER_MAX_COUNT, candidates.end());
+        candidates.resize(OCCLUDER_MAX_COUNT);
+    }
+    occlusion.begin(viewProjection);
+    for (size_t c = 0; c < candidates.size(); c++) {
+        const WorldObject &occluder = objects[candidates[c].second];
+        occlusion.addOccluder(*assets.occluders[occluder.binding.mesh], objectPlacement(*occluder.object, time));
+    }
+    occlusion.rasterize();
+
+    static std::vector<glm::vec3> boxMin, boxMax;
+    static std::vector<size_t> tested;
+    static std::vector<unsigned char> hidden;
+    boxMin.clear();
+    boxMax.clear();
+    tested.clear();
+    for (size_t i = 0; i < objects.size(); i++) {
+        const SceneObject &object = *objects[i].object;
+        if (objects[i].binding.mesh < 0 || object.radius <= 0.0f)
+            continue;
+        glm::vec3 center(object.position[0], object.position[1], object.position[2]);
+        boxMin.push_back(center - object.radius);
+        boxMax.push_back(center + object.radius);
+        tested.push_back(&object - assets.objects);
+    }
+    hidden.resize(tested.size());
+    occlusion.test(boxMin.data(), boxMax.data(), tested.size(), hidden.data());
+    for (size_t t = 0; t < tested.size(); t++)
+        assets.hidden[tested[t]] = hidden[t];
+}
 
-        for (unsigned int y = 0; y <= ySeg; ++y)
-        {
-            for (unsigned int x = 0; x <= xSeg; ++x)
-            {
-                float xSegment = (float)x / (float)xSeg;
-                float ySegment = (float)y / (float)ySeg;
-                float xPos = std::cos(xSegment * TAU) * std::sin(ySegment * PI);
-                float yPos = std::cos(ySegment * PI);
-                float zPos = std::sin(xSegment * TAU) * std::sin(ySegment * PI);
-
-                positions.emplace_back(xPos, yPos, zPos);
-                normals.emplace_back(xPos, yPos, zPos);
-                uv.emplace_back(xSegment, ySegment);
-            }
-        }
+// the features an object's variant is compiled with, out of the ones the pass has
+unsigned int litFeatures(const SceneBinding &binding, const SceneAssets &assets, unsigned int features)
+{
+    unsigned int variant = 0;
+    if (binding.emission >= 0)
+        variant |= LIT_EMISSION;
+    const VirtualTexture *virtualTexture = binding.virtualTexture >= 0 ? assets.virtualTextures[binding.virtualTexture].get() : nullptr;
+    if (virtualTexture && virtualTexture->ready())
+        variant |= LIT_VIRTUAL_MATERIAL;
+    return variant & features;
+}
 
-        bool oddRow = false;
-        for (int y = 0; y < ySeg; ++y)
-        {
-            if (!oddRow) // even rows: y == 0, y == 2; and so on
-            {
-                for (int x = 0; x <= xSeg; ++x)
-                {
-                    indices.push_back(y       * (xSeg + 1) + x);
-                    indices.push_back((y + 1) * (xSeg + 1) + x);
-                }
-            }
-            else
-            {
-                for (int x = xSeg; x >= 0; --x)
-                {
-                    indices.push_back((y + 1) * (xSeg + 1) + x);
-                    indices.push_back(y       * (xSeg + 1) + x);
+// renders the lit objects of the resident cells, each with the variant of shaders made for what it has out
+// of features; setup sets the pass's uniforms on every variant used. The program changes once per variant,
+// and within one the objects go out in a batch per set of textures, sorted so that each set is bound once,
+// to each of views (see submitViews)
+template <typename Setup>
+void renderScene(ShaderVariants &shaders, unsigned int features, const Setup &setup, const SceneAssets &assets, DrawBatch &batch,
+                 const std::vector<CullView> &views, float time)
+{
+    const std::vector<WorldObject> &objects = assets.world->objects();
+    unsigned int used = 0;
+    for (size_t i = 0; i < objects.size(); i++)
+        if (objects[i].object->pass == SCENE_LIT)
+            used |= 1u << litFeatures(objects[i].binding, assets, features);
+    for (unsigned int variant = 0; variant < 1u << LIT_FEATURES.size(); variant++) {
+        if (!(used & (1u << variant)))
+            continue;
+        Shader *program = shaders.get(variant);
+        if (!program)
+            continue; // compiling, with nothing to stand in
+        Shader &shader = *program;
+        shader.use();
+        setup(shader);
+        std::vector<size_t> lit;
+        for (size_t i = 0; i < objects.size(); i++)
+            if (objects[i].object->pass == SCENE_LIT && litFeatures(objects[i].binding, assets, features) == variant)
+                lit.push_back(i);
+        // textures the variant doesn't sample don't split batches
+        auto textures = [&](size_t i) {
+            const SceneBinding &binding = objects[i].binding;
+            return std::make_tuple(binding.material, variant & LIT_EMISSION ? binding.emission : -1,
+                                   variant & LIT_VIRTUAL_MATERIAL ? binding.virtualTexture : -1);
+        };
+        std::sort(lit.begin(), lit.end(), [&](size_t a, size_t b) { return textures(a) < textures(b); });
+        for (size_t l = 0; l < lit.size(); l++) {
+            const SceneObject &object = *objects[lit[l]].object;
+            const SceneBinding &binding = objects[lit[l]].binding;
+            if (l == 0 || textures(lit[l - 1]) != textures(lit[l])) {
+                submitViews(batch, shader, views);
+                // material (diffuse + specular), streamed from a virtual texture once it is cooked
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, assets.world->texture(binding.material));
+                if (variant & LIT_EMISSION) {
+                    glActiveTexture(GL_TEXTURE1);
+                    glBindTexture(GL_TEXTURE_2D, assets.world->texture(binding.emission));
                 }
+                if (variant & LIT_VIRTUAL_MATERIAL)
+                    assets.virtualTextures[binding.virtualTexture]->bind(shader, "virtualMaterial", 2, 3);
             }
-            oddRow = !oddRow;
+            batchObject(batch, assets, object, binding.mesh, time, views);
         }
-        sphereIndexCount = indices.size();
+        submitViews(batch, shader, views);
+    }
+}
 
-        std::vector<float> data;
-        for (int i = 0; i < positions.size(); ++i)
-        {
-            data.push_back(positions[i].x);
-            data.push_back(positions[i].y);
-            data.push_back(positions[i].z);
-            if (!normals.empty())
-            {
-                data.push_back(normals[i].x);
-                data.push_back(normals[i].y);
-                data.push_back(normals[i].z);
-            }
-            if (!uv.empty())
-            {
-                data.push_back(uv[i].x);
-                data.push_back(uv[i].y);
-            }
+// submits what batch holds with shader, culled against views, and clears it. Several views are the faces of
+// a cubemap its geometry shader layers: each face gets its own culled submit with face set to it when the
+// batch culls, otherwise one submit goes to every face (face -1)
+void submitViews(DrawBatch &batch, Shader &shader, const std::vector<CullView> &views)
+{
+    if (views.size() > 1 && batch.culls()) {
+        for (size_t v = 0; v < views.size(); v++) {
+            shader.setInt("face", (int)v);
+            batch.submit(shader, &views[v]);
         }
-        glBindVertexArray(sphereVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-        float stride = (3 + 3 + 2) * sizeof(float);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)nullptr);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-    }
-    glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLE_STRIP, sphereIndexCount, GL_UNSIGNED_INT, nullptr);
+    } else {
+        if (views.size() > 1)
+            shader.setInt("face", -1);
+        batch.submit(shader, views.size() == 1 ? &views[0] : nullptr);
+    }
+    batch.clear();
+}
+
+// the triangles of a shape from objects.h (helpers/static_primitives.h), in its object space; closed for a box
+template <typename Shape>
+OccluderMesh occluderMesh(const Shape &shape, bool closed)
+{
+    OccluderMesh mesh;
+    mesh.closed = closed;
+    for (size_t i = 0; i < Shape::vertexCount; i++)
+        mesh.positions.push_back(glm::vec3(shape.point(i).position[0], shape.point(i).position[1], shape.point(i).position[2]));
+    for (size_t j = 0; j < Shape::indexCount; j++)
+        mesh.indices.push_back(shape.index(j));
+    return mesh;
 }
 
-// renders (and builds at first invocation) a torus
-unsigned int torusVAO = 0;
-unsigned int torusIndexCount = 0;
-void renderTorus(double r, double c,
-                 int rSeg, int cSeg)
+// sub-allocates a mesh from objects.h in heap, straight from read-only data
+template <typename Heap, typename Vertex, size_t Vertices, size_t Indices>
+typename Heap::Handle uploadStaticMesh(Heap &heap, const StaticMesh<Vertex, Vertices, Indices> &mesh)
 {
-    if (torusVAO == 0)
+    typename Heap::Handle handle = heap.allocate(Vertices, sizeof(mesh.indices));
+    if (handle >= 0) {
+        heap.writeVertices(handle, 0, 0, mesh.vertices.data(), sizeof(mesh.vertices));
+        heap.writeIndices(handle, 0, mesh.indices.data(), sizeof(mesh.indices));
+    }
+    return handle;
+}
+
+// the meshes of objects.h, a heap per vertex layout: the floor and the cube share theirs and so a VAO
+struct StaticGeometry
+{
+    GeometryHeap<StaticVertex::Layout> lit;
+    GeometryHeap<StaticTangentVertex::Layout> tangent;
+    GeometryHeap<StaticPositionVertex::Layout> position;
+    int floor, cube, wall, skybox;
+
+    // sized for what goes in them
+    StaticGeometry()
+        : lit(floorMesh.vertices.size() + cubeMesh.vertices.size(), sizeof(floorMesh.indices) + sizeof(cubeMesh.indices)),
+          tangent(wallMesh.vertices.size(), sizeof(wallMesh.indices)), position(skyboxMesh.vertices.size(), sizeof(skyboxMesh.indices))
     {
-        glGenVertexArrays(1, &torusVAO);
+        floor = uploadStaticMesh(lit, floorMesh);
+        cube = uploadStaticMesh(lit, cubeMesh);
+        wall = uploadStaticMesh(tangent, wallMesh);
+        skybox = uploadStaticMesh(position, skyboxMesh);
+    }
+};
+std::unique_ptr<StaticGeometry> staticGeometry;
 
-        unsigned int vbo, ebo;
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
+void loadStaticGeometry()
+{
+    staticGeometry.reset(new StaticGeometry());
+}
 
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec2> uv;
-        std::vector<glm::vec3> normals;
-        std::vector<unsigned int> indices;
+// while the context is still there
+void releaseStaticGeometry()
+{
+    staticGeometry.reset();
+}
 
-        for (unsigned int i = 0; i <= rSeg; ++i)
-        {
-            for (unsigned int j = 0; j <= cSeg; ++j)
-            {
-                for (int k = 0; k < 2; k++) {
-                    double s = (i + k) % rSeg + 0.5;
-                    double t = j % (cSeg + 1);
-
-                    double xPos = (c + r * std::cos(s * TAU / rSeg)) * std::cos(t * TAU / cSeg);
-                    double yPos = (c + r * std::cos(s * TAU / rSeg)) * std::sin(t * TAU / cSeg);
-                    double zPos = r * std::sin(s * TAU / rSeg);
-
-                    double u = (float) (i + k) / (float) rSeg;
-                    double v = t / (float) cSeg;
-
-                    positions.emplace_back(2 * xPos, 2 * yPos, 2 * zPos);
-                    normals.emplace_back(2 * xPos, 2 * yPos, 2 * zPos);
-                    uv.emplace_back(u, v);
-                }
-            }
-        }
+// the floor, for a DrawBatch
+GeometryDraw floorDraw()
+{
+    return staticGeometry->lit.drawOf(staticGeometry->floor, GL_TRIANGLES, (GLsizei)floorMesh.indices.size(), GL_UNSIGNED_SHORT, 0);
+}
 
-        bool oddRow = false;
-        for (int j = 0; j < cSeg; ++j)
-        {
-            if (!oddRow)
-            {
-                for (int i = 0; i <= rSeg; ++i)
-                {
-                    indices.push_back(j       * (rSeg + 1) + i);
-                    indices.push_back((j + 1) * (rSeg + 1) + i);
-                }
-            }
-            else
-            {
-                for (int i = rSeg; i >= 0; --i)
-                {
-                    indices.push_back((j + 1) * (rSeg + 1) + i);
-                    indices.push_back(j       * (rSeg + 1) + i);
-                }
+// the cube
+GeometryDraw cubeDraw()
+{
+    return staticGeometry->lit.drawOf(staticGeometry->cube, GL_TRIANGLES, (GLsizei)cubeMesh.indices.size(), GL_UNSIGNED_SHORT, 0);
+}
 
-            }
-            oddRow = !oddRow;
-        }
-        torusIndexCount = indices.size();
+// a 2x2 wall with tangent vectors
+GeometryDraw wallDraw()
+{
+    return staticGeometry->tangent.drawOf(staticGeometry->wall, GL_TRIANGLES, (GLsizei)wallMesh.indices.size(), GL_UNSIGNED_SHORT, 0);
+}
 
-        std::vector<float> data;
-        for (int i = 0; i < positions.size(); ++i)
-        {
-            data.push_back(positions[i].x);
-            data.push_back(positions[i].y);
-            data.push_back(positions[i].z);
-            if (!normals.empty())
-            {
-                data.push_back(normals[i].x);
-                data.push_back(normals[i].y);
-                data.push_back(normals[i].z);
-            }
-            if (!uv.empty())
-            {
-                data.push_back(uv[i].x);
-                data.push_back(uv[i].y);
-            }
-        }
-        glBindVertexArray(torusVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-        float stride = (3 + 3 + 2) * sizeof(float);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)nullptr);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-    }
-    glBindVertexArray(torusVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, torusIndexCount);
+// renders skybox
+void renderSkybox()
+{
+    staticGeometry->position.draw(staticGeometry->skybox, GL_TRIANGLES, (GLsizei)skyboxMesh.indices.size(), GL_UNSIGNED_SHORT, 0);
 }
 
 // utility function for loading a 2D texture from file
@@ -818,7 +1117,8 @@ unsigned int loadTexture(char const * path)
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
+    AssetSpan file = FileSystem::read(path);
+    unsigned char *data = file.valid() ? stbi_load_from_memory(file.data, (int)file.size, &width, &height, &nrComponents, 0) : NULL;
     if (data)
     {
         GLenum format = 0;
@@ -842,7 +1142,7 @@ unsigned int loadTexture(char const * path)
     }
     else
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
+        Log::warning("Texture failed to load at path: %s", path);
         stbi_image_free(data);
     }
 
@@ -866,7 +1166,8 @@ unsigned int loadCubemap(std::vector<std::string> faces)
     int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
+        AssetSpan file = FileSystem::read(faces[i]);
+        unsigned char *data = file.valid() ? stbi_load_from_memory(file.data, (int)file.size, &width, &height, &nrChannels, 0) : NULL;
         if (data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
@@ -874,7 +1175,7 @@ unsigned int loadCubemap(std::vector<std::string> faces)
         }
         else
         {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+            Log::warning("Cubemap texture failed to load at path: %s", faces[i]);
             stbi_image_free(data);
         }
     }
@@ -3,18 +3,20 @@ layout (triangles) in;
 layout (triangle_strip, max_vertices=18) out;
 
 uniform mat4 shadowMatrices[6];
+uniform int face; // the one face to render to, culled for it on the GPU; -1 for all six
 
 out vec4 FragPos; // FragPos from GS (output per emitvertex)
 
 void main()
 {
-    for(int face = 0; face < 6; ++face)
+    int first = face < 0 ? 0 : face, last = face < 0 ? 5 : face;
+    for(int layer = first; layer <= last; ++layer)
     {
-        gl_Layer = face; // built-in variable that specifies to which face we render.
+        gl_Layer = layer; // built-in variable that specifies to which face we render.
         for(int i = 0; i < 3; ++i) // for each triangle's vertices
         {
             FragPos = gl_in[i].gl_Position;
-            gl_Position = shadowMatrices[face] * FragPos;
+            gl_Position = shadowMatrices[layer] * FragPos;
             EmitVertex();
         }
         EndPrimitive();
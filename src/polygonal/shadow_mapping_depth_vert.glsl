@@ -1,9 +1,9 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
+#include "draw_data.glsl"
 
 void main()
 {
-    gl_Position = model * vec4(aPos, 1.0);
+    gl_Position = DrawModel() * vec4(aPos, 1.0);
 }
\ No newline at end of file
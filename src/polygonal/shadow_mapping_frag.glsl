@@ -1,6 +1,16 @@
 #version 330 core
 out vec4 FragColor;
 
+// compiled per variant (see ShaderVariants in helpers/shader.h):
+//   PCF_SAMPLES            shadow map taps, up to 20
+//   WITH_VIRTUAL_MATERIAL  the material is streamed from a virtual texture
+#ifndef PCF_SAMPLES
+#define PCF_SAMPLES 20
+#endif
+#if PCF_SAMPLES > 20
+#error PCF_SAMPLES is at most 20, the offsets in gridSamplingDisk
+#endif
+
 in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
@@ -15,6 +25,13 @@ uniform vec3 viewPos;
 
 uniform float far_plane;
 
+#include "lighting.glsl"
+#include "virtual_texture.glsl"
+
+#ifdef WITH_VIRTUAL_MATERIAL
+uniform VirtualTexture virtualMaterial; // streamed instead of diffuseTexture
+#endif
+
 // array of offset direction for sampling
 vec3 gridSamplingDisk[20] = vec3[]
 (
@@ -34,7 +51,7 @@ float ShadowCalculation(vec3 fragPos)
     // Percentage-closer Filtering
     float shadow = 0.0;
     float bias = 0.10;
-    int samples = 20;
+    int samples = PCF_SAMPLES;
     float viewDistance = length(viewPos - fragPos);
     float diskRadius = (1.0 + (viewDistance / far_plane)) / 25.0;
     for(int i = 0; i < samples; ++i)
@@ -50,22 +67,21 @@ float ShadowCalculation(vec3 fragPos)
 
 void main()
 {           
+#ifdef WITH_VIRTUAL_MATERIAL
+    vec3 color = SampleVirtual(virtualMaterial, fs_in.TexCoords).rgb;
+#else
     vec3 color = texture(diffuseTexture, fs_in.TexCoords).rgb;
+#endif
     vec3 normal = normalize(fs_in.Normal);
     vec3 lightColor = vec3(0.3);
     // ambient
     vec3 ambient = 0.3 * color;
     // diffuse
     vec3 lightDir = normalize(lightPos - fs_in.FragPos);
-    float diff = max(dot(lightDir, normal), 0.0);
-    vec3 diffuse = diff * lightColor;
+    vec3 diffuse = Diffuse(normal, lightDir) * lightColor;
     // specular
     vec3 viewDir = normalize(viewPos - fs_in.FragPos);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = 0.0;
-    vec3 halfwayDir = normalize(lightDir + viewDir);  
-    spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
-    vec3 specular = spec * lightColor;    
+    vec3 specular = BlinnSpecular(normal, lightDir, viewDir, 64.0) * lightColor;
     // calculate shadow
     float shadow = ShadowCalculation(fs_in.FragPos);
     vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;
@@ -11,12 +11,14 @@ out VS_OUT {
     vec2 TexCoords;
 } vs_out;
 
+#include "draw_data.glsl"
+
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 model;
 
 void main()
 {
+    mat4 model = DrawModel();
     vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
     vs_out.Normal = transpose(inverse(mat3(model))) * aNormal;
     vs_out.TexCoords = aTexCoords;
@@ -0,0 +1,17 @@
+#version 330 core
+// virtual texture feedback: the page and level every pixel wants (see helpers/virtual_texture.h)
+layout (location = 0) out uvec4 Feedback;
+
+in vec2 TexCoords;
+
+#include "virtual_texture.glsl"
+
+uniform VirtualTexture virtualTexture;
+uniform float lodBias; // the feedback buffer is smaller than the screen
+
+void main()
+{
+    int level = VirtualLevel(virtualTexture, TexCoords, lodBias);
+    ivec2 page = VirtualPage(virtualTexture, TexCoords, level);
+    Feedback = uvec4(uvec2(page), uint(level), 1u);
+}
@@ -0,0 +1,48 @@
+// virtual texture (see helpers/virtual_texture.h)
+#define VT_MAX_LEVELS 16
+struct VirtualTexture {
+    sampler2D cache;             // resident pages, with borders
+    sampler2D indirection;       // per virtual page: cache slot xy, resident level, a = 0 while nothing is
+    vec4 levels[VT_MAX_LEVELS];  // width, height, first indirection row
+    int levelCount;
+    vec2 uvScale;
+    float pageContent;
+    float pageSize;
+    float border;
+    float cacheSize;
+};
+
+// the level a pixel samples; the feedback pass asks for the same one
+int VirtualLevel(VirtualTexture vt, vec2 uv, float bias)
+{
+    vec2 texel = uv * vt.uvScale * vt.levels[0].xy;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + bias;
+    return int(clamp(floor(lod + 0.5), 0.0, float(vt.levelCount - 1)));
+}
+
+ivec2 VirtualPage(VirtualTexture vt, vec2 uv, int level)
+{
+    vec2 size = vt.levels[level].xy;
+    ivec2 pages = ivec2(ceil(size / vt.pageContent));
+    return min(ivec2(clamp(uv * vt.uvScale, 0.0, 1.0) * size / vt.pageContent), pages - 1);
+}
+
+vec4 SampleVirtual(VirtualTexture vt, vec2 uv)
+{
+    int level = VirtualLevel(vt, uv, 0.0);
+    ivec2 page = VirtualPage(vt, uv, level);
+    vec4 entry = texelFetch(vt.indirection, ivec2(page.x, int(vt.levels[level].z) + page.y), 0);
+    if (entry.a == 0.0)
+        return vec4(0.5, 0.5, 0.5, 0.0);
+    entry.xyz = floor(entry.xyz * 255.0 + 0.5);
+    // the page itself or the ancestor standing in for it
+    int resident = int(entry.z);
+    vec2 size = vt.levels[resident].xy;
+    ivec2 residentPage = min(page >> (resident - level), ivec2(ceil(size / vt.pageContent)) - 1);
+    vec2 inPage = clamp(clamp(uv * vt.uvScale, 0.0, 1.0) * size - vec2(residentPage) * vt.pageContent,
+                        vec2(0.5 - vt.border), vec2(vt.pageContent + vt.border - 0.5));
+    vec2 cacheTexel = entry.xy * vt.pageSize + vt.border + inPage;
+    return textureLod(vt.cache, cacheTexel / vt.cacheSize, 0.0);
+}
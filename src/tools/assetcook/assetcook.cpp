@@ -0,0 +1,98 @@
+//
+// assetcook: runs the cookers listed in a manifest (resources/cook.list), in parallel and only for what changed
+// (see helpers/cook_graph.h)
+//
+
+#include <helpers/cook_graph.h>
+#include <helpers/filesystem.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void usage()
+{
+    std::cout << "usage: assetcook [options] <manifest>\n"
+                 "  -j <jobs>          cookers run at once (default: one per core)\n"
+                 "  --cache <dir>      where hashes and cooked files are kept (default: .cookcache in the source root)\n"
+                 "manifest lines: <output> <cooker> <argument>..., {out} standing for the output; paths relative to\n"
+                 "the source root, # starts a comment\n";
+}
+
+// paths are relative to the source root; constants ("0.2") and options stay as they are
+static std::string resolve(const std::string &argument)
+{
+    if (argument == "{out}" || argument.find('/') == std::string::npos || argument[0] == '/')
+        return argument;
+    return FileSystem::getPath(argument);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = (int)std::thread::hardware_concurrency();
+    std::string cache = FileSystem::getPath(".cookcache"), manifest;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (arg == "--cache" && i + 1 < argc)
+            cache = argv[++i];
+        else if (manifest.empty() && arg[0] != '-')
+            manifest = arg;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (manifest.empty())
+    {
+        usage();
+        return 1;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // the cookers are built next to assetcook
+    std::string self = argv[0];
+    size_t slash = self.find_last_of("/\\");
+    CookGraph graph(cache, slash == std::string::npos ? "." : self.substr(0, slash));
+
+    std::ifstream file(manifest.c_str());
+    if (!file)
+    {
+        std::cout << "ERROR::ASSETCOOK::FILE_NOT_SUCCESFULLY_READ: " << manifest << std::endl;
+        return 1;
+    }
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number)
+    {
+        std::istringstream tokens(line.substr(0, line.find('#')));
+        CookJob job;
+        std::string argument;
+        if (!(tokens >> job.output))
+            continue;
+        if (!(tokens >> job.cooker))
+        {
+            std::cout << "ERROR::ASSETCOOK::MANIFEST: " << manifest << ":" << number << ": " << job.output << " has no cooker" << std::endl;
+            return 1;
+        }
+        job.output = resolve(job.output);
+        while (tokens >> argument)
+            job.arguments.push_back(resolve(argument));
+        graph.add(job);
+    }
+
+    CookStats stats;
+    bool cooked = graph.run(threads, stats);
+    printf("assetcook: %d files, %d cooked, %d from the cache, %d up to date, %d failed, %d inputs hashed, %.2f s\n",
+           stats.jobs, stats.cooked, stats.cached, stats.upToDate, stats.failed, stats.hashed,
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return cooked ? 0 : 1;
+}
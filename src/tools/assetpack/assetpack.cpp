@@ -0,0 +1,280 @@
+//
+// assetpack: bundles loose assets into one memory-mapped archive (see helpers/asset_archive.h)
+//
+
+#include <helpers/asset_archive.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+struct PackedFile
+{
+    std::string name;                  // key in the archive
+    std::string path;                  // on disk
+    ArchiveEntry entry;
+    std::vector<unsigned char> stored; // compressed payload, empty when the file is copied as is
+};
+
+static bool readFile(const std::string &path, std::vector<unsigned char> &data)
+{
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    data.resize((size_t)file.tellg());
+    file.seekg(0);
+    return data.empty() || (bool)file.read((char *)data.data(), data.size());
+}
+
+static bool isDirectory(const std::string &path)
+{
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+// every file under path, recursively, as paths relative to it
+static void listFiles(const std::string &path, const std::string &prefix, std::vector<std::string> &files)
+{
+    std::vector<std::string> children;
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE find = FindFirstFileA((path + "/*").c_str(), &found);
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+    do
+        children.push_back(found.cFileName);
+    while (FindNextFileA(find, &found));
+    FindClose(find);
+#else
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    while (struct dirent *child = readdir(dir))
+        children.push_back(child->d_name);
+    closedir(dir);
+#endif
+    // directory order isn't stable across file systems
+    std::sort(children.begin(), children.end());
+    for (size_t i = 0; i < children.size(); ++i)
+    {
+        if (children[i] == "." || children[i] == "..")
+            continue;
+        std::string child = path + "/" + children[i];
+        if (isDirectory(child))
+            listFiles(child, prefix + children[i] + "/", files);
+        else
+            files.push_back(prefix + children[i]);
+    }
+}
+
+static std::string extension(const std::string &name)
+{
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos || name.find('/', dot) != std::string::npos ? "" : name.substr(dot + 1);
+}
+
+static std::string baseName(const std::string &path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// splits data into independent chunkSize blocks behind an offset table; false when that doesn't pay off
+static bool compressChunks(const std::vector<unsigned char> &data, unsigned int chunkSize, PackedFile &file)
+{
+    unsigned int chunkCount = (unsigned int)((data.size() + chunkSize - 1) / chunkSize);
+    std::vector<unsigned long long> offsets(chunkCount + 1);
+    std::vector<unsigned char> blocks;
+    size_t table = offsets.size() * sizeof(unsigned long long);
+    for (unsigned int i = 0; i < chunkCount; ++i)
+    {
+        offsets[i] = table + blocks.size();
+        size_t begin = (size_t)i * chunkSize;
+        Lz4Block::compress(&data[begin], std::min<size_t>(chunkSize, data.size() - begin), blocks);
+    }
+    offsets[chunkCount] = table + blocks.size();
+    // decoding costs more than reading a few percent more
+    if (offsets[chunkCount] > data.size() - data.size() / 16)
+        return false;
+    file.stored.resize(table);
+    memcpy(file.stored.data(), offsets.data(), table);
+    file.stored.insert(file.stored.end(), blocks.begin(), blocks.end());
+    file.entry.chunkSize = chunkSize;
+    file.entry.chunkCount = chunkCount;
+    return true;
+}
+
+static void usage()
+{
+    std::cout << "usage: assetpack [options] <output.pak> <root> <path>... [--flat <path>]...\n"
+                 "  <path>             a file or directory under root, packed under its path relative to root\n"
+                 "  --flat <path>      a file or directory packed under bare file names (shaders are opened by name)\n"
+                 "  --compress         LZ4 compress files in chunks, where it saves space\n"
+                 "  --chunk <KB>       compression chunk size (default: 256)\n"
+                 "  --store <ext>      never compress files with this extension (default: vtex, its pages are read\n"
+                 "                     straight from the mapping)\n";
+}
+
+int main(int argc, char **argv)
+{
+    bool compress = false;
+    unsigned int chunkSize = 256 * 1024;
+    std::vector<std::string> storedExtensions(1, "vtex");
+    std::vector<std::string> arguments;
+    std::vector<std::pair<std::string, bool> > inputs; // path, flat
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--compress")
+            compress = true;
+        else if (arg == "--chunk" && i + 1 < argc)
+            chunkSize = (unsigned int)std::max(1, atoi(argv[++i])) * 1024;
+        else if (arg == "--store" && i + 1 < argc)
+            storedExtensions.push_back(argv[++i]);
+        else if (arg == "--flat" && i + 1 < argc)
+            inputs.push_back(std::make_pair(std::string(argv[++i]), true));
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            usage();
+            return 1;
+        }
+        else if (arguments.size() < 2)
+            arguments.push_back(arg);
+        else
+            inputs.push_back(std::make_pair(arg, false));
+    }
+    if (arguments.size() < 2 || inputs.empty())
+    {
+        usage();
+        return 1;
+    }
+    const std::string &output = arguments[0], &root = arguments[1];
+
+    std::vector<PackedFile> files;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        std::string path = inputs[i].second ? inputs[i].first : root + "/" + inputs[i].first;
+        std::vector<std::string> found;
+        if (isDirectory(path))
+            listFiles(path, "", found);
+        else
+            found.push_back("");
+        for (size_t j = 0; j < found.size(); ++j)
+        {
+            PackedFile file;
+            file.path = found[j].empty() ? path : path + "/" + found[j];
+            if (inputs[i].second)
+                file.name = baseName(file.path);
+            else
+                file.name = found[j].empty() ? inputs[i].first : inputs[i].first + "/" + found[j];
+            files.push_back(file);
+        }
+    }
+
+    std::sort(files.begin(), files.end(), [](const PackedFile &a, const PackedFile &b) {
+        unsigned long long ha = archiveHash(a.name.data(), a.name.size());
+        unsigned long long hb = archiveHash(b.name.data(), b.name.size());
+        return ha != hb ? ha < hb : a.name < b.name;
+    });
+    for (size_t i = 1; i < files.size(); ++i)
+        if (files[i].name == files[i - 1].name)
+        {
+            std::cout << "ERROR::ASSETPACK::DUPLICATE_NAME: " << files[i].name << " (" << files[i - 1].path
+                      << ", " << files[i].path << ")" << std::endl;
+            return 1;
+        }
+
+    // header, index and names up front, so every payload offset is known before any is written
+    std::string names;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        ArchiveEntry &entry = files[i].entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.hash = archiveHash(files[i].name.data(), files[i].name.size());
+        entry.nameOffset = (unsigned int)names.size();
+        entry.nameLength = (unsigned int)files[i].name.size();
+        names += files[i].name;
+    }
+    ArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.entryCount = (unsigned int)files.size();
+    header.indexOffset = sizeof(ArchiveHeader);
+    header.namesOffset = header.indexOffset + files.size() * sizeof(ArchiveEntry);
+
+    unsigned long long offset = header.namesOffset + names.size();
+    size_t totalSize = 0, totalStored = 0;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        PackedFile &file = files[i];
+        std::vector<unsigned char> data;
+        if (!readFile(file.path, data))
+        {
+            std::cout << "ERROR::ASSETPACK::FILE_NOT_SUCCESFULLY_READ: " << file.path << std::endl;
+            return 1;
+        }
+        file.entry.size = data.size();
+        bool store = std::find(storedExtensions.begin(), storedExtensions.end(), extension(file.name)) != storedExtensions.end();
+        if (!compress || store || data.empty() || !compressChunks(data, chunkSize, file))
+            file.entry.storedSize = data.size();
+        else
+            file.entry.storedSize = file.stored.size();
+        offset = (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+        file.entry.offset = offset;
+        offset += file.entry.storedSize;
+        totalSize += (size_t)file.entry.size;
+        totalStored += (size_t)file.entry.storedSize;
+    }
+
+    std::ofstream out(output.c_str(), std::ios::binary);
+    if (!out)
+    {
+        std::cout << "ERROR::ASSETPACK::FILE_NOT_SUCCESFULLY_WRITTEN: " << output << std::endl;
+        return 1;
+    }
+    out.write((const char *)&header, sizeof(header));
+    for (size_t i = 0; i < files.size(); ++i)
+        out.write((const char *)&files[i].entry, sizeof(ArchiveEntry));
+    out.write(names.data(), names.size());
+    std::vector<unsigned char> data;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const PackedFile &file = files[i];
+        std::vector<char> padding((size_t)(file.entry.offset - (unsigned long long)out.tellp()), 0);
+        out.write(padding.data(), padding.size());
+        if (file.entry.chunkSize)
+            out.write((const char *)file.stored.data(), file.stored.size());
+        else
+        {
+            // read again instead of keeping every stored file in memory
+            readFile(file.path, data);
+            out.write((const char *)data.data(), data.size());
+        }
+    }
+    if (!out.good())
+    {
+        std::cout << "ERROR::ASSETPACK::FILE_NOT_SUCCESFULLY_WRITTEN: " << output << std::endl;
+        return 1;
+    }
+    printf("%s: %u files, %.1f MB -> %.1f MB\n", output.c_str(), header.entryCount,
+           totalSize / 1048576.0, totalStored / 1048576.0);
+    return 0;
+}
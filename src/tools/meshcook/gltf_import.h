@@ -0,0 +1,640 @@
+//
+// glTF 2.0 import for meshcook: .gltf (buffers in files next to it or in base64 data URIs) and .glb.
+// Every triangle primitive of every mesh in the default scene is baked with its node transform into one
+// mesh; POSITION, NORMAL and TEXCOORD_0 are read (float, or normalized integer texcoords), sparse
+// accessors, morph targets and skins are not.
+//
+
+#ifndef GLTF_IMPORT_H
+#define GLTF_IMPORT_H
+
+#include <helpers/mesh_file.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// just enough JSON for glTF
+struct JsonValue
+{
+    enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type;
+    double number;
+    std::string string;
+    std::vector<JsonValue> items;
+    std::map<std::string, JsonValue> members;
+
+    JsonValue() : type(NUL), number(0.0) {}
+
+    const JsonValue &operator[](const std::string &key) const
+    {
+        static const JsonValue missing;
+        std::map<std::string, JsonValue>::const_iterator found = members.find(key);
+        return found == members.end() ? missing : found->second;
+    }
+    const JsonValue &operator[](size_t index) const
+    {
+        static const JsonValue missing;
+        return index < items.size() ? items[index] : missing;
+    }
+    size_t size() const { return items.size(); }
+    bool has(const std::string &key) const { return members.count(key) != 0; }
+    double asNumber(double fallback = 0.0) const { return type == NUMBER ? number : fallback; }
+    int asInt(int fallback = -1) const { return type == NUMBER ? (int)number : fallback; }
+};
+
+class JsonParser
+{
+public:
+    static bool parse(const char *text, size_t size, JsonValue &value, std::string &error)
+    {
+        JsonParser parser(text, text + size);
+        if (!parser.value(value, 0))
+        {
+            error = "bad JSON near byte " + std::to_string(parser.p - text);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const char *p, *end;
+
+    JsonParser(const char *begin, const char *end) : p(begin), end(end) {}
+
+    void skip()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            ++p;
+    }
+
+    bool literal(const char *word)
+    {
+        size_t length = strlen(word);
+        if ((size_t)(end - p) < length || strncmp(p, word, length) != 0)
+            return false;
+        p += length;
+        return true;
+    }
+
+    bool string(std::string &out)
+    {
+        if (p >= end || *p != '"')
+            return false;
+        ++p;
+        out.clear();
+        while (p < end && *p != '"')
+        {
+            char c = *p++;
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (p >= end)
+                return false;
+            char escaped = *p++;
+            switch (escaped)
+            {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u':
+            {
+                // names and URIs only, anything past ASCII is kept as UTF-8
+                if (end - p < 4)
+                    return false;
+                unsigned int code = (unsigned int)strtoul(std::string(p, p + 4).c_str(), NULL, 16);
+                p += 4;
+                if (code < 0x80)
+                    out += (char)code;
+                else if (code < 0x800)
+                {
+                    out += (char)(0xc0 | (code >> 6));
+                    out += (char)(0x80 | (code & 0x3f));
+                }
+                else
+                {
+                    out += (char)(0xe0 | (code >> 12));
+                    out += (char)(0x80 | ((code >> 6) & 0x3f));
+                    out += (char)(0x80 | (code & 0x3f));
+                }
+                break;
+            }
+            default: out += escaped; break;
+            }
+        }
+        if (p >= end)
+            return false;
+        ++p;
+        return true;
+    }
+
+    bool value(JsonValue &out, int depth)
+    {
+        skip();
+        if (p >= end || depth > 64)
+            return false;
+        if (*p == '{')
+        {
+            out.type = JsonValue::OBJECT;
+            ++p;
+            skip();
+            if (p < end && *p == '}')
+            {
+                ++p;
+                return true;
+            }
+            for (;;)
+            {
+                skip();
+                std::string key;
+                if (!string(key))
+                    return false;
+                skip();
+                if (p >= end || *p++ != ':')
+                    return false;
+                if (!value(out.members[key], depth + 1))
+                    return false;
+                skip();
+                if (p < end && *p == ',')
+                {
+                    ++p;
+                    continue;
+                }
+                if (p < end && *p == '}')
+                {
+                    ++p;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (*p == '[')
+        {
+            out.type = JsonValue::ARRAY;
+            ++p;
+            skip();
+            if (p < end && *p == ']')
+            {
+                ++p;
+                return true;
+            }
+            for (;;)
+            {
+                out.items.push_back(JsonValue());
+                if (!value(out.items.back(), depth + 1))
+                    return false;
+                skip();
+                if (p < end && *p == ',')
+                {
+                    ++p;
+                    continue;
+                }
+                if (p < end && *p == ']')
+                {
+                    ++p;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (*p == '"')
+        {
+            out.type = JsonValue::STRING;
+            return string(out.string);
+        }
+        if (literal("true") || literal("false"))
+        {
+            out.type = JsonValue::BOOLEAN;
+            out.number = p[-1] == 'e' && p[-2] == 'u' ? 1.0 : 0.0;
+            return true;
+        }
+        if (literal("null"))
+            return true;
+        // numbers: strtod stops at the first character that can't be part of one
+        std::string digits;
+        while (p < end && strchr("+-0123456789.eE", *p))
+            digits += *p++;
+        if (digits.empty())
+            return false;
+        out.type = JsonValue::NUMBER;
+        out.number = strtod(digits.c_str(), NULL);
+        return true;
+    }
+};
+
+
+class GltfImporter
+{
+public:
+    // hasNormals is false when a primitive lacks them, the caller generates them then; the external buffers
+    // read go to dependencies
+    static bool import(const AssetSpan &file, const std::string &path, std::vector<MeshVertex> &vertices,
+                       std::vector<unsigned int> &indices, bool &hasNormals, std::string &error,
+                       std::vector<std::string> *dependencies = NULL)
+    {
+        GltfImporter importer(path);
+        bool imported = importer.run(file, vertices, indices, hasNormals, error);
+        if (dependencies)
+            dependencies->insert(dependencies->end(), importer.externalBuffers.begin(), importer.externalBuffers.end());
+        return imported;
+    }
+
+private:
+    struct Matrix
+    {
+        float m[16]; // column major
+
+        static Matrix identity()
+        {
+            Matrix r;
+            for (int i = 0; i < 16; ++i)
+                r.m[i] = i % 5 == 0 ? 1.0f : 0.0f;
+            return r;
+        }
+        Matrix operator*(const Matrix &b) const
+        {
+            Matrix r;
+            for (int c = 0; c < 4; ++c)
+                for (int row = 0; row < 4; ++row)
+                {
+                    float sum = 0.0f;
+                    for (int k = 0; k < 4; ++k)
+                        sum += m[k * 4 + row] * b.m[c * 4 + k];
+                    r.m[c * 4 + row] = sum;
+                }
+            return r;
+        }
+    };
+
+    std::string directory;
+    std::vector<std::string> externalBuffers;
+    JsonValue json;
+    std::vector<std::vector<unsigned char> > buffers;
+    const unsigned char *binaryChunk;
+    size_t binaryChunkSize;
+    AssetSpan source;
+
+    explicit GltfImporter(const std::string &path) : binaryChunk(NULL), binaryChunkSize(0)
+    {
+        size_t slash = path.find_last_of("/\\");
+        directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    }
+
+    bool run(const AssetSpan &file, std::vector<MeshVertex> &vertices, std::vector<unsigned int> &indices,
+             bool &hasNormals, std::string &error)
+    {
+        source = file;
+        const char *text = (const char *)file.data;
+        size_t textSize = file.size;
+        if (file.size >= 12 && !memcmp(file.data, "glTF", 4))
+        {
+            // glb: 12-byte header, a JSON chunk, then an optional BIN chunk
+            unsigned int chunkSize, chunkType;
+            memcpy(&chunkSize, file.data + 12, 4);
+            memcpy(&chunkType, file.data + 16, 4);
+            if (file.size < 20 || chunkType != 0x4e4f534a || chunkSize > file.size - 20)
+            {
+                error = "bad glb header";
+                return false;
+            }
+            text = (const char *)file.data + 20;
+            textSize = chunkSize;
+            size_t binary = 20 + ((chunkSize + 3) & ~3u);
+            if (binary + 8 <= file.size)
+            {
+                memcpy(&chunkSize, file.data + binary, 4);
+                memcpy(&chunkType, file.data + binary + 4, 4);
+                if (chunkType == 0x004e4942 && chunkSize <= file.size - binary - 8)
+                {
+                    binaryChunk = file.data + binary + 8;
+                    binaryChunkSize = chunkSize;
+                }
+            }
+        }
+        if (!JsonParser::parse(text, textSize, json, error) || !loadBuffers(error))
+            return false;
+
+        hasNormals = true;
+        const JsonValue &scenes = json["scenes"];
+        if (scenes.size())
+        {
+            const JsonValue &scene = scenes[(size_t)std::max(0, json["scene"].asInt(0))];
+            for (size_t i = 0; i < scene["nodes"].size(); ++i)
+                if (!node(scene["nodes"][i].asInt(), Matrix::identity(), 0, vertices, indices, hasNormals, error))
+                    return false;
+        }
+        else
+        {
+            // no scene: every mesh as it is
+            for (size_t i = 0; i < json["meshes"].size(); ++i)
+                if (!mesh((int)i, Matrix::identity(), vertices, indices, hasNormals, error))
+                    return false;
+        }
+        if (indices.empty())
+        {
+            error = "no triangles";
+            return false;
+        }
+        return true;
+    }
+
+    bool loadBuffers(std::string &error)
+    {
+        const JsonValue &list = json["buffers"];
+        buffers.resize(list.size());
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            const std::string &uri = list[i]["uri"].string;
+            size_t length = (size_t)list[i]["byteLength"].asNumber();
+            if (uri.empty())
+            {
+                if (!binaryChunk || binaryChunkSize < length)
+                {
+                    error = "buffer " + std::to_string(i) + " has no data";
+                    return false;
+                }
+                buffers[i].assign(binaryChunk, binaryChunk + length);
+            }
+            else if (uri.compare(0, 5, "data:") == 0)
+            {
+                size_t comma = uri.find(',');
+                if (comma == std::string::npos || uri.rfind(";base64", comma) == std::string::npos)
+                {
+                    error = "buffer " + std::to_string(i) + ": only base64 data URIs are supported";
+                    return false;
+                }
+                decodeBase64(uri.substr(comma + 1), buffers[i]);
+            }
+            else
+            {
+                externalBuffers.push_back(directory + decodeUri(uri));
+                AssetSpan data = FileSystem::read(externalBuffers.back());
+                if (!data.valid())
+                {
+                    error = "can't read buffer " + directory + uri;
+                    return false;
+                }
+                buffers[i].assign(data.data, data.data + data.size);
+            }
+            if (buffers[i].size() < length)
+            {
+                error = "buffer " + std::to_string(i) + " is shorter than its byteLength";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool node(int index, const Matrix &parent, int depth, std::vector<MeshVertex> &vertices,
+              std::vector<unsigned int> &indices, bool &hasNormals, std::string &error)
+    {
+        const JsonValue &n = json["nodes"][(size_t)std::max(0, index)];
+        if (index < 0 || n.type != JsonValue::OBJECT || depth > 64)
+        {
+            error = "bad node " + std::to_string(index);
+            return false;
+        }
+        Matrix local = Matrix::identity();
+        if (n.has("matrix"))
+            for (int i = 0; i < 16; ++i)
+                local.m[i] = (float)n["matrix"][i].asNumber();
+        else
+        {
+            // T * R * S
+            const JsonValue &t = n["translation"], &r = n["rotation"], &s = n["scale"];
+            float x = (float)r[0].asNumber(0.0), y = (float)r[1].asNumber(0.0), z = (float)r[2].asNumber(0.0),
+                  w = (float)r[3].asNumber(1.0);
+            float scale[3] = { (float)s[0].asNumber(1.0), (float)s[1].asNumber(1.0), (float)s[2].asNumber(1.0) };
+            float rotation[9] = { 1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+                                  2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+                                  2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y) };
+            for (int c = 0; c < 3; ++c)
+                for (int row = 0; row < 3; ++row)
+                    local.m[c * 4 + row] = rotation[c * 3 + row] * scale[c];
+            for (int row = 0; row < 3; ++row)
+                local.m[12 + row] = (float)t[(size_t)row].asNumber(0.0);
+        }
+        Matrix world = parent * local;
+        if (n.has("mesh") && !mesh(n["mesh"].asInt(), world, vertices, indices, hasNormals, error))
+            return false;
+        for (size_t i = 0; i < n["children"].size(); ++i)
+            if (!node(n["children"][i].asInt(), world, depth + 1, vertices, indices, hasNormals, error))
+                return false;
+        return true;
+    }
+
+    bool mesh(int index, const Matrix &world, std::vector<MeshVertex> &vertices, std::vector<unsigned int> &indices,
+              bool &hasNormals, std::string &error)
+    {
+        const JsonValue &primitives = json["meshes"][(size_t)std::max(0, index)]["primitives"];
+        // normals go through the inverse transpose of the upper 3x3
+        float normalMatrix[9];
+        inverseTranspose(world, normalMatrix);
+        for (size_t p = 0; p < primitives.size(); ++p)
+        {
+            const JsonValue &primitive = primitives[p];
+            if (primitive["mode"].asInt(4) != 4)
+                continue; // points, lines and strips
+            const JsonValue &attributes = primitive["attributes"];
+            std::vector<float> positions, normals, texCoords;
+            if (!accessor(attributes["POSITION"].asInt(), 3, positions, error))
+                return false;
+            size_t count = positions.size() / 3;
+            if (attributes.has("NORMAL") && !accessor(attributes["NORMAL"].asInt(), 3, normals, error))
+                return false;
+            if (attributes.has("TEXCOORD_0") && !accessor(attributes["TEXCOORD_0"].asInt(), 2, texCoords, error))
+                return false;
+            if (normals.size() != count * 3)
+            {
+                normals.clear();
+                hasNormals = false;
+            }
+            if (texCoords.size() != count * 2)
+                texCoords.clear();
+
+            unsigned int base = (unsigned int)vertices.size();
+            for (size_t v = 0; v < count; ++v)
+            {
+                MeshVertex vertex;
+                memset(&vertex, 0, sizeof(vertex));
+                const float *p3 = &positions[v * 3];
+                for (int row = 0; row < 3; ++row)
+                    vertex.position[row] = world.m[row] * p3[0] + world.m[4 + row] * p3[1] + world.m[8 + row] * p3[2] + world.m[12 + row];
+                if (!normals.empty())
+                {
+                    const float *n3 = &normals[v * 3];
+                    for (int row = 0; row < 3; ++row)
+                        vertex.normal[row] = normalMatrix[row] * n3[0] + normalMatrix[3 + row] * n3[1] + normalMatrix[6 + row] * n3[2];
+                }
+                if (!texCoords.empty())
+                {
+                    vertex.texCoords[0] = texCoords[v * 2];
+                    // glTF puts the origin top left, GL bottom left
+                    vertex.texCoords[1] = 1.0f - texCoords[v * 2 + 1];
+                }
+                vertices.push_back(vertex);
+            }
+
+            std::vector<unsigned int> primitiveIndices;
+            if (primitive.has("indices"))
+            {
+                std::vector<float> values;
+                if (!accessor(primitive["indices"].asInt(), 1, values, error, &primitiveIndices))
+                    return false;
+            }
+            else
+                for (size_t v = 0; v < count; ++v)
+                    primitiveIndices.push_back((unsigned int)v);
+            // a mirroring transform flips the winding
+            bool flip = determinant(world) < 0.0f;
+            for (size_t i = 0; i + 2 < primitiveIndices.size(); i += 3)
+                for (int k = 0; k < 3; ++k)
+                {
+                    unsigned int index = primitiveIndices[i + (flip && k ? 3 - k : k)];
+                    if (index >= count)
+                    {
+                        error = "index out of range in mesh " + std::to_string(index);
+                        return false;
+                    }
+                    indices.push_back(base + index);
+                }
+        }
+        return true;
+    }
+
+    // reads an accessor as floats (normalized integers mapped to 0..1 or -1..1), or as integers into integers
+    bool accessor(int index, int components, std::vector<float> &out, std::string &error,
+                  std::vector<unsigned int> *integers = NULL)
+    {
+        const JsonValue &a = json["accessors"][(size_t)std::max(0, index)];
+        if (index < 0 || a.type != JsonValue::OBJECT || !a.has("bufferView") || a.has("sparse"))
+        {
+            error = "accessor " + std::to_string(index) + " is missing, sparse or has no buffer view";
+            return false;
+        }
+        static const char *types[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+        if (a["type"].string != types[components - 1])
+        {
+            error = "accessor " + std::to_string(index) + " is " + a["type"].string;
+            return false;
+        }
+        const JsonValue &view = json["bufferViews"][(size_t)std::max(0, a["bufferView"].asInt())];
+        int buffer = view["buffer"].asInt();
+        if (buffer < 0 || buffer >= (int)buffers.size())
+        {
+            error = "accessor " + std::to_string(index) + " has a bad buffer";
+            return false;
+        }
+        int componentType = a["componentType"].asInt();
+        size_t componentSize = componentType == 5126 || componentType == 5125 ? 4 : componentType == 5123 || componentType == 5122 ? 2 : 1;
+        size_t count = (size_t)a["count"].asNumber();
+        size_t stride = (size_t)view["byteStride"].asNumber(0.0);
+        if (!stride)
+            stride = componentSize * components;
+        size_t offset = (size_t)view["byteOffset"].asNumber() + (size_t)a["byteOffset"].asNumber();
+        size_t needed = count ? offset + (count - 1) * stride + componentSize * components : offset;
+        if (needed > (size_t)view["byteOffset"].asNumber() + (size_t)view["byteLength"].asNumber() ||
+            needed > buffers[buffer].size())
+        {
+            error = "accessor " + std::to_string(index) + " runs past its buffer";
+            return false;
+        }
+        bool normalized = a["normalized"].type == JsonValue::BOOLEAN && a["normalized"].number != 0.0;
+        const unsigned char *data = &buffers[buffer][0] + offset;
+        if (integers)
+            integers->resize(count * components);
+        else
+            out.resize(count * components);
+        for (size_t i = 0; i < count; ++i)
+            for (int c = 0; c < components; ++c)
+            {
+                const unsigned char *element = data + i * stride + c * componentSize;
+                double value;
+                switch (componentType)
+                {
+                case 5126: { float f; memcpy(&f, element, 4); value = f; break; }
+                case 5125: { unsigned int u; memcpy(&u, element, 4); value = u; break; }
+                case 5123: { unsigned short u; memcpy(&u, element, 2); value = normalized ? u / 65535.0 : u; break; }
+                case 5122: { short s; memcpy(&s, element, 2); value = normalized ? std::max(s / 32767.0, -1.0) : s; break; }
+                case 5121: value = normalized ? element[0] / 255.0 : element[0]; break;
+                case 5120: value = normalized ? std::max((signed char)element[0] / 127.0, -1.0) : (signed char)element[0]; break;
+                default:
+                    error = "accessor " + std::to_string(index) + " has component type " + std::to_string(componentType);
+                    return false;
+                }
+                if (integers)
+                    (*integers)[i * components + c] = (unsigned int)value;
+                else
+                    out[i * components + c] = (float)value;
+            }
+        return true;
+    }
+
+    static float determinant(const Matrix &w)
+    {
+        const float *m = w.m;
+        return m[0] * (m[5] * m[10] - m[9] * m[6]) - m[4] * (m[1] * m[10] - m[9] * m[2]) + m[8] * (m[1] * m[6] - m[5] * m[2]);
+    }
+
+    // of the upper 3x3, column major; the cofactor matrix, as the scale doesn't matter for normals
+    static void inverseTranspose(const Matrix &w, float out[9])
+    {
+        const float *m = w.m;
+        float a[3][3] = { { m[0], m[4], m[8] }, { m[1], m[5], m[9] }, { m[2], m[6], m[10] } }; // a[row][col]
+        for (int row = 0; row < 3; ++row)
+            for (int col = 0; col < 3; ++col)
+            {
+                int r1 = (row + 1) % 3, r2 = (row + 2) % 3, c1 = (col + 1) % 3, c2 = (col + 2) % 3;
+                out[col * 3 + row] = a[r1][c1] * a[r2][c2] - a[r1][c2] * a[r2][c1];
+            }
+        if (determinant(w) < 0.0f)
+            for (int i = 0; i < 9; ++i)
+                out[i] = -out[i];
+    }
+
+    static void decodeBase64(const std::string &text, std::vector<unsigned char> &out)
+    {
+        unsigned int bits = 0;
+        int count = 0;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            const char *found = strchr(alphabet, text[i]);
+            if (!found || !text[i])
+                continue; // padding and whitespace
+            bits = (bits << 6) | (unsigned int)(found - alphabet);
+            count += 6;
+            if (count >= 8)
+            {
+                count -= 8;
+                out.push_back((unsigned char)(bits >> count));
+            }
+        }
+    }
+
+    static std::string decodeUri(const std::string &uri)
+    {
+        std::string out;
+        for (size_t i = 0; i < uri.size(); ++i)
+        {
+            if (uri[i] == '%' && i + 2 < uri.size())
+            {
+                out += (char)strtol(uri.substr(i + 1, 2).c_str(), NULL, 16);
+                i += 2;
+            }
+            else
+                out += uri[i];
+        }
+        return out;
+    }
+};
+#endif
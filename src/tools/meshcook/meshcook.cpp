@@ -0,0 +1,182 @@
+//
+// meshcook: imports OBJ and glTF meshes into the quantized, GPU-ready .gmesh format (see helpers/mesh_file.h)
+//
+
+#include <helpers/cook_graph.h>
+#include <helpers/mesh_file.h>
+#include <helpers/mesh_optimize.h>
+#include <helpers/mesh_simplify.h>
+#include <helpers/meshlet.h>
+
+#include "gltf_import.h"
+#include "obj_import.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static std::string lowerExtension(const std::string &path)
+{
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    for (size_t i = 0; i < extension.size(); ++i)
+        extension[i] = (char)tolower(extension[i]);
+    return extension;
+}
+
+// half the bounding box's diagonal, what the LOD error limit is relative to
+static float halfDiagonal(const std::vector<MeshVertex> &vertices)
+{
+    if (vertices.empty())
+        return 0.0f;
+    float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+    for (size_t v = 0; v < vertices.size(); ++v)
+        for (int c = 0; c < 3; ++c)
+        {
+            lo[c] = std::min(lo[c], vertices[v].position[c]);
+            hi[c] = std::max(hi[c], vertices[v].position[c]);
+        }
+    return 0.5f * std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) + (hi[2] - lo[2]) * (hi[2] - lo[2]));
+}
+
+// bump when the output changes for the same input (assetcook recooks everything made with another)
+const int MESHCOOK_VERSION = 3;
+
+static void usage()
+{
+    std::cout << "usage: meshcook [options] <input.obj|.gltf|.glb> <output.gmesh>\n"
+                 "  --normals          recompute smooth normals even when the input has them\n"
+                 "  --no-optimize      keep the input's triangle and vertex order\n"
+                 "  --lods <n>         levels of detail, the original included (default: 6, 1 turns simplification off)\n"
+                 "  --lod-ratio <r>    triangles of a level to the one before (default: 0.5)\n"
+                 "  --lod-error <e>    largest error of a level, as a fraction of half the mesh's diagonal (default: 0.05)\n"
+                 "  --double-sided     no normal cones on the meshlets, so none is culled as back-facing\n"
+                 "  --deps <file>      list the files read besides the input (glTF buffers) in file\n"
+                 "  --version          print the cooker and format versions\n";
+}
+
+int main(int argc, char **argv)
+{
+    bool recomputeNormals = false, optimize = true, cones = true;
+    int lodCount = 6;
+    float lodRatio = 0.5f, lodError = 0.05f;
+    std::string depfile;
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--normals")
+            recomputeNormals = true;
+        else if (arg == "--no-optimize")
+            optimize = false;
+        else if (arg == "--lods" && i + 1 < argc)
+            lodCount = std::max(1, atoi(argv[++i]));
+        else if (arg == "--lod-ratio" && i + 1 < argc)
+            lodRatio = std::min(std::max((float)atof(argv[++i]), 0.05f), 0.95f);
+        else if (arg == "--lod-error" && i + 1 < argc)
+            lodError = std::max((float)atof(argv[++i]), 0.0f);
+        else if (arg == "--double-sided")
+            cones = false;
+        else if (arg == "--deps" && i + 1 < argc)
+            depfile = argv[++i];
+        else if (arg == "--version")
+        {
+            std::cout << "meshcook " << MESHCOOK_VERSION << " gmesh " << MESH_VERSION << std::endl;
+            return 0;
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            usage();
+            return 1;
+        }
+        else
+            arguments.push_back(arg);
+    }
+    if (arguments.size() != 2)
+    {
+        usage();
+        return 1;
+    }
+    const std::string &input = arguments[0], &output = arguments[1];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    AssetSpan file = FileSystem::map(input);
+    if (!file.valid())
+    {
+        std::cout << "ERROR::MESHCOOK::FILE_NOT_SUCCESFULLY_READ: " << input << std::endl;
+        return 1;
+    }
+    std::vector<MeshVertex> vertices;
+    std::vector<unsigned int> indices;
+    bool hasNormals = false, imported = false;
+    std::string error, extension = lowerExtension(input);
+    std::vector<std::string> dependencies;
+    if (extension == "obj")
+        imported = importObj(file, input, vertices, indices, hasNormals, error);
+    else if (extension == "gltf" || extension == "glb")
+        imported = GltfImporter::import(file, input, vertices, indices, hasNormals, error, &dependencies);
+    else
+        error = "unknown mesh format ." + extension;
+    if (!imported)
+    {
+        std::cout << "ERROR::MESHCOOK::IMPORT_FAILED: " << error << std::endl;
+        return 1;
+    }
+    size_t importedVertices = vertices.size();
+
+    MeshOptimizer::weld(vertices, indices);
+    if (!hasNormals || recomputeNormals)
+        MeshOptimizer::generateNormals(vertices, indices);
+    VertexCacheStatistics before = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    if (optimize)
+    {
+        MeshOptimizer::optimizeVertexCache(indices, vertices.size());
+        MeshOptimizer::optimizeOverdraw(indices, vertices);
+    }
+
+    // coarser levels after the original in the one index buffer, all of them on the same vertices
+    std::vector<MeshLod> lods;
+    MeshSimplifier::buildLods(vertices, indices, lods, lodCount, lodRatio, lodError * halfDiagonal(vertices), optimize);
+    if (optimize)
+        MeshOptimizer::optimizeVertexFetch(vertices, indices);
+
+    std::vector<Meshlet> meshlets;
+    MeshletBuilder::build(vertices, indices, lods, meshlets, cones);
+
+    MeshData data;
+    MeshFile::build(vertices, indices, lods, meshlets, data);
+    if (!MeshFile::write(output, data, error))
+    {
+        std::cout << "ERROR::MESHCOOK::FILE_NOT_SUCCESFULLY_WRITTEN: " << error << std::endl;
+        return 1;
+    }
+    if (!depfile.empty() && !CookGraph::writeDependencies(depfile, dependencies))
+    {
+        std::cout << "ERROR::MESHCOOK::FILE_NOT_SUCCESFULLY_WRITTEN: " << depfile << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t bytes = data.positions.size() * 2 + data.attributes.size() * 4 + data.indices.size();
+    size_t floatBytes = vertices.size() * sizeof(MeshVertex) + indices.size() * 4;
+    printf("%s: %u vertices (%u imported), %u triangles, %s%.1f MB (%.1f MB as floats), %.2f s\n", output.c_str(),
+           (unsigned int)vertices.size(), (unsigned int)importedVertices, lods[0].indexCount / 3,
+           hasNormals && !recomputeNormals ? "" : "generated normals, ", bytes / 1048576.0, floatBytes / 1048576.0,
+           seconds);
+    VertexCacheStatistics after = MeshOptimizer::analyzeVertexCache(indices.data(), lods[0].indexCount, vertices.size());
+    printf("  vertex cache (%d-entry FIFO): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", MESH_CACHE_SIZE, before.acmr, after.acmr, before.atvr,
+           after.atvr);
+    int coned = 0;
+    for (unsigned int i = 0; i < lods[0].meshletCount; ++i)
+        coned += meshlets[i].coneCutoff < 1.0f;
+    printf("  meshlets: %u, %.1f triangles each, %d with a normal cone\n", lods[0].meshletCount,
+           lods[0].indexCount / 3.0 / std::max(lods[0].meshletCount, 1u), coned);
+    for (size_t i = 1; i < lods.size(); ++i)
+        printf("  LOD %u: %u triangles in %u meshlets, error %g\n", (unsigned int)i, lods[i].indexCount / 3, lods[i].meshletCount, lods[i].error);
+    return 0;
+}
@@ -0,0 +1,147 @@
+//
+// Wavefront OBJ import for meshcook: v, vt, vn and f (polygons as fans, negative indices counted from the
+// end); groups, objects and materials are ignored, so everything ends up in one mesh.
+//
+
+#ifndef OBJ_IMPORT_H
+#define OBJ_IMPORT_H
+
+#include <helpers/mesh_file.h>
+
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ObjCorner
+{
+    int position, texCoords, normal; // 0-based, -1 when absent
+    bool operator==(const ObjCorner &other) const
+    {
+        return position == other.position && texCoords == other.texCoords && normal == other.normal;
+    }
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const ObjCorner &c) const
+    {
+        return (size_t)c.position * 73856093u ^ (size_t)c.texCoords * 19349663u ^ (size_t)c.normal * 83492791u;
+    }
+};
+
+// an obj index (1-based, negative from the end) to 0-based, -1 when out of range
+inline int objIndex(long index, size_t count)
+{
+    long resolved = index < 0 ? (long)count + index : index - 1;
+    return resolved >= 0 && resolved < (long)count ? (int)resolved : -1;
+}
+
+// hasNormals is false when any face lacks them, the caller generates them then
+inline bool importObj(const AssetSpan &file, const std::string &name, std::vector<MeshVertex> &vertices,
+                      std::vector<unsigned int> &indices, bool &hasNormals, std::string &error)
+{
+    std::vector<float> positions, texCoords, normals;
+    std::unordered_map<ObjCorner, unsigned int, ObjCornerHash> corners;
+    std::vector<unsigned int> polygon;
+    hasNormals = true;
+    // the file isn't null-terminated, strtof needs a copy of each line
+    std::string line;
+    const char *p = (const char *)file.data, *end = p + file.size;
+    int lineNumber = 0;
+    while (p < end)
+    {
+        const char *eol = p;
+        while (eol < end && *eol != '\n')
+            ++eol;
+        line.assign(p, eol);
+        p = eol + 1;
+        ++lineNumber;
+        const char *s = line.c_str();
+        while (*s == ' ' || *s == '\t')
+            ++s;
+        if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t'))
+        {
+            char *next;
+            for (int c = 0; c < 3; ++c)
+            {
+                positions.push_back(strtof(s + (c ? 0 : 1), &next));
+                s = next;
+            }
+        }
+        else if (s[0] == 'v' && s[1] == 't')
+        {
+            char *next;
+            float u = strtof(s + 2, &next), v = strtof(next, &next);
+            texCoords.push_back(u);
+            texCoords.push_back(v);
+        }
+        else if (s[0] == 'v' && s[1] == 'n')
+        {
+            char *next = (char *)s + 2;
+            for (int c = 0; c < 3; ++c)
+                normals.push_back(strtof(next, &next));
+        }
+        else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t'))
+        {
+            polygon.clear();
+            char *next = (char *)s + 1;
+            for (;;)
+            {
+                while (*next == ' ' || *next == '\t' || *next == '\r')
+                    ++next;
+                if (!*next)
+                    break;
+                ObjCorner corner = { -1, -1, -1 };
+                corner.position = objIndex(strtol(next, &next, 10), positions.size() / 3);
+                if (*next == '/')
+                {
+                    ++next;
+                    if (*next != '/')
+                        corner.texCoords = objIndex(strtol(next, &next, 10), texCoords.size() / 2);
+                    if (*next == '/')
+                    {
+                        ++next;
+                        corner.normal = objIndex(strtol(next, &next, 10), normals.size() / 3);
+                    }
+                }
+                if (corner.position < 0)
+                {
+                    error = name + ":" + std::to_string(lineNumber) + ": bad face";
+                    return false;
+                }
+                while (*next && *next != ' ' && *next != '\t' && *next != '\r')
+                    ++next;
+                if (corner.normal < 0)
+                    hasNormals = false;
+                std::pair<std::unordered_map<ObjCorner, unsigned int, ObjCornerHash>::iterator, bool> found =
+                    corners.insert(std::make_pair(corner, (unsigned int)vertices.size()));
+                if (found.second)
+                {
+                    MeshVertex vertex;
+                    memset(&vertex, 0, sizeof(vertex));
+                    memcpy(vertex.position, &positions[corner.position * 3], sizeof(vertex.position));
+                    if (corner.texCoords >= 0)
+                        memcpy(vertex.texCoords, &texCoords[corner.texCoords * 2], sizeof(vertex.texCoords));
+                    if (corner.normal >= 0)
+                        memcpy(vertex.normal, &normals[corner.normal * 3], sizeof(vertex.normal));
+                    vertices.push_back(vertex);
+                }
+                polygon.push_back(found.first->second);
+            }
+            for (size_t i = 2; i < polygon.size(); ++i)
+            {
+                indices.push_back(polygon[0]);
+                indices.push_back(polygon[i - 1]);
+                indices.push_back(polygon[i]);
+            }
+        }
+    }
+    if (indices.empty())
+    {
+        error = name + " has no faces";
+        return false;
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,163 @@
+//
+// primbench: procedural mesh generation throughput, and how the meshes use the vertex cache
+//
+
+#include <helpers/mesh_optimize.h>
+#include <helpers/primitives.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void usage()
+{
+    std::cout << "usage: primbench [options]\n"
+                 "  --segments <n>  quads around each shape, half as many along (default: 512)\n"
+                 "  --threads <n>   threads of the parallel runs (default: one per core)\n"
+                 "  --runs <n>      generations per measurement, the best one is reported (default: 5)\n";
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// how the sphere used to be built: attribute vectors grown one push_back at a time, interleaved by a
+// second pass, a strip a row joined into one with 32-bit indices; returns the vertex count
+static size_t referenceSphere(int xSegments, int ySegments, std::vector<unsigned int> &indices)
+{
+    std::vector<float> positions, normals, uv;
+    indices.clear();
+    for (int y = 0; y <= ySegments; ++y)
+        for (int x = 0; x <= xSegments; ++x)
+        {
+            float xSegment = (float)x / xSegments, ySegment = (float)y / ySegments;
+            float xPos = std::cos(xSegment * PRIMITIVE_TAU) * std::sin(ySegment * PRIMITIVE_PI);
+            float yPos = std::cos(ySegment * PRIMITIVE_PI);
+            float zPos = std::sin(xSegment * PRIMITIVE_TAU) * std::sin(ySegment * PRIMITIVE_PI);
+            positions.push_back(xPos);
+            positions.push_back(yPos);
+            positions.push_back(zPos);
+            uv.push_back(xSegment);
+            uv.push_back(ySegment);
+            normals.push_back(xPos);
+            normals.push_back(yPos);
+            normals.push_back(zPos);
+        }
+    bool oddRow = false;
+    for (int y = 0; y < ySegments; ++y)
+    {
+        if (!oddRow)
+            for (int x = 0; x <= xSegments; ++x)
+            {
+                indices.push_back(y * (xSegments + 1) + x);
+                indices.push_back((y + 1) * (xSegments + 1) + x);
+            }
+        else
+            for (int x = xSegments; x >= 0; --x)
+            {
+                indices.push_back((y + 1) * (xSegments + 1) + x);
+                indices.push_back(y * (xSegments + 1) + x);
+            }
+        oddRow = !oddRow;
+    }
+    std::vector<float> data;
+    for (size_t i = 0; i < positions.size() / 3; ++i)
+    {
+        data.push_back(positions[3 * i]);
+        data.push_back(positions[3 * i + 1]);
+        data.push_back(positions[3 * i + 2]);
+        data.push_back(normals[3 * i]);
+        data.push_back(normals[3 * i + 1]);
+        data.push_back(normals[3 * i + 2]);
+        data.push_back(uv[2 * i]);
+        data.push_back(uv[2 * i + 1]);
+    }
+    return data.size() / 8;
+}
+
+// best time of runs writes into buffers sized once up front
+static double bestWrite(const Primitive &primitive, int threads, int runs, std::vector<PrimitiveVertex> &vertices, std::vector<unsigned int> &indices)
+{
+    vertices.resize(std::max(vertices.size(), primitive.vertexCount()));
+    indices.resize(std::max(indices.size(), primitive.indexCount()));
+    double best = 1e30;
+    for (int r = 0; r < runs; ++r)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (primitive.shortIndices())
+            primitive.write(vertices.data(), (unsigned short *)indices.data(), threads);
+        else
+            primitive.write(vertices.data(), indices.data(), threads);
+        best = std::min(best, millisecondsSince(start));
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    int segments = 512, runs = 5, threads = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--segments") && i + 1 < argc)
+            segments = std::max(4, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+            runs = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+        {
+            usage();
+            return 0;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    double reference = 1e30;
+    size_t referenceVertices = 0;
+    std::vector<unsigned int> referenceIndices;
+    for (int r = 0; r < runs; ++r)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        referenceVertices = referenceSphere(segments, segments / 2, referenceIndices);
+        reference = std::min(reference, millisecondsSince(start));
+    }
+    VertexCacheStatistics referenceCache =
+        MeshOptimizer::analyzeVertexCache(referenceIndices.data(), referenceIndices.size(), referenceVertices, true);
+    std::printf("sphere %dx%d, vectors + interleave: %7.2f ms  (%.1f Mvertices/s)  ACMR %.3f ATVR %.3f\n", segments, segments / 2, reference,
+                referenceVertices / reference / 1000.0, referenceCache.acmr, referenceCache.atvr);
+
+    const char *names[] = { "sphere", "torus", "box", "plane", "cylinder", "capsule" };
+    Primitive primitives[] = { Primitive::sphere(1.0f, segments, segments / 2), Primitive::torus(0.9f, 0.4f, segments, segments / 2),
+                               Primitive::box(), Primitive::plane(1.0f, 1.0f, segments, segments),
+                               Primitive::cylinder(0.5f, 1.0f, segments, segments / 2), Primitive::capsule(0.5f, 1.0f, segments, segments / 4) };
+    std::vector<PrimitiveVertex> vertices;
+    std::vector<unsigned int> indices;
+    for (size_t i = 0; i < sizeof(primitives) / sizeof(primitives[0]); ++i)
+    {
+        const Primitive &primitive = primitives[i];
+        double single = bestWrite(primitive, 1, runs, vertices, indices);
+        double parallel = bestWrite(primitive, threads, runs, vertices, indices);
+        VertexCacheStatistics cache =
+            primitive.shortIndices()
+                ? MeshOptimizer::analyzeVertexCache((const unsigned short *)indices.data(), primitive.indexCount(), primitive.vertexCount(), true)
+                : MeshOptimizer::analyzeVertexCache(indices.data(), primitive.indexCount(), primitive.vertexCount(), true);
+        std::printf("%-8s %8zu vertices %8zu indices (%d-bit): 1 thread %7.2f ms (%6.1f Mvertices/s)  parallel x%d %7.2f ms (%6.1f Mvertices/s)"
+                    "  ACMR %.3f ATVR %.3f\n",
+                    names[i], primitive.vertexCount(), primitive.indexCount(), primitive.shortIndices() ? 16 : 32, single,
+                    primitive.vertexCount() / single / 1000.0, threads, parallel, primitive.vertexCount() / parallel / 1000.0, cache.acmr,
+                    cache.atvr);
+    }
+    return 0;
+}
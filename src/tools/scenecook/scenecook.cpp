@@ -0,0 +1,73 @@
+//
+// scenecook: compiles the text form of a scene into a .gscene (see helpers/scene_file.h)
+//
+
+#include <helpers/cook_graph.h>
+#include <helpers/scene_file.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// bump when the output changes for the same input (assetcook recooks everything made with another)
+const int SCENECOOK_VERSION = 1;
+
+int main(int argc, char **argv)
+{
+    std::string depfile;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--deps" && i + 1 < argc)
+            depfile = argv[++i];
+        else if (arg == "--version")
+        {
+            std::cout << "scenecook " << SCENECOOK_VERSION << " gscene " << SCENE_VERSION << std::endl;
+            return 0;
+        }
+        else
+            files.push_back(arg);
+    }
+    if (files.size() != 2)
+    {
+        std::cout << "usage: scenecook [--deps <file>] <input.scene> <output.gscene>\n"
+                     "  --deps <file>      list the files read besides the input (the cooked meshes) in file\n"
+                     "  --version          print the cooker and format versions\n";
+        return 1;
+    }
+    std::string input = files[0], output = files[1];
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    AssetSpan text = FileSystem::read(input);
+    if (!text.valid())
+    {
+        std::cout << "ERROR::SCENECOOK::FILE_NOT_SUCCESFULLY_READ: " << input << std::endl;
+        return 1;
+    }
+    std::vector<unsigned char> data;
+    std::vector<std::string> dependencies;
+    std::string error;
+    if (!SceneFile::compile((const char *)text.data, text.size, input, data, error, &dependencies))
+    {
+        std::cout << "ERROR::SCENECOOK::COMPILE_FAILED: " << error << std::endl;
+        return 1;
+    }
+    if (!SceneFile::write(output, data, error))
+    {
+        std::cout << "ERROR::SCENECOOK::FILE_NOT_SUCCESFULLY_WRITTEN: " << error << std::endl;
+        return 1;
+    }
+    if (!depfile.empty() && !CookGraph::writeDependencies(depfile, dependencies))
+    {
+        std::cout << "ERROR::SCENECOOK::FILE_NOT_SUCCESFULLY_WRITTEN: " << depfile << std::endl;
+        return 1;
+    }
+    const SceneHeader *header = (const SceneHeader *)data.data();
+    printf("%s: %u assets, %u objects in %u cells, %u lights, %.1f KB, %.2f ms\n", output.c_str(), header->assetCount,
+           header->objectCount, header->cellCount, header->lightCount, data.size() / 1024.0,
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}
@@ -0,0 +1,188 @@
+//
+// texbench: texture decode benchmarks
+//
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static bool readFile(const std::string &path, std::vector<unsigned char> &data)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static void usage()
+{
+    std::cout << "usage: texbench [options] <image>...\n"
+                 "  --runs <n>   decodes per measurement, the best one is reported (default: 5)\n";
+}
+
+// average factor x factor blocks, the reference a mip chain would be built with
+static std::vector<unsigned char> boxFilter(const unsigned char *data, int w, int h, int channels, int scaleLog2, int &outW, int &outH)
+{
+    int factor = 1 << scaleLog2;
+    outW = (w + factor - 1) >> scaleLog2;
+    outH = (h + factor - 1) >> scaleLog2;
+    std::vector<unsigned char> out(outW * outH * channels);
+    for (int j = 0; j < outH; ++j)
+    {
+        int y0 = j << scaleLog2, y1 = std::min(y0 + factor, h);
+        for (int i = 0; i < outW; ++i)
+        {
+            int x0 = i << scaleLog2, x1 = std::min(x0 + factor, w);
+            int area = (x1 - x0) * (y1 - y0);
+            for (int c = 0; c < channels; ++c)
+            {
+                int sum = 0;
+                for (int y = y0; y < y1; ++y)
+                    for (int x = x0; x < x1; ++x)
+                        sum += data[(y * w + x) * channels + c];
+                out[(j * outW + i) * channels + c] = (unsigned char)((sum + area / 2) / area);
+            }
+        }
+    }
+    return out;
+}
+
+static double psnr(const unsigned char *a, const unsigned char *b, size_t size)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        double d = (double)a[i] - (double)b[i];
+        error += d * d;
+    }
+    if (error == 0.0)
+        return INFINITY;
+    return 10.0 * std::log10(255.0 * 255.0 * size / error);
+}
+
+template <typename F>
+static double bestOf(int runs, F f)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        f();
+        std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+        best = std::min(best, ms.count());
+    }
+    return best;
+}
+
+// png: the reference inflate + scalar unfilter against the fast paths
+static void benchPng(const std::string &path, const std::vector<unsigned char> &file, int runs)
+{
+    int w, h, n, fw, fh, fn;
+    stbi_set_png_fast_decode(0);
+    unsigned char *reference = stbi_load_from_memory(file.data(), (int)file.size(), &w, &h, &n, 0);
+    double referenceMs = bestOf(runs, [&]() {
+        int x, y, c;
+        stbi_image_free(stbi_load_from_memory(file.data(), (int)file.size(), &x, &y, &c, 0));
+    });
+    stbi_set_png_fast_decode(1);
+    unsigned char *fast = stbi_load_from_memory(file.data(), (int)file.size(), &fw, &fh, &fn, 0);
+    double fastMs = bestOf(runs, [&]() {
+        int x, y, c;
+        stbi_image_free(stbi_load_from_memory(file.data(), (int)file.size(), &x, &y, &c, 0));
+    });
+    if (!reference || !fast || fw != w || fh != h || fn != n || memcmp(reference, fast, w * h * n))
+        std::cout << "ERROR::TEXBENCH::PNG_MISMATCH: " << path << std::endl;
+    else
+        std::printf("  png: reference %7.2f ms  fast %7.2f ms  speedup %5.2fx  (%.1f MB/s out)\n",
+                    referenceMs, fastMs, referenceMs / fastMs, w * h * n / fastMs / 1000.0);
+    stbi_image_free(reference);
+    stbi_image_free(fast);
+}
+
+// full decode + box filter against decoding straight to 1/2, 1/4 and 1/8
+static void benchScaled(const std::string &path, const std::vector<unsigned char> &file, int runs)
+{
+    int w, h, n;
+    unsigned char *full = stbi_load_from_memory(file.data(), (int)file.size(), &w, &h, &n, 4);
+    if (!full)
+    {
+        std::cout << "ERROR::TEXBENCH::DECODE: " << path << ": " << stbi_failure_reason() << std::endl;
+        return;
+    }
+    double fullMs = bestOf(runs, [&]() {
+        int x, y, c;
+        stbi_image_free(stbi_load_from_memory(file.data(), (int)file.size(), &x, &y, &c, 4));
+    });
+    std::printf("%s: %dx%d, %d channels, full decode %.2f ms\n", path.c_str(), w, h, n, fullMs);
+
+    for (int scale = 1; scale <= 3; ++scale)
+    {
+        int rw, rh;
+        double boxMs = bestOf(runs, [&]() { boxFilter(full, w, h, 4, scale, rw, rh); });
+        std::vector<unsigned char> reference = boxFilter(full, w, h, 4, scale, rw, rh);
+
+        int sw, sh, sn;
+        unsigned char *scaled = stbi_load_from_memory_scaled(file.data(), (int)file.size(), scale, &sw, &sh, &sn, 4);
+        double scaledMs = bestOf(runs, [&]() {
+            int x, y, c;
+            stbi_image_free(stbi_load_from_memory_scaled(file.data(), (int)file.size(), scale, &x, &y, &c, 4));
+        });
+        if (!scaled || sw != rw || sh != rh)
+        {
+            std::cout << "ERROR::TEXBENCH::SCALED_DECODE: " << path << " 1/" << (1 << scale) << std::endl;
+            stbi_image_free(scaled);
+            continue;
+        }
+        std::printf("  1/%d %4dx%-4d  full+box %7.2f ms  scaled %7.2f ms  speedup %5.2fx  psnr %6.2f dB\n",
+                    1 << scale, sw, sh, fullMs + boxMs, scaledMs, (fullMs + boxMs) / scaledMs,
+                    psnr(scaled, reference.data(), reference.size()));
+        stbi_image_free(scaled);
+    }
+    stbi_image_free(full);
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 5;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+            runs = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+        {
+            usage();
+            return 0;
+        }
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.empty())
+    {
+        usage();
+        return 1;
+    }
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        std::vector<unsigned char> file;
+        if (!readFile(files[i], file))
+        {
+            std::cout << "ERROR::TEXBENCH::FILE_NOT_SUCCESFULLY_READ: " << files[i] << std::endl;
+            continue;
+        }
+        benchScaled(files[i], file, runs);
+        if (file.size() > 8 && !memcmp(file.data(), "\x89PNG", 4))
+            benchPng(files[i], file, runs);
+    }
+    return 0;
+}
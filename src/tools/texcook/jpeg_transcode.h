@@ -0,0 +1,581 @@
+#ifndef JPEG_TRANSCODE_H
+#define JPEG_TRANSCODE_H
+
+// Lossless JPEG re-encoding on top of stb_image's decoder internals: the
+// quantized DCT coefficients are pulled out of any baseline or progressive
+// file and written back as a single-scan baseline JPEG with a restart marker
+// every N MCUs and huffman tables optimized for the new stream.
+//
+// Needs the stb_image implementation in the same translation unit, so
+// include it after defining STB_IMAGE_IMPLEMENTATION.
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct JpegCoefficients
+{
+    struct Component
+    {
+        int id, h, v, tq;
+        int blocksW, blocksH;        // coefficient grid, padded to whole MCUs
+        int usedW, usedH;            // blocks that actually cover pixels
+        std::vector<short> coeff;    // 64 per block, natural (row-major) order
+    };
+
+    int width = 0, height = 0;
+    int mcuX = 0, mcuY = 0;
+    int restartInterval = 0;
+    bool progressive = false;
+    std::vector<Component> comps;
+    unsigned char quant[4][64];      // natural order
+    bool quantUsed[4] = { false, false, false, false };
+};
+
+namespace jpeg_transcode
+{
+    // the baseline entropy decoder, storing coefficients instead of running the IDCT
+    static int decodeBaselineScan(stbi__jpeg *z)
+    {
+        static stbi_uc ones[64] = {
+            1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,
+            1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1
+        };
+        STBI_SIMD_ALIGN(short, data[64]);
+        int row;
+        int total = stbi__jpeg_scan_mcus(z, &row);
+        stbi__jpeg_reset(z);
+        for (int m = 0; m < total; ++m)
+        {
+            int i = m % row, j = m / row;
+            for (int k = 0; k < z->scan_n; ++k)
+            {
+                int n = z->order[k];
+                // a single-component scan has one block per MCU
+                int bh = z->scan_n == 1 ? 1 : z->img_comp[n].h;
+                int bv = z->scan_n == 1 ? 1 : z->img_comp[n].v;
+                for (int y = 0; y < bv; ++y)
+                {
+                    for (int x = 0; x < bh; ++x)
+                    {
+                        int ha = z->img_comp[n].ha;
+                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, ones))
+                            return 0;
+                        int x2 = i * bh + x;
+                        int y2 = j * bv + y;
+                        memcpy(z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w), data, sizeof(data));
+                    }
+                }
+            }
+            if (--z->todo <= 0)
+            {
+                if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                if (!STBI__RESTART(z->marker)) return 1;
+                stbi__jpeg_reset(z);
+            }
+        }
+        return 1;
+    }
+
+    // mirrors stbi__decode_jpeg_image, minus the final dequantize + IDCT
+    static bool decodeCoefficients(stbi__jpeg *j, std::string &error)
+    {
+        for (int m = 0; m < 4; ++m)
+        {
+            j->img_comp[m].raw_data = NULL;
+            j->img_comp[m].raw_coeff = NULL;
+        }
+        j->restart_interval = 0;
+        if (!stbi__decode_jpeg_header(j, STBI__SCAN_load))
+        {
+            error = stbi_failure_reason();
+            return false;
+        }
+        // baseline images normally go straight to pixels; give them the same
+        // coefficient planes the progressive path uses
+        if (!j->progressive)
+        {
+            for (int i = 0; i < j->s->img_n; ++i)
+            {
+                j->img_comp[i].coeff_w = j->img_comp[i].w2 / 8;
+                j->img_comp[i].coeff_h = j->img_comp[i].h2 / 8;
+                j->img_comp[i].raw_coeff = stbi__malloc_mad3(j->img_comp[i].w2, j->img_comp[i].h2, sizeof(short), 15);
+                if (j->img_comp[i].raw_coeff == NULL)
+                {
+                    error = "out of memory";
+                    return false;
+                }
+                j->img_comp[i].coeff = (short *)(((size_t)j->img_comp[i].raw_coeff + 15) & ~15);
+                memset(j->img_comp[i].coeff, 0, j->img_comp[i].w2 * j->img_comp[i].h2 * sizeof(short));
+            }
+        }
+        int m = stbi__get_marker(j);
+        while (!stbi__EOI(m))
+        {
+            if (stbi__SOS(m))
+            {
+                if (!stbi__process_scan_header(j))
+                {
+                    error = stbi_failure_reason();
+                    return false;
+                }
+                int ok = j->progressive ? stbi__parse_entropy_coded_data(j) : decodeBaselineScan(j);
+                if (!ok)
+                {
+                    error = stbi_failure_reason();
+                    return false;
+                }
+                if (j->marker == STBI__MARKER_none)
+                {
+                    while (!stbi__at_eof(j->s))
+                    {
+                        int x = stbi__get8(j->s);
+                        if (x == 255)
+                        {
+                            j->marker = stbi__get8(j->s);
+                            break;
+                        }
+                        else if (x != 0)
+                        {
+                            error = "junk before marker";
+                            return false;
+                        }
+                    }
+                }
+            }
+            else if (!stbi__process_marker(j, m))
+            {
+                error = stbi_failure_reason();
+                return false;
+            }
+            m = stbi__get_marker(j);
+            if (m == STBI__MARKER_none && stbi__at_eof(j->s))
+            {
+                error = "missing EOI";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // canonical JPEG huffman table (ITU T.81 annex K.2) from symbol frequencies
+    struct HuffmanTable
+    {
+        unsigned char bits[17];      // bits[n]: number of codes of length n
+        std::vector<unsigned char> values;
+        unsigned short code[256];
+        unsigned char size[256];
+    };
+
+    static void buildOptimalTable(const long freqIn[256], HuffmanTable &table)
+    {
+        long freq[257];
+        int codesize[257], others[257];
+        for (int i = 0; i < 256; ++i)
+            freq[i] = freqIn[i];
+        freq[256] = 1; // reserves the all-ones code
+        for (int i = 0; i < 257; ++i)
+        {
+            codesize[i] = 0;
+            others[i] = -1;
+        }
+        for (;;)
+        {
+            int c1 = -1, c2 = -1;
+            long v = 1000000000L;
+            for (int i = 0; i <= 256; ++i)
+                if (freq[i] && freq[i] <= v) { v = freq[i]; c1 = i; }
+            v = 1000000000L;
+            for (int i = 0; i <= 256; ++i)
+                if (freq[i] && freq[i] <= v && i != c1) { v = freq[i]; c2 = i; }
+            if (c2 < 0)
+                break;
+            freq[c1] += freq[c2];
+            freq[c2] = 0;
+            codesize[c1]++;
+            while (others[c1] >= 0)
+            {
+                c1 = others[c1];
+                codesize[c1]++;
+            }
+            others[c1] = c2;
+            codesize[c2]++;
+            while (others[c2] >= 0)
+            {
+                c2 = others[c2];
+                codesize[c2]++;
+            }
+        }
+        int bits[33] = { 0 };
+        for (int i = 0; i <= 256; ++i)
+            if (codesize[i])
+                bits[codesize[i]]++;
+        // limit code lengths to 16 bits
+        for (int i = 32; i > 16; --i)
+        {
+            while (bits[i] > 0)
+            {
+                int j = i - 2;
+                while (bits[j] == 0)
+                    --j;
+                bits[i] -= 2;
+                bits[i - 1]++;
+                bits[j + 1] += 2;
+                bits[j]--;
+            }
+        }
+        int i = 16;
+        while (bits[i] == 0)
+            --i;
+        bits[i]--; // drop the reserved code again
+
+        memset(table.bits, 0, sizeof(table.bits));
+        memset(table.size, 0, sizeof(table.size));
+        for (int n = 1; n <= 16; ++n)
+            table.bits[n] = (unsigned char)bits[n];
+        table.values.clear();
+        for (int n = 1; n <= 32; ++n)
+            for (int s = 0; s < 256; ++s)
+                if (codesize[s] == n)
+                    table.values.push_back((unsigned char)s);
+        unsigned int code = 0;
+        size_t k = 0;
+        for (int n = 1; n <= 16; ++n)
+        {
+            for (int c = 0; c < table.bits[n]; ++c, ++k)
+            {
+                table.code[table.values[k]] = (unsigned short)code++;
+                table.size[table.values[k]] = (unsigned char)n;
+            }
+            code <<= 1;
+        }
+    }
+
+    // either counts symbols (first pass) or writes them (second pass)
+    class ScanWriter
+    {
+    public:
+        long dcFreq[2][256], acFreq[2][256];
+        const HuffmanTable *dc[2], *ac[2];
+        std::vector<unsigned char> *out = nullptr;
+        bool overflow = false;
+
+        ScanWriter()
+        {
+            memset(dcFreq, 0, sizeof(dcFreq));
+            memset(acFreq, 0, sizeof(acFreq));
+        }
+
+        void block(const short *data, int table, int &pred)
+        {
+            int diff = data[0] - pred;
+            pred = data[0];
+            int cat = category(diff);
+            if (cat > 11)
+                overflow = true;
+            symbol(true, table, cat);
+            bits(diff, cat);
+
+            int run = 0;
+            for (int k = 1; k < 64; ++k)
+            {
+                int v = data[stbi__jpeg_dezigzag[k]];
+                if (v == 0)
+                {
+                    ++run;
+                    continue;
+                }
+                while (run > 15)
+                {
+                    symbol(false, table, 0xF0);
+                    run -= 16;
+                }
+                cat = category(v);
+                if (cat > 10)
+                    overflow = true;
+                symbol(false, table, (run << 4) | cat);
+                bits(v, cat);
+                run = 0;
+            }
+            if (run > 0)
+                symbol(false, table, 0x00); // EOB
+        }
+
+        void restart(int n)
+        {
+            if (!out)
+                return;
+            flush();
+            out->push_back(0xFF);
+            out->push_back((unsigned char)(0xD0 + (n & 7)));
+        }
+
+        void flush()
+        {
+            if (!out)
+                return;
+            if (count > 0)
+                put(0x7F, 7); // pad with one bits
+            count = 0;
+            acc = 0;
+        }
+
+    private:
+        unsigned int acc = 0;
+        int count = 0;
+
+        static int category(int v)
+        {
+            if (v < 0)
+                v = -v;
+            int n = 0;
+            while (v)
+            {
+                ++n;
+                v >>= 1;
+            }
+            return n;
+        }
+
+        void symbol(bool isDc, int table, int s)
+        {
+            if (!out)
+            {
+                (isDc ? dcFreq : acFreq)[table][s]++;
+                return;
+            }
+            const HuffmanTable *t = isDc ? dc[table] : ac[table];
+            put(t->code[s], t->size[s]);
+        }
+
+        void bits(int v, int n)
+        {
+            if (!out || n == 0)
+                return;
+            if (v < 0)
+                v += (1 << n) - 1;
+            put((unsigned int)v & ((1u << n) - 1), n);
+        }
+
+        void put(unsigned int code, int n)
+        {
+            acc = (acc << n) | code;
+            count += n;
+            while (count >= 8)
+            {
+                unsigned char b = (unsigned char)(acc >> (count - 8));
+                out->push_back(b);
+                if (b == 0xFF)
+                    out->push_back(0x00); // byte stuffing
+                count -= 8;
+            }
+            acc &= (1u << count) - 1;
+        }
+    };
+
+    static void encodeScan(const JpegCoefficients &in, int interval, ScanWriter &writer)
+    {
+        int ncomp = (int)in.comps.size();
+        int preds[4] = { 0, 0, 0, 0 };
+        // a single-component scan is non-interleaved: one block per MCU
+        int mcusW = ncomp == 1 ? in.comps[0].usedW : in.mcuX;
+        int mcusH = ncomp == 1 ? in.comps[0].usedH : in.mcuY;
+        int total = mcusW * mcusH, restarts = 0;
+        for (int m = 0; m < total; ++m)
+        {
+            if (interval > 0 && m > 0 && m % interval == 0)
+            {
+                writer.restart(restarts++);
+                preds[0] = preds[1] = preds[2] = preds[3] = 0;
+            }
+            int i = m % mcusW, j = m / mcusW;
+            for (int c = 0; c < ncomp; ++c)
+            {
+                const JpegCoefficients::Component &comp = in.comps[c];
+                int bh = ncomp == 1 ? 1 : comp.h;
+                int bv = ncomp == 1 ? 1 : comp.v;
+                for (int y = 0; y < bv; ++y)
+                    for (int x = 0; x < bh; ++x)
+                    {
+                        int bx = i * bh + x, by = j * bv + y;
+                        writer.block(&comp.coeff[64 * (bx + by * comp.blocksW)], c == 0 ? 0 : 1, preds[c]);
+                    }
+            }
+        }
+        writer.flush();
+    }
+
+    static void put16(std::vector<unsigned char> &out, int v)
+    {
+        out.push_back((unsigned char)(v >> 8));
+        out.push_back((unsigned char)(v & 0xFF));
+    }
+
+    static void writeTable(std::vector<unsigned char> &out, int tableClass, int id, const HuffmanTable &t)
+    {
+        out.push_back(0xFF);
+        out.push_back(0xC4);
+        put16(out, 2 + 1 + 16 + (int)t.values.size());
+        out.push_back((unsigned char)((tableClass << 4) | id));
+        for (int n = 1; n <= 16; ++n)
+            out.push_back(t.bits[n]);
+        out.insert(out.end(), t.values.begin(), t.values.end());
+    }
+}
+
+// read the quantized coefficients of a JPEG held in memory
+inline bool readJpegCoefficients(const unsigned char *data, int len, JpegCoefficients &out, std::string &error)
+{
+    stbi__context s;
+    stbi__start_mem(&s, data, len);
+    stbi__jpeg *j = (stbi__jpeg *)stbi__malloc(sizeof(stbi__jpeg));
+    if (!j)
+    {
+        error = "out of memory";
+        return false;
+    }
+    j->s = &s;
+    stbi__setup_jpeg(j);
+    bool ok = jpeg_transcode::decodeCoefficients(j, error);
+    if (ok)
+    {
+        out.width = s.img_x;
+        out.height = s.img_y;
+        out.mcuX = j->img_mcu_x;
+        out.mcuY = j->img_mcu_y;
+        out.restartInterval = j->restart_interval;
+        out.progressive = j->progressive != 0;
+        out.comps.resize(s.img_n);
+        for (int t = 0; t < 4; ++t)
+            out.quantUsed[t] = false;
+        for (int i = 0; i < s.img_n; ++i)
+        {
+            JpegCoefficients::Component &c = out.comps[i];
+            c.id = j->img_comp[i].id;
+            c.h = j->img_comp[i].h;
+            c.v = j->img_comp[i].v;
+            c.tq = j->img_comp[i].tq;
+            c.blocksW = j->img_comp[i].coeff_w;
+            c.blocksH = j->img_comp[i].coeff_h;
+            c.usedW = (j->img_comp[i].x + 7) >> 3;
+            c.usedH = (j->img_comp[i].y + 7) >> 3;
+            c.coeff.assign(j->img_comp[i].coeff, j->img_comp[i].coeff + 64 * c.blocksW * c.blocksH);
+            out.quantUsed[c.tq] = true;
+        }
+        memcpy(out.quant, j->dequant, sizeof(out.quant));
+    }
+    stbi__free_jpeg_components(j, s.img_n, 0);
+    STBI_FREE(j);
+    return ok;
+}
+
+// write the coefficients as a baseline JPEG with a restart marker every
+// 'interval' MCUs (0 disables restart markers)
+inline bool writeJpegWithRestarts(const JpegCoefficients &in, int interval, std::vector<unsigned char> &out, std::string &error)
+{
+    using namespace jpeg_transcode;
+    if (in.comps.empty() || in.comps.size() > 3)
+    {
+        error = "unsupported component count";
+        return false;
+    }
+    if (interval < 0 || interval > 0xFFFF)
+    {
+        error = "restart interval out of range";
+        return false;
+    }
+
+    // first pass gathers statistics for the huffman tables
+    ScanWriter stats;
+    encodeScan(in, interval, stats);
+    if (stats.overflow)
+    {
+        error = "coefficient out of baseline range";
+        return false;
+    }
+    int ntables = in.comps.size() > 1 ? 2 : 1;
+    HuffmanTable dc[2], ac[2];
+    for (int t = 0; t < ntables; ++t)
+    {
+        buildOptimalTable(stats.dcFreq[t], dc[t]);
+        buildOptimalTable(stats.acFreq[t], ac[t]);
+    }
+
+    out.clear();
+    out.reserve(in.width * in.height / 2);
+    // SOI + minimal JFIF APP0
+    static const unsigned char header[] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,
+        0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+    };
+    out.insert(out.end(), header, header + sizeof(header));
+    // DQT, back in zigzag order
+    for (int t = 0; t < 4; ++t)
+    {
+        if (!in.quantUsed[t])
+            continue;
+        out.push_back(0xFF);
+        out.push_back(0xDB);
+        put16(out, 2 + 1 + 64);
+        out.push_back((unsigned char)t);
+        for (int i = 0; i < 64; ++i)
+            out.push_back(in.quant[t][stbi__jpeg_dezigzag[i]]);
+    }
+    // SOF0
+    out.push_back(0xFF);
+    out.push_back(0xC0);
+    put16(out, 8 + 3 * (int)in.comps.size());
+    out.push_back(8);
+    put16(out, in.height);
+    put16(out, in.width);
+    out.push_back((unsigned char)in.comps.size());
+    for (size_t c = 0; c < in.comps.size(); ++c)
+    {
+        out.push_back((unsigned char)in.comps[c].id);
+        out.push_back((unsigned char)((in.comps[c].h << 4) | in.comps[c].v));
+        out.push_back((unsigned char)in.comps[c].tq);
+    }
+    for (int t = 0; t < ntables; ++t)
+    {
+        writeTable(out, 0, t, dc[t]);
+        writeTable(out, 1, t, ac[t]);
+    }
+    // DRI
+    if (interval > 0)
+    {
+        out.push_back(0xFF);
+        out.push_back(0xDD);
+        put16(out, 4);
+        put16(out, interval);
+    }
+    // SOS
+    out.push_back(0xFF);
+    out.push_back(0xDA);
+    put16(out, 6 + 2 * (int)in.comps.size());
+    out.push_back((unsigned char)in.comps.size());
+    for (size_t c = 0; c < in.comps.size(); ++c)
+    {
+        int t = c == 0 ? 0 : 1;
+        out.push_back((unsigned char)in.comps[c].id);
+        out.push_back((unsigned char)((t << 4) | t));
+    }
+    out.push_back(0);
+    out.push_back(63);
+    out.push_back(0);
+
+    ScanWriter writer;
+    writer.dc[0] = &dc[0];
+    writer.ac[0] = &ac[0];
+    writer.dc[1] = &dc[ntables - 1];
+    writer.ac[1] = &ac[ntables - 1];
+    writer.out = &out;
+    encodeScan(in, interval, writer);
+
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+    return true;
+}
+
+// JPEG_TRANSCODE_H
+#endif
@@ -0,0 +1,211 @@
+//
+// texcook: offline texture cooker
+//
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+// helpers include stb_image.h again, for the declarations only
+#undef STB_IMAGE_IMPLEMENTATION
+
+#include <helpers/texture_pack.h>
+#include <helpers/virtual_texture_file.h>
+
+#include "jpeg_transcode.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// bump when the output changes for the same input (assetcook recooks everything made with another)
+const int TEXCOOK_VERSION = 1;
+
+static bool readFile(const std::string &path, std::vector<unsigned char> &data)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool writeFile(const std::string &path, const std::vector<unsigned char> &data)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file)
+        return false;
+    file.write((const char *)data.data(), data.size());
+    return file.good();
+}
+
+static void usage()
+{
+    std::cout << "usage: texcook [options] <input.jpg> <output.jpg>\n"
+                 "       texcook --pack <output.dds> <source>...\n"
+                 "       texcook --normal <input> <output.dds>\n"
+                 "       texcook --virtual <output.vtex> [--tile <x> <y>] [--page <texels>] <source>...\n"
+                 "  --restart <mcus>   restart interval in MCUs (default: one MCU row, 0 = none)\n"
+                 "  --pack             pack sources into RGBA with mips, a source is path[:channels] or a constant\n"
+                 "                     in 0..1, e.g. albedo.jpg:rgb specular.png:r (see helpers/texture_pack.h)\n"
+                 "  --normal           keep x and y of a normal map, with mips, compressed to BC5\n"
+                 "  --virtual          pack sources like --pack into pages of a virtual texture\n"
+                 "  --tile <x> <y>     repeat the packed image x by y times (default: 1 1)\n"
+                 "  --page <texels>    page size with borders (default: 128)\n"
+                 "  --deps <file>      for assetcook; texcook reads nothing but its arguments, so the list stays empty\n"
+                 "  --version          print the cooker and format versions\n";
+}
+
+// re-encode a JPEG losslessly as baseline with restart markers, so the
+// loader can decode its restart intervals in parallel
+static int cookRestartJpeg(const std::string &input, const std::string &output, int interval)
+{
+    std::vector<unsigned char> source;
+    if (!readFile(input, source))
+    {
+        std::cout << "ERROR::TEXCOOK::FILE_NOT_SUCCESFULLY_READ: " << input << std::endl;
+        return 1;
+    }
+    JpegCoefficients coefficients;
+    std::string error;
+    if (!readJpegCoefficients(source.data(), (int)source.size(), coefficients, error))
+    {
+        std::cout << "ERROR::TEXCOOK::JPEG_DECODE: " << input << ": " << error << std::endl;
+        return 1;
+    }
+    if (interval < 0)
+        interval = coefficients.comps.size() == 1 ? coefficients.comps[0].usedW : coefficients.mcuX;
+
+    std::vector<unsigned char> cooked;
+    if (!writeJpegWithRestarts(coefficients, interval, cooked, error))
+    {
+        std::cout << "ERROR::TEXCOOK::JPEG_ENCODE: " << input << ": " << error << std::endl;
+        return 1;
+    }
+    if (!writeFile(output, cooked))
+    {
+        std::cout << "ERROR::TEXCOOK::FILE_NOT_SUCCESFULLY_WRITTEN: " << output << std::endl;
+        return 1;
+    }
+    std::cout << input << " -> " << output << ": " << coefficients.width << "x" << coefficients.height
+              << (coefficients.progressive ? " progressive" : " baseline")
+              << ", restart every " << interval << " MCUs, "
+              << source.size() << " -> " << cooked.size() << " bytes" << std::endl;
+    return 0;
+}
+
+// pack channels (or a normal map) into a .dds with a full mip chain
+static int cookPacked(const std::vector<std::string> &sources, const std::string &output, bool normal)
+{
+    PackedImage image;
+    std::string error;
+    bool packed = normal ? TexturePacker::packNormal(sources[0], 0, image, error)
+                         : TexturePacker::pack(sources, 0, image, error);
+    if (!packed)
+    {
+        std::cout << "ERROR::TEXCOOK::PACK: " << error << std::endl;
+        return 1;
+    }
+    TexturePacker::buildMips(image);
+    if (normal)
+        TexturePacker::compressBC5(image);
+    if (!TexturePacker::writeDDS(output, image, error))
+    {
+        std::cout << "ERROR::TEXCOOK::FILE_NOT_SUCCESFULLY_WRITTEN: " << error << std::endl;
+        return 1;
+    }
+    size_t bytes = 0;
+    for (size_t i = 0; i < image.levels.size(); ++i)
+        bytes += image.levels[i].size();
+    std::cout << output << ": " << image.width << "x" << image.height << (normal ? " BC5" : " RGBA8") << ", "
+              << image.levels.size() << " levels, " << bytes << " bytes" << std::endl;
+    return 0;
+}
+
+// pack, repeat and cut into virtual texture pages
+static int cookVirtual(const std::vector<std::string> &sources, const std::string &output,
+                       int tilesX, int tilesY, int pageSize)
+{
+    PackedImage tile, image;
+    std::string error;
+    if (!TexturePacker::pack(sources, 0, tile, error))
+    {
+        std::cout << "ERROR::TEXCOOK::PACK: " << error << std::endl;
+        return 1;
+    }
+    image.format = PackedImage::RGBA8;
+    image.width = tile.width * tilesX;
+    image.height = tile.height * tilesY;
+    image.levels.assign(1, std::vector<unsigned char>((size_t)image.width * image.height * 4));
+    size_t row = (size_t)tile.width * 4;
+    for (int y = 0; y < image.height; ++y)
+        for (int x = 0; x < tilesX; ++x)
+            memcpy(&image.levels[0][((size_t)y * image.width + x * tile.width) * 4],
+                   &tile.levels[0][(y % tile.height) * row], row);
+    TexturePacker::buildMips(image);
+
+    VirtualTextureFile file;
+    if (!VirtualTextureFile::write(output, image, tilesX, tilesY, pageSize, 4, error) || !file.open(output, error))
+    {
+        std::cout << "ERROR::TEXCOOK::FILE_NOT_SUCCESFULLY_WRITTEN: " << error << std::endl;
+        return 1;
+    }
+    std::cout << output << ": " << image.width << "x" << image.height << ", " << file.levels.size() << " levels, "
+              << file.pageCount() << " pages of " << pageSize << "x" << pageSize << ", "
+              << (size_t)file.pageCount() * file.pageBytes() << " bytes" << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int interval = -1;
+    bool pack = false, normal = false, virtualTexture = false;
+    int tilesX = 1, tilesY = 1, pageSize = 128;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--restart") && i + 1 < argc)
+            interval = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--pack"))
+            pack = true;
+        else if (!strcmp(argv[i], "--normal"))
+            normal = true;
+        else if (!strcmp(argv[i], "--virtual"))
+            virtualTexture = true;
+        else if (!strcmp(argv[i], "--tile") && i + 2 < argc)
+        {
+            tilesX = std::max(1, atoi(argv[++i]));
+            tilesY = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--page") && i + 1 < argc)
+            pageSize = std::max(16, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--deps") && i + 1 < argc)
+            writeFile(argv[++i], std::vector<unsigned char>());
+        else if (!strcmp(argv[i], "--version"))
+        {
+            std::cout << "texcook " << TEXCOOK_VERSION << " vtex " << VTEX_VERSION << std::endl;
+            return 0;
+        }
+        else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+        {
+            usage();
+            return 0;
+        }
+        else
+            files.push_back(argv[i]);
+    }
+    if (virtualTexture && !pack && !normal && files.size() >= 2)
+        return cookVirtual(std::vector<std::string>(files.begin() + 1, files.end()), files[0], tilesX, tilesY, pageSize);
+    if (pack && !normal && !virtualTexture && files.size() >= 2)
+        return cookPacked(std::vector<std::string>(files.begin() + 1, files.end()), files[0], false);
+    if (pack || virtualTexture || files.size() != 2)
+    {
+        usage();
+        return 1;
+    }
+    if (normal)
+        return cookPacked(std::vector<std::string>(1, files[0]), files[1], true);
+    return cookRestartJpeg(files[0], files[1], interval);
+}